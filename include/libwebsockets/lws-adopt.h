@@ -87,6 +87,17 @@ struct lws_udp {
 	struct sockaddr		sa_pending;
 	socklen_t		salen_pending;
 };
+
+/*
+ * LWS_CALLBACK_RAW_RX_UDP_BATCH provides an array of these in "in", with the
+ * count of them in "len".  The buffers are only valid during the callback.
+ */
+typedef struct lws_udp_dgram {
+	const uint8_t		*buf;
+	size_t			len;
+	const struct sockaddr	*sa; /* sender */
+	socklen_t		salen;
+} lws_udp_dgram_t;
 #endif
 
 /**
@@ -203,6 +214,12 @@ lws_adopt_socket_vhost_readbuf(struct lws_vhost *vhost,
 #define LWS_CAUDP_BIND (1 << 0)
 #define LWS_CAUDP_BROADCAST (1 << 1)
 #define LWS_CAUDP_PF_PACKET (1 << 2)
+#define LWS_CAUDP_BATCH (1 << 3)
+/**< rx datagrams in batches via LWS_CALLBACK_RAW_RX_UDP_BATCH and allow tx
+ * batching via lws_udp_batch_queue() */
+#define LWS_CAUDP_GSO_GRO (1 << 4)
+/**< with LWS_CAUDP_BATCH, also use UDP_GRO / UDP_SEGMENT offload if the
+ * kernel supports it */
 
 #if defined(LWS_WITH_UDP)
 /**
@@ -211,7 +228,7 @@ lws_adopt_socket_vhost_readbuf(struct lws_vhost *vhost,
  * \param vhost:	 lws vhost
  * \param ads:		 NULL or address to do dns lookup on
  * \param port:		 UDP port to bind to, -1 means unbound
- * \param flags:	 0 or LWS_CAUDP_NO_BIND
+ * \param flags:	 0 or bitmap of LWS_CAUDP_ flags
  * \param protocol_name: Name of protocol on vhost to bind wsi to
  * \param ifname:	 NULL, for network interface name to bind socket to
  * \param parent_wsi:	 NULL or parent wsi new wsi will be a child of
@@ -226,6 +243,41 @@ lws_create_adopt_udp(struct lws_vhost *vhost, const char *ads, int port,
 		     int flags, const char *protocol_name, const char *ifname,
 		     struct lws *parent_wsi, void *opaque,
 		     const lws_retry_bo_t *retry_policy);
+
+/**
+ * lws_udp_batch_queue() - queue a datagram for batched sending
+ *
+ * \param wsi:	 UDP wsi
+ * \param buf:	 datagram payload, copied into the queue
+ * \param len:	 length of datagram payload
+ * \param sa:	 destination address
+ * \param salen: length of destination address
+ *
+ * Queued datagrams are sent together with one sendmmsg() when the queue is
+ * flushed, which happens automatically after LWS_CALLBACK_RAW_WRITEABLE and
+ * LWS_CALLBACK_RAW_RX_UDP_BATCH callbacks return, or explicitly with
+ * lws_udp_batch_flush().  If the wsi was created with LWS_CAUDP_GSO_GRO,
+ * runs of same-size datagrams to the same peer are sent using UDP_SEGMENT.
+ *
+ * On platforms without sendmmsg(), the datagram is sent immediately.
+ *
+ * Returns 0 if queued, 1 if there is no room until the wsi becomes writeable
+ * (a writeable callback has already been requested), or -1 on error.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_udp_batch_queue(struct lws *wsi, const uint8_t *buf, size_t len,
+		    const struct sockaddr *sa, socklen_t salen);
+
+/**
+ * lws_udp_batch_flush() - send any datagrams queued on the wsi now
+ *
+ * \param wsi:	 UDP wsi
+ *
+ * Returns 0 if everything was sent, 1 if some datagrams remain queued until
+ * the wsi becomes writeable, or -1 on error, when the queue is dropped.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_udp_batch_flush(struct lws *wsi);
 #endif
 
 
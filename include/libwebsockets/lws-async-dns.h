@@ -27,6 +27,7 @@
 typedef enum dns_query_type {
 	LWS_ADNS_RECORD_A					= 0x01,
 	LWS_ADNS_RECORD_CNAME					= 0x05,
+	LWS_ADNS_RECORD_PTR					= 0x0c,
 	LWS_ADNS_RECORD_MX					= 0x0f,
 	LWS_ADNS_RECORD_AAAA					= 0x1c,
 } adns_query_type_t;
@@ -63,6 +64,10 @@ typedef struct lws * (*lws_async_dns_cb_t)(struct lws *wsi, const char *ads,
  * The cached object can't be evicted until the reference count reaches zero...
  * use lws_async_dns_freeaddrinfo() to indicate you're finsihed with the
  * results for each callback that happened with them.
+ *
+ * For LWS_ADNS_RECORD_PTR queries, \p name is the in-addr.arpa or ip6.arpa
+ * name, and each result has no ai_addr, just ai_canonname set to the name the
+ * PTR record points to.  lws_async_dns_rdns() is an easier way to use them.
  */
 LWS_VISIBLE LWS_EXTERN lws_async_dns_retcode_t
 lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
@@ -82,4 +87,67 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 LWS_VISIBLE LWS_EXTERN void
 lws_async_dns_freeaddrinfo(const struct addrinfo **ai);
 
+typedef void (*lws_async_dns_rdns_cb_t)(struct lws_context *context,
+					const lws_sockaddr46 *sa46,
+					const char *name, void *opaque);
+
+/**
+ * lws_async_dns_rdns() - find the hostname for an address using async dns
+ *
+ * \param context: the lws_context
+ * \param tsi: thread service index (usually 0)
+ * \param sa46: the address to look up
+ * \param cb: completion callback
+ * \param opaque: passed to the callback
+ *
+ * Issues a PTR query for the address, and then a forward query for the name
+ * it gives to confirm the name really maps back to the address.  On
+ * completion \p cb is called with the confirmed name, or NULL if there is
+ * none or it didn't confirm.  IPv4-mapped IPv6 addresses are looked up as
+ * IPv4.
+ *
+ * Results, including failures, are cached per-address for the PTR record's
+ * TTL, so repeated lookups for the same peer are answered immediately.  If
+ * the result is already cached, \p cb is called before this returns, and it
+ * returns LADNS_RET_FOUND, otherwise LADNS_RET_CONTINUING.
+ *
+ * Nothing is held about any wsi... if the callback may outlive what \p opaque
+ * points to, use lws_async_dns_rdns_cancel() when it goes away.
+ */
+LWS_VISIBLE LWS_EXTERN lws_async_dns_retcode_t
+lws_async_dns_rdns(struct lws_context *context, int tsi,
+		   const lws_sockaddr46 *sa46, lws_async_dns_rdns_cb_t cb,
+		   void *opaque);
+
+/**
+ * lws_async_dns_rdns_cancel() - cancel ongoing rdns callbacks for opaque
+ *
+ * \param context: the lws_context
+ * \param opaque: the opaque pointer given to lws_async_dns_rdns()
+ *
+ * Any ongoing lws_async_dns_rdns() lookups started with \p opaque will not
+ * call back.  The lookups themselves continue, so the results still get
+ * cached.
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_async_dns_rdns_cancel(struct lws_context *context, void *opaque);
+
+/**
+ * lws_get_peer_name_async() - async version of lws_get_peer_addresses()
+ *
+ * \param wsi: the connection whose peer we want the hostname for
+ * \param cb: completion callback
+ * \param opaque: passed to the callback
+ *
+ * Gets the peer address of the network connection under \p wsi and starts
+ * lws_async_dns_rdns() on it, see there for how the callback is made.
+ *
+ * Unlike lws_get_peer_addresses(), it never blocks the event loop.  The
+ * callback is not tied to \p wsi's lifetime, \p opaque should be something
+ * you can use lws_async_dns_rdns_cancel() on when the wsi closes.
+ */
+LWS_VISIBLE LWS_EXTERN lws_async_dns_retcode_t
+lws_get_peer_name_async(struct lws *wsi, lws_async_dns_rdns_cb_t cb,
+			void *opaque);
+
 #endif
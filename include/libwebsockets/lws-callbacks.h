@@ -758,6 +758,12 @@ enum lws_callback_reasons {
 	LWS_CALLBACK_RAW_CONNECTED				= 101,
 	/**< outgoing client RAW mode connection was connected */
 
+	LWS_CALLBACK_RAW_RX_UDP_BATCH				= 105,
+	/**< UDP wsi created with LWS_CAUDP_BATCH received one or more
+	 * datagrams.  in points to an array of lws_udp_dgram_t, len is the
+	 * number of datagrams in the array.  On platforms without
+	 * recvmmsg(), LWS_CALLBACK_RAW_RX is used instead. */
+
 	LWS_CALLBACK_RAW_SKT_BIND_PROTOCOL			= 81,
 	LWS_CALLBACK_RAW_SKT_DROP_PROTOCOL			= 82,
 
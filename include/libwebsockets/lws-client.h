@@ -55,7 +55,12 @@ enum lws_client_connect_ssl_connection_flags {
 		 *
 		 * HTTP/1.0: possible if Keep-Alive: yes sent by server
 		 * HTTP/1.1: always possible... uses pipelining
-		 * HTTP/2:   always possible... uses parallel streams
+		 * HTTP/2:   always possible... uses parallel streams, up to
+		 *	     the server's MAX_CONCURRENT_STREAMS, after which
+		 *	     new connections queue for a stream to close.  A
+		 *	     different hostname can also share an h2 connection
+		 *	     if it resolves to the same address and port and the
+		 *	     server certificate is valid for it too.
 		 */
 	LCCSCF_MUXABLE_STREAM			= (1 << 17),
 };
@@ -736,6 +736,17 @@ struct lws_context_creation_info {
 	 * nonzero means connect via a tcp socket to the tcp address in
 	 * ss_proxy_bind and the given port */
 #endif
+	size_t mem_budget;
+	/**< CONTEXT: 0 for no limit, else the amount of heap lws may have
+	 * allocated (see lws_get_allocated_heap()) before it starts to shed
+	 * load.  From 7/8 of this, new accepts are paused; at the budget the
+	 * connections holding the most buffered data are rx flow-controlled,
+	 * and from 9/8 of it idle connections are closed.  It all recovers
+	 * once usage falls under 3/4 of the budget.  Only effective on
+	 * platforms with malloc_usable_size(). */
+	uint16_t adns_rdns_negative_ttl_secs;
+	/**< CONTEXT: 0 for the default of 60s, else how long a failed
+	 * lws_async_dns_rdns() lookup is cached for the address */
 
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
@@ -1126,6 +1137,12 @@ struct lws_http_mount {
 	const char *basic_auth_login_file;
 	/**<NULL, or filepath to use to check basic auth logins against. (requires LWSAUTHM_DEFAULT) */
 
+	const struct lws_protocol_vhost_options *push;
+	/**< optional linked-list of h2 push manifest entries.  name is a file
+	 * relative to the mount origin, eg, "index.html", value is a comma-
+	 * separated list of absolute urls to push when that file is served
+	 * on an h2 stream, eg, "/css/site.css,/js/site.js" */
+
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
 	 *
@@ -40,6 +40,12 @@ typedef DBusHandlerResult (*lws_dbus_message_handler)(DBusConnection *conn,
 struct lws_dbus_ctx;
 typedef void (*lws_dbus_closing_t)(struct lws_dbus_ctx *ctx);
 
+/* the most messages passed to a batch handler in one call */
+#define LWS_DBUS_BATCH_MAX 32
+
+typedef void (*lws_dbus_batch_t)(struct lws_dbus_ctx *ctx,
+				 DBusMessage **msgs, int count);
+
 struct lws_dbus_ctx {
 	struct lws_dll2_owner owner; /* dbusserver ctx: HEAD of accepted list */
 	struct lws_dll2 next; /* dbusserver ctx: HEAD of accepted list */
@@ -61,6 +67,15 @@ struct lws_dbus_ctx {
  	 * ctx.
  	 */
  	lws_dbus_closing_t cb_closing;
+
+	/* private to lws, set up by lws_dbus_set_batch_handler() */
+	lws_dbus_batch_t cb_batch;
+	DBusMessage *batch[LWS_DBUS_BATCH_MAX];
+	int batch_count;
+
+	/* private to lws, the shadow wsi currently being serviced */
+	struct lws *wsi_service;
+	char watch_changed;
 };
 
 /**
@@ -71,6 +86,8 @@ struct lws_dbus_ctx {
  *
  * This configures a DBusConnection object to use lws for watchers and timeout
  * operations.
+ *
+ * \p ctx should be zeroed before it is first set up.
  */
 LWS_VISIBLE LWS_EXTERN int
 lws_dbus_connection_setup(struct lws_dbus_ctx *ctx, DBusConnection *conn,
@@ -86,9 +103,71 @@ lws_dbus_connection_setup(struct lws_dbus_ctx *ctx, DBusConnection *conn,
  *
  * This creates a DBusServer and binds it to the lws event loop, and your
  * callback to accept new connections.
+ *
+ * \p ctx should be zeroed before it is first set up.
  */
 LWS_VISIBLE LWS_EXTERN DBusServer *
 lws_dbus_server_listen(struct lws_dbus_ctx *ctx, const char *ads,
 		       DBusError *err, DBusNewConnectionFunction new_conn);
 
+/**
+ * lws_dbus_set_batch_handler() - receive incoming messages in batches
+ *
+ * \param ctx: the lws dbus context, after lws_dbus_connection_setup()
+ * \param cb: the batch handler, or NULL to go back to normal dispatch
+ *
+ * Normally each incoming message is dispatched on its own through the
+ * connection's filters and object path handlers.  With a batch handler set,
+ * lws reads and parses everything waiting on the connection at each wakeup,
+ * then passes the messages to \p cb together, up to LWS_DBUS_BATCH_MAX at a
+ * time.
+ *
+ * The messages are taken by a filter added here, so filters added earlier
+ * still see them first.  Replies to pending calls and the Disconnected signal
+ * are still dispatched normally.  Since the messages count as handled, the
+ * batch handler must reply to any method calls itself.
+ *
+ * lws unreferences the messages after \p cb returns; use dbus_message_ref()
+ * on any that must be kept longer.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_dbus_set_batch_handler(struct lws_dbus_ctx *ctx, lws_dbus_batch_t cb);
+
+/**
+ * lws_dbus_msg_payload() - find a message's payload without copying it
+ *
+ * \param m: the message
+ * \param buf: set to point at the payload inside the message
+ * \param len: set to the payload length in bytes
+ * \param binary: set to 1 if the payload is a byte array, or 0 for a string
+ *
+ * Looks at the first argument of \p m, which must be a byte array ("ay") or a
+ * string, and points \p buf at its contents inside the message.  \p buf stays
+ * valid for as long as a reference is held on \p m, so for example a message
+ * can be queued until the ws connection is writeable and the payload then
+ * copied just once, directly into the LWS_PRE-prefixed buffer for lws_write().
+ *
+ * Returns 0 if OK, or nonzero if the first argument is some other type.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_dbus_msg_payload(DBusMessage *m, const uint8_t **buf, size_t *len,
+		     int *binary);
+
+/**
+ * lws_dbus_msg_append_bytes() - append a buffer to a message as a byte array
+ *
+ * \param m: the message being built
+ * \param buf: the data, eg, an lws rx buffer
+ * \param len: the data length in bytes
+ *
+ * Appends \p buf as a byte array ("ay") argument, copied directly into the
+ * message.  Unlike a string argument it doesn't need to be NUL-terminated
+ * first, so a received ws payload can be passed on without an intermediate
+ * copy.
+ *
+ * Returns 0 if OK, or nonzero on OOM.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_dbus_msg_append_bytes(DBusMessage *m, const void *buf, size_t len);
+
 #endif
@@ -37,20 +37,26 @@
  * an opaque struct that represents the disk cache.
  *
  * `lws_diskcache_trim()` should be called at eg, 1s intervals to perform the
- * cache dir monitoring and LRU autodelete in the background lazily.  It can
- * be done in its own thread or on a timer... it monitors the directories in a
- * stateful way that stats one or more file in the cache per call, and keeps
- * a list of the oldest files as it goes.  When it completes a scan, if the
- * aggregate size is over the limit, it will delete oldest files first to try
- * to keep it under the limit.
- *
- * The cache size monitoring is extremely efficient in time and memory even when
- * the cache directory becomes huge.
+ * LRU autodelete in the background lazily.  It can be done in its own thread
+ * or on a timer.  The opaque cache struct has its own mutex, so trim in its own
+ * thread and query / finalize from the service thread is fine.
+ *
+ * The cache keeps an in-memory index of every cached file, its size and when
+ * it was last used, which is persisted in an append-only journal file in the
+ * cache dir and rebuilt from it by `lws_diskcache_create()`.  So trimming only
+ * costs as much as what it deletes, however huge the cache directory becomes.
+ * Only one `lws_diskcache_create()` instance should manage a cache dir at a
+ * time.
+ *
+ * If there's no journal yet, `lws_diskcache_trim()` builds the index by
+ * walking the cache dirs statefully, one subdir per call.  It also walks them
+ * once an hour to pick up files added to the cache without the index being
+ * told, only stat()-ing files it doesn't already know about.
  *
  * `lws_diskcache_query()` is used to determine if the file already exists in
  * the cache, or if it must be created.  If it must be created, then the file
  * is opened using a temp name that must be converted to a findable name with
- * `lws_diskcache_finalize_name()` when the generation of the file contents are
+ * `lws_diskcache_finalize()` when the generation of the file contents are
  * complete.  Aborted cached files that did not complete generation will be
  * flushed by the LRU eventually.  If the file already exists, it is 'touched'
  * to make it new again and the fd returned.
@@ -155,20 +161,31 @@ lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
 LWS_VISIBLE LWS_EXTERN int
 lws_diskcache_finalize_name(char *cache);
 
+/**
+ * lws_diskcache_finalize() - rename the cache file and add it to the index
+ *
+ * \param lds: The opaque object representing the cache
+ * \param cache: The cache file temp name returned with LWS_DISKCACHE_QUERY_CREATING
+ *
+ * Like lws_diskcache_finalize_name(), but also adds the finished file to the
+ * cache index with its size, as the most recently used.  Files finalized with
+ * lws_diskcache_finalize_name() are only found by the hourly scan.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_diskcache_finalize(struct lws_diskcache_scan *lds, char *cache);
+
 /**
  * lws_diskcache_trim() - performs one or more file checks in the cache for size management
  *
  * \param lds: The opaque object representing the cache
  *
- * This should be called periodically to statefully walk the cache on disk
- * collecting the oldest files.  When it has visited every file, if the cache
- * is oversize it will delete the oldest files until it's back under size again.
+ * This should be called periodically.  If the cache is oversize, it deletes
+ * the least recently used files until it's back under size again.
  *
- * Each time it's called, it will look at one or more dir in the cache.  If
- * called when the cache is oversize, it increases the amount of work done each
- * call until it is reduced again.  Typically it will take 256 calls before it
- * deletes anything, so if called once per second, it will delete files once
- * every 4 minutes.  Each call is very inexpensive both in memory and time.
+ * If the index is still being built from the cache dirs, or is being checked
+ * against them, each call looks at one of the 256 cache subdirs, so it will
+ * take 256 calls before it deletes anything.  Otherwise each call only costs
+ * as much as the files it deletes.
  */
 LWS_VISIBLE LWS_EXTERN int
 lws_diskcache_trim(struct lws_diskcache_scan *lds);
@@ -180,7 +197,9 @@ lws_diskcache_trim(struct lws_diskcache_scan *lds);
  * \param lds: The opaque object representing the cache
  *
  * If the cache is undersize, there's no need to monitor it immediately.  This
- * suggests how long to "sleep" before calling `lws_diskcache_trim()` again.
+ * suggests how long to "sleep" before calling `lws_diskcache_trim()` again,
+ * in seconds.  It's 0 while the cache dirs are being scanned, since each trim
+ * call only walks one subdir then.
  */
 LWS_VISIBLE LWS_EXTERN int
 lws_diskcache_secs_to_idle(struct lws_diskcache_scan *lds);
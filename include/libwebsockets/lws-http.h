@@ -652,6 +652,74 @@ lws_add_http_common_headers(struct lws *wsi, unsigned int code,
 			    const char *content_type, lws_filepos_t content_len,
 			    unsigned char **p, unsigned char *end);
 
+typedef struct lws_http_hdr_template lws_http_hdr_template_t;
+
+#define LWSHTT_FLAG_DATE			(1 << 0)
+
+/**
+ * lws_http_hdr_template_create() - prerender a fixed response header set
+ *
+ * \param vh: the vhost whose vhost headers, security and server name
+ *	      options should be baked into the template
+ * \param code: an HTTP code like 200, 404 etc, may take LWSAHH_ flags
+ * \param content_type: NULL, or the content type, like "application/json"
+ * \param headers: NULL, or linked-list of additional name: value headers
+ * \param flags: LWSHTT_FLAG_ flags
+ *
+ * Endpoints that send the same headers on nearly every response can render
+ * them once, into both h1 and HPACK forms, rather than build them a header at
+ * a time per response.  The template holds everything
+ * lws_add_http_header_status() would emit for the vhost, then the content
+ * type and additional headers in list order.
+ *
+ * Applying the template fills two slots per response: the content length
+ * and, if LWSHTT_FLAG_DATE is given, a Date: header cached per service
+ * thread per second.
+ *
+ * HPACK names found in the static table are sent by index, other names as
+ * literals, and nothing goes in the peer's dynamic table, so the same bytes
+ * are valid on any stream.
+ *
+ * Templates don't apply http stream compression.
+ *
+ * Returns NULL on OOM or if the rendered headers are too large.
+ */
+LWS_VISIBLE LWS_EXTERN lws_http_hdr_template_t *
+lws_http_hdr_template_create(struct lws_vhost *vh, unsigned int code,
+			     const char *content_type,
+			     const struct lws_protocol_vhost_options *headers,
+			     unsigned int flags);
+
+/**
+ * lws_http_hdr_template_destroy() - free a header template
+ *
+ * \param pht: pointer to the template pointer, set to NULL after freeing
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_http_hdr_template_destroy(lws_http_hdr_template_t **pht);
+
+/**
+ * lws_http_hdr_template_apply() - emit a prerendered header set
+ *
+ * \param wsi: the connection to send the headers on
+ * \param ht: the template from lws_http_hdr_template_create()
+ * \param content_len: the content length, or LWS_ILLEGAL_HTTP_CONTENT_LEN
+ * \param p: pointer to current position in buffer pointer
+ * \param end: pointer to end of buffer
+ *
+ * Use instead of lws_add_http_common_headers(); it copies the h1 or HPACK
+ * rendering as appropriate for the wsi and fills in the slots.  Like that,
+ * with LWS_ILLEGAL_HTTP_CONTENT_LEN no content-length is sent and on h1 the
+ * connection is marked to close after the response.
+ *
+ * It does not call lws_finalize_http_header(), to allow you to add further
+ * headers after calling this.  You will need to call that yourself at the end.
+ */
+LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
+lws_http_hdr_template_apply(struct lws *wsi, const lws_http_hdr_template_t *ht,
+			    lws_filepos_t content_len, unsigned char **p,
+			    unsigned char *end);
+
 enum {
 	LWSHUMETH_GET,
 	LWSHUMETH_POST,
@@ -47,12 +47,47 @@ struct lws_buflist;
  * \param buf: buffer to stash
  * \param len: length of buffer to stash
  *
+ * The list head segment tracks the tail, so appending is O(1) however long
+ * the list has become.
+ *
  * Returns -1 on OOM, 1 if this was the first segment on the list, and 0 if
  * it was a subsequent segment.
  */
 LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
 			   size_t len);
+
+typedef void (*lws_buflist_ref_destroy_cb)(void *opaque, uint8_t *buf);
+
+/**
+ * lws_buflist_append_segment_ref(): add caller buffer to buflist by reference
+ *
+ * \param head: list head
+ * \param buf: buffer to reference (not copied)
+ * \param len: length of buffer to reference
+ * \param destroy: called with opaque and buf when the segment is consumed or
+ *		   destroyed, may be NULL if the buffer needs no cleanup
+ * \param opaque: passed to destroy
+ *
+ * Like lws_buflist_append_segment(), but the data is not copied, the segment
+ * refers to the caller's buffer directly.  The caller must keep the buffer
+ * valid and unchanged until destroy is called, which is where it can be freed
+ * or have its refcount dropped.  If the buffer may be consumed by something
+ * that writes protocol framing in front of it, the caller should arrange that
+ * LWS_PRE bytes before buf are also writeable, as is the case for segments
+ * created by lws_buflist_append_segment().
+ *
+ * On OOM, destroy is called before returning -1, so ownership always passes
+ * to the buflist.
+ *
+ * Returns -1 on OOM, 1 if this was the first segment on the list, and 0 if
+ * it was a subsequent segment.
+ */
+LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
+lws_buflist_append_segment_ref(struct lws_buflist **head, uint8_t *buf,
+			       size_t len, lws_buflist_ref_destroy_cb destroy,
+			       void *opaque);
+
 /**
  * lws_buflist_next_segment_len(): number of bytes left in current segment
  *
@@ -474,6 +509,7 @@ enum {
 	LWS_RXFLOW_REASON_USER_BOOL		= (1 << 0),
 	LWS_RXFLOW_REASON_HTTP_RXBUFFER		= (1 << 6),
 	LWS_RXFLOW_REASON_H2_PPS_PENDING	= (1 << 7),
+	LWS_RXFLOW_REASON_MEM_BUDGET		= (1 << 8),
 
 	LWS_RXFLOW_REASON_APPLIES		= (1 << 14),
 	LWS_RXFLOW_REASON_APPLIES_ENABLE_BIT	= (1 << 13),
@@ -570,13 +606,90 @@ lws_dir_callback_function(const char *dirpath, void *user,
  * \param user: pointer to give to callback
  * \param cb: callback to receive information on each file or dir
  *
- * Calls \p cb (with \p user) for every object in dirpath.
+ * Calls \p cb (with \p user) for every object in dirpath, in alphabetical
+ * order.  If the callback returns nonzero, the walk stops there.
+ *
+ * The whole listing is collected and sorted before the first callback, into
+ * two allocations; if you don't need the order, lws_dir_stream() is cheaper.
  *
  * This wraps whether it's using POSIX apis, or libuv (as needed for windows,
  * since it refuses to support POSIX apis for this).
  */
 LWS_VISIBLE LWS_EXTERN int
 lws_dir(const char *dirpath, void *user, lws_dir_callback_function cb);
+
+typedef int
+lws_dir_compare_function(const struct lws_dir_entry *a,
+			 const struct lws_dir_entry *b);
+
+/**
+ * lws_dir_stream() - callback for objects in a directory without listing it
+ *
+ * \param dirpath: the directory to scan
+ * \param user: pointer to give to callback
+ * \param cb: callback to receive information on each file or dir
+ * \param compare: NULL for alphabetical, or a strcmp()-style comparison
+ * \param top_n: 0 for everything unsorted, else how many entries to report
+ *
+ * With \p top_n of 0, calls \p cb for every object in the order the
+ * filesystem returns them, as they are read, so nothing is allocated per
+ * object however large the directory is.
+ *
+ * Otherwise only the first \p top_n objects according to \p compare are
+ * reported, in that order, using a bounded heap of \p top_n entries.  Names
+ * of 256 chars or more are skipped in this mode.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_dir_stream(const char *dirpath, void *user, lws_dir_callback_function cb,
+	       lws_dir_compare_function *compare, size_t top_n);
+
+struct lws_dir_cache;
+
+/**
+ * lws_dir_cache_create() - create a reusable listing of a directory
+ *
+ * \param dirpath: the directory to list
+ * \param compare: NULL for filesystem order, or comparison to sort by
+ *
+ * The listing is read on the first lws_dir_cache_walk(), and then only
+ * read again when inotify reports the directory has changed.  Where there
+ * is no inotify, every walk reads the directory again.
+ *
+ * Returns NULL on OOM.
+ */
+LWS_VISIBLE LWS_EXTERN struct lws_dir_cache *
+lws_dir_cache_create(const char *dirpath, lws_dir_compare_function *compare);
+
+/**
+ * lws_dir_cache_walk() - callback for everything in a cached listing
+ *
+ * \param dc: the cached listing
+ * \param user: pointer to give to callback
+ * \param cb: callback to receive information on each file or dir
+ *
+ * Like lws_dir(), but from the cached listing if it's still valid.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_dir_cache_walk(struct lws_dir_cache *dc, void *user,
+		   lws_dir_callback_function cb);
+
+/**
+ * lws_dir_cache_invalidate() - force the next walk to read the directory
+ *
+ * \param dc: the cached listing
+ *
+ * For changes inotify can't see, eg, on network filesystems.
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_dir_cache_invalidate(struct lws_dir_cache *dc);
+
+/**
+ * lws_dir_cache_destroy() - destroy a cached listing
+ *
+ * \param dc: pointer to the cached listing, set to NULL
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_dir_cache_destroy(struct lws_dir_cache **dc);
 #endif
 
 /**
@@ -61,6 +61,12 @@ lws_canonical_hostname(struct lws_context *context);
  *	the client connected with socket descriptor fd.  Names may be
  *	truncated if there is not enough room.  If either cannot be
  *	determined, they will be returned as valid zero-length strings.
+ *
+ *	The name is found by blocking reverse and forward DNS lookups, which
+ *	can stall the whole service thread for seconds if the DNS is slow.  It
+ *	should only be used where that doesn't matter... if you just need the
+ *	IP, use lws_get_peer_simple(), and if you need the name from inside the
+ *	event loop, use lws_get_peer_name_async() from LWS_WITH_SYS_ASYNC_DNS.
  */
 LWS_VISIBLE LWS_EXTERN void
 lws_get_peer_addresses(struct lws *wsi, lws_sockfd_type fd, char *name,
@@ -112,8 +112,16 @@ typedef struct lws_spa_create_info {
 	struct lwsac **ac;	/* NULL, or pointer to lwsac * to contain all
 				   related heap allocations */
 	size_t ac_chunk_size;	/* 0 for default, or ac chunk size */
+	unsigned int flags;	/* LWS_SPA_FLAG_... */
 } lws_spa_create_info_t;
 
+#define LWS_SPA_FLAG_FILE_SPANS			(1 << 0)
+	/**< multipart file content is passed to opt_cb directly from the
+	 * buffer given to lws_spa_process(), in spans as large as possible,
+	 * instead of being copied through max_storage sized chunks first.
+	 * buf is then only valid during the callback and must not be
+	 * modified. */
+
 /**
  * lws_spa_create_via_info() - create urldecode parser
  *
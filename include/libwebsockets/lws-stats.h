@@ -58,6 +58,12 @@ enum {
 	LWSSTATS_C_PEER_LIMIT_WSI_DENIED, /**< number of times we would have given a wsi but for the peer limit */
 	LWSSTATS_C_CONNS_CLIENT, /**< attempted client conns */
 	LWSSTATS_C_CONNS_CLIENT_FAILED, /**< failed client conns */
+	LWSSTATS_C_AH_WAITED, /**< count of wsi that had to wait for an ah */
+	LWSSTATS_US_AH_WAIT_AVG, /**< aggregate delay waiting for an ah */
+	LWSSTATS_US_WORST_AH_WAIT, /**< single worst delay waiting for an ah */
+	LWSSTATS_C_MEM_BUDGET_ACCEPT_PAUSED, /**< times accepts were paused for the mem budget */
+	LWSSTATS_C_MEM_BUDGET_RXFLOW, /**< conns rx flow-controlled for the mem budget */
+	LWSSTATS_C_MEM_BUDGET_SHED, /**< idle conns closed for the mem budget */
 
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
@@ -214,6 +214,26 @@ LWS_VISIBLE LWS_EXTERN int
 lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 	  enum lws_write_protocol protocol);
 
+/**
+ * lws_set_cork() - collect what is written from the writeable callback
+ *
+ * \param wsi: the struct lws to operate on
+ * \param cork: nonzero to cork the wsi, zero to uncork it
+ *
+ * While a wsi is corked, everything lws_write() sends from inside its
+ * WRITEABLE callback, including NO_FIN continuations, is collected and goes
+ * out in one send (or one TLS record) when the callback returns, instead of
+ * one per lws_write().  Eg, headers and a few small body chunks written in one
+ * callback leave together.
+ *
+ * Uncorking from inside the callback sends what was collected so far.  For
+ * an h2 stream, the frames collected are those of the network connection.
+ *
+ * Returns nonzero if sending what was collected failed.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_set_cork(struct lws *wsi, int cork);
+
 /* helper for case where buffer may be const */
 #define lws_write_http(wsi, buf, len) \
 	lws_write(wsi, (unsigned char *)(buf), len, LWS_WRITE_HTTP)
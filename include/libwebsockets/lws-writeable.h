@@ -85,6 +85,12 @@ lws_callback_on_writable_all_protocol(const struct lws_context *context,
  * - Which:  connections using this protocol on GIVEN VHOST ONLY
  * - When:   when the individual connection becomes writeable
  * - What: LWS_CALLBACK_*_WRITEABLE
+ *
+ * With the default poll() event loop, the call only records the request, so
+ * its cost doesn't depend on how many connections are bound to the protocol.
+ * The callbacks are handed out on the next service pass.  Like the other
+ * writeable requests, only call this from lws service thread context, eg,
+ * from inside a callback; use lws_cancel_service() from other threads.
  */
 LWS_VISIBLE LWS_EXTERN int
 lws_callback_on_writable_all_protocol_vhost(const struct lws_vhost *vhost,
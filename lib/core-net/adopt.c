@@ -410,7 +410,7 @@ adopt_socket_readbuf(struct lws *wsi, const char *readbuf, size_t len)
 	if (n < 0)
 		goto bail;
 	if (n)
-		lws_dll2_add_head(&wsi->dll_buflist, &pt->dll_buflist_owner);
+		__lws_add_wsi_to_buflist_list(pt, wsi);
 
 	/*
 	 * we can't process the initial read data until we can attach an ah.
@@ -526,6 +526,11 @@ lws_create_adopt_udp2(struct lws *wsi, const char *ads,
 		    lws_plat_BINDTODEVICE(sock.sockfd, (const char *)opaque))
 			goto resume;
 
+#if defined(LWS_HAVE_RECVMMSG)
+		if (wsi->udp_batch)
+			lws_udp_batch_socket_init(wsi, sock.sockfd);
+#endif
+
 		if (wsi->do_bind &&
 		    bind(sock.sockfd, wsi->dns_results_next->ai_addr,
 #if defined(_WIN32)
@@ -600,6 +605,9 @@ lws_create_adopt_udp(struct lws_vhost *vhost, const char *ads, int port,
 	wsi->do_bind = !!(flags & LWS_CAUDP_BIND);
 	wsi->do_broadcast = !!(flags & LWS_CAUDP_BROADCAST);
 	wsi->pf_packet = !!(flags & LWS_CAUDP_PF_PACKET);
+	wsi->udp_batch = !!(flags & LWS_CAUDP_BATCH);
+	wsi->udp_gso_gro = wsi->udp_batch && !wsi->pf_packet &&
+			   !!(flags & LWS_CAUDP_GSO_GRO);
 	wsi->c_port = port;
 	if (retry_policy)
 		wsi->retry_policy = retry_policy;
@@ -86,6 +86,9 @@ __lws_reset_wsi(struct lws *wsi)
 	lws_buflist_destroy_all_segments(&wsi->buflist_out);
 #if defined(LWS_WITH_UDP)
 	lws_free_set_NULL(wsi->udp);
+#if defined(LWS_HAVE_RECVMMSG)
+	lws_udp_batch_destroy_wsi(wsi);
+#endif
 #endif
 	wsi->retry = 0;
 
@@ -102,6 +105,9 @@ __lws_reset_wsi(struct lws *wsi)
 	if (wsi->http.buflist_post_body)
 		lws_buflist_destroy_all_segments(&wsi->http.buflist_post_body);
 #endif
+#if defined(LWS_WITH_RANGES)
+	lws_free_set_NULL(wsi->http.range);
+#endif
 
 	if (wsi->vhost && wsi->vhost->lserv_wsi == wsi)
 		wsi->vhost->lserv_wsi = NULL;
@@ -126,6 +132,7 @@ __lws_reset_wsi(struct lws *wsi)
 
 #if defined(LWS_WITH_OPENSSL)
 	__lws_ssl_remove_wsi_from_buffered_list(wsi);
+	__lws_tls_hot_remove(wsi);
 #endif
 	__lws_wsi_remove_from_sul(wsi);
 
@@ -140,9 +147,17 @@ __lws_reset_wsi(struct lws *wsi)
 void
 __lws_free_wsi(struct lws *wsi)
 {
+	struct lws_context_per_thread *pt;
+
 	if (!wsi)
 		return;
 
+	pt = &wsi->context->pt[(int)wsi->tsi];
+	if (pt->cork_wsi == wsi) {
+		pt->cork_wsi = NULL;
+		pt->cork_len = 0;
+	}
+
 	__lws_reset_wsi(wsi);
 
 	if (wsi->context->event_loop_ops->destroy_wsi)
@@ -428,6 +443,9 @@ just_kill_connection:
 #if defined(LWS_WITH_UDP)
 	if (wsi->udp)
 		lws_free_set_NULL(wsi->udp);
+#if defined(LWS_HAVE_RECVMMSG)
+	lws_udp_batch_destroy_wsi(wsi);
+#endif
 #endif
 
 	if (wsi->role_ops->close_kill_connection)
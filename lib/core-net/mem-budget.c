@@ -0,0 +1,236 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2020 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "private-lib-core.h"
+
+#if defined(LWS_HAVE_MALLOC_USABLE_SIZE)
+
+/*
+ * info->mem_budget gives a ceiling for the heap lws itself has allocated,
+ * as reported by lws_get_allocated_heap().  Each pt checks it periodically
+ * and degrades in steps as it is approached, cheapest first:
+ *
+ *   >= 7/8 budget:  stop accepting new connections on this pt
+ *   >= budget:      rxflow the connections holding the most buffered data
+ *   >= 9/8 budget:  close idle connections (h1 keepalive, h2 with no streams)
+ *   <  3/4 budget:  undo the above
+ *
+ * The gap between the on and off thresholds keeps it from flapping.
+ */
+
+#define LWS_MEM_BUDGET_INTERVAL_US	(250 * LWS_US_PER_MS)
+#define LWS_MEM_BUDGET_RXFLOW_PER_TICK	4
+#define LWS_MEM_BUDGET_SHED_PER_TICK	8
+
+static size_t
+lws_mem_budget_weight(struct lws *wsi)
+{
+	return lws_buflist_total_len(&wsi->buflist) +
+	       lws_buflist_total_len(&wsi->buflist_out);
+}
+
+static int
+lws_mem_budget_wsi_is_idle(struct lws *wsi)
+{
+	if (!lwsi_role_server(wsi) || wsi->buflist || wsi->buflist_out)
+		return 0;
+
+#if defined(LWS_ROLE_H2)
+	if (lwsi_role_h2(wsi) && !wsi->mux_substream && !wsi->mux.child_list)
+		return 1;
+#endif
+#if defined(LWS_ROLE_H1)
+	if (lwsi_role_h1(wsi) && lwsi_state(wsi) == LRS_ESTABLISHED &&
+	    !wsi->http.ah)
+		/* between transactions on a keepalive connection */
+		return 1;
+#endif
+
+	return 0;
+}
+
+static void
+lws_mem_budget_rxflow(struct lws_context_per_thread *pt)
+{
+	struct lws *heaviest[LWS_MEM_BUDGET_RXFLOW_PER_TICK];
+	size_t weight[LWS_MEM_BUDGET_RXFLOW_PER_TICK], w;
+	unsigned int n;
+	int m, count = 0;
+
+	for (n = 0; n < pt->fds_count; n++) {
+		struct lws *wsi = wsi_from_fd(pt->context, pt->fds[n].fd);
+
+		if (!wsi || lwsi_role_h2(wsi) ||
+		    (wsi->rxflow_bitmap & LWS_RXFLOW_REASON_MEM_BUDGET))
+			continue;
+
+		w = lws_mem_budget_weight(wsi);
+		if (!w)
+			continue;
+
+		/* keep the list sorted heaviest first */
+
+		if (count < LWS_MEM_BUDGET_RXFLOW_PER_TICK)
+			m = count++;
+		else {
+			m = LWS_MEM_BUDGET_RXFLOW_PER_TICK - 1;
+			if (weight[m] >= w)
+				continue;
+		}
+
+		while (m && weight[m - 1] < w) {
+			heaviest[m] = heaviest[m - 1];
+			weight[m] = weight[m - 1];
+			m--;
+		}
+		heaviest[m] = wsi;
+		weight[m] = w;
+	}
+
+	for (m = 0; m < count; m++) {
+		lwsl_notice("%s: tsi %d: over budget, rxflow %p (%lu buffered)\n",
+			    __func__, pt->tid, heaviest[m],
+			    (unsigned long)weight[m]);
+		lws_rx_flow_control(heaviest[m],
+				    LWS_RXFLOW_REASON_APPLIES_DISABLE |
+				    LWS_RXFLOW_REASON_MEM_BUDGET |
+				    LWS_RXFLOW_REASON_FLAG_PROCESS_NOW);
+		lws_stats_bump(pt, LWSSTATS_C_MEM_BUDGET_RXFLOW, 1);
+	}
+
+	if (count)
+		pt->mem_budget_throttling = 1;
+}
+
+static void
+lws_mem_budget_unthrottle(struct lws_context_per_thread *pt)
+{
+	unsigned int n;
+
+	for (n = 0; n < pt->fds_count; n++) {
+		struct lws *wsi = wsi_from_fd(pt->context, pt->fds[n].fd);
+
+		if (wsi && (wsi->rxflow_bitmap & LWS_RXFLOW_REASON_MEM_BUDGET))
+			lws_rx_flow_control(wsi,
+					    LWS_RXFLOW_REASON_APPLIES_ENABLE |
+					    LWS_RXFLOW_REASON_MEM_BUDGET |
+					    LWS_RXFLOW_REASON_FLAG_PROCESS_NOW);
+	}
+
+	pt->mem_budget_throttling = 0;
+}
+
+static void
+lws_mem_budget_shed(struct lws_context_per_thread *pt)
+{
+	struct lws *idle[LWS_MEM_BUDGET_SHED_PER_TICK];
+	unsigned int n;
+	int m, count = 0;
+
+	/* closing changes the fds table, so collect them first */
+
+	for (n = 0; n < pt->fds_count &&
+		    count < LWS_MEM_BUDGET_SHED_PER_TICK; n++) {
+		struct lws *wsi = wsi_from_fd(pt->context, pt->fds[n].fd);
+
+		if (wsi && lws_mem_budget_wsi_is_idle(wsi))
+			idle[count++] = wsi;
+	}
+
+	for (m = 0; m < count; m++) {
+		lwsl_notice("%s: tsi %d: over budget, closing idle %p\n",
+			    __func__, pt->tid, idle[m]);
+		__lws_close_free_wsi(idle[m], LWS_CLOSE_STATUS_NOSTATUS,
+				     "mem budget");
+		lws_stats_bump(pt, LWSSTATS_C_MEM_BUDGET_SHED, 1);
+	}
+}
+
+static void
+lws_sul_mem_budget_cb(lws_sorted_usec_list_t *sul)
+{
+	struct lws_context_per_thread *pt = lws_container_of(sul,
+			struct lws_context_per_thread, sul_mem_budget);
+	struct lws_context *context = pt->context;
+	size_t heap = lws_get_allocated_heap(), budget = context->mem_budget;
+
+	if (heap >= budget - (budget / 8)) {
+		if (!pt->mem_budget_accepts_paused) {
+			lwsl_notice("%s: tsi %d: heap %lu near budget %lu, "
+				    "pausing accepts\n", __func__, pt->tid,
+				    (unsigned long)heap, (unsigned long)budget);
+			pt->mem_budget_accepts_paused = 1;
+			lws_accept_modulation(context, pt, 0);
+			lws_stats_bump(pt, LWSSTATS_C_MEM_BUDGET_ACCEPT_PAUSED, 1);
+		}
+
+		if (heap >= budget)
+			lws_mem_budget_rxflow(pt);
+
+		if (heap >= budget + (budget / 8))
+			lws_mem_budget_shed(pt);
+
+		goto again;
+	}
+
+	if (heap >= budget - (budget / 4))
+		goto again;
+
+	if (pt->mem_budget_throttling) {
+		lwsl_notice("%s: tsi %d: heap %lu, ending rxflow\n", __func__,
+			    pt->tid, (unsigned long)heap);
+		lws_mem_budget_unthrottle(pt);
+	}
+
+	if (pt->mem_budget_accepts_paused) {
+		lwsl_notice("%s: tsi %d: heap %lu, resuming accepts\n",
+			    __func__, pt->tid, (unsigned long)heap);
+		pt->mem_budget_accepts_paused = 0;
+		if ((unsigned int)pt->fds_count <
+					context->fd_limit_per_thread - 1)
+			lws_accept_modulation(context, pt, 1);
+	}
+
+again:
+	__lws_sul_insert(&pt->pt_sul_owner, &pt->sul_mem_budget,
+			 LWS_MEM_BUDGET_INTERVAL_US);
+}
+
+void
+lws_mem_budget_init(struct lws_context *context)
+{
+	int n;
+
+	if (!context->mem_budget)
+		return;
+
+	for (n = 0; n < context->count_threads; n++) {
+		context->pt[n].sul_mem_budget.cb = lws_sul_mem_budget_cb;
+		__lws_sul_insert(&context->pt[n].pt_sul_owner,
+				 &context->pt[n].sul_mem_budget,
+				 LWS_MEM_BUDGET_INTERVAL_US);
+	}
+}
+
+#endif
@@ -606,6 +606,9 @@ lws_parse_numeric_address(const char *ads, uint8_t *result, size_t max_len)
 		switch (ts.e) {
 		case LWS_TOKZE_TOKEN:
 			dm = 0;
+			/* eg, an ip6.arpa name has too many parts to fit */
+			if (lws_ptr_diff(result, orig) + 1 + ipv6 > (int)max_len)
+				return -1;
 			if (ipv6) {
 				if (ts.token_len > 4)
 					return -1;
@@ -644,6 +647,8 @@ lws_parse_numeric_address(const char *ads, uint8_t *result, size_t max_len)
 					return -8;
 				if (*ts.token != ':')
 					return -9;
+				if (lws_ptr_diff(result, orig) + 2 > (int)max_len)
+					return -1;
 				/* back to back : */
 				*result++ = 0;
 				*result++ = 0;
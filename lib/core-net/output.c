@@ -24,6 +24,89 @@
 
 #include "private-lib-core.h"
 
+/*
+ * While a wsi is corked, whatever it writes is collected in a per-pt buffer
+ * and goes out in one write when the cork ends, instead of one write per
+ * lws_issue_raw().  This is used around the writeable callback of wsi that
+ * asked for it with lws_set_cork(), and by h1 around dispatching a run of
+ * pipelined requests, so their responses leave together.
+ *
+ * Only one wsi per pt can own the buffer, a wsi serviced recursively while
+ * another is corked just writes directly.
+ */
+
+void
+lws_cork_begin(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+
+	if (!pt->cork_wsi && !lws_has_buffered_out(wsi))
+		pt->cork_wsi = wsi;
+}
+
+int
+lws_cork_end(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	size_t len = pt->cork_len;
+
+	if (pt->cork_wsi != wsi)
+		return 0;
+
+	pt->cork_wsi = NULL;
+	pt->cork_len = 0;
+
+	if (!len)
+		return 0;
+
+	return lws_issue_raw(wsi, pt->cork, len) < 0;
+}
+
+/*
+ * Called from lws_issue_raw() for the corked wsi.  Returns 0 if the caller
+ * should send buf itself, 1 if we took it, or -1 on error.
+ */
+
+static int
+lws_cork_append(struct lws *wsi, const unsigned char *buf, size_t len)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	size_t size = wsi->context->pt_serv_buf_size;
+
+	if (!pt->cork) {
+		pt->cork = lws_malloc(size, __func__);
+		if (!pt->cork)
+			return 0;
+	}
+
+	if (pt->cork_len + len > size) {
+		/* send what we have, then this if it still doesn't fit */
+		if (lws_cork_end(wsi))
+			return -1;
+
+		if (len > size || lws_has_buffered_out(wsi))
+			return 0;
+
+		pt->cork_wsi = wsi;
+	}
+
+	memcpy(pt->cork + pt->cork_len, buf, len);
+	pt->cork_len += len;
+
+	return 1;
+}
+
+int
+lws_set_cork(struct lws *wsi, int cork)
+{
+	wsi->cork = !!cork;
+
+	if (cork)
+		return 0;
+
+	return lws_cork_end(lws_get_network_wsi(wsi));
+}
+
 /*
  * notice this returns number of bytes consumed, or -1
  */
@@ -63,6 +146,12 @@ lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 	    )
 		return (int)len;
 
+	if (buf && pt->cork_wsi == wsi) {
+		n = (unsigned int)lws_cork_append(wsi, buf, len);
+		if (n)
+			return (int)n < 0 ? -1 : (int)len;
+	}
+
 	if (buf && lws_has_buffered_out(wsi)) {
 		lwsl_info("** %p: vh: %s, prot: %s, incr buflist_out by %lu\n",
 			  wsi, wsi->vhost ? wsi->vhost->name : "no vhost",
@@ -259,7 +348,7 @@ lws_write(struct lws *wsi, unsigned char *buf, size_t len,
 	if (!wsi->role_ops->write_role_protocol)
 		return lws_issue_raw(wsi, buf, len);
 
-	m = wsi->role_ops->write_role_protocol(wsi, buf, len, &wp);
+	m = lws_rops_write_role_protocol(wsi, buf, len, &wp);
 	if (m < 0)
 		return m;
 
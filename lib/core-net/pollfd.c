@@ -221,7 +221,7 @@ bail:
  * Enable or disable listen sockets on this pt globally...
  * it's modulated according to the pt having space for a new accept.
  */
-static void
+void
 lws_accept_modulation(struct lws_context *context,
 		      struct lws_context_per_thread *pt, int allow)
 {
@@ -436,7 +436,7 @@ __remove_wsi_socket_from_fds(struct lws *wsi)
 #endif
 
 #if defined(LWS_WITH_SERVER)
-	if (!context->being_destroyed &&
+	if (!context->being_destroyed && !pt->mem_budget_accepts_paused &&
 	    /* if this made some room, accept connects on this thread */
 	    (unsigned int)pt->fds_count < context->fd_limit_per_thread - 1)
 		lws_accept_modulation(context, pt, 1);
@@ -572,6 +572,8 @@ lws_same_vh_protocol_insert(struct lws *wsi, int n)
 			  &wsi->vhost->same_vh_protocol_owner[n]);
 
 	wsi->bound_vhost_index = n;
+	/* we're not interested in any writable_all from before we joined */
+	wsi->writable_gen = wsi->vhost->writable_all_gen[n];
 
 	lws_vhost_unlock(wsi->vhost);
 }
@@ -601,6 +603,7 @@ int
 lws_callback_on_writable_all_protocol_vhost(const struct lws_vhost *vhost,
 				           const struct lws_protocols *protocol)
 {
+	struct lws_context_per_thread *pt;
 	struct lws *wsi;
 	int n;
 
@@ -615,14 +618,47 @@ lws_callback_on_writable_all_protocol_vhost(const struct lws_vhost *vhost,
 
 	n = (int)(protocol - vhost->protocols);
 
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+#if defined(LWS_WITH_POLL)
+	if (vhost->context->event_loop_ops != &event_loop_ops_poll)
+#endif
+	{
+		/*
+		 * Event libs only come back to us for io they are watching,
+		 * so they need each wsi to ask for POLLOUT itself
+		 */
+		lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
 			lws_dll2_get_head(&vhost->same_vh_protocol_owner[n])) {
-		wsi = lws_container_of(d, struct lws, same_vh_protocol);
+			wsi = lws_container_of(d, struct lws, same_vh_protocol);
 
-		assert(wsi->protocol == protocol);
-		lws_callback_on_writable(wsi);
+			assert(wsi->protocol == protocol);
+			lws_callback_on_writable(wsi);
+
+		} lws_end_foreach_dll_safe(d, d1);
+
+		return 0;
+	}
 
-	} lws_end_foreach_dll_safe(d, d1);
+	/*
+	 * Rather than visit, and maybe change the pollfd of, every wsi bound
+	 * to the protocol here, just bump the protocol's generation.  Each pt
+	 * notices on its next service pass and services the bound wsi whose
+	 * generation is behind directly, see lws_service_writable_all().
+	 */
+
+	vhost->writable_all_gen[n]++;
+
+	pt = &vhost->context->pt[0];
+	for (n = 0; n < vhost->context->count_threads; n++, pt++) {
+		pt->writable_all_pending = 1;
+		lws_memory_barrier();
+		/*
+		 * With SMP, another pt's service thread may already be waiting
+		 * in poll().  He checks writable_all_pending again after
+		 * setting inside_poll, so one of us sees the other.
+		 */
+		if (pt->inside_poll && pt->pipe_wsi)
+			lws_cancel_service_pt(pt->pipe_wsi);
+	}
 
 	return 0;
 }
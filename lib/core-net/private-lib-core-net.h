@@ -264,6 +264,32 @@ struct client_info_stash {
 
 #if defined(LWS_WITH_UDP)
 #define lws_wsi_is_udp(___wsi) (!!___wsi->udp)
+
+#if defined(LWS_HAVE_RECVMMSG)
+#define lws_wsi_is_udp_batch(___wsi) (!!___wsi->udp && ___wsi->udp_batch)
+#else
+#define lws_wsi_is_udp_batch(___wsi) (0)
+#endif
+
+#ifndef LWS_UDP_BATCH_MMSG
+/* max datagrams (or GRO / GSO buffers) per recvmmsg() / sendmmsg() */
+#define LWS_UDP_BATCH_MMSG		64
+#endif
+#ifndef LWS_UDP_BATCH_BUF_SIZE
+/* per-pt rx ring, allocated when a pt first services a batched wsi */
+#define LWS_UDP_BATCH_BUF_SIZE		(256 * 1024)
+#endif
+#ifndef LWS_UDP_BATCH_DGRAMS
+/* max datagrams delivered in one callback, after splitting GRO buffers */
+#define LWS_UDP_BATCH_DGRAMS		256
+#endif
+#ifndef LWS_UDP_TXQ_SIZE
+/* per-wsi tx queue payload buffer, allocated on first lws_udp_batch_queue() */
+#define LWS_UDP_TXQ_SIZE		(64 * 1024)
+#endif
+#define LWS_UDP_GRO_SLOT_SIZE		65536
+#define LWS_UDP_GSO_MAX_SEGS		64
+#define LWS_UDP_GSO_MAX_SIZE		65000
 #endif
 
 #define LWS_H2_FRAME_HEADER_LENGTH 9
@@ -325,8 +351,11 @@ typedef struct lws_async_dns {
 	lws_sockaddr46 		sa46; /* nameserver */
 	lws_dll2_owner_t	waiting;
 	lws_dll2_owner_t	cached;
+	lws_dll2_owner_t	rdns_waiting;
+	lws_dll2_owner_t	rdns_cached;
 	struct lws		*wsi;
 	time_t			time_set_server;
+	uint16_t		rdns_negative_ttl; /* secs, 0 = default */
 	char			dns_server_set;
 } lws_async_dns_t;
 
@@ -356,6 +385,7 @@ struct lws_context_per_thread {
 	pthread_t self;
 #endif
 	struct lws_dll2_owner dll_buflist_owner;  /* guys with pending rxflow */
+	struct lws_dll2_owner dll_buflist_fc_owner; /* ... but flowcontrolled */
 	struct lws_dll2_owner seq_owner;	   /* list of lws_sequencer-s */
 	lws_dll2_owner_t      attach_owner;	/* pending lws_attach */
 
@@ -370,12 +400,13 @@ struct lws_context_per_thread {
 
 	struct lws_dll2_owner pt_sul_owner;
 
+#if defined(LWS_WITH_UDP) && defined(LWS_HAVE_RECVMMSG)
+	struct lws_udp_batch_rx *udp_rx;
+#endif
+
 #if defined (LWS_WITH_SEQUENCER)
 	lws_sorted_usec_list_t sul_seq_heartbeat;
 #endif
-#if (defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)) && defined(LWS_WITH_SERVER)
-	lws_sorted_usec_list_t sul_ah_lifecheck;
-#endif
 #if defined(LWS_WITH_TLS) && defined(LWS_WITH_SERVER)
 	lws_sorted_usec_list_t sul_tls;
 #endif
@@ -393,6 +424,9 @@ struct lws_context_per_thread {
 #if defined(LWS_WITH_PEER_LIMITS)
 	lws_sorted_usec_list_t sul_peer_limits;
 #endif
+#if defined(LWS_WITH_SERVER) && defined(LWS_HAVE_MALLOC_USABLE_SIZE)
+	lws_sorted_usec_list_t sul_mem_budget;
+#endif
 
 #if defined(LWS_WITH_TLS)
 	struct lws_pt_tls tls;
@@ -408,6 +442,10 @@ struct lws_context_per_thread {
 	 */
 	unsigned char *serv_buf;
 
+	unsigned char *cork; /* corked writes, lazily allocated */
+	struct lws *cork_wsi; /* wsi whose writes are going into cork */
+	size_t cork_len;
+
 	struct lws_pollfd *fds;
 	volatile struct lws_foreign_thread_pollfd * volatile foreign_pfd_list;
 #ifdef _WIN32
@@ -468,6 +506,7 @@ struct lws_context_per_thread {
 
 	volatile unsigned char inside_poll;
 	volatile unsigned char foreign_spinlock;
+	volatile unsigned char writable_all_pending;
 
 	unsigned char tid;
 
@@ -477,6 +516,8 @@ struct lws_context_per_thread {
 	unsigned char event_loop_destroy_processing_done:1;
 	unsigned char destroy_self:1;
 	unsigned char is_destroyed:1;
+	unsigned char mem_budget_accepts_paused:1;
+	unsigned char mem_budget_throttling:1;
 #ifdef _WIN32
 	unsigned char interrupt_requested:1;
 #endif
@@ -543,6 +584,7 @@ struct lws_vhost {
 
 	struct lws_context *context;
 	struct lws_vhost *vhost_next;
+	lws_dll2_t vh_being_destroyed_list;
 
 	const lws_retry_bo_t *retry_policy;
 
@@ -561,6 +603,7 @@ struct lws_vhost {
 	const struct lws_protocol_vhost_options *pvo;
 	const struct lws_protocol_vhost_options *headers;
 	struct lws_dll2_owner *same_vh_protocol_owner;
+	uint32_t *writable_all_gen; /* per protocol, bumped by writable_all */
 	struct lws_vhost *no_listener_vhost_list;
 	struct lws_dll2_owner abstract_instances_owner;		/* vh lock */
 
@@ -640,6 +683,112 @@ lws_wsi_mux_apply_queue(struct lws *wsi);
  */
 
 struct lws {
+	/*
+	 * Hot members: looked at on every rx / tx service of the connection,
+	 * kept together at the start so they share the first two cachelines.
+	 * wsi.c checks the hot part doesn't grow past that.
+	 */
+
+	struct lws_context		*context;
+	struct lws_vhost		*vhost;
+	const struct lws_role_ops	*role_ops;
+	const struct lws_protocols	*protocol;
+	void				*user_space;
+	struct lws_buflist		*buflist; /* input-side buflist */
+	struct lws_buflist		*buflist_out; /* output-side buflist */
+	struct lws_dll2			dll_buflist; /* guys with pending rxflow */
+
+	lws_sock_file_fd_type		desc; /* .filefd / .sockfd */
+	lws_wsi_state_t			wsistate;
+#define LWS_NO_FDS_POS (-1)
+	int				position_in_fds_table;
+	uint32_t			writable_gen; /* last writable_all seen */
+
+	unsigned int			hdr_parsing_completed:1;
+	unsigned int			mux_substream:1;
+	unsigned int			upgraded_to_http2:1;
+	unsigned int			mux_stream_immortal:1;
+	unsigned int			h2_stream_carries_ws:1; /* immortal set as well */
+	unsigned int			h2_stream_carries_sse:1; /* immortal set as well */
+	unsigned int			h2_acked_settings:1;
+	unsigned int			seen_nonpseudoheader:1;
+	unsigned int			listener:1;
+	unsigned int			pf_packet:1;
+	unsigned int			do_broadcast:1;
+	unsigned int			user_space_externally_allocated:1;
+	unsigned int			socket_is_permanently_unusable:1;
+	unsigned int			rxflow_change_to:2;
+	unsigned int			conn_stat_done:1;
+	unsigned int			cache_reuse:1;
+	unsigned int			cache_revalidate:1;
+	unsigned int			cache_intermediaries:1;
+	unsigned int			favoured_pollin:1;
+	unsigned int			sending_chunked:1;
+	unsigned int			interpreting:1;
+	unsigned int			already_did_cce:1;
+	unsigned int			told_user_closed:1;
+	unsigned int			told_event_loop_closed:1;
+	unsigned int			waiting_to_send_close_frame:1;
+	unsigned int			close_needs_ack:1;
+	unsigned int			ipv6:1;
+	unsigned int			parent_pending_cb_on_writable:1;
+	unsigned int			cgi_stdout_zero_length:1;
+	unsigned int			seen_zero_length_recv:1;
+	unsigned int			rxflow_will_be_applied:1;
+	unsigned int			event_pipe:1;
+	unsigned int			handling_404:1;
+	unsigned int			protocol_bind_balance:1;
+	unsigned int			unix_skt:1;
+	unsigned int			close_when_buffered_out_drained:1;
+	unsigned int			h1_ws_proxied:1;
+	unsigned int			proxied_ws_parent:1;
+	unsigned int			do_bind:1;
+	unsigned int			udp_batch:1;
+	unsigned int			udp_gso_gro:1;
+	unsigned int			oom4:1;
+	unsigned int			validity_hup:1;
+	unsigned int			skip_fallback:1;
+	unsigned int			file_desc:1;
+
+	unsigned int			could_have_pending:1; /* detect back-to-back writes */
+	unsigned int			cork:1; /* collect writes from writeable cb */
+	unsigned int			outer_will_close:1;
+	unsigned int			shadow:1; /* we do not control fd lifecycle at all */
+
+#ifdef LWS_WITH_ACCESS_LOG
+	unsigned int			access_log_pending:1;
+#endif
+#if defined(LWS_WITH_CLIENT)
+	unsigned int			do_ws:1; /* whether we are doing http or ws flow */
+	unsigned int			chunked:1; /* if the clientside connection is chunked */
+	unsigned int			client_rx_avail:1;
+	unsigned int			client_http_body_pending:1;
+	unsigned int			transaction_from_pipeline_queue:1;
+	unsigned int			keepalive_active:1;
+	unsigned int			keepalive_rejected:1;
+	unsigned int			redirected_to_get:1;
+	unsigned int			client_pipeline:1;
+	unsigned int			client_h2_alpn:1;
+	unsigned int			client_mux_substream:1;
+	unsigned int			client_mux_migrated:1;
+	unsigned int			client_subsequent_mime_part:1;
+	unsigned int                    client_no_follow_redirect:1;
+#endif
+
+#ifdef _WIN32
+	unsigned int sock_send_blocking:1;
+#endif
+
+	char pending_timeout; /* enum pending_timeout */
+	char tsi; /* thread service index we belong to */
+	uint16_t rxflow_bitmap; /* LWS_RXFLOW_REASON_ b11..b0 */
+	uint8_t bound_vhost_index;
+	/* volatile to make sure code is aware other thread can change */
+	volatile char handling_pollout;
+	volatile char leave_pollout_active;
+
+	/* cold members: role, timer and lifetime state */
+
 	/* structs */
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
@@ -681,7 +830,6 @@ struct lws {
 	lws_sorted_usec_list_t		sul_hrtimer;
 	lws_sorted_usec_list_t		sul_validity;
 
-	struct lws_dll2			dll_buflist; /* guys with pending rxflow */
 	struct lws_dll2			same_vh_protocol;
 	struct lws_dll2			vh_awaiting_socket;
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
@@ -699,13 +847,9 @@ struct lws {
 #endif
 	/* pointers */
 
-	struct lws_context		*context;
-	struct lws_vhost		*vhost;
 	struct lws			*parent; /* points to parent, if any */
 	struct lws			*child_list; /* points to first child */
 	struct lws			*sibling_list; /* subsequent children at same level */
-	const struct lws_role_ops	*role_ops;
-	const struct lws_protocols	*protocol;
 	struct lws_sequencer		*seq;	/* associated sequencer if any */
 	const lws_retry_bo_t		*retry_policy;
 
@@ -719,6 +863,9 @@ struct lws {
 
 #if defined(LWS_WITH_UDP)
 	struct lws_udp			*udp;
+#if defined(LWS_HAVE_RECVMMSG)
+	struct lws_udp_txq		*udp_txq;
+#endif
 #endif
 #if defined(LWS_WITH_CLIENT)
 	struct client_info_stash	*stash;
@@ -726,109 +873,28 @@ struct lws {
 	const struct addrinfo		*dns_results;
 	const struct addrinfo		*dns_results_next;
 #endif
-	void				*user_space;
 	void				*opaque_parent_data;
 	void				*opaque_user_data;
 
-	struct lws_buflist		*buflist; /* input-side buflist */
-	struct lws_buflist		*buflist_out; /* output-side buflist */
-
 #if defined(LWS_WITH_TLS)
 	struct lws_lws_tls		tls;
 #endif
 
-	lws_sock_file_fd_type		desc; /* .filefd / .sockfd */
 #if defined(LWS_WITH_STATS)
 	uint64_t active_writable_req_us;
 #if defined(LWS_WITH_TLS)
 	uint64_t accept_start_us;
 #endif
 #endif
-	lws_wsi_state_t			wsistate;
 	lws_wsi_state_t			wsistate_pre_close;
 
 	/* ints */
-#define LWS_NO_FDS_POS (-1)
-	int				position_in_fds_table;
-
 #if defined(LWS_WITH_CLIENT)
 	int				chunk_remaining;
 	int				flags;
 #endif
 	unsigned int			cache_secs;
 
-	unsigned int			hdr_parsing_completed:1;
-	unsigned int			mux_substream:1;
-	unsigned int			upgraded_to_http2:1;
-	unsigned int			mux_stream_immortal:1;
-	unsigned int			h2_stream_carries_ws:1; /* immortal set as well */
-	unsigned int			h2_stream_carries_sse:1; /* immortal set as well */
-	unsigned int			h2_acked_settings:1;
-	unsigned int			seen_nonpseudoheader:1;
-	unsigned int			listener:1;
-	unsigned int			pf_packet:1;
-	unsigned int			do_broadcast:1;
-	unsigned int			user_space_externally_allocated:1;
-	unsigned int			socket_is_permanently_unusable:1;
-	unsigned int			rxflow_change_to:2;
-	unsigned int			conn_stat_done:1;
-	unsigned int			cache_reuse:1;
-	unsigned int			cache_revalidate:1;
-	unsigned int			cache_intermediaries:1;
-	unsigned int			favoured_pollin:1;
-	unsigned int			sending_chunked:1;
-	unsigned int			interpreting:1;
-	unsigned int			already_did_cce:1;
-	unsigned int			told_user_closed:1;
-	unsigned int			told_event_loop_closed:1;
-	unsigned int			waiting_to_send_close_frame:1;
-	unsigned int			close_needs_ack:1;
-	unsigned int			ipv6:1;
-	unsigned int			parent_pending_cb_on_writable:1;
-	unsigned int			cgi_stdout_zero_length:1;
-	unsigned int			seen_zero_length_recv:1;
-	unsigned int			rxflow_will_be_applied:1;
-	unsigned int			event_pipe:1;
-	unsigned int			handling_404:1;
-	unsigned int			protocol_bind_balance:1;
-	unsigned int			unix_skt:1;
-	unsigned int			close_when_buffered_out_drained:1;
-	unsigned int			h1_ws_proxied:1;
-	unsigned int			proxied_ws_parent:1;
-	unsigned int			do_bind:1;
-	unsigned int			oom4:1;
-	unsigned int			validity_hup:1;
-	unsigned int			skip_fallback:1;
-	unsigned int			file_desc:1;
-
-	unsigned int			could_have_pending:1; /* detect back-to-back writes */
-	unsigned int			outer_will_close:1;
-	unsigned int			shadow:1; /* we do not control fd lifecycle at all */
-
-#ifdef LWS_WITH_ACCESS_LOG
-	unsigned int			access_log_pending:1;
-#endif
-#if defined(LWS_WITH_CLIENT)
-	unsigned int			do_ws:1; /* whether we are doing http or ws flow */
-	unsigned int			chunked:1; /* if the clientside connection is chunked */
-	unsigned int			client_rx_avail:1;
-	unsigned int			client_http_body_pending:1;
-	unsigned int			transaction_from_pipeline_queue:1;
-	unsigned int			keepalive_active:1;
-	unsigned int			keepalive_rejected:1;
-	unsigned int			redirected_to_get:1;
-	unsigned int			client_pipeline:1;
-	unsigned int			client_h2_alpn:1;
-	unsigned int			client_mux_substream:1;
-	unsigned int			client_mux_migrated:1;
-	unsigned int			client_subsequent_mime_part:1;
-	unsigned int                    client_no_follow_redirect:1;
-#endif
-
-#ifdef _WIN32
-	unsigned int sock_send_blocking:1;
-#endif
-
 	uint16_t			ocport, c_port;
 	uint16_t			retry;
 
@@ -836,12 +902,8 @@ struct lws {
 
 	char lws_rx_parse_state; /* enum lws_rx_parse_state */
 	char rx_frame_type; /* enum lws_write_protocol */
-	char pending_timeout; /* enum pending_timeout */
-	char tsi; /* thread service index we belong to */
 	char protocol_interpret_idx;
 	char redirects;
-	uint8_t rxflow_bitmap;
-	uint8_t bound_vhost_index;
 	uint8_t lsp_channel; /* which of stdin/out/err */
 #ifdef LWS_WITH_CGI
 	char hdr_state;
@@ -858,9 +920,6 @@ struct lws {
 	char seen_rx;
 #endif
 	uint8_t immortal_substream_count;
-	/* volatile to make sure code is aware other thread can change */
-	volatile char handling_pollout;
-	volatile char leave_pollout_active;
 #if LWS_MAX_SMP > 1
 	volatile char undergoing_init_from_other_pt;
 #endif
@@ -919,6 +978,11 @@ lws_spawn_reap(struct lws_spawn_piped *lsp);
 
 void
 lws_service_do_ripe_rxflow(struct lws_context_per_thread *pt);
+void
+__lws_add_wsi_to_buflist_list(struct lws_context_per_thread *pt,
+			      struct lws *wsi);
+void
+__lws_rxflow_requeue(struct lws *wsi);
 
 const struct lws_role_ops *
 lws_role_by_name(const char *name);
@@ -940,6 +1004,111 @@ __lws_close_free_wsi(struct lws *wsi, enum lws_close_status, const char *caller)
 void
 __lws_free_wsi(struct lws *wsi);
 
+#if defined(LWS_WITH_DIRECT_ROLE_DISPATCH)
+#if defined(LWS_ROLE_H1)
+int
+rops_handle_POLLIN_h1(struct lws_context_per_thread *pt, struct lws *wsi,
+		      struct lws_pollfd *pollfd);
+int
+rops_handle_POLLOUT_h1(struct lws *wsi);
+int
+rops_write_role_protocol_h1(struct lws *wsi, unsigned char *buf, size_t len,
+			    enum lws_write_protocol *wp);
+#endif
+#if defined(LWS_ROLE_H2)
+int
+rops_handle_POLLIN_h2(struct lws_context_per_thread *pt, struct lws *wsi,
+		      struct lws_pollfd *pollfd);
+int
+rops_handle_POLLOUT_h2(struct lws *wsi);
+int
+rops_write_role_protocol_h2(struct lws *wsi, unsigned char *buf, size_t len,
+			    enum lws_write_protocol *wp);
+#endif
+#if defined(LWS_ROLE_WS)
+int
+rops_handle_POLLIN_ws(struct lws_context_per_thread *pt, struct lws *wsi,
+		      struct lws_pollfd *pollfd);
+int
+rops_handle_POLLOUT_ws(struct lws *wsi);
+int
+rops_write_role_protocol_ws(struct lws *wsi, unsigned char *buf, size_t len,
+			    enum lws_write_protocol *wp);
+#endif
+#endif
+
+/*
+ * The per-event role ops used by the service and output paths.  Normally these
+ * go through the wsi->role_ops function pointers.  With
+ * LWS_WITH_DIRECT_ROLE_DISPATCH, the ws, h1 and h2 roles the build knows about
+ * are matched first and get direct calls, which the cpu predicts without
+ * needing an indirect branch; other roles still use the pointer.
+ *
+ * Callers check the role_ops member is non-NULL first as before.
+ */
+
+static LWS_INLINE int
+lws_rops_handle_POLLIN(struct lws_context_per_thread *pt, struct lws *wsi,
+		       struct lws_pollfd *pollfd)
+{
+#if defined(LWS_WITH_DIRECT_ROLE_DISPATCH)
+#if defined(LWS_ROLE_WS)
+	if (wsi->role_ops == &role_ops_ws)
+		return rops_handle_POLLIN_ws(pt, wsi, pollfd);
+#endif
+#if defined(LWS_ROLE_H1)
+	if (wsi->role_ops == &role_ops_h1)
+		return rops_handle_POLLIN_h1(pt, wsi, pollfd);
+#endif
+#if defined(LWS_ROLE_H2)
+	if (wsi->role_ops == &role_ops_h2)
+		return rops_handle_POLLIN_h2(pt, wsi, pollfd);
+#endif
+#endif
+	return wsi->role_ops->handle_POLLIN(pt, wsi, pollfd);
+}
+
+static LWS_INLINE int
+lws_rops_handle_POLLOUT(struct lws *wsi)
+{
+#if defined(LWS_WITH_DIRECT_ROLE_DISPATCH)
+#if defined(LWS_ROLE_WS)
+	if (wsi->role_ops == &role_ops_ws)
+		return rops_handle_POLLOUT_ws(wsi);
+#endif
+#if defined(LWS_ROLE_H1)
+	if (wsi->role_ops == &role_ops_h1)
+		return rops_handle_POLLOUT_h1(wsi);
+#endif
+#if defined(LWS_ROLE_H2)
+	if (wsi->role_ops == &role_ops_h2)
+		return rops_handle_POLLOUT_h2(wsi);
+#endif
+#endif
+	return wsi->role_ops->handle_POLLOUT(wsi);
+}
+
+static LWS_INLINE int
+lws_rops_write_role_protocol(struct lws *wsi, unsigned char *buf, size_t len,
+			     enum lws_write_protocol *wp)
+{
+#if defined(LWS_WITH_DIRECT_ROLE_DISPATCH)
+#if defined(LWS_ROLE_WS)
+	if (wsi->role_ops == &role_ops_ws)
+		return rops_write_role_protocol_ws(wsi, buf, len, wp);
+#endif
+#if defined(LWS_ROLE_H1)
+	if (wsi->role_ops == &role_ops_h1)
+		return rops_write_role_protocol_h1(wsi, buf, len, wp);
+#endif
+#if defined(LWS_ROLE_H2)
+	if (wsi->role_ops == &role_ops_h2)
+		return rops_write_role_protocol_h2(wsi, buf, len, wp);
+#endif
+#endif
+	return wsi->role_ops->write_role_protocol(wsi, buf, len, wp);
+}
+
 #if LWS_MAX_SMP > 1
 
 static LWS_INLINE void
@@ -1121,6 +1290,10 @@ __lws_change_pollfd(struct lws *wsi, int _and, int _or);
 
 int
 lws_callback_as_writeable(struct lws *wsi);
+void
+lws_cork_begin(struct lws *wsi);
+int
+lws_cork_end(struct lws *wsi);
 
 int
 lws_role_call_client_bind(struct lws *wsi,
@@ -1341,6 +1514,18 @@ void
 lws_peer_dump_from_wsi(struct lws *wsi);
 #endif
 
+#if defined(LWS_WITH_SERVER)
+void
+lws_accept_modulation(struct lws_context *context,
+		      struct lws_context_per_thread *pt, int allow);
+#if defined(LWS_HAVE_MALLOC_USABLE_SIZE)
+void
+lws_mem_budget_init(struct lws_context *context);
+#else
+#define lws_mem_budget_init(_c)
+#endif
+#endif
+
 #ifdef LWS_WITH_HUBBUB
 hubbub_error
 html_parser_cb(const hubbub_token *token, void *pw);
@@ -1367,6 +1552,17 @@ int
 lws_buflist_aware_finished_consuming(struct lws *wsi, struct lws_tokens *ebuf,
 				     int used, int buffered, const char *hint);
 
+#if defined(LWS_WITH_UDP) && defined(LWS_HAVE_RECVMMSG)
+void
+lws_udp_batch_socket_init(struct lws *wsi, lws_sockfd_type fd);
+int
+lws_udp_batch_rx(struct lws_context_per_thread *pt, struct lws *wsi);
+void
+lws_udp_batch_destroy_wsi(struct lws *wsi);
+void
+lws_udp_batch_destroy_pt(struct lws_context_per_thread *pt);
+#endif
+
 extern const struct lws_protocols protocol_abs_client_raw_skt,
 				  protocol_abs_client_unit_test;
 
@@ -1397,6 +1593,10 @@ _lws_generic_transaction_completed_active_conn(struct lws **wsi, char take_vh_lo
 
 int
 lws_vhost_active_conns(struct lws *wsi, struct lws **nwsi, const char *adsin);
+#if defined(LWS_WITH_HTTP2) && defined(LWS_WITH_TLS)
+int
+lws_vhost_active_conns_coalesce(struct lws *wsi, struct lws **nwsi);
+#endif
 
 const char *
 lws_wsi_client_stash_item(struct lws *wsi, int stash_idx, int hdr_idx);
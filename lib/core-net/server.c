@@ -249,7 +249,7 @@ lws_json_dump_context(const struct lws_context *context, char *buf, int len,
 				"    }",
 				pt->fds_count,
 				pt->http.ah_count_in_use,
-				pt->http.ah_wait_list_length);
+				pt->http.ah_wait_owner.count);
 	}
 
 	buf += lws_snprintf(buf, end - buf, "]");
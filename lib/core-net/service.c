@@ -52,11 +52,18 @@ lws_callback_as_writeable(struct lws *wsi)
 		      ((uint32_t)us - wsi->detlat.earliest_write_req_pre_write);
 	}
 #endif
+	if (wsi->cork)
+		/* collect what the callback writes, and send it as one */
+		lws_cork_begin(lws_get_network_wsi(wsi));
+
 	n = wsi->role_ops->writeable_cb[lwsi_role_server(wsi)];
 	m = user_callback_handle_rxflow(wsi->protocol->callback,
 					wsi, (enum lws_callback_reasons) n,
 					wsi->user_space, NULL, 0);
 
+	if (wsi->cork && lws_cork_end(lws_get_network_wsi(wsi)))
+		return -1;
+
 	return m;
 }
 
@@ -114,7 +121,7 @@ lws_handle_POLLOUT_event(struct lws *wsi, struct lws_pollfd *pollfd)
 				wsi->http.comp_ctx.may_have_more
 				);
 
-		if (wsi->role_ops->write_role_protocol(wsi, NULL, 0, &wp) < 0) {
+		if (lws_rops_write_role_protocol(wsi, NULL, 0, &wp) < 0) {
 			lwsl_info("%s signalling to close\n", __func__);
 			goto bail_die;
 		}
@@ -146,7 +153,7 @@ lws_handle_POLLOUT_event(struct lws *wsi, struct lws_pollfd *pollfd)
 	if (!wsi->role_ops->handle_POLLOUT)
 		goto bail_ok;
 
-	n = wsi->role_ops->handle_POLLOUT(wsi);
+	n = lws_rops_handle_POLLOUT(wsi);
 	switch (n) {
 	case LWS_HP_RET_BAIL_OK:
 		goto bail_ok;
@@ -242,6 +249,48 @@ bail_die:
 	return -1;
 }
 
+/*
+ * Guys with buffered rx wait on one of two lists: dll_buflist_owner if they
+ * can use it as soon as we get around to them, or dll_buflist_fc_owner while
+ * they are rx flowcontrolled.  So the service loop only has to look at the
+ * guys who can actually do something, however many are parked.
+ */
+
+void
+__lws_add_wsi_to_buflist_list(struct lws_context_per_thread *pt,
+			      struct lws *wsi)
+{
+	if (!lws_dll2_is_detached(&wsi->dll_buflist))
+		return;
+
+	lws_dll2_add_head(&wsi->dll_buflist, lws_is_flowcontrolled(wsi) ?
+					&pt->dll_buflist_fc_owner :
+					&pt->dll_buflist_owner);
+}
+
+/*
+ * The wsi's rx flowcontrol state changed, move him to the matching list for
+ * his buffered rx, if he has any
+ */
+
+void
+__lws_rxflow_requeue(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+
+	if (!lws_dll2_is_detached(&wsi->dll_buflist)) {
+		lws_dll2_remove(&wsi->dll_buflist);
+		__lws_add_wsi_to_buflist_list(pt, wsi);
+	}
+
+#if defined(LWS_WITH_TLS)
+	if (!lws_dll2_is_detached(&wsi->tls.dll_pending_tls)) {
+		__lws_ssl_remove_wsi_from_buffered_list(wsi);
+		__lws_ssl_add_wsi_to_buffered_list(pt, wsi);
+	}
+#endif
+}
+
 int
 lws_rxflow_cache(struct lws *wsi, unsigned char *buf, int n, int len)
 {
@@ -280,8 +329,7 @@ lws_rxflow_cache(struct lws *wsi, unsigned char *buf, int n, int len)
 		return LWSRXFC_ERROR;
 	if (m) {
 		lwsl_debug("%s: added %p to rxflow list\n", __func__, wsi);
-		if (lws_dll2_is_detached(&wsi->dll_buflist))
-			lws_dll2_add_head(&wsi->dll_buflist, &pt->dll_buflist_owner);
+		__lws_add_wsi_to_buflist_list(pt, wsi);
 	}
 
 	return ret;
@@ -322,6 +370,10 @@ lws_service_adjust_timeout(struct lws_context *context, int timeout_ms, int tsi)
 			return 0;
 #endif
 
+	/* 3) if a writable_all is waiting to be handed out, do not wait */
+	if (pt->writable_all_pending)
+		return 0;
+
 	/*
 	 * 4) If there is any wsi with rxflow buffered and in a state to process
 	 *    it, we should not wait in poll
@@ -413,9 +465,8 @@ lws_buflist_aware_read(struct lws_context_per_thread *pt, struct lws *wsi,
 		n = lws_buflist_append_segment(&wsi->buflist, ebuf->token, ebuf->len);
 		if (n < 0)
 			return -1;
-		if (n && lws_dll2_is_detached(&wsi->dll_buflist))
-			lws_dll2_add_head(&wsi->dll_buflist,
-					  &pt->dll_buflist_owner);
+		if (n)
+			__lws_add_wsi_to_buflist_list(pt, wsi);
 
 		goto buflist_material;
 	}
@@ -482,9 +533,7 @@ lws_buflist_aware_finished_consuming(struct lws *wsi, struct lws_tokens *ebuf,
 		if (m) {
 			lwsl_debug("%s: added %p to rxflow list\n",
 				   __func__, wsi);
-			if (lws_dll2_is_detached(&wsi->dll_buflist))
-				lws_dll2_add_head(&wsi->dll_buflist,
-					 &pt->dll_buflist_owner);
+			__lws_add_wsi_to_buflist_list(pt, wsi);
 		}
 		// lws_buflist_describe(&wsi->buflist, wsi, __func__);
 	}
@@ -492,24 +541,41 @@ lws_buflist_aware_finished_consuming(struct lws *wsi, struct lws_tokens *ebuf,
 	return 0;
 }
 
+/* most guys with buffered rx we will service in one pass */
+#define LWS_RIPE_RXFLOW_BATCH 32
+
 void
 lws_service_do_ripe_rxflow(struct lws_context_per_thread *pt)
 {
 	struct lws_pollfd pfd;
+	int n;
 
 	if (!pt->dll_buflist_owner.head)
 		return;
 
 	/*
-	 * service all guys with pending rxflow that reached a state they can
-	 * accept the pending data
+	 * service guys with pending rxflow that reached a state they can
+	 * accept the pending data... flowcontrolled guys are parked on
+	 * dll_buflist_fc_owner and don't appear here.
+	 *
+	 * We only do a batch at a time, and rotate whoever we looked at to the
+	 * tail, so nobody gets starved and one pass is bounded no matter how
+	 * many are waiting.  If he still has something buffered afterwards,
+	 * he's still on the list and poll won't wait for the next batch.
 	 */
 
 	lws_pt_lock(pt, __func__);
 
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   pt->dll_buflist_owner.head) {
-		struct lws *wsi = lws_container_of(d, struct lws, dll_buflist);
+	n = (int)pt->dll_buflist_owner.count;
+	if (n > LWS_RIPE_RXFLOW_BATCH)
+		n = LWS_RIPE_RXFLOW_BATCH;
+
+	while (n-- && pt->dll_buflist_owner.head) {
+		struct lws *wsi = lws_container_of(pt->dll_buflist_owner.head,
+						   struct lws, dll_buflist);
+
+		lws_dll2_remove(&wsi->dll_buflist);
+		lws_dll2_add_tail(&wsi->dll_buflist, &pt->dll_buflist_owner);
 
 		pfd.events = LWS_POLLIN;
 		pfd.revents = LWS_POLLIN;
@@ -523,18 +589,82 @@ lws_service_do_ripe_rxflow(struct lws_context_per_thread *pt)
 		    lwsi_state(wsi) != LRS_DEFERRING_ACTION) {
 			pt->inside_lws_service = 1;
 
-			if ((wsi->role_ops->handle_POLLIN)(pt, wsi, &pfd) ==
+			if (lws_rops_handle_POLLIN(pt, wsi, &pfd) ==
 						   LWS_HPI_RET_PLEASE_CLOSE_ME)
 				lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS,
 						"close_and_handled");
 			pt->inside_lws_service = 0;
 		}
-
-	} lws_end_foreach_dll_safe(d, d1);
+	}
 
 	lws_pt_unlock(pt);
 }
 
+/*
+ * Returns nonzero if the wsi is bound to a protocol that had a writable_all
+ * since it last looked, and brings it up to date
+ */
+static int
+lws_writable_all_due(struct lws *wsi)
+{
+	uint32_t gen;
+
+	if (!wsi->vhost || !wsi->vhost->writable_all_gen ||
+	    lws_dll2_is_detached(&wsi->same_vh_protocol))
+		return 0;
+
+	gen = wsi->vhost->writable_all_gen[wsi->bound_vhost_index];
+	if (wsi->writable_gen == gen)
+		return 0;
+
+	wsi->writable_gen = gen;
+
+	return 1;
+}
+
+/*
+ * Somebody called lws_callback_on_writable_all_protocol_vhost() since our
+ * last pass.  Established connections with nothing already waiting to go out
+ * get POLLOUT faked directly, without changing their pollfd: if the socket
+ * can't actually take it, the write becomes a partial and that arms POLLOUT
+ * in the usual way.  Anything else asks for writable the normal way.
+ */
+static int
+lws_service_writable_all(struct lws_context_per_thread *pt)
+{
+	unsigned int n;
+	int forced = 0;
+
+	for (n = 0; n < pt->fds_count; n++) {
+		struct lws *wsi = wsi_from_fd(pt->context, pt->fds[n].fd);
+
+		if (!wsi)
+			continue;
+
+#if defined(LWS_ROLE_H2) || defined(LWS_ROLE_MQTT)
+		/* mux children have no fd of their own */
+		lws_start_foreach_ll(struct lws *, w, wsi->mux.child_list) {
+			if (lws_writable_all_due(w))
+				lws_callback_on_writable(w);
+		} lws_end_foreach_ll(w, mux.sibling_list);
+#endif
+
+		if (!lws_writable_all_due(wsi))
+			continue;
+
+		if (lwsi_state(wsi) != LRS_ESTABLISHED ||
+		    lws_has_buffered_out(wsi)) {
+			lws_callback_on_writable(wsi);
+			continue;
+		}
+
+		pt->fds[n].revents |= LWS_POLLOUT;
+		forced = 1;
+	}
+
+	return forced;
+}
+
 /*
  * guys that need POLLIN service again without waiting for network action
  * can force POLLIN here if not flowcontrolled, so they will get service.
@@ -604,6 +734,14 @@ lws_service_flag_pending(struct lws_context *context, int tsi)
 	} lws_end_foreach_dll_safe(p, p1);
 #endif
 
+	/*
+	 * 3) Anybody due a writable from lws_callback_on_writable_all_protocol()
+	 */
+	if (pt->writable_all_pending) {
+		pt->writable_all_pending = 0;
+		forced |= lws_service_writable_all(pt);
+	}
+
 	lws_pt_unlock(pt);
 
 	return forced;
@@ -700,7 +838,7 @@ lws_service_fd_tsi(struct lws_context *context, struct lws_pollfd *pollfd,
 	// lwsl_notice("%s: %s: wsistate 0x%x\n", __func__, wsi->role_ops->name,
 	//	    wsi->wsistate);
 
-	switch ((wsi->role_ops->handle_POLLIN)(pt, wsi, pollfd)) {
+	switch (lws_rops_handle_POLLIN(pt, wsi, pollfd)) {
 	case LWS_HPI_RET_WSI_ALREADY_DIED:
 		pt->inside_lws_service = 0;
 		return 1;
@@ -64,6 +64,12 @@ static const char * stat_names[] = {
 	"C_PEER_LIMIT_WSI_DENIED",
 	"C_CONNECTIONS_CLIENT",
 	"C_CONNECTIONS_CLIENT_FAILED",
+	"C_AH_WAITED",
+	"US_AH_WAIT_AVG",
+	"US_WORST_AH_WAIT",
+	"C_MEM_BUDGET_ACCEPT_PAUSED",
+	"C_MEM_BUDGET_RXFLOW",
+	"C_MEM_BUDGET_SHED",
 };
 
 static int
@@ -95,6 +101,11 @@ quantify(struct lws_context *context, int tsi, char *p, int len, int idx,
 		if (u1)
 			u = u / u1;
 		break;
+	case LWSSTATS_US_AH_WAIT_AVG:
+		u1 = pt->lws_stats[LWSSTATS_C_AH_WAITED];
+		if (u1)
+			u = u / u1;
+		break;
 	}
 	lws_pt_stats_unlock(pt);
 
@@ -179,8 +190,6 @@ lws_stats_log_dump(struct lws_context *context)
 
 	for (n = 0; n < context->count_threads; n++) {
 		struct lws_context_per_thread *pt = &context->pt[n];
-		struct lws *wl;
-		int m = 0;
 
 		lwsl_notice("PT %d\n", n + 1);
 
@@ -190,14 +199,12 @@ lws_stats_log_dump(struct lws_context *context)
 				pt->http.ah_count_in_use,
 				context->max_http_header_pool);
 
-		wl = pt->http.ah_wait_list;
-		while (wl) {
-			m++;
-			wl = wl->http.ah_wait_list;
-		}
+		lwsl_notice("  AH pool / idle:                   %u / %u\n",
+				pt->http.ah_pool_length,
+				pt->http.ah_free_list_length);
 
-		lwsl_notice("  AH wait list count / actual:      %d / %d\n",
-				pt->http.ah_wait_list_length, m);
+		lwsl_notice("  AH wait list count:               %d\n",
+				pt->http.ah_wait_owner.count);
 
 		lws_pt_unlock(pt);
 	}
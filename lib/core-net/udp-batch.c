@@ -0,0 +1,499 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2020 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Batched UDP rx and tx for wsi created with LWS_CAUDP_BATCH.
+ *
+ * Rx uses recvmmsg() into a per-pt datagram ring, so one syscall can deliver
+ * many datagrams, which are passed to the user code in one
+ * LWS_CALLBACK_RAW_RX_UDP_BATCH callback.  Tx datagrams are queued on the wsi
+ * with lws_udp_batch_queue() and go out in one sendmmsg() when the queue is
+ * flushed.
+ *
+ * With LWS_CAUDP_GSO_GRO as well, where the kernel has them, UDP_GRO lets the
+ * kernel coalesce rx datagrams from the same flow that we split back up here,
+ * and runs of same-size tx datagrams to the same peer are sent as one buffer
+ * with UDP_SEGMENT.
+ *
+ * Where there is no recvmmsg(), the wsi is serviced by the normal single
+ * datagram path and queued tx is sent immediately one datagram at a time.
+ */
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "private-lib-core.h"
+
+#if defined(LWS_HAVE_RECVMMSG)
+#include <netinet/udp.h>
+#if !defined(SOL_UDP)
+#define SOL_UDP 17
+#endif
+#endif
+
+#if defined(LWS_HAVE_RECVMMSG)
+
+struct lws_udp_batch_rx {
+	struct mmsghdr		mm[LWS_UDP_BATCH_MMSG];
+	struct iovec		iov[LWS_UDP_BATCH_MMSG];
+	struct sockaddr_storage	sa[LWS_UDP_BATCH_MMSG];
+	uint8_t			cmsg[LWS_UDP_BATCH_MMSG][CMSG_SPACE(sizeof(int))];
+	lws_udp_dgram_t		dg[LWS_UDP_BATCH_DGRAMS];
+	uint8_t			buf[LWS_UDP_BATCH_BUF_SIZE];
+};
+
+struct lws_udp_txq_entry {
+	struct sockaddr_storage	sa;
+	socklen_t		salen;
+	size_t			ofs;
+	size_t			len;
+};
+
+struct lws_udp_txq {
+	struct mmsghdr		mm[LWS_UDP_BATCH_MMSG];
+	struct iovec		iov[LWS_UDP_BATCH_MMSG];
+	uint8_t			cmsg[LWS_UDP_BATCH_MMSG][CMSG_SPACE(sizeof(uint16_t))];
+	struct lws_udp_txq_entry q[LWS_UDP_BATCH_MMSG];
+	int			head; /* first unsent entry */
+	int			count; /* entries queued, including sent ones */
+	size_t			used; /* bytes of buf used, including sent */
+	uint8_t			buf[LWS_UDP_TXQ_SIZE];
+};
+
+void
+lws_udp_batch_socket_init(struct lws *wsi, lws_sockfd_type fd)
+{
+#if defined(UDP_GRO)
+	int one = 1;
+
+	if (wsi->udp_gso_gro &&
+	    setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+		lwsl_info("%s: UDP_GRO not available\n", __func__);
+#endif
+}
+
+static int
+lws_udp_gro_size(struct msghdr *mh, size_t len)
+{
+#if defined(UDP_GRO)
+	struct cmsghdr *cm;
+
+	for (cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm))
+		if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+			int gso;
+
+			memcpy(&gso, CMSG_DATA(cm), sizeof(gso));
+			if (gso > 0)
+				return gso;
+		}
+#endif
+
+	return (int)len;
+}
+
+int
+lws_udp_batch_rx(struct lws_context_per_thread *pt, struct lws *wsi)
+{
+	struct lws_udp_batch_rx *r = pt->udp_rx;
+	size_t slot, tot = 0, o, seg;
+	int n, m, count = 0, nslots;
+
+	if (!r) {
+		/* only pts actually servicing batched wsi pay for this */
+		r = pt->udp_rx = lws_malloc(sizeof(*r), "udp batch rx");
+		if (!r)
+			return -1;
+	}
+
+	/*
+	 * A GRO'd buffer can hold up to 64KB of datagrams, otherwise we
+	 * accept the same max datagram size as the unbatched path
+	 */
+	slot = wsi->udp_gso_gro ? LWS_UDP_GRO_SLOT_SIZE :
+				  wsi->context->pt_serv_buf_size;
+	nslots = (int)(sizeof(r->buf) / slot);
+	if (nslots > LWS_UDP_BATCH_MMSG)
+		nslots = LWS_UDP_BATCH_MMSG;
+
+	for (n = 0; n < nslots; n++) {
+		struct msghdr *mh = &r->mm[n].msg_hdr;
+
+		r->iov[n].iov_base = r->buf + (slot * (unsigned int)n);
+		r->iov[n].iov_len = slot;
+
+		memset(mh, 0, sizeof(*mh));
+		mh->msg_name = &r->sa[n];
+		mh->msg_namelen = sizeof(r->sa[n]);
+		mh->msg_iov = &r->iov[n];
+		mh->msg_iovlen = 1;
+		if (wsi->udp_gso_gro) {
+			mh->msg_control = r->cmsg[n];
+			mh->msg_controllen = sizeof(r->cmsg[n]);
+		}
+	}
+
+	lws_stats_bump(pt, LWSSTATS_C_API_READ, 1);
+
+	n = recvmmsg(wsi->desc.sockfd, r->mm, (unsigned int)nslots,
+		     MSG_DONTWAIT, NULL);
+	if (n < 0) {
+		if (LWS_ERRNO == LWS_EAGAIN ||
+		    LWS_ERRNO == LWS_EWOULDBLOCK ||
+		    LWS_ERRNO == LWS_EINTR)
+			return 0;
+
+		lwsl_info("%s: recvmmsg errno %d\n", __func__, LWS_ERRNO);
+
+		return -1;
+	}
+
+	for (m = 0; m < n; m++) {
+		struct msghdr *mh = &r->mm[m].msg_hdr;
+		size_t len = r->mm[m].msg_len;
+
+		if (mh->msg_flags & MSG_TRUNC)
+			lwsl_warn("%s: truncated dgram\n", __func__);
+
+		tot += len;
+		seg = (size_t)lws_udp_gro_size(mh, len);
+
+		/* split any GRO'd buffer back into the original datagrams */
+
+		for (o = 0; o < len && count < LWS_UDP_BATCH_DGRAMS; o += seg) {
+			lws_udp_dgram_t *dg = &r->dg[count];
+
+			if (wsi->context->udp_loss_sim_rx_pc) {
+				uint16_t u16;
+
+				if (lws_get_random(wsi->context, &u16, 2) == 2 &&
+				    ((u16 * 100) / 0xffff) <=
+					    wsi->context->udp_loss_sim_rx_pc) {
+					lwsl_warn("%s: dropping udp rx\n",
+						  __func__);
+					continue;
+				}
+			}
+
+			dg->buf = (uint8_t *)r->iov[m].iov_base + o;
+			dg->len = len - o < seg ? len - o : seg;
+			dg->sa = (const struct sockaddr *)&r->sa[m];
+			dg->salen = mh->msg_namelen;
+			count++;
+		}
+
+		/* lws_get_udp() reflects the last peer we heard from */
+		memcpy(&wsi->udp->sa, &r->sa[m],
+		       mh->msg_namelen < sizeof(wsi->udp->sa) ?
+				mh->msg_namelen : sizeof(wsi->udp->sa));
+		wsi->udp->salen = mh->msg_namelen;
+	}
+
+	lws_stats_bump(pt, LWSSTATS_B_READ, tot);
+#if defined(LWS_WITH_SERVER_STATUS)
+	if (wsi->vhost)
+		wsi->vhost->conn_stats.rx += tot;
+#endif
+
+	if (!count)
+		return 0;
+
+	n = user_callback_handle_rxflow(wsi->protocol->callback, wsi,
+					LWS_CALLBACK_RAW_RX_UDP_BATCH,
+					wsi->user_space, r->dg, (size_t)count);
+	if (n < 0)
+		return -1;
+
+	/* any replies queued while handling the batch can go out together */
+
+	return lws_udp_batch_flush(wsi) < 0 ? -1 : 0;
+}
+
+/*
+ * Compact the queue so unsent datagrams start at the beginning again
+ */
+
+static void
+lws_udp_txq_compact(struct lws_udp_txq *t)
+{
+	size_t ofs;
+	int n;
+
+	if (!t->head)
+		return;
+
+	if (t->head == t->count) {
+		t->head = t->count = 0;
+		t->used = 0;
+
+		return;
+	}
+
+	ofs = t->q[t->head].ofs;
+	memmove(t->buf, t->buf + ofs, t->used - ofs);
+	t->used -= ofs;
+
+	for (n = t->head; n < t->count; n++) {
+		t->q[n - t->head] = t->q[n];
+		t->q[n - t->head].ofs -= ofs;
+	}
+	t->count -= t->head;
+	t->head = 0;
+}
+
+static int
+lws_udp_txq_same_peer(struct lws_udp_txq_entry *a, struct lws_udp_txq_entry *b)
+{
+	return a->salen == b->salen && !memcmp(&a->sa, &b->sa, a->salen);
+}
+
+int
+lws_udp_batch_flush(struct lws *wsi)
+{
+	struct lws_udp_txq *t = wsi->udp_txq;
+	int n, m, e, nmsg = 0, ents[LWS_UDP_BATCH_MMSG];
+	struct lws_context_per_thread *pt;
+	size_t tot = 0;
+
+	if (!t || t->head == t->count)
+		return 0;
+
+	pt = &wsi->context->pt[(int)wsi->tsi];
+
+	/*
+	 * Build one msghdr per datagram, or with GSO, one per run of datagrams
+	 * to the same peer that are all the same size except maybe the last.
+	 * Queued datagrams are contiguous in buf, so a run is one iov.
+	 */
+
+	e = t->head;
+	while (e < t->count) {
+		struct msghdr *mh = &t->mm[nmsg].msg_hdr;
+		struct lws_udp_txq_entry *q = &t->q[e];
+		size_t len = q->len;
+		int run = 1;
+
+#if defined(UDP_SEGMENT)
+		while (wsi->udp_gso_gro && e + run < t->count &&
+		       run < LWS_UDP_GSO_MAX_SEGS &&
+		       t->q[e + run - 1].len == q->len &&
+		       t->q[e + run].len <= q->len &&
+		       len + t->q[e + run].len <= LWS_UDP_GSO_MAX_SIZE &&
+		       lws_udp_txq_same_peer(q, &t->q[e + run])) {
+			len += t->q[e + run].len;
+			run++;
+		}
+#endif
+
+		t->iov[nmsg].iov_base = t->buf + q->ofs;
+		t->iov[nmsg].iov_len = len;
+
+		memset(mh, 0, sizeof(*mh));
+		mh->msg_name = &q->sa;
+		mh->msg_namelen = q->salen;
+		mh->msg_iov = &t->iov[nmsg];
+		mh->msg_iovlen = 1;
+
+#if defined(UDP_SEGMENT)
+		if (run > 1) {
+			struct cmsghdr *cm;
+			uint16_t gso = (uint16_t)q->len;
+
+			mh->msg_control = t->cmsg[nmsg];
+			mh->msg_controllen = sizeof(t->cmsg[nmsg]);
+			cm = CMSG_FIRSTHDR(mh);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(gso));
+			memcpy(CMSG_DATA(cm), &gso, sizeof(gso));
+		}
+#endif
+		ents[nmsg++] = run;
+		e += run;
+	}
+
+	lws_stats_bump(pt, LWSSTATS_C_API_WRITE, 1);
+
+	n = sendmmsg(wsi->desc.sockfd, t->mm, (unsigned int)nmsg,
+		     MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (n < 0) {
+		if (LWS_ERRNO == LWS_EAGAIN ||
+		    LWS_ERRNO == LWS_EWOULDBLOCK ||
+		    LWS_ERRNO == LWS_EINTR) {
+			lws_callback_on_writable(wsi);
+
+			return 1;
+		}
+
+#if defined(UDP_SEGMENT)
+		if (wsi->udp_gso_gro && (LWS_ERRNO == EIO ||
+					 LWS_ERRNO == EINVAL)) {
+			/* kernel or nic can't do GSO for us, stop asking */
+			lwsl_notice("%s: disabling UDP GSO\n", __func__);
+			wsi->udp_gso_gro = 0;
+
+			return lws_udp_batch_flush(wsi);
+		}
+#endif
+
+		lwsl_info("%s: sendmmsg errno %d, dropping %d\n", __func__,
+			  LWS_ERRNO, t->count - t->head);
+		t->head = t->count = 0;
+		t->used = 0;
+
+		return -1;
+	}
+
+	for (m = 0; m < n; m++) {
+		tot += t->iov[m].iov_len;
+		t->head += ents[m];
+	}
+
+	lws_stats_bump(pt, LWSSTATS_B_WRITE, tot);
+#if defined(LWS_WITH_SERVER_STATUS)
+	if (wsi->vhost)
+		wsi->vhost->conn_stats.tx += tot;
+#endif
+
+	lws_udp_txq_compact(t);
+
+	if (t->count) {
+		/* the kernel didn't take everything, finish when writeable */
+		lws_callback_on_writable(wsi);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+lws_udp_batch_queue(struct lws *wsi, const uint8_t *buf, size_t len,
+		    const struct sockaddr *sa, socklen_t salen)
+{
+	struct lws_udp_txq_entry *q;
+	struct lws_udp_txq *t;
+
+	if (!lws_wsi_is_udp(wsi) || len > LWS_UDP_TXQ_SIZE ||
+	    salen > sizeof(q->sa))
+		return -1;
+
+	if (wsi->context->udp_loss_sim_tx_pc) {
+		uint16_t u16;
+
+		if (lws_get_random(wsi->context, &u16, 2) == 2 &&
+		    ((u16 * 100) / 0xffff) <=
+			    wsi->context->udp_loss_sim_tx_pc) {
+			lwsl_warn("%s: dropping udp tx\n", __func__);
+			/* pretend it was queued */
+			return 0;
+		}
+	}
+
+	if (!wsi->udp_txq) {
+		wsi->udp_txq = lws_malloc(sizeof(*wsi->udp_txq), "udp txq");
+		if (!wsi->udp_txq)
+			return -1;
+		wsi->udp_txq->head = wsi->udp_txq->count = 0;
+		wsi->udp_txq->used = 0;
+	}
+	t = wsi->udp_txq;
+
+	lws_udp_txq_compact(t);
+
+	if (t->count == LWS_UDP_BATCH_MMSG || t->used + len > sizeof(t->buf)) {
+		/* no room, try to send what we have first */
+		if (lws_udp_batch_flush(wsi) < 0)
+			return -1;
+		if (t->count == LWS_UDP_BATCH_MMSG ||
+		    t->used + len > sizeof(t->buf))
+			return 1; /* come back when writeable */
+	}
+
+	q = &t->q[t->count++];
+	memcpy(&q->sa, sa, salen);
+	q->salen = salen;
+	q->ofs = t->used;
+	q->len = len;
+	memcpy(t->buf + t->used, buf, len);
+	t->used += len;
+
+	return 0;
+}
+
+void
+lws_udp_batch_destroy_wsi(struct lws *wsi)
+{
+	lws_free_set_NULL(wsi->udp_txq);
+}
+
+void
+lws_udp_batch_destroy_pt(struct lws_context_per_thread *pt)
+{
+	lws_free_set_NULL(pt->udp_rx);
+}
+
+#else
+
+/*
+ * No mmsg apis on this platform... the wsi uses the normal rx path and we
+ * just send queued tx immediately
+ */
+
+int
+lws_udp_batch_flush(struct lws *wsi)
+{
+	return 0;
+}
+
+int
+lws_udp_batch_queue(struct lws *wsi, const uint8_t *buf, size_t len,
+		    const struct sockaddr *sa, socklen_t salen)
+{
+	int n;
+
+	if (!lws_wsi_is_udp(wsi))
+		return -1;
+
+	n = (int)sendto(wsi->desc.sockfd,
+#if defined(WIN32)
+			(const char *)
+#endif
+			buf,
+#if defined(WIN32)
+			(int)
+#endif
+			len, 0, sa, salen);
+	if (n >= 0)
+		return 0;
+
+	if (LWS_ERRNO == LWS_EAGAIN ||
+	    LWS_ERRNO == LWS_EWOULDBLOCK ||
+	    LWS_ERRNO == LWS_EINTR) {
+		lws_callback_on_writable(wsi);
+
+		return 1;
+	}
+
+	return -1;
+}
+
+#endif
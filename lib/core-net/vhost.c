@@ -705,6 +705,8 @@ lws_create_vhost(struct lws_context *context,
 	vh->same_vh_protocol_owner = (struct lws_dll2_owner *)
 			lws_zalloc(sizeof(struct lws_dll2_owner) *
 				   vh->count_protocols, "same vh list");
+	vh->writable_all_gen = (uint32_t *)lws_zalloc(sizeof(uint32_t) *
+				   vh->count_protocols, "writable all gen");
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 	vh->http.mount_list = info->mounts;
 #endif
@@ -1039,6 +1041,10 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 
 #endif
 
+	vh->being_destroyed = 1;
+	lws_dll2_add_tail(&vh->vh_being_destroyed_list,
+			  &context->owner_vh_being_destroyed);
+
 	lws_vhost_unlock(vh); /* } vh -------------- */
 
 	/*
@@ -1075,6 +1081,7 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 	int n;
 
 	vh->being_destroyed = 0;
+	lws_dll2_remove(&vh->vh_being_destroyed_list);
 
 #if defined(LWS_WITH_CLIENT)
 	/*
@@ -1181,6 +1188,7 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 		lws_free(vh->protocol_vh_privs);
 	lws_ssl_SSL_CTX_destroy(vh);
 	lws_free(vh->same_vh_protocol_owner);
+	lws_free(vh->writable_all_gen);
 
 	if (
 #if defined(LWS_WITH_PLUGINS)
@@ -1264,12 +1272,19 @@ lws_check_deferred_free(struct lws_context *context, int tsi, int force)
 
 	lws_context_lock(context, "check deferred free"); /* ------ context { */
 
-	lws_start_foreach_ll_safe(struct lws_vhost *, v, context->vhost_list, vhost_next) {
-		if (v->being_destroyed
+	/*
+	 * Only the vhosts actually being destroyed are listed here, so the
+	 * periodic check costs nothing however many live vhosts there are
+	 */
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   context->owner_vh_being_destroyed.head) {
+		struct lws_vhost *v = lws_container_of(d, struct lws_vhost,
+						       vh_being_destroyed_list);
 #if LWS_MAX_SMP > 1
-			&& !v->close_flow_vs_tsi[tsi]
+		if (!v->close_flow_vs_tsi[tsi])
 #endif
-		) {
+		{
 
 			pt = &context->pt[tsi];
 
@@ -1295,7 +1310,7 @@ lws_check_deferred_free(struct lws_context *context, int tsi, int force)
 
 			lws_pt_unlock(pt); /* } pt -------------- */
 		}
-	} lws_end_foreach_ll_safe(v);
+	} lws_end_foreach_dll_safe(d, d1);
 
 
 	lws_context_unlock(context); /* } context ------------------- */
@@ -1499,7 +1514,9 @@ lws_vhost_active_conns(struct lws *wsi, struct lws **nwsi, const char *adsin)
 			if (w->client_h2_alpn && w->client_mux_migrated &&
 			    (lwsi_state(w) == LRS_H2_WAITING_TO_SEND_HEADERS ||
 			     lwsi_state(w) == LRS_ESTABLISHED ||
-			     lwsi_state(w) == LRS_IDLING)) {
+			     lwsi_state(w) == LRS_IDLING) &&
+			    /* else queue until a stream closes */
+			    lws_wsi_h2_client_stream_room(w)) {
 
 				lwsl_notice("%s: just join h2 directly 0x%x\n",
 						__func__, lwsi_state(w));
@@ -1584,5 +1601,129 @@ solo:
 
 	return ACTIVE_CONNS_SOLO;
 }
+
+#if defined(LWS_WITH_HTTP2) && defined(LWS_WITH_TLS)
+static int
+lws_vhost_h2_can_coalesce(struct lws *wsi, struct lws *w, const char *name)
+{
+	lws_sockaddr46 sa46, sa46r;
+	const struct addrinfo *ai;
+	socklen_t sl;
+
+	if (w == wsi || !w->client_h2_alpn || !w->client_mux_migrated ||
+	    !(w->tls.use_ssl & LCCSCF_USE_SSL) ||
+	    w->tls.use_ssl != wsi->tls.use_ssl || w->c_port != wsi->c_port ||
+	    (lwsi_state(w) != LRS_H2_WAITING_TO_SEND_HEADERS &&
+	     lwsi_state(w) != LRS_ESTABLISHED &&
+	     lwsi_state(w) != LRS_IDLING))
+		return 0;
+
+	memset(&sa46, 0, sizeof(sa46));
+	sl = sizeof(sa46);
+	if (getpeername(w->desc.sockfd, (struct sockaddr *)&sa46, &sl))
+		return 0;
+
+	for (ai = wsi->dns_results; ai; ai = ai->ai_next) {
+		memset(&sa46r, 0, sizeof(sa46r));
+		memcpy(&sa46r, ai->ai_addr, ai->ai_addrlen < sizeof(sa46r) ?
+					ai->ai_addrlen : sizeof(sa46r));
+		if (!lws_sa46_compare_ads(&sa46, &sa46r))
+			return lws_tls_client_peer_cert_covers(w, name);
+	}
+
+	return 0;
+}
+
+/*
+ * RFC7540 9.1.1 connection coalescing.  Once DNS has told us where a new
+ * https client connection would go, an established h2 connection from the
+ * same vhost to one of those addresses and the same port can carry it as
+ * another stream, if the certificate the server showed on that connection
+ * is also valid for our authority.  That lets eg, several CDN hostnames
+ * share one connection.
+ *
+ * Returns ACTIVE_CONNS_MUXED if we became a stream on *nwsi, or
+ * ACTIVE_CONNS_QUEUED if *nwsi is at the peer's MAX_CONCURRENT_STREAMS and
+ * we are waiting on its transaction queue for a stream to close.  Anybody
+ * who had queued on us while we were resolving moves across with us.
+ */
+
+int
+lws_vhost_active_conns_coalesce(struct lws *wsi, struct lws **nwsi)
+{
+	struct lws *w = NULL;
+	const char *host;
+	char name[128];
+	size_t n;
+	int r;
+
+	host = lws_wsi_client_stash_item(wsi, CIS_HOST, _WSI_TOKEN_CLIENT_HOST);
+	if (!host || !*host)
+		host = lws_wsi_client_stash_item(wsi, CIS_ADDRESS,
+					_WSI_TOKEN_CLIENT_PEER_ADDRESS);
+	if (!host || *host == '[' || !wsi->dns_results)
+		return ACTIVE_CONNS_SOLO;
+
+	/* the cert has to cover the authority without any :port */
+
+	n = strcspn(host, ":");
+	if (n >= sizeof(name))
+		return ACTIVE_CONNS_SOLO;
+	memcpy(name, host, n);
+	name[n] = '\0';
+
+	lws_vhost_lock(wsi->vhost); /* ----------------------------------- { */
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      wsi->vhost->dll_cli_active_conns_owner.head) {
+		w = lws_container_of(d, struct lws, dll_cli_active_conns);
+
+		if (lws_vhost_h2_can_coalesce(wsi, w, name))
+			break;
+		w = NULL;
+	} lws_end_foreach_dll(d);
+
+	if (!w) {
+		lws_vhost_unlock(wsi->vhost); /* } -------------------------- */
+
+		return ACTIVE_CONNS_SOLO;
+	}
+
+	lwsl_info("%s: %p: coalescing %s onto h2 conn %p (%s)\n", __func__,
+		  wsi, name, w, w->cli_hostname_copy);
+
+	/* we won't be making our own connection after all */
+
+	lws_dll2_remove(&wsi->dll_cli_active_conns);
+
+	if (lwsi_state(w) == LRS_IDLING)
+		_lws_generic_transaction_completed_active_conn(&w, 0);
+
+	if (lws_wsi_h2_client_stream_room(w)) {
+		wsi->client_h2_alpn = 1;
+		lws_wsi_h2_adopt(w, wsi);
+		r = ACTIVE_CONNS_MUXED;
+	} else {
+		lws_dll2_add_tail(&wsi->dll2_cli_txn_queue,
+				  &w->dll2_cli_txn_queue_owner);
+		r = ACTIVE_CONNS_QUEUED;
+	}
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   wsi->dll2_cli_txn_queue_owner.head) {
+		lws_dll2_remove(d);
+		lws_dll2_add_tail(d, &w->dll2_cli_txn_queue_owner);
+	} lws_end_foreach_dll_safe(d, d1);
+
+	lws_vhost_unlock(wsi->vhost); /* } ---------------------------------- */
+
+	if (r == ACTIVE_CONNS_MUXED && w->dll2_cli_txn_queue_owner.count)
+		lws_wsi_mux_apply_queue(w);
+
+	*nwsi = w;
+
+	return r;
+}
+#endif
 #endif
 #endif
@@ -91,7 +91,7 @@ lws_sul_wsitimeout_cb(lws_sorted_usec_list_t *sul)
 			  "(did hdr %d, ah %p, wl %d)\n",
 			  (void *)wsi, wsi->pending_timeout,
 			  wsi->hdr_parsing_completed, wsi->http.ah,
-			  pt->http.ah_wait_list_length);
+			  pt->http.ah_wait_owner.count);
 #if defined(LWS_WITH_CGI)
 	if (wsi->http.cgi)
 		lwsl_notice("CGI timeout: %s\n", wsi->http.cgi->summary);
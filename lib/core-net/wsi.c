@@ -24,6 +24,28 @@
 
 #include "private-lib-core.h"
 
+/*
+ * The hot members at the start of struct lws must stay inside the first two
+ * 64-byte cachelines... this fails the build if they grow past that
+ */
+typedef char lws_wsi_hot_members_fit[
+		offsetof(struct lws, leave_pollout_active) < 128 ? 1 : -1];
+
+/*
+ * ...and the whole wsi must stay inside 14 cachelines, so cold members can't
+ * creep in unnoticed either.  Builds with the optional features that carry
+ * bulky per-wsi state of their own (access log, stats, cgi, proxy, event lib
+ * watchers...) are not held to it.
+ */
+#if !defined(LWS_WITH_ACCESS_LOG) && !defined(LWS_WITH_STATS) && \
+    !defined(LWS_WITH_DETAILED_LATENCY) && !defined(LWS_WITH_CGI) && \
+    !defined(LWS_WITH_HTTP_PROXY) && !defined(LWS_WITH_THREADPOOL) && \
+    !defined(LWS_WITH_HTTP_STREAM_COMPRESSION) && \
+    !defined(LWS_WITH_LIBEV) && !defined(LWS_WITH_LIBUV) && \
+    !defined(LWS_WITH_LIBEVENT) && !defined(LWS_WITH_GLIB)
+typedef char lws_wsi_size_fits[sizeof(struct lws) <= 14 * 64 ? 1 : -1];
+#endif
+
 #if defined (_DEBUG)
 void lwsi_set_role(struct lws *wsi, lws_wsi_state_t role)
 {
@@ -221,7 +243,7 @@ int
 lws_rx_flow_control(struct lws *wsi, int _enable)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
-	int en = _enable;
+	int en = _enable, was;
 
 	// h2 ignores rx flow control atm
 	if (lwsi_role_h2(wsi) || wsi->mux_substream ||
@@ -243,10 +265,15 @@ lws_rx_flow_control(struct lws *wsi, int _enable)
 	lws_pt_lock(pt, __func__);
 
 	/* any bit set in rxflow_bitmap DISABLEs rxflow control */
+	was = lws_is_flowcontrolled(wsi);
 	if (en & LWS_RXFLOW_REASON_APPLIES_ENABLE_BIT)
-		wsi->rxflow_bitmap &= ~(en & 0xff);
+		wsi->rxflow_bitmap &= (uint16_t)~(en & 0xfff);
 	else
-		wsi->rxflow_bitmap |= en & 0xff;
+		wsi->rxflow_bitmap |= (uint16_t)(en & 0xfff);
+
+	if (was != lws_is_flowcontrolled(wsi))
+		/* his buffered rx moves between the ready and parked lists */
+		__lws_rxflow_requeue(wsi);
 
 	if ((LWS_RXFLOW_PENDING_CHANGE | (!wsi->rxflow_bitmap)) ==
 	    wsi->rxflow_change_to)
@@ -1361,6 +1388,14 @@ lws_wsi_mux_apply_queue(struct lws *wsi)
 #if defined(LWS_ROLE_H2)
 		if (lwsi_role_http(wsi) &&
 		    lwsi_state(w) == LRS_H2_WAITING_TO_SEND_HEADERS) {
+
+			/*
+			 * the rest stay queued until streams on the
+			 * connection close and make room for them
+			 */
+			if (!lws_wsi_h2_client_stream_room(wsi))
+				break;
+
 			lwsl_info("%s: cli pipeq %p to be h2\n", __func__, w);
 
 			lwsi_set_state(w, LRS_H1C_ISSUE_HANDSHAKE2);
@@ -30,34 +30,46 @@
 
 /* lws_buflist */
 
+static int
+lws_buflist_link_tail(struct lws_buflist **head, struct lws_buflist *nbuf)
+{
+	struct lws_buflist *h = *head;
+
+	nbuf->next = NULL;
+	nbuf->tail = NULL;
+
+	if (!h) {
+		nbuf->tail = nbuf;
+		*head = nbuf;
+
+		return 1; /* first segment just created */
+	}
+
+	assert(h->tail);
+	if (h->tail->next) {
+		lwsl_err("%s: corrupt list tail\n", __func__);
+		return -1;
+	}
+
+	/* append at the tail, the head segment tracks where that is */
+	h->tail->next = nbuf;
+	h->tail = nbuf;
+
+	return 0;
+}
+
 int
 lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
 			   size_t len)
 {
 	struct lws_buflist *nbuf;
-	int first = !*head;
-	void *p = *head;
-	int sanity = 1024;
+	int n;
 
 	assert(buf);
 	assert(len);
 
-	/* append at the tail */
-	while (*head) {
-		if (!--sanity) {
-			lwsl_err("%s: buflist reached sanity limit\n", __func__);
-			return -1;
-		}
-		if (*head == (*head)->next) {
-			lwsl_err("%s: corrupt list points to self\n", __func__);
-			return -1;
-		}
-		head = &((*head)->next);
-	}
-
-	(void)p;
 	lwsl_info("%s: len %u first %d %p\n", __func__, (unsigned int)len,
-					      first, p);
+					      !*head, *head);
 
 	nbuf = (struct lws_buflist *)lws_malloc(sizeof(struct lws_buflist) +
 						len + LWS_PRE + 1, __func__);
@@ -68,15 +80,64 @@ lws_buflist_append_segment(struct lws_buflist **head, const uint8_t *buf,
 
 	nbuf->len = len;
 	nbuf->pos = 0;
-	nbuf->next = NULL;
+	nbuf->destroy = NULL;
+	nbuf->opaque = NULL;
 
 	/* whoever consumes this might need LWS_PRE from the start... */
-	p = (uint8_t *)nbuf + sizeof(*nbuf) + LWS_PRE;
-	memcpy(p, buf, len);
+	nbuf->buf = (uint8_t *)nbuf + sizeof(*nbuf) + LWS_PRE;
+	memcpy(nbuf->buf, buf, len);
+
+	n = lws_buflist_link_tail(head, nbuf);
+	if (n < 0)
+		lws_free(nbuf);
 
-	*head = nbuf;
+	return n; /* returns 1 if first segment just created */
+}
+
+int
+lws_buflist_append_segment_ref(struct lws_buflist **head, uint8_t *buf,
+			       size_t len, lws_buflist_ref_destroy_cb destroy,
+			       void *opaque)
+{
+	struct lws_buflist *nbuf;
+	int n;
+
+	assert(buf);
+	assert(len);
+
+	nbuf = (struct lws_buflist *)lws_malloc(sizeof(*nbuf), __func__);
+	if (!nbuf) {
+		lwsl_err("%s: OOM\n", __func__);
+		if (destroy)
+			destroy(opaque, buf);
+
+		return -1;
+	}
+
+	nbuf->len = len;
+	nbuf->pos = 0;
+	nbuf->buf = buf;
+	/* may be NULL, still marks the payload as not inline */
+	nbuf->destroy = destroy;
+	nbuf->opaque = opaque;
+
+	n = lws_buflist_link_tail(head, nbuf);
+	if (n < 0) {
+		if (destroy)
+			destroy(opaque, buf);
+		lws_free(nbuf);
+	}
+
+	return n; /* returns 1 if first segment just created */
+}
+
+static void
+lws_buflist_free_segment(struct lws_buflist *b)
+{
+	if (b->destroy)
+		b->destroy(b->opaque, b->buf);
 
-	return first; /* returns 1 if first segment just created */
+	lws_free(b);
 }
 
 static int
@@ -86,9 +147,12 @@ lws_buflist_destroy_segment(struct lws_buflist **head)
 
 	assert(*head);
 	*head = old->next;
+	if (*head)
+		/* the new head segment inherits the tail */
+		(*head)->tail = old->tail;
 	old->next = NULL;
 	old->pos = old->len = 0;
-	lws_free(old);
+	lws_buflist_free_segment(old);
 
 	return !*head; /* returns 1 if last segment just destroyed */
 }
@@ -101,7 +165,7 @@ lws_buflist_destroy_all_segments(struct lws_buflist **head)
 	while (p) {
 		p1 = p->next;
 		p->next = NULL;
-		lws_free(p);
+		lws_buflist_free_segment(p);
 		p = p1;
 	}
 
@@ -130,7 +194,7 @@ lws_buflist_next_segment_len(struct lws_buflist **head, uint8_t **buf)
 	assert(b->pos < b->len);
 
 	if (buf)
-		*buf = ((uint8_t *)b) + sizeof(*b) + b->pos + LWS_PRE;
+		*buf = b->buf + b->pos;
 
 	return b->len - b->pos;
 }
@@ -185,7 +249,7 @@ lws_buflist_linear_copy(struct lws_buflist **head, size_t ofs, uint8_t *buf,
 			s = p->len - ofs;
 			if (s > len)
 				s = len;
-			memcpy(buf, ((uint8_t *)&p[1]) + LWS_PRE + ofs, s);
+			memcpy(buf, p->buf + ofs, s);
 			len -= s;
 			buf += s;
 			ofs = 0;
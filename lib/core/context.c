@@ -727,6 +727,10 @@ lws_create_context(const struct lws_context_creation_info *info)
 	__lws_sul_insert(&context->pt[0].pt_sul_owner,
 			 &context->pt[0].sul_peer_limits, 10 * LWS_US_PER_SEC);
 #endif
+#if defined(LWS_WITH_SERVER) && defined(LWS_WITH_NETWORK)
+	context->mem_budget = info->mem_budget;
+	lws_mem_budget_init(context);
+#endif
 
 #if defined(LWS_HAVE_SYS_CAPABILITY_H) && defined(LWS_HAVE_LIBCAP)
 	memcpy(context->caps, info->caps, sizeof(context->caps));
@@ -786,6 +790,8 @@ lws_create_context(const struct lws_context_creation_info *info)
 			goto bail;
 		}
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
+		context->async_dns.rdns_negative_ttl =
+					info->adns_rdns_negative_ttl_secs;
 		if (lws_async_dns_init(context))
 			goto bail;
 #endif
@@ -1052,8 +1058,7 @@ lws_context_destroy3(struct lws_context *context)
 #endif
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
-		while (pt->http.ah_list)
-			_lws_destroy_ah(pt, pt->http.ah_list);
+		_lws_destroy_ah_pool(pt);
 #endif
 	}
 
@@ -1149,8 +1154,7 @@ lws_context_destroy2(struct lws_context *context)
 			context->event_loop_ops->destroy_pt(context, n);
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
-		while (pt->http.ah_list)
-			_lws_destroy_ah(pt, pt->http.ah_list);
+		_lws_destroy_ah_pool(pt);
 #endif
 	}
 
@@ -1262,6 +1266,10 @@ lws_pt_destroy(struct lws_context_per_thread *pt)
 				"ctx destroy"
 				/* no protocol close */);
 	}
+#if defined(LWS_WITH_UDP) && defined(LWS_HAVE_RECVMMSG)
+	lws_udp_batch_destroy_pt(pt);
+#endif
+	lws_free_set_NULL(pt->cork);
 	lws_pt_mutex_destroy(pt);
 
 	pt->is_destroyed = 1;
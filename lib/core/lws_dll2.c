@@ -187,6 +187,16 @@ void
 lws_dll2_add_sorted(lws_dll2_t *d, lws_dll2_owner_t *own,
 		    int (*compare)(const lws_dll2_t *d, const lws_dll2_t *i))
 {
+	/*
+	 * Timeouts of the same duration are usually added in order, so first
+	 * check if he belongs at the tail and we can skip walking the list
+	 */
+	if (own->tail && compare(own->tail, d) < 0) {
+		lws_dll2_add_tail(d, own);
+
+		return;
+	}
+
 	lws_start_foreach_dll_safe(struct lws_dll2 *, p, tp,
 				   lws_dll2_get_head(own)) {
 		assert(p != d);
@@ -67,6 +67,14 @@
 #ifndef LWS_DEF_HEADER_LEN
 #define LWS_DEF_HEADER_LEN 4096
 #endif
+#ifndef LWS_AH_DATA_CHUNK
+/* ah data starts at this size and grows in these steps up to the max */
+#define LWS_AH_DATA_CHUNK 1024
+#endif
+#ifndef LWS_AH_FREE_LIST_MAX
+/* max idle ahs kept per pt for reuse instead of being freed */
+#define LWS_AH_FREE_LIST_MAX 8
+#endif
 #ifndef LWS_DEF_HEADER_POOL
 #define LWS_DEF_HEADER_POOL 4
 #endif
@@ -377,6 +385,7 @@ struct lws_context {
 	struct lws_vhost *no_listener_vhost_list;
 	struct lws_vhost *vhost_pending_destruction_list;
 	struct lws_vhost *vhost_system;
+	lws_dll2_owner_t owner_vh_being_destroyed;
 
 #if defined(LWS_WITH_SERVER)
 	const char *server_string;
@@ -487,6 +496,7 @@ struct lws_context {
 	int count_wsi_allocated;
 	int count_cgi_spawned;
 	unsigned int fd_limit_per_thread;
+	size_t mem_budget;
 	unsigned int timeout_secs;
 	unsigned int pt_serv_buf_size;
 	int max_http_header_data;
@@ -560,6 +570,10 @@ lws_system_do_attach(struct lws_context_per_thread *pt);
 
 struct lws_buflist {
 	struct lws_buflist *next;
+	struct lws_buflist *tail; /* only maintained on the list head segment */
+	uint8_t *buf; /* points to payload, either inline or by reference */
+	lws_buflist_ref_destroy_cb destroy; /* NULL for inline copied payload */
+	void *opaque; /* passed to destroy */
 	size_t len;
 	size_t pos;
 };
@@ -36,10 +36,24 @@
 
 #define COMBO_SIZEOF 256
 
+#if defined(LWS_HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#include <fcntl.h>
+#endif
+
+/*
+ * Each platform provides lws_dir_enum(), which calls back for every object in
+ * the directory in whatever order the filesystem gives them, without
+ * allocating per object.  The sorted, top-N and cached listings are built on
+ * top of that below.
+ */
+
 #if defined(LWS_WITH_LIBUV) && UV_VERSION_MAJOR > 0
 
-int
-lws_dir(const char *dirpath, void *user, lws_dir_callback_function cb)
+#define LWS_DIR_HAVE_ENUM
+
+static int
+lws_dir_enum(const char *dirpath, void *user, lws_dir_callback_function cb)
 {
 	struct lws_dir_entry lde;
 	uv_dirent_t dent;
@@ -82,20 +96,34 @@ bail:
 
 #if !defined(LWS_PLAT_FREERTOS)
 
+#define LWS_DIR_HAVE_ENUM
+
 #if defined(WIN32)
 #include "../../win32port/dirent/dirent-win32.h"
 #else
 #include <dirent.h>
 #endif
 
-static int filter(const struct dirent *ent)
-{
-	if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
-		return 0;
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <fcntl.h>
+#if defined(SYS_getdents64)
+#define LWS_DIR_GETDENTS64
 
-	return 1;
-}
+#ifndef LWS_DIR_GETDENTS_BUF
+/* one getdents64() fetches as many entries as fit in this */
+#define LWS_DIR_GETDENTS_BUF		(32 * 1024)
+#endif
 
+struct lws_linux_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+#endif
+#endif
 
 #if !defined(WIN32)
 static char csep = '/';
@@ -140,97 +168,525 @@ lws_dir_via_stat(char *combo, size_t l, const char *path, struct lws_dir_entry *
         }
 }
 
-int
-lws_dir(const char *dirpath, void *user, lws_dir_callback_function cb)
-{
-	struct lws_dir_entry lde;
-	struct dirent **namelist;
-	int n, i, ret = 1;
-	char combo[COMBO_SIZEOF];
-	size_t l;
-
-	l = lws_snprintf(combo, COMBO_SIZEOF - 2, "%s", dirpath);
-	combo[l++] = csep;
-	combo[l] = '\0';
+/*
+ * Returns nonzero if the object should not be reported, otherwise fills in
+ * lde from the name and the dirent type
+ */
 
-	n = scandir((char *)dirpath, &namelist, filter, alphasort);
-	if (n < 0) {
-		lwsl_err("Scandir on '%s' failed, errno %d\n", dirpath, LWS_ERRNO);
+static int
+lws_dir_entry_prep(char *combo, size_t l, const char *name, int d_type,
+		   struct lws_dir_entry *lde)
+{
+	if ((name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) ||
+	    strchr(name, '~'))
 		return 1;
-	}
 
-	for (i = 0; i < n; i++) {
-		if (strchr(namelist[i]->d_name, '~'))
-			goto skip;
-		lde.name = namelist[i]->d_name;
+	lde->name = name;
 
-		/*
-		 * some filesystems don't report this (ZFS) and tell that
-		 * files are LDOT_UNKNOWN
-		 */
+	/*
+	 * some filesystems don't report this (ZFS) and tell that
+	 * files are LDOT_UNKNOWN
+	 */
 
 #if defined(__sun)
-		lws_dir_via_stat(combo, l, namelist[i]->d_name, &lde);
+	lws_dir_via_stat(combo, l, name, lde);
 #else
-		/*
-		 * XFS on Linux doesn't fill in d_type at all, always zero.
-		 */
+	/*
+	 * XFS on Linux doesn't fill in d_type at all, always zero.
+	 */
 
-		switch (namelist[i]->d_type) {
+	switch (d_type) {
 #if DT_BLK != DT_UNKNOWN
-		case DT_BLK:
-			lde.type = LDOT_BLOCK;
-			break;
+	case DT_BLK:
+		lde->type = LDOT_BLOCK;
+		break;
 #endif
 #if DT_CHR != DT_UNKNOWN
-		case DT_CHR:
-			lde.type = LDOT_CHAR;
-			break;
+	case DT_CHR:
+		lde->type = LDOT_CHAR;
+		break;
 #endif
 #if DT_DIR != DT_UNKNOWN
-		case DT_DIR:
-			lde.type = LDOT_DIR;
-			break;
+	case DT_DIR:
+		lde->type = LDOT_DIR;
+		break;
 #endif
 #if DT_FIFO != DT_UNKNOWN
-		case DT_FIFO:
-			lde.type = LDOT_FIFO;
-			break;
+	case DT_FIFO:
+		lde->type = LDOT_FIFO;
+		break;
 #endif
 #if DT_LNK != DT_UNKNOWN
-		case DT_LNK:
-			lde.type = LDOT_LINK;
-			break;
+	case DT_LNK:
+		lde->type = LDOT_LINK;
+		break;
 #endif
-		case DT_REG:
-			lde.type = LDOT_FILE;
-			break;
+	case DT_REG:
+		lde->type = LDOT_FILE;
+		break;
 #if DT_SOCK != DT_UNKNOWN
-		case DT_SOCK:
-			lde.type = LDOTT_SOCKET;
-			break;
+	case DT_SOCK:
+		lde->type = LDOTT_SOCKET;
+		break;
 #endif
-		default:
-			lde.type = LDOT_UNKNOWN;
-			lws_dir_via_stat(combo, l, namelist[i]->d_name, &lde);
-			break;
-		}
+	default:
+		lde->type = LDOT_UNKNOWN;
+		lws_dir_via_stat(combo, l, name, lde);
+		break;
+	}
 #endif
-		if (cb(dirpath, user, &lde)) {
-			while (i++ < n)
-				free(namelist[i]);
-			goto bail;
+
+	return 0;
+}
+
+static int
+lws_dir_enum(const char *dirpath, void *user, lws_dir_callback_function cb)
+{
+	struct lws_dir_entry lde;
+	char combo[COMBO_SIZEOF];
+	int ret = 1;
+	size_t l;
+#if defined(LWS_DIR_GETDENTS64)
+	struct lws_linux_dirent64 *de;
+	uint8_t *buf;
+	long n, pos;
+	int fd;
+#else
+	struct dirent *de;
+	DIR *dir;
+#endif
+
+	l = lws_snprintf(combo, COMBO_SIZEOF - 2, "%s", dirpath);
+	combo[l++] = csep;
+	combo[l] = '\0';
+
+#if defined(LWS_DIR_GETDENTS64)
+	fd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		lwsl_err("Scandir on '%s' failed, errno %d\n", dirpath, LWS_ERRNO);
+		return 1;
+	}
+
+	buf = lws_malloc(LWS_DIR_GETDENTS_BUF, __func__);
+	if (!buf)
+		goto bail;
+
+	while ((n = syscall(SYS_getdents64, fd, buf,
+			    LWS_DIR_GETDENTS_BUF)) > 0) {
+		for (pos = 0; pos < n; pos += de->d_reclen) {
+			de = (struct lws_linux_dirent64 *)(buf + pos);
+
+			if (lws_dir_entry_prep(combo, l, de->d_name,
+					       de->d_type, &lde))
+				continue;
+
+			if (cb(dirpath, user, &lde))
+				goto bail;
 		}
-skip:
-		free(namelist[i]);
+	}
+
+	if (n < 0)
+		lwsl_err("%s: getdents64 on '%s' failed, errno %d\n", __func__,
+			 dirpath, LWS_ERRNO);
+	else
+		ret = 0;
+
+bail:
+	lws_free(buf);
+	close(fd);
+#else
+	dir = opendir(dirpath);
+	if (!dir) {
+		lwsl_err("Scandir on '%s' failed, errno %d\n", dirpath, LWS_ERRNO);
+		return 1;
+	}
+
+	while ((de = readdir(dir))) {
+		if (lws_dir_entry_prep(combo, l, de->d_name, de->d_type, &lde))
+			continue;
+
+		if (cb(dirpath, user, &lde))
+			goto bail;
 	}
 
 	ret = 0;
 
 bail:
-	free(namelist);
+	closedir(dir);
+#endif
+
+	return ret;
+}
+
+#endif
+#endif
+
+#if defined(LWS_DIR_HAVE_ENUM)
+
+/*
+ * Heap helpers working on an array of struct lws_dir_entry.  The heap is
+ * arranged so the root is the entry that sorts last, so it's the one to
+ * replace when collecting the first N, and repeatedly moving it to the end
+ * leaves the array in ascending order.
+ */
+
+static int
+lws_dir_default_compare(const struct lws_dir_entry *a,
+			const struct lws_dir_entry *b)
+{
+	return strcmp(a->name, b->name);
+}
+
+static void
+lws_dir_heap_sift_down(struct lws_dir_entry *h, size_t count, size_t n,
+		       lws_dir_compare_function *compare)
+{
+	struct lws_dir_entry t;
+	size_t c;
+
+	while ((c = (n * 2) + 1) < count) {
+		if (c + 1 < count && compare(&h[c + 1], &h[c]) > 0)
+			c++;
+		if (compare(&h[c], &h[n]) <= 0)
+			return;
+
+		t = h[n];
+		h[n] = h[c];
+		h[c] = t;
+		n = c;
+	}
+}
+
+static void
+lws_dir_heap_sift_up(struct lws_dir_entry *h, size_t n,
+		     lws_dir_compare_function *compare)
+{
+	struct lws_dir_entry t;
+
+	while (n && compare(&h[n], &h[(n - 1) / 2]) > 0) {
+		t = h[n];
+		h[n] = h[(n - 1) / 2];
+		h[(n - 1) / 2] = t;
+		n = (n - 1) / 2;
+	}
+}
+
+static void
+lws_dir_heapsort(struct lws_dir_entry *h, size_t count,
+		 lws_dir_compare_function *compare, int is_heap)
+{
+	struct lws_dir_entry t;
+	size_t n;
+
+	if (count < 2)
+		return;
+
+	if (!is_heap)
+		for (n = count / 2; n-- > 0; )
+			lws_dir_heap_sift_down(h, count, n, compare);
+
+	while (--count) {
+		t = h[0];
+		h[0] = h[count];
+		h[count] = t;
+		lws_dir_heap_sift_down(h, count, 0, compare);
+	}
+}
+
+/*
+ * A listing held in two allocations: the names packed back to back in one
+ * buffer, and an array of entries pointing into it
+ */
+
+struct lws_dir_listing {
+	struct lws_dir_entry	*e;
+	char			*names;
+	size_t			count;
+	size_t			count_alloc;
+	size_t			names_len;
+	size_t			names_alloc;
+};
+
+static void
+lws_dir_listing_free(struct lws_dir_listing *li)
+{
+	lws_free_set_NULL(li->e);
+	lws_free_set_NULL(li->names);
+	li->count = li->count_alloc = li->names_len = li->names_alloc = 0;
+}
+
+static int
+lws_dir_listing_cb(const char *dirpath, void *user, struct lws_dir_entry *lde)
+{
+	struct lws_dir_listing *li = (struct lws_dir_listing *)user;
+	size_t nl = strlen(lde->name) + 1;
+	void *p;
+
+	if (li->count == li->count_alloc) {
+		li->count_alloc = li->count_alloc ? li->count_alloc * 2 : 64;
+		p = lws_realloc(li->e, li->count_alloc * sizeof(*li->e),
+				"dir entries");
+		if (!p)
+			return 1;
+		li->e = (struct lws_dir_entry *)p;
+	}
+
+	if (li->names_len + nl > li->names_alloc) {
+		li->names_alloc = li->names_alloc ? li->names_alloc * 2 : 2048;
+		if (li->names_alloc < li->names_len + nl)
+			li->names_alloc = li->names_len + nl;
+		p = lws_realloc(li->names, li->names_alloc, "dir names");
+		if (!p)
+			return 1;
+		li->names = (char *)p;
+	}
+
+	memcpy(li->names + li->names_len, lde->name, nl);
+
+	/* the names buffer may move, so record the offset for now */
+	li->e[li->count].name = (const char *)(intptr_t)li->names_len;
+	li->e[li->count++].type = lde->type;
+	li->names_len += nl;
+
+	return 0;
+}
+
+static int
+lws_dir_listing_fill(struct lws_dir_listing *li, const char *dirpath,
+		     lws_dir_compare_function *compare)
+{
+	size_t n;
+	int ret;
+
+	memset(li, 0, sizeof(*li));
+
+	ret = lws_dir_enum(dirpath, li, lws_dir_listing_cb);
+	if (ret) {
+		lws_dir_listing_free(li);
+
+		return ret;
+	}
+
+	for (n = 0; n < li->count; n++)
+		li->e[n].name = li->names + (intptr_t)li->e[n].name;
+
+	if (compare)
+		lws_dir_heapsort(li->e, li->count, compare, 0);
+
+	return 0;
+}
+
+static int
+lws_dir_listing_walk(struct lws_dir_listing *li, const char *dirpath,
+		     void *user, lws_dir_callback_function cb)
+{
+	struct lws_dir_entry lde;
+	size_t n;
+
+	for (n = 0; n < li->count; n++) {
+		/* the callback gets its own copy it may scribble on */
+		lde = li->e[n];
+		if (cb(dirpath, user, &lde))
+			return 1;
+	}
+
+	return 0;
+}
+
+int
+lws_dir(const char *dirpath, void *user, lws_dir_callback_function cb)
+{
+	struct lws_dir_listing li;
+	int ret;
+
+	ret = lws_dir_listing_fill(&li, dirpath, lws_dir_default_compare);
+	if (ret)
+		return ret;
+
+	ret = lws_dir_listing_walk(&li, dirpath, user, cb);
+	lws_dir_listing_free(&li);
+
+	return ret;
+}
+
+/*
+ * Collect the first top_n entries according to compare in a bounded heap,
+ * with the names in fixed slots so nothing is allocated per object
+ */
+
+struct lws_dir_topn {
+	struct lws_dir_entry		*h;
+	char				*slots;
+	lws_dir_compare_function	*compare;
+	size_t				count;
+	size_t				max;
+};
+
+#define LWS_DIR_NAME_SLOT 256
+
+static int
+lws_dir_topn_cb(const char *dirpath, void *user, struct lws_dir_entry *lde)
+{
+	struct lws_dir_topn *t = (struct lws_dir_topn *)user;
+	char *slot;
+
+	if (strlen(lde->name) >= LWS_DIR_NAME_SLOT) {
+		lwsl_warn("%s: skipping overlong name\n", __func__);
+
+		return 0;
+	}
+
+	if (t->count < t->max) {
+		slot = t->slots + (t->count * LWS_DIR_NAME_SLOT);
+		strcpy(slot, lde->name);
+		t->h[t->count].name = slot;
+		t->h[t->count].type = lde->type;
+		lws_dir_heap_sift_up(t->h, t->count++, t->compare);
+
+		return 0;
+	}
+
+	/* full: only interesting if it sorts before the current last one */
+
+	if (t->compare(lde, &t->h[0]) >= 0)
+		return 0;
+
+	slot = (char *)t->h[0].name;
+	strcpy(slot, lde->name);
+	t->h[0].type = lde->type;
+	lws_dir_heap_sift_down(t->h, t->count, 0, t->compare);
+
+	return 0;
+}
+
+int
+lws_dir_stream(const char *dirpath, void *user, lws_dir_callback_function cb,
+	       lws_dir_compare_function *compare, size_t top_n)
+{
+	struct lws_dir_topn t;
+	size_t n;
+	int ret;
+
+	if (!top_n)
+		return lws_dir_enum(dirpath, user, cb);
+
+	t.compare = compare ? compare : lws_dir_default_compare;
+	t.max = top_n;
+	t.count = 0;
+	t.h = lws_malloc(top_n * sizeof(*t.h), "dir topn");
+	t.slots = lws_malloc(top_n * LWS_DIR_NAME_SLOT, "dir topn names");
+	if (!t.h || !t.slots) {
+		ret = 1;
+		goto bail;
+	}
+
+	ret = lws_dir_enum(dirpath, &t, lws_dir_topn_cb);
+	if (ret)
+		goto bail;
+
+	lws_dir_heapsort(t.h, t.count, t.compare, 1);
+
+	for (n = 0; n < t.count; n++)
+		if (cb(dirpath, user, &t.h[n])) {
+			ret = 1;
+			break;
+		}
+
+bail:
+	lws_free(t.h);
+	lws_free(t.slots);
 
 	return ret;
 }
+
+/*
+ * Cached listing, rescanned only after inotify told us the directory
+ * changed (or every time, where there is no inotify)
+ */
+
+struct lws_dir_cache {
+	struct lws_dir_listing		li;
+	lws_dir_compare_function	*compare;
+	int				fd; /* inotify, or -1 */
+	char				valid;
+	char				dirpath[1]; /* overallocated */
+};
+
+struct lws_dir_cache *
+lws_dir_cache_create(const char *dirpath, lws_dir_compare_function *compare)
+{
+	size_t len = strlen(dirpath);
+	struct lws_dir_cache *dc;
+
+	dc = lws_zalloc(sizeof(*dc) + len, "dir cache");
+	if (!dc)
+		return NULL;
+
+	memcpy(dc->dirpath, dirpath, len + 1);
+	dc->compare = compare;
+	dc->fd = -1;
+
+#if defined(LWS_HAVE_SYS_INOTIFY_H)
+	dc->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (dc->fd >= 0 &&
+	    inotify_add_watch(dc->fd, dirpath, IN_CREATE | IN_DELETE |
+				IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+				IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+		lwsl_info("%s: unable to watch %s\n", __func__, dirpath);
+		close(dc->fd);
+		dc->fd = -1;
+	}
+#endif
+
+	return dc;
+}
+
+void
+lws_dir_cache_invalidate(struct lws_dir_cache *dc)
+{
+	dc->valid = 0;
+}
+
+int
+lws_dir_cache_walk(struct lws_dir_cache *dc, void *user,
+		   lws_dir_callback_function cb)
+{
+	int ret;
+
+#if defined(LWS_HAVE_SYS_INOTIFY_H)
+	if (dc->fd >= 0) {
+		char ev[512];
+
+		/* any queued event at all means the listing is stale */
+		while (read(dc->fd, ev, sizeof(ev)) > 0)
+			dc->valid = 0;
+	} else
 #endif
+		dc->valid = 0;
+
+	if (!dc->valid) {
+		lws_dir_listing_free(&dc->li);
+		ret = lws_dir_listing_fill(&dc->li, dc->dirpath, dc->compare);
+		if (ret)
+			return ret;
+		dc->valid = 1;
+	}
+
+	return lws_dir_listing_walk(&dc->li, dc->dirpath, user, cb);
+}
+
+void
+lws_dir_cache_destroy(struct lws_dir_cache **pdc)
+{
+	struct lws_dir_cache *dc = *pdc;
+
+	if (!dc)
+		return;
+
+	if (dc->fd >= 0)
+		close(dc->fd);
+	lws_dir_listing_free(&dc->li);
+	lws_free_set_NULL(*pdc);
+}
+
 #endif
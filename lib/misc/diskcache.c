@@ -51,51 +51,476 @@
 #endif
 #endif
 
-struct file_entry {
-	lws_list_ptr sorted;
-	lws_list_ptr prev;
-	char name[64];
-	time_t modified;
-	size_t size;
+/*
+ * The cache keeps an index of every file in it, with its size and when it was
+ * last used, so trimming only has to look at the files it deletes.
+ *
+ * Entries are hashed by name, and listed oldest-first on the lru owner.  The
+ * index is persisted in an append-only journal in the cache dir, replayed in
+ * order at create time to get back the same lru order, and rewritten compactly
+ * from time to time.  If there is no usable journal, or periodically after
+ * that to notice files we were not told about, trim walks the cache dirs a
+ * subdir at a time, only stat()-ing files that aren't already indexed.
+ *
+ * The index and journal are protected by lds->lock, since trim may be called
+ * from its own thread while the service thread queries and finalizes.
+ */
+
+struct lws_diskcache_entry {
+	lws_dll2_t			list; /* lru, or pending until scan done */
+	struct lws_diskcache_entry	*hash_next;
+	uint64_t			size;
+	time_t				used;
+	time_t				used_journaled;
+
+	/* name is overallocated after this */
 };
 
 struct lws_diskcache_scan {
-	struct file_entry *batch;
+	pthread_mutex_t lock; /* protects everything below */
+	struct lws_diskcache_entry **hash;
 	const char *cache_dir_base;
-	lws_list_ptr head;
+	lws_dll2_owner_t lru; /* oldest at head */
+	lws_dll2_owner_t pending; /* found by the scan in progress */
 	time_t last_scan_completed;
 	uint64_t agg_size;
 	uint64_t cache_size_limit;
 	uint64_t avg_size;
 	uint64_t cache_tries;
 	uint64_t cache_hits;
+	unsigned int hash_size; /* power of 2 */
+	unsigned int count;
+	unsigned int journal_records;
+	int journal_fd;
 	int cache_subdir;
-	int batch_in_use;
-	int agg_file_count;
-	int secs_waiting;
+	char index_valid;
+	char scanning;
 };
 
 #define KIB (1024)
 #define MIB (KIB * KIB)
 
-#define lp_to_fe(p, _n) lws_list_ptr_container(p, struct file_entry, _n)
+#define lde_name(_e) ((char *)&(_e)[1])
 
 static const char *hex = "0123456789abcdef";
+static const char *journal_magic = "lws-diskcache-journal 1\n";
+
+/* rescan the cache dirs for files we weren't told about this often */
+#define LWS_DISKCACHE_RECONCILE_SECS	3600
+/* only journal repeated uses of the same entry this often */
+#define LWS_DISKCACHE_JOURNAL_USE_SECS	60
+/* leave temp files younger than this alone, they may still be in use */
+#define LWS_DISKCACHE_TEMP_GRACE_SECS	3600
+#define LWS_DISKCACHE_HASH_INITIAL	1024
+#define LWS_DISKCACHE_NAME_MAX		128
+
+static unsigned int
+lws_diskcache_hash(const char *name)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (*name)
+		h = (h ^ (uint8_t)*name++) * 0x01000193;
+
+	return h;
+}
+
+static struct lws_diskcache_entry *
+lws_diskcache_find(struct lws_diskcache_scan *lds, const char *name)
+{
+	struct lws_diskcache_entry *e;
+
+	e = lds->hash[lws_diskcache_hash(name) & (lds->hash_size - 1)];
+	while (e && strcmp(lde_name(e), name))
+		e = e->hash_next;
+
+	return e;
+}
+
+static void
+lws_diskcache_rehash(struct lws_diskcache_scan *lds)
+{
+	unsigned int n, ns = lds->hash_size * 2;
+	struct lws_diskcache_entry **nh, *e, *en;
+
+	nh = lws_zalloc(ns * sizeof(*nh), "diskcache hash");
+	if (!nh)
+		/* we can live with longer chains */
+		return;
+
+	for (n = 0; n < lds->hash_size; n++)
+		for (e = lds->hash[n]; e; e = en) {
+			unsigned int b = lws_diskcache_hash(lde_name(e)) &
+								(ns - 1);
+			en = e->hash_next;
+			e->hash_next = nh[b];
+			nh[b] = e;
+		}
 
-#define BATCH_COUNT 128
+	lws_free(lds->hash);
+	lds->hash = nh;
+	lds->hash_size = ns;
+}
+
+/* the new entry is not on any list yet */
+
+static struct lws_diskcache_entry *
+lws_diskcache_add(struct lws_diskcache_scan *lds, const char *name,
+		  uint64_t size, time_t used)
+{
+	size_t nl = strlen(name);
+	struct lws_diskcache_entry *e;
+	unsigned int b;
+
+	if (nl < 2 || nl >= LWS_DISKCACHE_NAME_MAX)
+		return NULL;
+
+	e = lws_malloc(sizeof(*e) + nl + 1, "diskcache entry");
+	if (!e)
+		return NULL;
+
+	memset(e, 0, sizeof(*e));
+	memcpy(lde_name(e), name, nl + 1);
+	e->size = size;
+	e->used = used;
+
+	if (lds->count >= lds->hash_size * 2)
+		lws_diskcache_rehash(lds);
+
+	b = lws_diskcache_hash(name) & (lds->hash_size - 1);
+	e->hash_next = lds->hash[b];
+	lds->hash[b] = e;
+
+	lds->count++;
+	lds->agg_size += size;
+
+	return e;
+}
+
+static void
+lws_diskcache_remove(struct lws_diskcache_scan *lds,
+		     struct lws_diskcache_entry *e)
+{
+	struct lws_diskcache_entry **pe;
+
+	pe = &lds->hash[lws_diskcache_hash(lde_name(e)) & (lds->hash_size - 1)];
+	while (*pe && *pe != e)
+		pe = &(*pe)->hash_next;
+	if (*pe)
+		*pe = e->hash_next;
+
+	lws_dll2_remove(&e->list);
+	lds->count--;
+	lds->agg_size -= e->size;
+	lws_free(e);
+}
+
+static void
+lws_diskcache_journal(struct lws_diskcache_scan *lds, char op,
+		      struct lws_diskcache_entry *e)
+{
+	char line[LWS_DISKCACHE_NAME_MAX + 64];
+	int n;
+
+	if (lds->journal_fd < 0)
+		return;
+
+	if (op == 'A') {
+		n = lws_snprintf(line, sizeof(line), "A %llu %lld %s\n",
+				 (unsigned long long)e->size,
+				 (long long)e->used, lde_name(e));
+		e->used_journaled = e->used;
+	} else
+		n = lws_snprintf(line, sizeof(line), "D %s\n", lde_name(e));
+
+	/* with O_APPEND, each record is written atomically at the end */
+	if (write(lds->journal_fd, line, n) != n)
+		lwsl_notice("%s: journal write failed\n", __func__);
+
+	lds->journal_records++;
+}
+
+/* e has just been used, or we just learned about it */
+
+static void
+lws_diskcache_used(struct lws_diskcache_scan *lds,
+		   struct lws_diskcache_entry *e, time_t t)
+{
+	e->used = t;
+	lws_dll2_remove(&e->list);
+	lws_dll2_add_tail(&e->list, &lds->lru);
+
+	if (!e->used_journaled ||
+	    e->used - e->used_journaled >= LWS_DISKCACHE_JOURNAL_USE_SECS)
+		lws_diskcache_journal(lds, 'A', e);
+}
+
+static void
+lws_diskcache_journal_line(struct lws_diskcache_scan *lds, const char *line)
+{
+	char name[LWS_DISKCACHE_NAME_MAX];
+	struct lws_diskcache_entry *e;
+	unsigned long long size;
+	long long used;
+
+	if (line[0] == 'A' && sscanf(line, "A %llu %lld %127s", &size, &used,
+				     name) == 3) {
+		e = lws_diskcache_find(lds, name);
+		if (e) {
+			lds->agg_size -= e->size;
+			lds->agg_size += size;
+			e->size = size;
+		} else
+			e = lws_diskcache_add(lds, name, size, (time_t)used);
+		if (!e)
+			return;
+
+		/* the journal order is the lru order */
+		e->used = e->used_journaled = (time_t)used;
+		lws_dll2_remove(&e->list);
+		lws_dll2_add_tail(&e->list, &lds->lru);
+
+		return;
+	}
+
+	if (line[0] == 'D' && sscanf(line, "D %127s", name) == 1) {
+		e = lws_diskcache_find(lds, name);
+		if (e)
+			lws_diskcache_remove(lds, e);
+	}
+}
+
+/*
+ * Rebuild the index from the journal... it's only usable if it was started by
+ * lws_diskcache_journal_rewrite(), so it contains the whole index
+ */
 
 static int
-fe_modified_sort(lws_list_ptr a, lws_list_ptr b)
+lws_diskcache_journal_load(struct lws_diskcache_scan *lds)
 {
-	struct file_entry *p1 = lp_to_fe(a, sorted), *p2 = lp_to_fe(b, sorted);
+	char path[256], buf[4096], *p, *nl;
+	size_t have = 0, ml = strlen(journal_magic);
+	ssize_t n;
+	int fd, ok = 0;
+
+	lws_snprintf(path, sizeof(path), "%s/journal", lds->cache_dir_base);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	while ((n = read(fd, buf + have, sizeof(buf) - 1 - have)) > 0) {
+		have += (size_t)n;
+		p = buf;
+
+		if (!ok) {
+			if (have < ml)
+				continue;
+			if (memcmp(buf, journal_magic, ml))
+				break;
+			ok = 1;
+			p += ml;
+		}
+
+		while ((nl = memchr(p, '\n', have - lws_ptr_diff(p, buf)))) {
+			*nl = '\0';
+			lws_diskcache_journal_line(lds, p);
+			lds->journal_records++;
+			p = nl + 1;
+		}
+
+		/* a partial line at the end of the journal is ignored */
+
+		have -= lws_ptr_diff(p, buf);
+		memmove(buf, p, have);
+		if (have == sizeof(buf) - 1)
+			have = 0;
+	}
+
+	close(fd);
 
-	return p2->modified - p1->modified;
+	return !ok;
+}
+
+/*
+ * Write the whole index in lru order to a new journal and switch to it
+ */
+
+static int
+lws_diskcache_journal_rewrite(struct lws_diskcache_scan *lds)
+{
+	char path[256], temp[256], line[LWS_DISKCACHE_NAME_MAX + 64];
+	struct lws_diskcache_entry *e;
+	int fd, n, m;
+
+	lws_snprintf(path, sizeof(path), "%s/journal", lds->cache_dir_base);
+	lws_snprintf(temp, sizeof(temp), "%s/journal~%d", lds->cache_dir_base,
+		     (int)getpid());
+
+	fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		lwsl_notice("%s: can't create %s\n", __func__, temp);
+		return 1;
+	}
+
+	n = (int)strlen(journal_magic);
+	if (write(fd, journal_magic, n) != n)
+		goto bail;
+
+	lws_start_foreach_dll(struct lws_dll2 *, d, lds->lru.head) {
+		e = lws_container_of(d, struct lws_diskcache_entry, list);
+
+		m = lws_snprintf(line, sizeof(line), "A %llu %lld %s\n",
+				 (unsigned long long)e->size,
+				 (long long)e->used, lde_name(e));
+		if (write(fd, line, m) != m)
+			goto bail;
+		e->used_journaled = e->used;
+	} lws_end_foreach_dll(d);
+
+	close(fd);
+
+	if (rename(temp, path)) {
+		unlink(temp);
+		return 1;
+	}
+
+	if (lds->journal_fd >= 0)
+		close(lds->journal_fd);
+	lds->journal_fd = open(path, O_WRONLY | O_APPEND);
+	lds->journal_records = lds->lru.count;
+
+	return 0;
+
+bail:
+	lwsl_notice("%s: failed writing %s\n", __func__, temp);
+	close(fd);
+	unlink(temp);
+
+	return 1;
+}
+
+static int
+lws_diskcache_used_sort(const void *a, const void *b)
+{
+	const struct lws_diskcache_entry *e1 =
+				*(const struct lws_diskcache_entry **)a,
+					 *e2 =
+				*(const struct lws_diskcache_entry **)b;
+
+	return e1->used < e2->used ? -1 : e1->used > e2->used;
+}
+
+/*
+ * The scan finished... the files it found that we didn't know about go at the
+ * old end of the lru, oldest first by mtime
+ */
+
+static void
+lws_diskcache_merge_pending(struct lws_diskcache_scan *lds)
+{
+	struct lws_diskcache_entry **a;
+	unsigned int n = 0, c = lds->pending.count;
+
+	if (!c)
+		return;
+
+	a = lws_malloc(c * sizeof(*a), "diskcache merge");
+	if (!a) {
+		/* just take them in the order we found them then */
+		while (lds->pending.head) {
+			struct lws_dll2 *d = lds->pending.head;
+
+			lws_dll2_remove(d);
+			lws_dll2_add_head(d, &lds->lru);
+		}
+
+		return;
+	}
+
+	lws_start_foreach_dll(struct lws_dll2 *, d, lds->pending.head) {
+		a[n++] = lws_container_of(d, struct lws_diskcache_entry, list);
+	} lws_end_foreach_dll(d);
+
+	qsort(a, c, sizeof(*a), lws_diskcache_used_sort);
+
+	while (n--) {
+		lws_dll2_remove(&a[n]->list);
+		lws_dll2_add_head(&a[n]->list, &lds->lru);
+	}
+
+	lws_free(a);
+}
+
+static void
+lws_diskcache_evict(struct lws_diskcache_scan *lds)
+{
+	uint64_t cache_size_limit = lds->cache_size_limit, trimmed = 0;
+	char filepath[256];
+	struct lws_diskcache_entry *e;
+	int files_trimmed = 0;
+
+	/* if really no guidence, then 256MiB */
+	if (!cache_size_limit)
+		cache_size_limit = 256 * 1024 * 1024;
+
+	while (lds->agg_size > cache_size_limit && lds->lru.head) {
+		e = lws_container_of(lds->lru.head, struct lws_diskcache_entry,
+				     list);
+
+		lws_snprintf(filepath, sizeof(filepath), "%s/%c/%c/%s",
+			     lds->cache_dir_base, lde_name(e)[0],
+			     lde_name(e)[1], lde_name(e));
+
+		/*
+		 * Even if we can't delete it, forget it... if it's still
+		 * there the next reconcile scan will find it again
+		 */
+
+		if (!unlink(filepath) || errno == ENOENT) {
+			trimmed += e->size;
+			files_trimmed++;
+		} else
+			lwsl_notice("%s: Failed to unlink %s\n", __func__,
+				    filepath);
+
+		lws_diskcache_journal(lds, 'D', e);
+		lws_diskcache_remove(lds, e);
+	}
+
+	if (files_trimmed)
+		lwsl_notice("%s: %s: trimmed %d files totalling "
+			    "%lldKib, leaving %lldMiB\n", __func__,
+			    lds->cache_dir_base, files_trimmed,
+			    ((unsigned long long)trimmed) / KIB,
+			    ((unsigned long long)lds->agg_size) / MIB);
+}
+
+static void
+lws_diskcache_destroy_entries(struct lws_diskcache_scan *lds)
+{
+	struct lws_diskcache_entry *e, *en;
+	unsigned int n;
+
+	for (n = 0; n < lds->hash_size; n++) {
+		for (e = lds->hash[n]; e; e = en) {
+			en = e->hash_next;
+			lws_free(e);
+		}
+		lds->hash[n] = NULL;
+	}
+
+	lws_dll2_owner_clear(&lds->lru);
+	lws_dll2_owner_clear(&lds->pending);
+	lds->count = 0;
+	lds->agg_size = 0;
+	lds->journal_records = 0;
 }
 
 struct lws_diskcache_scan *
 lws_diskcache_create(const char *cache_dir_base, uint64_t cache_size_limit)
 {
 	struct lws_diskcache_scan *lds = lws_malloc(sizeof(*lds), "cachescan");
+	char path[256];
 
 	if (!lds)
 		return NULL;
@@ -104,6 +529,48 @@ lws_diskcache_create(const char *cache_dir_base, uint64_t cache_size_limit)
 
 	lds->cache_dir_base = cache_dir_base;
 	lds->cache_size_limit = cache_size_limit;
+	lds->journal_fd = -1;
+	lds->hash_size = LWS_DISKCACHE_HASH_INITIAL;
+	lds->hash = lws_zalloc(lds->hash_size * sizeof(*lds->hash),
+			       "diskcache hash");
+	if (!lds->hash) {
+		lws_free(lds);
+
+		return NULL;
+	}
+
+	pthread_mutex_init(&lds->lock, NULL);
+
+	if (!cache_dir_base)
+		return lds;
+
+	if (lws_diskcache_journal_load(lds)) {
+		/*
+		 * No usable journal, the first trim will scan the cache to
+		 * rebuild the index.  Start afresh so there is no partial
+		 * index left behind from it.
+		 */
+		lwsl_info("%s: %s: no journal, will scan\n", __func__,
+			  cache_dir_base);
+		lws_diskcache_destroy_entries(lds);
+
+		return lds;
+	}
+
+	lwsl_info("%s: %s: journal has %u files, %lluKiB\n", __func__,
+		  cache_dir_base, lds->count,
+		  (unsigned long long)lds->agg_size / KIB);
+
+	lds->index_valid = 1;
+	lds->last_scan_completed = time(NULL);
+
+	if (lds->journal_records > (lds->count * 2) + 1024)
+		lws_diskcache_journal_rewrite(lds);
+
+	if (lds->journal_fd < 0) {
+		lws_snprintf(path, sizeof(path), "%s/journal", cache_dir_base);
+		lds->journal_fd = open(path, O_WRONLY | O_APPEND);
+	}
 
 	return lds;
 }
@@ -111,8 +578,11 @@ lws_diskcache_create(const char *cache_dir_base, uint64_t cache_size_limit)
 void
 lws_diskcache_destroy(struct lws_diskcache_scan **lds)
 {
-	if ((*lds)->batch)
-		lws_free((*lds)->batch);
+	lws_diskcache_destroy_entries(*lds);
+	lws_free((*lds)->hash);
+	if ((*lds)->journal_fd >= 0)
+		close((*lds)->journal_fd);
+	pthread_mutex_destroy(&(*lds)->lock);
 	lws_free(*lds);
 	*lds = NULL;
 }
@@ -173,16 +643,49 @@ lws_diskcache_finalize_name(char *cache)
 }
 
 int
-lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
-		    const char *hash_hex, int *_fd, char *cache, int cache_len,
-		    size_t *extant_cache_len)
+lws_diskcache_finalize(struct lws_diskcache_scan *lds, char *cache)
 {
+	struct lws_diskcache_entry *e;
+	const char *name;
 	struct stat s;
-	int n;
 
-	/* caching is disabled? */
-	if (!lds->cache_dir_base)
-		return LWS_DISKCACHE_QUERY_NO_CACHE;
+	if (lws_diskcache_finalize_name(cache))
+		return 1;
+
+	if (stat(cache, &s))
+		return 1;
+
+	name = strrchr(cache, '/');
+	name = name ? name + 1 : cache;
+
+	pthread_mutex_lock(&lds->lock);
+
+	e = lws_diskcache_find(lds, name);
+	if (e) {
+		lds->agg_size -= e->size;
+		lds->agg_size += (uint64_t)s.st_size;
+		e->size = (uint64_t)s.st_size;
+		/* the size changed, so it must be journalled */
+		e->used_journaled = 0;
+	} else
+		e = lws_diskcache_add(lds, name, (uint64_t)s.st_size,
+				      time(NULL));
+	if (e)
+		lws_diskcache_used(lds, e, time(NULL));
+
+	pthread_mutex_unlock(&lds->lock);
+
+	return 0;
+}
+
+static int
+__lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
+		      const char *hash_hex, int *_fd, char *cache, int cache_len,
+		      size_t *extant_cache_len)
+{
+	struct lws_diskcache_entry *e;
+	struct stat s;
+	int n;
 
 	if (!is_bot)
 		lds->cache_tries++;
@@ -192,10 +695,10 @@ lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
 
 	lwsl_info("%s: job cache %s\n", __func__, cache);
 
+	e = lws_diskcache_find(lds, hash_hex);
+
 	*_fd = open(cache, O_RDONLY);
 	if (*_fd >= 0) {
-		int fd;
-
 		if (!is_bot)
 			lds->cache_hits++;
 
@@ -207,14 +710,23 @@ lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
 
 		*extant_cache_len = (size_t)s.st_size;
 
-		/* "touch" the hit cache file so it's last for LRU now */
-		fd = open(cache, O_RDWR);
-		if (fd >= 0)
-			close(fd);
+		/* it's the most recently used now */
+
+		if (!e)
+			e = lws_diskcache_add(lds, hash_hex,
+					      (uint64_t)s.st_size, 0);
+		if (e)
+			lws_diskcache_used(lds, e, time(NULL));
 
 		return LWS_DISKCACHE_QUERY_EXISTS;
 	}
 
+	if (e) {
+		/* somebody else deleted it */
+		lws_diskcache_journal(lds, 'D', e);
+		lws_diskcache_remove(lds, e);
+	}
+
 	/* bots are too random to pollute the cache with their antics */
 	if (is_bot)
 		return LWS_DISKCACHE_QUERY_NO_CACHE;
@@ -235,69 +747,102 @@ lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
 	return LWS_DISKCACHE_QUERY_CREATING;
 }
 
+int
+lws_diskcache_query(struct lws_diskcache_scan *lds, int is_bot,
+		    const char *hash_hex, int *_fd, char *cache, int cache_len,
+		    size_t *extant_cache_len)
+{
+	int n;
+
+	/* caching is disabled? */
+	if (!lds->cache_dir_base)
+		return LWS_DISKCACHE_QUERY_NO_CACHE;
+
+	pthread_mutex_lock(&lds->lock);
+	n = __lws_diskcache_query(lds, is_bot, hash_hex, _fd, cache,
+				  cache_len, extant_cache_len);
+	pthread_mutex_unlock(&lds->lock);
+
+	return n;
+}
+
+/*
+ * With a valid index, trim is cheap and we see every add, so we only need to
+ * come back promptly if the cache is getting near the limit, or when the next
+ * reconcile scan is due.  While scanning, each call does one subdir, so come
+ * back immediately.
+ */
+
 int
 lws_diskcache_secs_to_idle(struct lws_diskcache_scan *lds)
 {
-	return lds->secs_waiting;
+	uint64_t cache_size_limit = lds->cache_size_limit;
+	time_t now = time(NULL);
+	int secs = 0;
+
+	if (!lds->cache_dir_base)
+		return LWS_DISKCACHE_RECONCILE_SECS;
+
+	/* if really no guidence, then 256MiB */
+	if (!cache_size_limit)
+		cache_size_limit = 256 * 1024 * 1024;
+
+	pthread_mutex_lock(&lds->lock);
+
+	if (lds->scanning || !lds->index_valid ||
+	    lds->last_scan_completed + LWS_DISKCACHE_RECONCILE_SECS <= now)
+		goto bail;
+
+	/* if the cache grew by 10%, would we hit the limit? */
+	if ((lds->agg_size * 11) / 10 >= cache_size_limit) {
+		secs = lds->agg_size >= cache_size_limit ? 0 : 1;
+		goto bail;
+	}
+
+	secs = (int)(lds->last_scan_completed +
+		     LWS_DISKCACHE_RECONCILE_SECS - now);
+
+bail:
+	pthread_mutex_unlock(&lds->lock);
+
+	return secs;
 }
 
 /*
- * The goal is to collect the oldest BATCH_COUNT filepaths and filesizes from
- * the dirs under the cache dir.  Since we don't need or want a full list of
- * files in there in memory at once, we restrict the linked-list size to
- * BATCH_COUNT entries, and once it is full, simply ignore any further files
- * that are newer than the newest one on that list.  Files older than the
- * newest guy already on the list evict the newest guy already on the list
- * and are sorted into the correct order.  In this way no matter the number
- * of files to be processed the memory requirement is fixed at BATCH_COUNT
- * struct file_entry-s.
- *
- * The oldest subset of BATCH_COUNT files are sorted into the cd->batch
- * allocation in more recent -> least recent order.
- *
- * We want to track the total size of all files we saw as well, so we know if
- * we need to actually do anything yet to restrict how much space it's taking
- * up.
- *
- * And we want to do those things statefully and incrementally instead of one
- * big atomic operation, since the user may want a huge cache, so we look in
- * one cache dir at a time and track state in the repodir struct.
+ * Trimming with a valid index just deletes from the old end of the lru until
+ * we're under the limit, so it only costs as much as what it deletes.
  *
- * When we have seen everything, we add the doubly-linked prev pointers and then
- * if we are over the limit, start deleting up to BATCH_COUNT files working back
- * from the end.
+ * If we have no index yet, or every LWS_DISKCACHE_RECONCILE_SECS to find files
+ * that appeared without us being told, we walk the cache dirs, one of the 256
+ * subdirs per call.  Files we already know about are skipped without stat();
+ * new ones are collected on the pending list and sorted into the old end of
+ * the lru by their mtime when the walk completes.
  */
 
-int
-lws_diskcache_trim(struct lws_diskcache_scan *lds)
+static int
+__lws_diskcache_trim(struct lws_diskcache_scan *lds)
 {
-	size_t cache_size_limit = lds->cache_size_limit;
-	char dirpath[132], filepath[132 + 32];
-	lws_list_ptr lp, op = NULL;
-	int files_trimmed = 0;
-	struct file_entry *p;
-	int fd, n, ret = -1;
-	size_t trimmed = 0;
+	char dirpath[132], filepath[132 + LWS_DISKCACHE_NAME_MAX];
+	struct lws_diskcache_entry *e;
+	time_t now = time(NULL);
 	struct dirent *de;
 	struct stat s;
 	DIR *dir;
 
-	if (!lds->cache_subdir) {
+	if (!lds->scanning) {
+		if (lds->index_valid) {
+			lws_diskcache_evict(lds);
 
-		if (lds->last_scan_completed + lds->secs_waiting > time(NULL))
-			return 0;
+			if (lds->journal_records > (lds->count * 2) + 1024)
+				lws_diskcache_journal_rewrite(lds);
 
-		lds->batch = lws_malloc(sizeof(struct file_entry) *
-				BATCH_COUNT, "cache_trim");
-		if (!lds->batch) {
-			lwsl_err("%s: OOM\n", __func__);
-
-			return 1;
+			if (lds->last_scan_completed +
+					LWS_DISKCACHE_RECONCILE_SECS > now)
+				return 0;
 		}
-		lds->agg_size = 0;
-		lds->head = NULL;
-		lds->batch_in_use = 0;
-		lds->agg_file_count = 0;
+
+		lds->scanning = 1;
+		lds->cache_subdir = 0;
 	}
 
 	lws_snprintf(dirpath, sizeof(dirpath), "%s/%c/%c",
@@ -306,185 +851,84 @@ lws_diskcache_trim(struct lws_diskcache_scan *lds)
 
 	dir = opendir(dirpath);
 	if (!dir) {
-		lwsl_err("Unable to walk repo dir '%s'\n",
-			 lds->cache_dir_base);
+		lwsl_err("Unable to walk repo dir '%s'\n", dirpath);
+		lds->scanning = 0;
+		lds->last_scan_completed = now;
+
 		return -1;
 	}
 
-	do {
-		de = readdir(dir);
-		if (!de)
-			break;
-
-		if (de->d_type != DT_REG)
+	while ((de = readdir(dir))) {
+		if (de->d_type != DT_REG && de->d_type != DT_UNKNOWN)
 			continue;
 
-		lds->agg_file_count++;
+		if (lws_diskcache_find(lds, de->d_name))
+			continue;
 
 		lws_snprintf(filepath, sizeof(filepath), "%s/%s", dirpath,
 			     de->d_name);
 
-		fd = open(filepath, O_RDONLY);
-		if (fd < 0) {
-			lwsl_err("%s: cannot open %s\n", __func__, filepath);
-
+		if (stat(filepath, &s) || !S_ISREG(s.st_mode))
 			continue;
-		}
 
-		n = fstat(fd, &s);
-		close(fd);
-		if (n) {
-			lwsl_notice("%s: cannot stat %s\n", __func__, filepath);
+		/* a temp file may still be being written */
+		if (strchr(de->d_name, '~') &&
+		    s.st_mtime + LWS_DISKCACHE_TEMP_GRACE_SECS > now)
 			continue;
-		}
-
-		lds->agg_size += s.st_size;
 
-		if (lds->batch_in_use == BATCH_COUNT) {
-			/*
-			 * once we filled up the batch with candidates, we don't
-			 * need to consider any files newer than the newest guy
-			 * on the list...
-			 */
-			if (lp_to_fe(lds->head, sorted)->modified < s.st_mtime)
-				continue;
-
-			/*
-			 * ... and if we find an older file later, we know it
-			 * will be replacing the newest guy on the list, so use
-			 * that directly...
-			 */
-			p = lds->head;
-			lds->head = p->sorted;
-		} else
-			/* we are still accepting anything to fill the batch */
-
-			p = &lds->batch[lds->batch_in_use++];
-
-		p->sorted = NULL;
-		strncpy(p->name, de->d_name, sizeof(p->name) - 1);
-		p->name[sizeof(p->name) - 1] = '\0';
-		p->modified = s.st_mtime;
-		p->size = s.st_size;
-
-		lws_list_ptr_insert(&lds->head, &p->sorted, fe_modified_sort);
-	} while (de);
+		e = lws_diskcache_add(lds, de->d_name, (uint64_t)s.st_size,
+				      s.st_mtime);
+		if (e)
+			lws_dll2_add_tail(&e->list, &lds->pending);
+	}
 
-	ret = 0;
+	closedir(dir);
 
-	lds->cache_subdir++;
-	if (lds->cache_subdir != 0x100)
-		goto done;
+	if (++lds->cache_subdir != 0x100)
+		return 0;
 
 	/* we completed the whole scan... */
 
-	/* if really no guidence, then 256MiB */
-	if (!cache_size_limit)
-		cache_size_limit = 256 * 1024 * 1024;
-
-	if (lds->agg_size > cache_size_limit) {
-
-		/* apply prev pointers to make the list doubly-linked */
-
-		lp = lds->head;
-		while (lp) {
-			p = lp_to_fe(lp, sorted);
-
-			p->prev = op;
-			op = &p->prev;
-			lp = p->sorted;
-		}
+	lwsl_info("%s: %s: scan found %u new files\n", __func__,
+		  lds->cache_dir_base, lds->pending.count);
 
+	if (lds->pending.count || !lds->index_valid) {
 		/*
-		 * reverse the list (start from tail, now traverse using
-		 * .prev)... it's oldest-first now...
+		 * New entries went in at the old end of the lru, appending
+		 * them to the journal would put them at the wrong end
 		 */
-
-		lp = op;
-
-		while (lp && lds->agg_size > cache_size_limit) {
-			p = lp_to_fe(lp, prev);
-
-			lws_snprintf(filepath, sizeof(filepath), "%s/%c/%c/%s",
-				     lds->cache_dir_base, p->name[0],
-				     p->name[1], p->name);
-
-			if (!unlink(filepath)) {
-				lds->agg_size -= p->size;
-				trimmed += p->size;
-				files_trimmed++;
-			} else
-				lwsl_notice("%s: Failed to unlink %s\n",
-					    __func__, filepath);
-
-			lp = p->prev;
-		}
-
-		if (files_trimmed)
-			lwsl_notice("%s: %s: trimmed %d files totalling "
-				    "%lldKib, leaving %lldMiB\n", __func__,
-				    lds->cache_dir_base, files_trimmed,
-				    ((unsigned long long)trimmed) / KIB,
-				    ((unsigned long long)lds->agg_size) / MIB);
+		lws_diskcache_merge_pending(lds);
+		lws_diskcache_journal_rewrite(lds);
 	}
 
-	if (lds->agg_size && lds->agg_file_count)
-		lds->avg_size = lds->agg_size / lds->agg_file_count;
-
-	/*
-	 * estimate how long we can go before scanning again... default we need
-	 * to start again immediately
-	 */
-
-	lds->last_scan_completed = time(NULL);
-	lds->secs_waiting = 1;
-
-	if (lds->agg_size < cache_size_limit) {
-		uint64_t avg = 4096, capacity, projected;
-
-		/* let's use 80% of the real average for margin */
-		if (lds->agg_size && lds->agg_file_count)
-			avg = ((lds->agg_size * 8) / lds->agg_file_count) / 10;
-
-		/*
-		 * if we collected BATCH_COUNT files of the average size,
-		 * how much can we clean up in 256s?
-		 */
-
-		capacity = avg * BATCH_COUNT;
+	lds->scanning = 0;
+	lds->index_valid = 1;
+	lds->last_scan_completed = now;
 
-		/*
-		 * if the cache grew by 10%, would we hit the limit even then?
-		 */
-		projected = (lds->agg_size * 11) / 10;
-		if (projected < cache_size_limit)
-			/* no... */
-			lds->secs_waiting  = (256 / 2) * ((cache_size_limit -
-						    projected) / capacity);
+	lws_diskcache_evict(lds);
 
-		/*
-		 * large waits imply we may not have enough info yet, so
-		 * check once an hour at least.
-		 */
+	if (lds->count)
+		lds->avg_size = lds->agg_size / lds->count;
 
-		if (lds->secs_waiting > 3600)
-			lds->secs_waiting = 3600;
-	} else
-		lds->secs_waiting = 0;
-
-	lwsl_info("%s: cache %s: %lldKiB / %lldKiB, next scan %ds\n", __func__,
+	lwsl_info("%s: cache %s: %lldKiB / %lldKiB\n", __func__,
 		  lds->cache_dir_base,
 		  (unsigned long long)lds->agg_size / KIB,
-		  (unsigned long long)cache_size_limit / KIB,
-		  lds->secs_waiting);
+		  (unsigned long long)lds->cache_size_limit / KIB);
 
-	lws_free(lds->batch);
-	lds->batch = NULL;
+	return 0;
+}
 
-	lds->cache_subdir = 0;
+int
+lws_diskcache_trim(struct lws_diskcache_scan *lds)
+{
+	int n;
 
-done:
-	closedir(dir);
+	if (!lds->cache_dir_base)
+		return 0;
+
+	pthread_mutex_lock(&lds->lock);
+	n = __lws_diskcache_trim(lds);
+	pthread_mutex_unlock(&lds->lock);
 
-	return ret;
+	return n;
 }
@@ -48,7 +48,7 @@ rm_rf_cb(const char *dirpath, void *user, struct lws_dir_entry *lde)
 	lws_snprintf(path, sizeof(path), "%s/%s", dirpath, lde->name);
 
 	if (lde->type == LDOT_DIR) {
-		lws_dir(path, NULL, rm_rf_cb);
+		lws_dir_stream(path, NULL, rm_rf_cb, NULL, 0);
 		rmdir(path);
 	} else
 		unlink(path);
@@ -87,7 +87,7 @@ lws_fsmount_mount(struct lws_fsmount *fsm)
 	lws_snprintf(opts, sizeof(opts), "%s/overlays/%s/session",
 		     fsm->overlay_path, fsm->ovname);
 	lwsl_info("%s: emptying session dir %s\n", __func__, opts);
-	lws_dir(opts, NULL, rm_rf_cb);
+	lws_dir_stream(opts, NULL, rm_rf_cb, NULL, 0);
 
 	/*
 	 * Piece together the options for the overlay mount...
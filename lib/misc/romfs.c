@@ -34,6 +34,7 @@
 #include <libwebsockets.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include "romfs.h"
 #if defined(LWS_WITH_ESP32)
@@ -42,6 +43,46 @@
 
 #define RFS_STRING_MAX 96
 
+/*
+ * Upper bound on the heap used by the path index.  Each indexed path costs
+ * 10 bytes plus 2 or 3 bytes of hash slots, so the default covers images with
+ * around 2000 files and dirs.  Bigger images fall back to walking the image
+ * for every lookup, the same as having no index.
+ */
+#ifndef LWS_ROMFS_INDEX_MAX_BYTES
+#define LWS_ROMFS_INDEX_MAX_BYTES 32768
+#endif
+#ifndef LWS_ROMFS_INDEX_MAX_DEPTH
+#define LWS_ROMFS_INDEX_MAX_DEPTH 16
+#endif
+
+#define RFS_INDEX_ROOT 0xffff
+
+/*
+ * Side table mapping full paths to the directory entry inode, so opening a
+ * file doesn't have to walk every directory from the root comparing names
+ * out of flash.  It's built on the first lookup and doesn't change the image.
+ *
+ * Only the hash of each path is kept.  A hash match is confirmed by checking
+ * the names of the entry and its parents against the path components, which
+ * costs one name read per path level instead of one per directory entry.
+ */
+
+struct romfs_index {
+	romfs_t		romfs;
+	uint32_t	*hash;
+	uint32_t	*ofs;		/* of the directory entry inode */
+	uint16_t	*parent;	/* entry index of containing dir */
+	uint16_t	*slot;		/* entry index + 1, or 0 if empty */
+	uint16_t	count;
+	uint16_t	mask;
+
+	uint8_t		built:1;
+	uint8_t		complete:1;	/* a miss in the index is definitive */
+};
+
+static struct romfs_index rfs_index;
+
 static u32_be_t cache[(RFS_STRING_MAX + 32) / 4];
 static romfs_inode_t ci = (romfs_inode_t)cache;
 static romfs_t cr = (romfs_t)cache;
@@ -215,6 +256,259 @@ romfs_lookup(romfs_t romfs, romfs_inode_t start, const char *path)
 	return NULL;
 }
 
+static uint32_t
+rfs_hash(uint32_t h, const char *p, size_t len)
+{
+	while (len--)
+		h = (h ^ (uint8_t)*p++) * 16777619;
+
+	return h;
+}
+
+/*
+ * Reads the directory entry at i into the cache, returning the length of its
+ * name, which is left in cache, or -1 if it's too long for us to match.
+ */
+
+static int
+rfs_entry(romfs_inode_t i, uint32_t *next, uint32_t *dir_start)
+{
+	size_t n;
+
+	set_cache(i, sizeof(*i));
+	*next = untohl(ci->next);
+	*dir_start = untohl(ci->dir_start);
+
+	set_cache((romfs_inode_t)((const uint8_t *)i + sizeof(*i)),
+		  RFS_STRING_MAX);
+	n = strnlen((const char *)cache, RFS_STRING_MAX);
+	if (n == RFS_STRING_MAX)
+		return -1;
+
+	return (int)n;
+}
+
+/*
+ * Walks one directory, either counting (x->hash NULL) or adding the entries
+ * to the index, then recurses into its subdirs.  Anything we can't index
+ * faithfully, like symlinks or names too long to match, just clears
+ * x->complete so misses go on to the linear lookup.
+ *
+ * Hardlinks (other than . and ..) are indexed, so a lookup ending on one
+ * resolves it, but we don't follow them: paths through one are left to the
+ * linear lookup as well.
+ */
+
+static int
+rfs_index_dir(struct romfs_index *x, romfs_inode_t i, uint16_t parent,
+	      uint32_t h, int depth)
+{
+	uint32_t next, dir_start, eh;
+	int n, type;
+
+	while (i != (romfs_inode_t)x->romfs) {
+		n = rfs_entry(i, &next, &dir_start);
+		type = (int)(next & 7);
+
+		if (n < 0 || type == RFST_SYMLINK)
+			x->complete = 0;
+		else if (strcmp((const char *)cache, ".") &&
+			 strcmp((const char *)cache, "..")) {
+
+			if (x->count == RFS_INDEX_ROOT - 1)
+				return 1;
+
+			eh = h;
+			if (parent != RFS_INDEX_ROOT)
+				eh = rfs_hash(eh, "/", 1);
+			eh = rfs_hash(eh, (const char *)cache, (size_t)n);
+
+			if (x->hash) {
+				x->hash[x->count] = eh;
+				x->ofs[x->count] = (uint32_t)
+					((const uint8_t *)i -
+					 (const uint8_t *)x->romfs);
+				x->parent[x->count] = parent;
+			}
+			x->count++;
+
+			if (type == RFST_HARDLINK)
+				x->complete = 0;
+
+			if (type == RFST_DIR) {
+				if (depth == LWS_ROMFS_INDEX_MAX_DEPTH)
+					x->complete = 0;
+				else if (rfs_index_dir(x, (romfs_inode_t)
+					((const uint8_t *)x->romfs + dir_start),
+					(uint16_t)(x->count - 1), eh, depth + 1))
+					return 1;
+			}
+		}
+
+		if (!(next & ~15))
+			break;
+		i = (romfs_inode_t)((const uint8_t *)x->romfs + (next & ~15));
+	}
+
+	return 0;
+}
+
+static void
+rfs_index_build(struct romfs_index *x, romfs_t romfs)
+{
+	size_t slots = 1, size;
+	uint8_t *p;
+	int n;
+
+	if (x->hash)
+		free(x->hash);
+	memset(x, 0, sizeof(*x));
+	x->romfs = romfs;
+	x->built = 1;
+	x->complete = 1;
+
+	/* first pass just finds out how big the index needs to be */
+
+	if (rfs_index_dir(x, skip_and_pad((romfs_inode_t)romfs),
+			  RFS_INDEX_ROOT, 2166136261u, 0)) {
+		lwsl_notice("%s: romfs too large to index\n", __func__);
+		goto bail;
+	}
+
+	while (slots < (size_t)x->count + (x->count / 2))
+		slots <<= 1;
+
+	size = (x->count * (sizeof(*x->hash) + sizeof(*x->ofs) +
+		sizeof(*x->parent))) + (slots * sizeof(*x->slot));
+	if (size > LWS_ROMFS_INDEX_MAX_BYTES || slots > RFS_INDEX_ROOT) {
+		lwsl_notice("%s: romfs too large to index\n", __func__);
+		goto bail;
+	}
+	if (!x->count)
+		goto bail;
+
+	p = malloc(size);
+	if (!p)
+		goto bail;
+
+	x->hash = (uint32_t *)p;
+	x->ofs = x->hash + x->count;
+	x->parent = (uint16_t *)(x->ofs + x->count);
+	x->slot = x->parent + x->count;
+	x->mask = (uint16_t)(slots - 1);
+	memset(x->slot, 0, slots * sizeof(*x->slot));
+
+	n = x->count;
+	x->count = 0;
+	x->complete = 1;
+	if (rfs_index_dir(x, skip_and_pad((romfs_inode_t)romfs),
+			  RFS_INDEX_ROOT, 2166136261u, 0) || x->count != n) {
+		free(p);
+		goto bail;
+	}
+
+	for (n = 0; n < x->count; n++) {
+		size_t s = x->hash[n] & x->mask;
+
+		while (x->slot[s])
+			s = (s + 1) & x->mask;
+		x->slot[s] = (uint16_t)(n + 1);
+	}
+
+	lwsl_info("%s: indexed %d paths in %uB\n", __func__, x->count,
+		  (unsigned int)size);
+
+	return;
+
+bail:
+	x->hash = NULL;
+	x->count = 0;
+	x->complete = 0;
+}
+
+/*
+ * Returns 0 and sets *pi if found, 1 if the path definitely isn't in the
+ * image, or -1 if the linear lookup has to decide.
+ */
+
+static int
+rfs_index_lookup(romfs_t romfs, const char *path, romfs_inode_t *pi)
+{
+	const char *comp[LWS_ROMFS_INDEX_MAX_DEPTH + 1];
+	uint8_t clen[LWS_ROMFS_INDEX_MAX_DEPTH + 1];
+	struct romfs_index *x = &rfs_index;
+	uint32_t h = 2166136261u, next, dir_start;
+	const char *p = path;
+	int depth = 0, n, e;
+	size_t s;
+
+	if (!x->built || x->romfs != romfs)
+		rfs_index_build(x, romfs);
+	if (!x->hash)
+		return -1;
+
+	/* hash the path the same way it was indexed, collapsing // */
+
+	while (*p) {
+		const char *c = p;
+
+		while (*p && *p != '/')
+			p++;
+		if (depth > LWS_ROMFS_INDEX_MAX_DEPTH ||
+		    p - c >= RFS_STRING_MAX || p == c ||
+		    (c[0] == '.' && (p - c == 1 || (p - c == 2 && c[1] == '.'))))
+			return -1;
+
+		comp[depth] = c;
+		clen[depth++] = (uint8_t)(p - c);
+		if (c != path)
+			h = rfs_hash(h, "/", 1);
+		h = rfs_hash(h, c, (size_t)(p - c));
+
+		if (*p == '/') {
+			while (*p == '/')
+				p++;
+			if (!*p)
+				/* trailing / */
+				return -1;
+		}
+	}
+
+	if (!depth)
+		return -1;
+
+	for (s = h & x->mask; x->slot[s]; s = (s + 1) & x->mask) {
+		e = x->slot[s] - 1;
+		if (x->hash[e] != h)
+			continue;
+
+		/* confirm it by matching names from the leaf back up */
+
+		for (n = depth - 1; n >= 0 && e != RFS_INDEX_ROOT; n--) {
+			if (rfs_entry((romfs_inode_t)((const uint8_t *)romfs +
+				      x->ofs[e]), &next, &dir_start) !=
+							clen[n] ||
+			    memcmp(cache, comp[n], clen[n]))
+				break;
+			e = x->parent[e];
+		}
+		if (n >= 0 || e != RFS_INDEX_ROOT)
+			continue;
+
+		e = x->slot[s] - 1;
+		*pi = (romfs_inode_t)((const uint8_t *)romfs + x->ofs[e]);
+
+		rfs_entry(*pi, &next, &dir_start);
+		if ((next & 7) == RFST_HARDLINK)
+			*pi = (romfs_inode_t)((const uint8_t *)romfs +
+					      (dir_start & ~15));
+
+		return 0;
+	}
+
+	return x->complete ? 1 : -1;
+}
+
 const void *
 romfs_get_info(romfs_t romfs, const char *path, size_t *len, size_t *csum)
 {
@@ -223,7 +517,15 @@ romfs_get_info(romfs_t romfs, const char *path, size_t *len, size_t *csum)
 	if (*path == '/')
 		path++;
 
-	i = romfs_lookup(romfs, (romfs_inode_t)romfs, path);
+	switch (rfs_index_lookup(romfs, path, &i)) {
+	case 0:
+		break;
+	case 1:
+		return NULL;
+	default:
+		i = romfs_lookup(romfs, (romfs_inode_t)romfs, path);
+		break;
+	}
 
 	if (!i)
 		return NULL;
@@ -171,7 +171,7 @@ again:
 			}
 		}
 
-		m = 0;
+		m = pt->writable_all_pending;
 
 	#if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
 		m |= !!pt->ws.rx_draining_ext_list;
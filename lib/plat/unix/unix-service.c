@@ -71,10 +71,7 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 	volatile struct lws_context_per_thread *vpt;
 	struct lws_context_per_thread *pt;
 	lws_usec_t timeout_us, us;
-	int n = -1;
-#if (defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)) || defined(LWS_WITH_TLS)
-	int m;
-#endif
+	int n = -1, m;
 
 	/* stay dead once we are dead */
 
@@ -131,6 +128,9 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 
 	vpt->inside_poll = 1;
 	lws_memory_barrier();
+	/* a writable_all from another pt may have missed seeing inside_poll */
+	if (vpt->writable_all_pending)
+		timeout_us = 0;
 	n = poll(pt->fds, pt->fds_count, timeout_us /* ms now */ );
 	vpt->inside_poll = 0;
 	lws_memory_barrier();
@@ -181,9 +181,7 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 
 	lws_pt_unlock(pt);
 
-#if (defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)) || defined(LWS_WITH_TLS)
-	m = 0;
-#endif
+	m = pt->writable_all_pending;
 #if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
 	m |= !!pt->ws.rx_draining_ext_list;
 #endif
@@ -194,11 +192,7 @@ _lws_plat_service_tsi(struct lws_context *context, int timeout_ms, int tsi)
 		m |= pt->context->tls_ops->fake_POLLIN_for_buffered(pt);
 #endif
 
-	if (
-#if (defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)) || defined(LWS_WITH_TLS)
-		!m &&
-#endif
-		!n) { /* nothing to do */
+	if (!m && !n) { /* nothing to do */
 		lws_service_do_ripe_rxflow(pt);
 
 		return 0;
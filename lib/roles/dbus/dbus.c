@@ -181,13 +181,54 @@ lws_dbus_add_watch(DBusWatch *w, void *data)
 	lwsl_info("%s: w %p, fd %d, data %p, flags %d\n", __func__, w,
 		  dbus_watch_get_unix_fd(w), data, lws_flags);
 
-	__lws_change_pollfd(wsi, 0, lws_flags);
+	if (wsi == ctx->wsi_service)
+		/* applied once when we finish servicing it */
+		ctx->watch_changed = 1;
+	else
+		__lws_change_pollfd(wsi, 0, lws_flags);
 
 	lws_pt_unlock(pt);
 
 	return TRUE;
 }
 
+static void
+lws_dbus_batch_flush(struct lws_dbus_ctx *ctx)
+{
+	DBusMessage *batch[LWS_DBUS_BATCH_MAX];
+	int n, count = ctx->batch_count;
+
+	if (!count)
+		return;
+
+	/* the handler may cause more dispatch, so take the batch first */
+
+	memcpy(batch, ctx->batch, (unsigned int)count * sizeof(batch[0]));
+	ctx->batch_count = 0;
+
+	if (ctx->cb_batch)
+		ctx->cb_batch(ctx, batch, count);
+
+	for (n = 0; n < count; n++)
+		dbus_message_unref(batch[n]);
+}
+
+/*
+ * Drop any refs still held in the batch without delivering them, for when the
+ * ctx is being set up again
+ */
+
+static void
+lws_dbus_batch_release(struct lws_dbus_ctx *ctx)
+{
+	int n;
+
+	for (n = 0; n < ctx->batch_count; n++)
+		dbus_message_unref(ctx->batch[n]);
+
+	ctx->batch_count = 0;
+}
+
 static int
 check_destroy_shadow_wsi(struct lws_dbus_ctx *ctx, struct lws *wsi)
 {
@@ -209,6 +250,9 @@ check_destroy_shadow_wsi(struct lws_dbus_ctx *ctx, struct lws *wsi)
 						     DBUS_DISPATCH_DATA_REMAINS)
 		return 0;
 
+	/* the user code won't hear about these after it closes the ctx */
+	lws_dbus_batch_flush(ctx);
+
 	if (ctx->cb_closing)
 		ctx->cb_closing(ctx);
 
@@ -248,7 +292,10 @@ lws_dbus_remove_watch(DBusWatch *w, void *data)
 	lwsl_info("%s: w %p, fd %d, data %p, clearing lws flags %d\n",
 		  __func__, w, dbus_watch_get_unix_fd(w), data, lws_flags);
 
-	__lws_change_pollfd(wsi, lws_flags, 0);
+	if (wsi == ctx->wsi_service)
+		ctx->watch_changed = 1;
+	else
+		__lws_change_pollfd(wsi, lws_flags, 0);
 
 bail:
 	lws_pt_unlock(pt);
@@ -343,6 +390,10 @@ lws_dbus_connection_setup(struct lws_dbus_ctx *ctx, DBusConnection *conn,
 	ctx->cb_closing = cb_closing;
 	ctx->hup = 0;
 	ctx->timeouts = 0;
+	lws_dbus_batch_release(ctx);
+	ctx->cb_batch = NULL;
+	ctx->wsi_service = NULL;
+	ctx->watch_changed = 0;
 	for (n = 0; n < (int)LWS_ARRAY_SIZE(ctx->w); n++)
 		ctx->w[n] = NULL;
 
@@ -384,6 +435,10 @@ lws_dbus_server_listen(struct lws_dbus_ctx *ctx, const char *ads, DBusError *e,
 	ctx->cb_closing = NULL;
 	ctx->hup = 0;
 	ctx->timeouts = 0;
+	lws_dbus_batch_release(ctx);
+	ctx->cb_batch = NULL;
+	ctx->wsi_service = NULL;
+	ctx->watch_changed = 0;
 
 	ctx->dbs = dbus_server_listen(ads, e);
 	if (!ctx->dbs)
@@ -419,6 +474,161 @@ bail:
 }
 
 
+static DBusHandlerResult
+lws_dbus_batch_filter(DBusConnection *c, DBusMessage *m, void *data)
+{
+	struct lws_dbus_ctx *ctx = (struct lws_dbus_ctx *)data;
+
+	if (!ctx->cb_batch ||
+	    dbus_message_is_signal(m, DBUS_INTERFACE_LOCAL, "Disconnected"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (ctx->batch_count == (int)LWS_ARRAY_SIZE(ctx->batch))
+		lws_dbus_batch_flush(ctx);
+
+	ctx->batch[ctx->batch_count++] = dbus_message_ref(m);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+int
+lws_dbus_set_batch_handler(struct lws_dbus_ctx *ctx, lws_dbus_batch_t cb)
+{
+	if (!ctx->conn)
+		return 1;
+
+	if (cb && !ctx->cb_batch &&
+	    !dbus_connection_add_filter(ctx->conn, lws_dbus_batch_filter,
+					ctx, NULL)) {
+		lwsl_err("%s: unable to add filter\n", __func__);
+
+		return 1;
+	}
+
+	if (!cb && ctx->cb_batch) {
+		lws_dbus_batch_flush(ctx);
+		dbus_connection_remove_filter(ctx->conn, lws_dbus_batch_filter,
+					      ctx);
+	}
+
+	ctx->cb_batch = cb;
+
+	return 0;
+}
+
+int
+lws_dbus_msg_payload(DBusMessage *m, const uint8_t **buf, size_t *len,
+		     int *binary)
+{
+	DBusMessageIter iter, sub;
+	const char *str;
+	int n;
+
+	if (!dbus_message_iter_init(m, &iter))
+		return 1;
+
+	switch (dbus_message_iter_get_arg_type(&iter)) {
+	case DBUS_TYPE_ARRAY:
+		if (dbus_message_iter_get_element_type(&iter) != DBUS_TYPE_BYTE)
+			return 1;
+		dbus_message_iter_recurse(&iter, &sub);
+		dbus_message_iter_get_fixed_array(&sub, buf, &n);
+		*len = (size_t)n;
+		*binary = 1;
+		break;
+
+	case DBUS_TYPE_STRING:
+		dbus_message_iter_get_basic(&iter, &str);
+		*buf = (const uint8_t *)str;
+		*len = strlen(str);
+		*binary = 0;
+		break;
+
+	default:
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+lws_dbus_msg_append_bytes(DBusMessage *m, const void *buf, size_t len)
+{
+	DBusMessageIter iter, sub;
+
+	dbus_message_iter_init_append(m, &iter);
+
+	if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					      DBUS_TYPE_BYTE_AS_STRING, &sub))
+		return 1;
+
+	if (!dbus_message_iter_append_fixed_array(&sub, DBUS_TYPE_BYTE, &buf,
+						  (int)len)) {
+		dbus_message_iter_abandon_container(&iter, &sub);
+
+		return 1;
+	}
+
+	return !dbus_message_iter_close_container(&iter, &sub);
+}
+
+/*
+ * After servicing, tell lws about the final watch state just once, instead of
+ * every time libdbus toggled the write watch while we dispatched
+ */
+
+static void
+lws_dbus_apply_watches(struct lws_dbus_ctx *ctx, struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &ctx->vh->context->pt[ctx->tsi];
+	unsigned int flags = 0;
+	int n, lws_flags = 0;
+
+	ctx->wsi_service = NULL;
+	if (!ctx->watch_changed)
+		return;
+	ctx->watch_changed = 0;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(ctx->w); n++)
+		if (ctx->w[n])
+			flags |= dbus_watch_get_flags(ctx->w[n]);
+
+	if (flags & DBUS_WATCH_READABLE)
+		lws_flags |= LWS_POLLIN;
+	if (flags & DBUS_WATCH_WRITABLE)
+		lws_flags |= LWS_POLLOUT;
+
+	lws_pt_lock(pt, __func__);
+	__lws_change_pollfd(wsi, (LWS_POLLIN | LWS_POLLOUT) & ~lws_flags,
+			    lws_flags);
+	lws_pt_unlock(pt);
+}
+
+/*
+ * Is there still a readable watch and more data waiting on its fd?
+ */
+
+static int
+lws_dbus_more_rx(struct lws_dbus_ctx *ctx, struct lws *wsi)
+{
+	struct lws_pollfd pfd;
+	int n;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(ctx->w); n++)
+		if (ctx->w[n] &&
+		    (dbus_watch_get_flags(ctx->w[n]) & DBUS_WATCH_READABLE))
+			break;
+
+	if (n == (int)LWS_ARRAY_SIZE(ctx->w))
+		return 0;
+
+	pfd.fd = wsi->desc.sockfd;
+	pfd.events = LWS_POLLIN;
+	pfd.revents = 0;
+
+	return poll(&pfd, 1, 0) == 1 && (pfd.revents & LWS_POLLIN);
+}
+
 /*
  * There shouldn't be a race here with watcher removal and poll wait, because
  * everything including the dbus activity is serialized in one event loop.
@@ -435,7 +645,7 @@ rops_handle_POLLIN_dbus(struct lws_context_per_thread *pt, struct lws *wsi,
 	struct lws_dbus_ctx *ctx =
 			(struct lws_dbus_ctx *)wsi->opaque_parent_data;
 	unsigned int flags = 0;
-	int n;
+	int n, reads = 0;
 
 	if (pollfd->revents & LWS_POLLIN)
 		flags |= DBUS_WATCH_READABLE;
@@ -450,17 +660,43 @@ rops_handle_POLLIN_dbus(struct lws_context_per_thread *pt, struct lws *wsi,
 	 * wsi.  wsi->opaque_parent_data is the watcher handle bound to the wsi
 	 */
 
-	for (n = 0; n < (int)LWS_ARRAY_SIZE(ctx->w); n++)
-		if (ctx->w[n] && !dbus_watch_handle(ctx->w[n], flags))
-			lwsl_err("%s: dbus_watch_handle failed\n", __func__);
+	ctx->wsi_service = wsi;
+
+	do {
+		for (n = 0; n < (int)LWS_ARRAY_SIZE(ctx->w); n++)
+			if (ctx->w[n] && !dbus_watch_handle(ctx->w[n], flags))
+				lwsl_err("%s: dbus_watch_handle failed\n",
+					 __func__);
+
+		if (!ctx->conn)
+			break;
 
-	if (ctx->conn) {
 		lwsl_info("%s: conn: flags %d\n", __func__, flags);
 
 		while (dbus_connection_get_dispatch_status(ctx->conn) ==
 						DBUS_DISPATCH_DATA_REMAINS)
 			dbus_connection_dispatch(ctx->conn);
 
+		/*
+		 * libdbus only reads a couple of KB each time, if more is
+		 * already waiting, take it now rather than on the next wakeup
+		 */
+
+		flags &= (unsigned int)~DBUS_WATCH_WRITABLE;
+
+	} while ((flags & DBUS_WATCH_READABLE) &&
+		 ++reads < LWS_DBUS_MAX_READS_PER_WAKEUP &&
+		 lws_dbus_more_rx(ctx, wsi));
+
+	lws_dbus_apply_watches(ctx, wsi);
+
+	/*
+	 * Deliver whatever was batched even if the connection went away while
+	 * we were dispatching, so the refs aren't left behind in the ctx
+	 */
+	lws_dbus_batch_flush(ctx);
+
+	if (ctx->conn) {
 		handle_dispatch_status(NULL, DBUS_DISPATCH_DATA_REMAINS, NULL);
 
 		check_destroy_shadow_wsi(ctx, wsi);
@@ -30,6 +30,14 @@ extern const struct lws_role_ops role_ops_dbus;
 
 #define lwsi_role_dbus(wsi) (wsi->role_ops == &role_ops_dbus)
 
+/*
+ * Upper limit on how many times we let libdbus read from the same fd in one
+ * wakeup before returning to the event loop
+ */
+#ifndef LWS_DBUS_MAX_READS_PER_WAKEUP
+#define LWS_DBUS_MAX_READS_PER_WAKEUP 16
+#endif
+
 struct lws_role_dbus_timer {
 	struct lws_dll2 timer_list;
 	void *data;
@@ -28,6 +28,8 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
+/* how many pipelined requests we will dispatch from one read */
+#define LWS_H1_PIPELINE_BATCH_MAX 16
 
 /*
  * We have to take care about parsing because the headers may be split
@@ -279,6 +281,11 @@ read_ok:
 	return lws_ptr_diff(buf, oldbuf);
 
 bail:
+#if defined(LWS_WITH_SERVER)
+	/* a response before a close should still go out */
+	lws_cork_end(wsi);
+#endif
+
 	/*
 	 * h2 / h2-ws calls us recursively in
 	 *
@@ -298,6 +305,42 @@ bail:
 	return -1;
 }
 #if defined(LWS_WITH_SERVER)
+
+/*
+ * The transaction completed and the client already pipelined more requests
+ * behind it.  Rather than wait for POLLOUT and then a buflist service pass
+ * per request, dispatch what's on the buflist now, until one doesn't complete
+ * synchronously.
+ */
+
+static int
+lws_h1_dispatch_pipelined(struct lws *wsi)
+{
+	struct lws_tokens ebuf;
+	int n, batch = 0;
+
+	while (lwsi_state(wsi) == LRS_DEFERRING_ACTION && wsi->http.ah &&
+	       !lws_has_buffered_out(wsi) && !lws_is_flowcontrolled(wsi) &&
+	       batch++ < LWS_H1_PIPELINE_BATCH_MAX) {
+
+		ebuf.len = (int)lws_buflist_next_segment_len(&wsi->buflist,
+							     &ebuf.token);
+		if (!ebuf.len)
+			break;
+
+		lwsi_set_state(wsi, LRS_ESTABLISHED);
+		n = lws_read_h1(wsi, ebuf.token, ebuf.len);
+		if (n < 0) /* we closed wsi */
+			return LWS_HPI_RET_WSI_ALREADY_DIED;
+
+		if (lws_buflist_aware_finished_consuming(wsi, &ebuf, n, 1,
+							 __func__))
+			return LWS_HPI_RET_PLEASE_CLOSE_ME;
+	}
+
+	return LWS_HPI_RET_HANDLED;
+}
+
 static int
 lws_h1_server_socket_service(struct lws *wsi, struct lws_pollfd *pollfd)
 {
@@ -414,7 +457,11 @@ lws_h1_server_socket_service(struct lws *wsi, struct lws_pollfd *pollfd)
 			n = lws_read_h2(wsi, ebuf.token, ebuf.len);
 		else
 #endif
+		{
+			if (lwsi_role_h1(wsi))
+				lws_cork_begin(wsi);
 			n = lws_read_h1(wsi, ebuf.token, ebuf.len);
+		}
 		if (n < 0) /* we closed wsi */
 			return LWS_HPI_RET_WSI_ALREADY_DIED;
 
@@ -424,6 +471,13 @@ lws_h1_server_socket_service(struct lws *wsi, struct lws_pollfd *pollfd)
 							 buffered, __func__))
 			return LWS_HPI_RET_PLEASE_CLOSE_ME;
 
+		n = lws_h1_dispatch_pipelined(wsi);
+		if (n != LWS_HPI_RET_HANDLED)
+			return n;
+
+		if (lws_cork_end(wsi))
+			return LWS_HPI_RET_PLEASE_CLOSE_ME;
+
 		/*
 		 * during the parsing our role changed to something non-http,
 		 * so the ah has no further meaning
@@ -480,20 +534,25 @@ try_pollout:
 		}
 	}
 
+	/*
+	 * Batched responses to pipelined requests may have left a partial
+	 * after the transactions already completed
+	 */
+
+	if (lwsi_state(wsi) != LRS_ISSUING_FILE && lws_has_buffered_out(wsi)) {
+		//lwsl_notice("%s: completing partial\n", __func__);
+		if (lws_issue_raw(wsi, NULL, 0) < 0) {
+			lwsl_info("%s signalling to close\n", __func__);
+			goto fail;
+		}
+		return LWS_HPI_RET_HANDLED;
+	}
+
 	if (!wsi->hdr_parsing_completed)
 		return LWS_HPI_RET_HANDLED;
 
 	if (lwsi_state(wsi) != LRS_ISSUING_FILE) {
 
-		if (lws_has_buffered_out(wsi)) {
-			//lwsl_notice("%s: completing partial\n", __func__);
-			if (lws_issue_raw(wsi, NULL, 0) < 0) {
-				lwsl_info("%s signalling to close\n", __func__);
-				goto fail;
-			}
-			return LWS_HPI_RET_HANDLED;
-		}
-
 		lws_stats_bump(pt, LWSSTATS_C_WRITEABLE_CB, 1);
 #if defined(LWS_WITH_STATS)
 		if (wsi->active_writable_req_us) {
@@ -507,14 +566,30 @@ try_pollout:
 		}
 #endif
 
+		/*
+		 * If the client already pipelined more requests, let what we
+		 * write now share a send with the next response's headers
+		 */
+		if (wsi->cork ||
+		    lws_buflist_next_segment_len(&wsi->buflist, NULL))
+			lws_cork_begin(wsi);
+
 		n = user_callback_handle_rxflow(wsi->protocol->callback, wsi,
 						LWS_CALLBACK_HTTP_WRITEABLE,
 						wsi->user_space, NULL, 0);
 		if (n < 0) {
 			lwsl_info("writeable_fail\n");
+			lws_cork_end(wsi);
 			goto fail;
 		}
 
+		n = lws_h1_dispatch_pipelined(wsi);
+		if (n != LWS_HPI_RET_HANDLED)
+			return n;
+
+		if (lws_cork_end(wsi))
+			goto fail;
+
 		return LWS_HPI_RET_HANDLED;
 	}
 
@@ -542,7 +617,7 @@ fail:
 }
 #endif
 
-static int
+LWS_ROPS_DIRECT int
 rops_handle_POLLIN_h1(struct lws_context_per_thread *pt, struct lws *wsi,
 		       struct lws_pollfd *pollfd)
 {
@@ -703,7 +778,7 @@ rops_handle_POLLIN_h1(struct lws_context_per_thread *pt, struct lws *wsi,
 	return LWS_HPI_RET_HANDLED;
 }
 
-static int
+LWS_ROPS_DIRECT int
 rops_handle_POLLOUT_h1(struct lws *wsi)
 {
 
@@ -766,7 +841,7 @@ rops_handle_POLLOUT_h1(struct lws *wsi)
 	return LWS_HP_RET_BAIL_OK;
 }
 
-static int
+LWS_ROPS_DIRECT int
 rops_write_role_protocol_h1(struct lws *wsi, unsigned char *buf, size_t len,
 			    enum lws_write_protocol *wp)
 {
@@ -1116,34 +1191,11 @@ rops_close_kill_connection_h1(struct lws *wsi, enum lws_close_status reason)
 	return 0;
 }
 
-int
-rops_pt_init_destroy_h1(struct lws_context *context,
-		    const struct lws_context_creation_info *info,
-		    struct lws_context_per_thread *pt, int destroy)
-{
-	/*
-	 * We only want to do this once... we will do it if no h2 support
-	 * otherwise let h2 ops do it.
-	 */
-#if !defined(LWS_ROLE_H2) && defined(LWS_WITH_SERVER)
-	if (!destroy) {
-
-		pt->sul_ah_lifecheck.cb = lws_sul_http_ah_lifecheck;
-
-		__lws_sul_insert(&pt->pt_sul_owner, &pt->sul_ah_lifecheck,
-				 30 * LWS_US_PER_SEC);
-	} else
-		lws_dll2_remove(&pt->sul_ah_lifecheck.list);
-#endif
-
-	return 0;
-}
-
 const struct lws_role_ops role_ops_h1 = {
 	/* role name */			"h1",
 	/* alpn id */			"http/1.1",
 	/* check_upgrades */		NULL,
-	/* pt_init_destroy */		rops_pt_init_destroy_h1,
+	/* pt_init_destroy */		NULL,
 	/* init_vhost */		NULL,
 	/* destroy_vhost */		NULL,
 	/* service_flag_pending */	NULL,
@@ -267,6 +267,9 @@ static int lws_frag_start(struct lws *wsi, int hdr_token_idx)
 
 		/* cookie continuations need a separator token of ';' */
 		if (hdr_token_idx == WSI_TOKEN_HTTP_COOKIE) {
+			if (ah->pos >= ah->data_length &&
+			    _lws_ah_grow(wsi->context, ah))
+				return 1;
 			ah->data[ah->pos++] = ';';
 			ah->frags[ah->nfrag].len++;
 		}
@@ -280,6 +283,9 @@ static int lws_frag_append(struct lws *wsi, unsigned char c)
 {
 	struct allocated_headers *ah = wsi->http.ah;
 
+	if (ah->pos >= ah->data_length && _lws_ah_grow(wsi->context, ah))
+		return 1;
+
 	ah->data[ah->pos++] = c;
 	ah->frags[ah->nfrag].len++;
 
@@ -341,9 +347,18 @@ static void lws_dump_header(struct lws *wsi, int hdr)
 /*
  * dynamic table
  *
- *  [ 0 ....   num_entries - 1]
+ * The table lives in one allocation: an index ring of num_entries
+ * struct hpack_dt_entry, followed by a byte ring of ring_size holding the
+ * entry values back to back.
+ *
+ *  entries: [ 0 ....   num_entries - 1]
+ *  ring:    [ 0 ....   ring_size - 1]
  *
- *  Starts filling at 0+
+ *  Both start filling at 0+ and wrap, dyn->pos is the next entry index to
+ *  write and dyn->ring_tail the next value byte.  Values may wrap across the
+ *  end of the byte ring.  Since insertion and eviction are both strictly in
+ *  order, evicting the oldest entry just returns its bytes from the head of
+ *  the byte ring.
  *
  *  #62 is *most recently entered*
  *
@@ -352,18 +367,201 @@ static void lws_dump_header(struct lws *wsi, int hdr)
  *  imagined implementation, and lws implementation is much more efficient
  *  (ignoring unknown headers and using the lws token index for the header
  *  name part).
+ *
+ *  We only store the values, and the peer counts the name and 32 bytes of
+ *  overhead on top of that for each entry, so a byte ring the size of the
+ *  negotiated SETTINGS_HEADER_TABLE_SIZE always holds at least everything the
+ *  peer may still refer to.
+ *
+ *  Nothing here knows about the wsi, so the same table can back either side
+ *  of the HPACK context.
  */
 
+static struct hpack_dt_entry *
+lws_hpack_dt_entry(struct hpack_dynamic_table *dyn, int n)
+{
+	/* n = 0 is the most recently inserted */
+
+	n = (dyn->pos - 1 - n) % dyn->num_entries;
+	if (n < 0)
+		n += dyn->num_entries;
+
+	return &dyn->entries[n];
+}
+
+static void
+lws_hpack_dt_copy_out(struct hpack_dynamic_table *dyn,
+		      const struct hpack_dt_entry *dte, char *dest)
+{
+	uint32_t first = dyn->ring_size - dte->value_ofs;
+
+	if (first > dte->value_len)
+		first = dte->value_len;
+
+	memcpy(dest, dyn->ring + dte->value_ofs, first);
+	memcpy(dest + first, dyn->ring, dte->value_len - first);
+}
+
+static void
+lws_hpack_dt_evict_oldest(struct hpack_dynamic_table *dyn)
+{
+	struct hpack_dt_entry *dte =
+			lws_hpack_dt_entry(dyn, dyn->used_entries - 1);
+
+	lwsl_header("evicting oldest, %d bytes\n", dte->value_len);
+
+	dyn->virtual_payload_usage -= dte->value_len + dte->hdr_len;
+	dyn->ring_used -= dte->value_len;
+	dyn->used_entries--;
+}
+
+static void
+lws_hpack_dt_destroy(struct hpack_dynamic_table *dyn)
+{
+	lws_free_set_NULL(dyn->entries);
+	dyn->ring = NULL;
+	dyn->ring_size = 0;
+	dyn->ring_used = 0;
+	dyn->ring_tail = 0;
+	dyn->virtual_payload_usage = 0;
+	dyn->pos = 0;
+	dyn->used_entries = 0;
+	dyn->num_entries = 0;
+}
+
+static int
+lws_hpack_dt_insert(struct hpack_dynamic_table *dyn, int hdr_len,
+		    int lws_hdr_index, const char *arg, int len)
+{
+	struct hpack_dt_entry *dte;
+	uint32_t first;
+
+	if (lws_hdr_index == LWS_HPACK_IGNORE_ENTRY)
+		/* we won't be asked for the value, don't keep it */
+		len = 0;
+
+	if (!dyn->num_entries || (uint32_t)len > dyn->ring_size) {
+		/*
+		 * It can't fit even in an empty table... the peer can't keep
+		 * it either, so it empties its table and adds nothing
+		 */
+		lwsl_info("%s: %d too big for table\n", __func__, len);
+		while (dyn->used_entries)
+			lws_hpack_dt_evict_oldest(dyn);
+
+		return 0;
+	}
+
+	if (dyn->used_entries == dyn->num_entries) {
+		if (dyn->virtual_payload_usage < dyn->virtual_payload_max)
+			lwsl_err("Dropping header content before limit!\n");
+		/* we have to drop the oldest to make space */
+		lws_hpack_dt_evict_oldest(dyn);
+	}
+
+	/*
+	 * evict guys to make room, allowing for some overage in the virtual
+	 * accounting.  The real bytes in the ring must always fit.
+	 */
+
+	while (dyn->used_entries &&
+	       (dyn->virtual_payload_usage + hdr_len + len >
+				dyn->virtual_payload_max + 1024 ||
+		dyn->ring_used + len > dyn->ring_size))
+		lws_hpack_dt_evict_oldest(dyn);
+
+	dte = &dyn->entries[dyn->pos];
+	dte->value_ofs = dyn->ring_tail;
+	dte->value_len = len;
+	dte->hdr_len = hdr_len;
+	dte->lws_hdr_idx = lws_hdr_index;
+
+	first = dyn->ring_size - dyn->ring_tail;
+	if (first > (uint32_t)len)
+		first = len;
+	memcpy(dyn->ring + dyn->ring_tail, arg, first);
+	memcpy(dyn->ring, arg + first, len - first);
+
+	dyn->ring_tail = (dyn->ring_tail + len) % dyn->ring_size;
+	dyn->ring_used += len;
+	dyn->virtual_payload_usage += hdr_len + len;
+	dyn->used_entries++;
+	dyn->pos = (dyn->pos + 1) % dyn->num_entries;
+
+	return 0;
+}
+
+/*
+ * Reallocate the table for a new virtual size limit, keeping as many of the
+ * newest entries as still fit.  The byte ring is compacted to start at 0.
+ */
+
+static int
+lws_hpack_dt_resize(struct hpack_dynamic_table *dyn, uint32_t virt_max,
+		    int num_entries)
+{
+	struct hpack_dt_entry *dte, *old;
+	uint32_t ring_used = 0;
+	char *ring;
+	int n, keep;
+
+	dte = lws_malloc(sizeof(*dte) * (num_entries + 1) + virt_max,
+			 "hpack dyn");
+	if (!dte)
+		return 1;
+	ring = (char *)&dte[num_entries + 1];
+
+	dyn->virtual_payload_max = virt_max;
+
+	while (dyn->used_entries &&
+	       (dyn->virtual_payload_usage > dyn->virtual_payload_max ||
+		dyn->ring_used > virt_max))
+		lws_hpack_dt_evict_oldest(dyn);
+
+	keep = dyn->used_entries;
+	if (keep > num_entries)
+		keep = num_entries;
+
+	/* copy the kept entries oldest first */
+
+	for (n = 0; n < keep; n++) {
+		old = lws_hpack_dt_entry(dyn, keep - 1 - n);
+		dte[n] = *old;
+		dte[n].value_ofs = ring_used;
+		lws_hpack_dt_copy_out(dyn, old, ring + ring_used);
+		ring_used += old->value_len;
+	}
+
+	/* anything we couldn't keep in the index drops out of the accounting */
+
+	while (dyn->used_entries > keep)
+		lws_hpack_dt_evict_oldest(dyn);
+
+	lws_free(dyn->entries);
+
+	dyn->entries = dte;
+	dyn->num_entries = num_entries;
+	dyn->used_entries = keep;
+	dyn->pos = num_entries ? keep % num_entries : 0;
+	dyn->ring = ring;
+	dyn->ring_size = virt_max;
+	dyn->ring_used = ring_used;
+	dyn->ring_tail = virt_max ? ring_used % virt_max : 0;
+
+	return 0;
+}
+
 /*
- * returns 0 if dynamic entry (arg and len are filled)
+ * returns 0 if dynamic entry (*pdte is set)
  * returns -1 if failure
  * returns nonzero token index if actually static token
  */
 static int
-lws_token_from_index(struct lws *wsi, int index, const char **arg, int *len,
-		     uint32_t *hdr_len)
+lws_token_from_index(struct lws *wsi, int index,
+		     const struct hpack_dt_entry **pdte, uint32_t *hdr_len)
 {
 	struct hpack_dynamic_table *dyn;
+	const struct hpack_dt_entry *dte;
 
 	if (index == LWS_HPACK_IGNORE_ENTRY)
 		return LWS_HPACK_IGNORE_ENTRY;
@@ -379,21 +577,12 @@ lws_token_from_index(struct lws *wsi, int index, const char **arg, int *len,
 		return -1;
 
 	if (index < (int)LWS_ARRAY_SIZE(static_token)) {
-		if (arg && index < (int)LWS_ARRAY_SIZE(http2_canned)) {
-			*arg = http2_canned[index];
-			*len = (int)strlen(http2_canned[index]);
-		}
 		if (hdr_len)
 			*hdr_len = static_hdr_len[index];
 
 		return static_token[index];
 	}
 
-	if (!dyn) {
-		lwsl_notice("no dynamic table\n");
-		return -1;
-	}
-
 	if (index >= (int)LWS_ARRAY_SIZE(static_token) + dyn->used_entries) {
 		lwsl_info("  %s: adjusted index %d >= %d\n", __func__, index,
 				(int)LWS_ARRAY_SIZE(static_token) + dyn->used_entries);
@@ -402,23 +591,18 @@ lws_token_from_index(struct lws *wsi, int index, const char **arg, int *len,
 		return -1;
 	}
 
-	index -= (int)LWS_ARRAY_SIZE(static_token);
-	index = (dyn->pos - 1 - index) % dyn->num_entries;
-	if (index < 0)
-		index += dyn->num_entries;
+	dte = lws_hpack_dt_entry(dyn, index - (int)LWS_ARRAY_SIZE(static_token));
 
 	lwsl_header("%s: dyn index %d, tok %d\n", __func__, index,
-		    dyn->entries[index].lws_hdr_idx);
+		    dte->lws_hdr_idx);
 
-	if (arg && len) {
-		*arg = dyn->entries[index].value;
-		*len = dyn->entries[index].value_len;
-	}
+	if (pdte)
+		*pdte = dte;
 
 	if (hdr_len)
-		*hdr_len = dyn->entries[index].hdr_len;
+		*hdr_len = dte->hdr_len;
 
-	return dyn->entries[index].lws_hdr_idx;
+	return dte->lws_hdr_idx;
 }
 
 static int
@@ -427,51 +611,35 @@ lws_h2_dynamic_table_dump(struct lws *wsi)
 #if 0
 	struct lws *nwsi = lws_get_network_wsi(wsi);
 	struct hpack_dynamic_table *dyn;
-	int n, m;
+	struct hpack_dt_entry *dte;
 	const char *p;
+	int n;
 
 	if (!nwsi->h2.h2n)
 		return 1;
 	dyn = &nwsi->h2.h2n->hpack_dyn_table;
 
 	lwsl_header("Dump dyn table for nwsi %p (%d / %d members, pos = %d, "
-		    "start index %d, virt used %d / %d)\n", nwsi,
+		    "start index %d, virt used %d / %d, ring %d / %d)\n", nwsi,
 		    dyn->used_entries, dyn->num_entries, dyn->pos,
 		    (uint32_t)LWS_ARRAY_SIZE(static_token),
-		    dyn->virtual_payload_usage, dyn->virtual_payload_max);
+		    dyn->virtual_payload_usage, dyn->virtual_payload_max,
+		    dyn->ring_used, dyn->ring_size);
 
 	for (n = 0; n < dyn->used_entries; n++) {
-		m = (dyn->pos - 1 - n) % dyn->num_entries;
-		if (m < 0)
-			m += dyn->num_entries;
-		if (dyn->entries[m].lws_hdr_idx != LWS_HPACK_IGNORE_ENTRY)
-			p = (const char *)lws_token_to_string(
-					dyn->entries[m].lws_hdr_idx);
+		dte = lws_hpack_dt_entry(dyn, n);
+		if (dte->lws_hdr_idx != LWS_HPACK_IGNORE_ENTRY)
+			p = (const char *)lws_token_to_string(dte->lws_hdr_idx);
 		else
 			p = "(ignored)";
-		lwsl_header("   %3d: tok %s: (len %d) val '%s'\n",
+		lwsl_header("   %3d: tok %s: (len %d) val len %d at %d\n",
 			    (int)(n + LWS_ARRAY_SIZE(static_token)), p,
-			    dyn->entries[m].hdr_len, dyn->entries[m].value ?
-			    dyn->entries[m].value : "null");
+			    dte->hdr_len, dte->value_len, dte->value_ofs);
 	}
 #endif
 	return 0;
 }
 
-static void
-lws_dynamic_free(struct hpack_dynamic_table *dyn, int idx)
-{
-	lwsl_header("freeing %d for reuse\n", idx);
-	dyn->virtual_payload_usage -=  dyn->entries[idx].value_len +
-				dyn->entries[idx].hdr_len;
-	lws_free_set_NULL(dyn->entries[idx].value);
-	dyn->entries[idx].value = NULL;
-	dyn->entries[idx].value_len = 0;
-	dyn->entries[idx].hdr_len = 0;
-	dyn->entries[idx].lws_hdr_idx = LWS_HPACK_IGNORE_ENTRY;
-	dyn->used_entries--;
-}
-
 /*
  * There are two address spaces, 1) internal ringbuffer and 2) HPACK indexes.
  *
@@ -491,7 +659,6 @@ lws_dynamic_token_insert(struct lws *wsi, int hdr_len,
 			 int lws_hdr_index, char *arg, int len)
 {
 	struct hpack_dynamic_table *dyn;
-	int new_index;
 
 	/* dynamic table only belongs to network wsi */
 	wsi = lws_get_network_wsi(wsi);
@@ -506,60 +673,12 @@ lws_dynamic_token_insert(struct lws *wsi, int hdr_len,
 	}
 	lws_h2_dynamic_table_dump(wsi);
 
-	new_index = (dyn->pos) % dyn->num_entries;
-	if (dyn->num_entries && dyn->used_entries == dyn->num_entries) {
-		if (dyn->virtual_payload_usage < dyn->virtual_payload_max)
-			lwsl_err("Dropping header content before limit!\n");
-		/* we have to drop the oldest to make space */
-		lws_dynamic_free(dyn, new_index);
-	}
-
-	/*
-	 * evict guys to make room, allowing for some overage.  We have to
-	 * take care about getting a single huge header, and evicting
-	 * everything
-	 */
-
-	while (dyn->virtual_payload_usage &&
-	       dyn->used_entries &&
-	       dyn->virtual_payload_usage + hdr_len + len >
-				dyn->virtual_payload_max + 1024) {
-		int n = (dyn->pos - dyn->used_entries) % dyn->num_entries;
-		if (n < 0)
-			n += dyn->num_entries;
-		lws_dynamic_free(dyn, n);
-	}
-
-	if (dyn->used_entries < dyn->num_entries)
-		dyn->used_entries++;
-
-	dyn->entries[new_index].value_len = 0;
-
-	if (lws_hdr_index != LWS_HPACK_IGNORE_ENTRY) {
-		if (dyn->entries[new_index].value)
-			lws_free_set_NULL(dyn->entries[new_index].value);
-		dyn->entries[new_index].value =
-				lws_malloc(len + 1, "hpack dyn");
-		if (!dyn->entries[new_index].value)
-			return 1;
-
-		memcpy(dyn->entries[new_index].value, arg, len);
-		dyn->entries[new_index].value[len] = '\0';
-		dyn->entries[new_index].value_len = len;
-	} else
-		dyn->entries[new_index].value = NULL;
-
-	dyn->entries[new_index].lws_hdr_idx = lws_hdr_index;
-	dyn->entries[new_index].hdr_len = hdr_len;
-
-	dyn->virtual_payload_usage += hdr_len + len;
+	if (lws_hpack_dt_insert(dyn, hdr_len, lws_hdr_index, arg, len))
+		return 1;
 
-	lwsl_info("%s: index %ld: lws_hdr_index 0x%x, hdr len %d, '%s' len %d\n",
+	lwsl_info("%s: index %ld: lws_hdr_index 0x%x, hdr len %d, len %d\n",
 		  __func__, (long)LWS_ARRAY_SIZE(static_token),
-		  lws_hdr_index, hdr_len, dyn->entries[new_index].value ?
-				 dyn->entries[new_index].value : "null", len);
-
-	dyn->pos = (dyn->pos + 1) % dyn->num_entries;
+		  lws_hdr_index, hdr_len, len);
 
 	lws_h2_dynamic_table_dump(wsi);
 
@@ -570,9 +689,7 @@ int
 lws_hpack_dynamic_size(struct lws *wsi, int size)
 {
 	struct hpack_dynamic_table *dyn;
-	struct hpack_dt_entry *dte;
 	struct lws *nwsi;
-	int min, n = 0, m;
 
 	/*
 	 * "size" here is coming from the http/2 SETTING
@@ -620,56 +737,12 @@ lws_hpack_dynamic_size(struct lws *wsi, int size)
 		size = nwsi->vhost->h2.set.s[H2SET_HEADER_TABLE_SIZE];
 	}
 
-	dyn->virtual_payload_max = size;
-
-	size = size / 8;
-	min = size;
-	if (min > dyn->used_entries)
-		min = dyn->used_entries;
-
-	if (size == dyn->num_entries)
+	if (dyn->entries && (uint32_t)size == dyn->virtual_payload_max)
 		return 0;
 
-	if (dyn->num_entries < min)
-		min = dyn->num_entries;
-
-	// lwsl_notice("dte requested size %d\n", size);
-
-	dte = lws_zalloc(sizeof(*dte) * (size + 1), "dynamic table entries");
-	if (!dte)
+	if (lws_hpack_dt_resize(dyn, (uint32_t)size, size / 8))
 		goto bail;
 
-	while (dyn->virtual_payload_usage && dyn->used_entries &&
-	       dyn->virtual_payload_usage > dyn->virtual_payload_max) {
-		n = (dyn->pos - dyn->used_entries) % dyn->num_entries;
-		if (n < 0)
-			n += dyn->num_entries;
-		lws_dynamic_free(dyn, n);
-	}
-
-	if (min > dyn->used_entries)
-		min = dyn->used_entries;
-
-	if (dyn->entries) {
-		for (n = 0; n < min; n++) {
-			m = (dyn->pos - dyn->used_entries + n) %
-						dyn->num_entries;
-			if (m < 0)
-				m += dyn->num_entries;
-			dte[n] = dyn->entries[m];
-		}
-
-		lws_free(dyn->entries);
-	}
-
-	dyn->entries = dte;
-	dyn->num_entries = size;
-	dyn->used_entries = min;
-	if (size)
-		dyn->pos = min % size;
-	else
-		dyn->pos = 0;
-
 	lws_h2_dynamic_table_dump(wsi);
 
 	return 0;
@@ -683,31 +756,20 @@ bail:
 void
 lws_hpack_destroy_dynamic_header(struct lws *wsi)
 {
-	struct hpack_dynamic_table *dyn;
-	int n;
-
 	if (!wsi->h2.h2n)
 		return;
 
-	dyn = &wsi->h2.h2n->hpack_dyn_table;
-
-	if (!dyn->entries)
-		return;
-
-	for (n = 0; n < dyn->num_entries; n++)
-		if (dyn->entries[n].value)
-			lws_free_set_NULL(dyn->entries[n].value);
-
-	lws_free_set_NULL(dyn->entries);
+	lws_hpack_dt_destroy(&wsi->h2.h2n->hpack_dyn_table);
 }
 
 static int
 lws_hpack_use_idx_hdr(struct lws *wsi, int idx, int known_token)
 {
-	const char *arg = NULL;
-	int len = 0;
+	const struct hpack_dt_entry *dte = NULL;
+	struct hpack_dynamic_table *dyn;
 	const char *p = NULL;
-	int tok = lws_token_from_index(wsi, idx, &arg, &len, NULL);
+	int tok = lws_token_from_index(wsi, idx, &dte, NULL);
+	uint32_t n, ofs;
 
 	if (tok == LWS_HPACK_IGNORE_ENTRY) {
 		lwsl_header("%s: lws_token says ignore, returning\n", __func__);
@@ -719,12 +781,12 @@ lws_hpack_use_idx_hdr(struct lws *wsi, int idx, int known_token)
 		return 1;
 	}
 
-	if (arg) {
+	if (dte) {
 		/* dynamic result */
 		if (known_token > 0)
 			tok = known_token;
-		lwsl_header("%s: dyn: idx %d '%s' tok %d\n", __func__, idx, arg,
-			   tok);
+		lwsl_header("%s: dyn: idx %d len %d tok %d\n", __func__, idx,
+			    dte->value_len, tok);
 	} else
 		lwsl_header("writing indexed hdr %d (tok %d '%s')\n", idx, tok,
 				lws_token_to_string(tok));
@@ -732,19 +794,26 @@ lws_hpack_use_idx_hdr(struct lws *wsi, int idx, int known_token)
 	if (tok == LWS_HPACK_IGNORE_ENTRY)
 		return 0;
 
-	if (arg)
-		p = arg;
-
 	if (idx < (int)LWS_ARRAY_SIZE(http2_canned))
 		p = http2_canned[idx];
 
 	if (lws_frag_start(wsi, tok))
 		return 1;
 
-	if (p)
-		while (*p && len--)
-			if (lws_frag_append(wsi, *p++))
+	if (dte) {
+		dyn = &lws_get_network_wsi(wsi)->h2.h2n->hpack_dyn_table;
+		ofs = dte->value_ofs;
+		for (n = 0; n < dte->value_len; n++) {
+			if (lws_frag_append(wsi, (unsigned char)dyn->ring[ofs]))
 				return 1;
+			if (++ofs == dyn->ring_size)
+				ofs = 0;
+		}
+	} else
+		if (p)
+			while (*p)
+				if (lws_frag_append(wsi, *p++))
+					return 1;
 
 	if (lws_frag_end(wsi))
 		return 1;
@@ -875,7 +944,7 @@ int lws_hpack_interpret(struct lws *wsi, unsigned char c)
 			}
 
 			m = lws_token_from_index(wsi, h2n->hdr_idx,
-						 NULL, NULL, NULL);
+						 NULL, NULL);
 			if (lws_hpack_handle_pseudo_rules(nwsi, wsi, m))
 				return 1;
 
@@ -1065,7 +1134,7 @@ pre_data:
 				h2n->hdr_idx = 1;
 		} else {
 			n = lws_token_from_index(wsi, h2n->hdr_idx, NULL,
-						 NULL, NULL);
+						 NULL);
 			lwsl_header("  lws_tok_from_idx(%u) says %d\n",
 				   (unsigned int)h2n->hdr_idx, n);
 		}
@@ -1274,7 +1343,7 @@ fin:
 		/* NEW indexed hdr with value */
 		case HPKT_INDEXED_HDR_6_VALUE_INCR:
 			/* header length is determined by known index */
-			m = lws_token_from_index(wsi, h2n->hdr_idx, NULL, NULL,
+			m = lws_token_from_index(wsi, h2n->hdr_idx, NULL,
 					&h2n->hpack_hdr_len);
 			goto add_it;
 		/* NEW literal hdr with value */
@@ -1332,7 +1401,7 @@ add_it:
 					m = -1;
 			} else
 				m = lws_token_from_index(wsi, h2n->hdr_idx,
-							 NULL, NULL, NULL);
+							 NULL, NULL);
 		}
 
 		if (m != -1 && m != LWS_HPACK_IGNORE_ENTRY)
@@ -1385,6 +1454,106 @@ lws_h2_num(int starting_bits, unsigned long num,
 	return 0;
 }
 
+/*
+ * Wsi-less encoders for prerendered header templates.  Since the result is
+ * reused for many responses, it's worth looking the name up in the static
+ * table once so only its index goes on the wire.
+ */
+
+int
+lws_hpack_render_indexed(int idx, const unsigned char *value, int length,
+			 unsigned char **p, unsigned char *end)
+{
+	if (end - *p < length + 8)
+		return 1;
+
+	/* literal hdr without indexing, indexed name */
+
+	*((*p)++) = 0 | lws_h2_num_start(4, idx);
+	if (lws_h2_num(4, idx, p, end))
+		return 1;
+
+	*((*p)++) = 0 | lws_h2_num_start(7, length); /* non-HUF */
+	if (lws_h2_num(7, length, p, end))
+		return 1;
+
+	memcpy(*p, value, length);
+	*p += length;
+
+	return 0;
+}
+
+int
+lws_hpack_render_header(const unsigned char *name, const unsigned char *value,
+			int length, unsigned char **p, unsigned char *end)
+{
+	const unsigned char *s;
+	int n, len;
+
+	len = (int)strlen((char *)name);
+	if (len && name[len - 1] == ':')
+		len--;
+
+	if (len == 17 &&
+	    !strncasecmp((const char *)name, "transfer-encoding", len))
+		return 0;
+
+	/* static table entries below 15 are pseudoheaders */
+
+	for (n = 15; n < (int)LWS_ARRAY_SIZE(static_token); n++) {
+		s = lws_token_to_string(static_token[n]);
+		if (s && !strncasecmp((const char *)s, (const char *)name, len) &&
+		    s[len] == ':' && !s[len + 1])
+			return lws_hpack_render_indexed(n, value, length, p, end);
+	}
+
+	if (end - *p < len + length + 8)
+		return 1;
+
+	*((*p)++) = 0; /* literal hdr, literal name,  */
+
+	*((*p)++) = 0 | lws_h2_num_start(7, len); /* non-HUF */
+	if (lws_h2_num(7, len, p, end))
+		return 1;
+
+	while (len--)
+		*((*p)++) = tolower((int)*name++);
+
+	*((*p)++) = 0 | lws_h2_num_start(7, length); /* non-HUF */
+	if (lws_h2_num(7, length, p, end))
+		return 1;
+
+	memcpy(*p, value, length);
+	*p += length;
+
+	return 0;
+}
+
+int
+lws_hpack_render_status(unsigned int code, unsigned char **p,
+			unsigned char *end)
+{
+	static const uint16_t canned[] = { 200, 204, 206, 304, 400, 404, 500 };
+	unsigned char status[10];
+	int n;
+
+	if (end - *p < 1)
+		return 1;
+
+	/* static table 8 .. 14 are :status with these values */
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(canned); n++)
+		if (canned[n] == code) {
+			*((*p)++) = 0x80 | (8 + n);
+
+			return 0;
+		}
+
+	n = lws_snprintf((char *)status, sizeof(status), "%u", code);
+
+	return lws_hpack_render_indexed(8, status, n, p, end);
+}
+
 int lws_add_http2_header_by_name(struct lws *wsi, const unsigned char *name,
 				 const unsigned char *value, int length,
 				 unsigned char **p, unsigned char *end)
@@ -150,6 +150,15 @@ lws_h2_state(struct lws *wsi, enum lws_h2_states s)
 	wsi->h2.h2_state = (uint8_t)s;
 }
 
+/* odd sids are opened by the peer, even ones are our pushes */
+
+static int
+lws_h2_sid_was_opened(struct lws_h2_netconn *h2n, uint32_t sid)
+{
+	return sid <= h2n->highest_sid_opened ||
+	       (!(sid & 1) && sid <= h2n->highest_push_sid);
+}
+
 int
 lws_h2_update_peer_txcredit(struct lws *wsi, int sid, int bump)
 {
@@ -210,46 +219,20 @@ lws_h2_update_peer_txcredit_thresh(struct lws *wsi, int sid, int threshold, int
 	return lws_h2_update_peer_txcredit(wsi, sid, bump);
 }
 
-struct lws *
-lws_wsi_server_new(struct lws_vhost *vh, struct lws *parent_wsi,
-			    unsigned int sid)
+static struct lws *
+lws_wsi_h2_stream_new(struct lws_vhost *vh, struct lws *parent_wsi,
+		      unsigned int sid)
 {
-	struct lws *wsi;
 	struct lws *nwsi = lws_get_network_wsi(parent_wsi);
-	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
-
-	/*
-	 * The identifier of a newly established stream MUST be numerically
-   	 * greater than all streams that the initiating endpoint has opened or
-   	 * reserved.  This governs streams that are opened using a HEADERS frame
-   	 * and streams that are reserved using PUSH_PROMISE.  An endpoint that
-   	 * receives an unexpected stream identifier MUST respond with a
-   	 * connection error (Section 5.4.1) of type PROTOCOL_ERROR.
-	 */
-	if (sid <= h2n->highest_sid_opened) {
-		lwsl_info("%s: tried to open lower sid %d (%d)\n", __func__,
-				sid, (int)h2n->highest_sid_opened);
-		lws_h2_goaway(nwsi, H2_ERR_PROTOCOL_ERROR, "Bad sid");
-		return NULL;
-	}
+	struct lws *wsi;
 
-	/* no more children allowed by parent */
-	if (parent_wsi->mux.child_count + 1 >
-	    parent_wsi->h2.h2n->our_set.s[H2SET_MAX_CONCURRENT_STREAMS]) {
-		lwsl_notice("reached concurrent stream limit\n");
-		return NULL;
-	}
 	wsi = lws_create_new_server_wsi(vh, parent_wsi->tsi);
 	if (!wsi) {
 		lwsl_notice("new server wsi failed (vh %p)\n", vh);
 		return NULL;
 	}
 
-	h2n->highest_sid_opened = sid;
-
 	lws_wsi_mux_insert(wsi, parent_wsi, sid);
-	if (sid >= h2n->highest_sid)
-		h2n->highest_sid = sid + 2;
 
 	wsi->mux_substream = 1;
 	wsi->seen_nonpseudoheader = 0;
@@ -297,17 +280,70 @@ bail1:
 }
 
 struct lws *
-lws_wsi_h2_adopt(struct lws *parent_wsi, struct lws *wsi)
+lws_wsi_server_new(struct lws_vhost *vh, struct lws *parent_wsi,
+			    unsigned int sid)
 {
+	struct lws *wsi;
 	struct lws *nwsi = lws_get_network_wsi(parent_wsi);
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+
+	/*
+	 * The identifier of a newly established stream MUST be numerically
+   	 * greater than all streams that the initiating endpoint has opened or
+   	 * reserved.  This governs streams that are opened using a HEADERS frame
+   	 * and streams that are reserved using PUSH_PROMISE.  An endpoint that
+   	 * receives an unexpected stream identifier MUST respond with a
+   	 * connection error (Section 5.4.1) of type PROTOCOL_ERROR.
+	 */
+	if (sid <= h2n->highest_sid_opened) {
+		lwsl_info("%s: tried to open lower sid %d (%d)\n", __func__,
+				sid, (int)h2n->highest_sid_opened);
+		lws_h2_goaway(nwsi, H2_ERR_PROTOCOL_ERROR, "Bad sid");
+		return NULL;
+	}
 
-	/* no more children allowed by parent */
-	if (parent_wsi->mux.child_count + 1 >
+	/* no more children allowed by parent (our pushes don't count) */
+	if (parent_wsi->mux.child_count - h2n->pushes_live + 1 >
 	    parent_wsi->h2.h2n->our_set.s[H2SET_MAX_CONCURRENT_STREAMS]) {
 		lwsl_notice("reached concurrent stream limit\n");
 		return NULL;
 	}
 
+	wsi = lws_wsi_h2_stream_new(vh, parent_wsi, sid);
+	if (!wsi)
+		return NULL;
+
+	h2n->highest_sid_opened = sid;
+	if (sid >= h2n->highest_sid)
+		h2n->highest_sid = sid + 2;
+
+	return wsi;
+}
+
+/*
+ * Streams we open as the client count against the peer's
+ * MAX_CONCURRENT_STREAMS, not ours... until its SETTINGS arrive that is the
+ * unlimited protocol default
+ */
+
+int
+lws_wsi_h2_client_stream_room(struct lws *nwsi)
+{
+	return nwsi->mux.child_count <
+			nwsi->h2.h2n->peer_set.s[H2SET_MAX_CONCURRENT_STREAMS];
+}
+
+struct lws *
+lws_wsi_h2_adopt(struct lws *parent_wsi, struct lws *wsi)
+{
+	struct lws *nwsi = lws_get_network_wsi(parent_wsi);
+
+	/* no more children allowed by peer */
+	if (!lws_wsi_h2_client_stream_room(nwsi)) {
+		lwsl_notice("reached concurrent stream limit\n");
+		return NULL;
+	}
+
 	/* sid is set just before issuing the headers, ensuring monoticity */
 
 	wsi->seen_nonpseudoheader = 0;
@@ -316,13 +352,8 @@ lws_wsi_h2_adopt(struct lws *parent_wsi, struct lws *wsi)
 #endif
 	wsi->h2.initialized = 1;
 
-	if (!wsi->mux.my_sid) {
-		wsi->mux.my_sid = nwsi->h2.h2n->highest_sid;
-		nwsi->h2.h2n->highest_sid += 2;
-	}
-
-	lwsl_info("%s: binding wsi %p to sid %d (next %d)\n", __func__,
-			wsi, (int)wsi->mux.my_sid, (int)nwsi->h2.h2n->highest_sid);
+	lwsl_info("%s: binding wsi %p (sid %d)\n", __func__, wsi,
+			(int)wsi->mux.my_sid);
 
 	lws_wsi_mux_insert(wsi, parent_wsi, wsi->mux.my_sid);
 
@@ -917,7 +948,8 @@ lws_h2_parse_frame_header(struct lws *wsi)
 	/* b31 is a reserved bit */
 	h2n->sid = h2n->sid & 0x7fffffff;
 
-	if (h2n->sid && !(h2n->sid & 1)) {
+	/* the peer may only refer to even sids we reserved with a push */
+	if (h2n->sid && !(h2n->sid & 1) && h2n->sid > h2n->highest_push_sid) {
 		lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR, "Even Stream ID");
 
 		return 0;
@@ -978,7 +1010,7 @@ lws_h2_parse_frame_header(struct lws *wsi)
 			}
 		}
 		/* if the sid is credible, treat as wsi for it closed */
-		if (h2n->sid > h2n->highest_sid_opened &&
+		if (!lws_h2_sid_was_opened(h2n, h2n->sid) &&
 		    h2n->type != LWS_H2_FRAME_TYPE_HEADERS &&
 		    h2n->type != LWS_H2_FRAME_TYPE_PRIORITY) {
 			/* if not credible, reject it */
@@ -1079,7 +1111,7 @@ lws_h2_parse_frame_header(struct lws *wsi)
 		if (!h2n->sid)
 			return 1;
 		if (!h2n->swsi) {
-			if (h2n->sid <= h2n->highest_sid_opened)
+			if (lws_h2_sid_was_opened(h2n, h2n->sid))
 				break;
 			lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
 				      "crazy sid on RST_STREAM");
@@ -1202,7 +1234,7 @@ lws_h2_parse_frame_header(struct lws *wsi)
 
 		if (!h2n->swsi) {
 			/* no more children allowed by parent */
-			if (wsi->mux.child_count + 1 >
+			if (wsi->mux.child_count - h2n->pushes_live + 1 >
 			    wsi->h2.h2n->our_set.s[H2SET_MAX_CONCURRENT_STREAMS]) {
 				lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
 				"Another stream not allowed");
@@ -1738,7 +1770,7 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 			eff_wsi = h2n->swsi;
 
 		if (!eff_wsi) {
-			if (h2n->sid > h2n->highest_sid_opened)
+			if (!lws_h2_sid_was_opened(h2n, h2n->sid))
 				lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
 					      "alien sid");
 			break; /* ignore */
@@ -2090,9 +2122,8 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t inlen,
 						pt = &wsi->context->pt[(int)wsi->tsi];
 						lwsl_debug("%s: added %p to rxflow list\n",
 							   __func__, wsi);
-						lws_dll2_add_head(
-							&h2n->swsi->dll_buflist,
-							&pt->dll_buflist_owner);
+						__lws_add_wsi_to_buflist_list(pt,
+								h2n->swsi);
 					}
 					in += n - 1;
 					h2n->inside += n;
@@ -2325,14 +2356,19 @@ lws_h2_client_handshake(struct lws *wsi)
 	 * receives an unexpected stream identifier MUST respond with a
 	 * connection error (Section 5.4.1) of type PROTOCOL_ERROR.
 	 */
-	int sid = nwsi->h2.h2n->highest_sid_opened + 2;
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
 
 	lwsl_debug("%s\n", __func__);
 
-	nwsi->h2.h2n->highest_sid_opened = sid;
-	if (!wsi->mux.my_sid)
-		wsi->mux.my_sid = sid;
-	else {
+	/*
+	 * Streams adopted together send their headers in whatever order their
+	 * POLLOUT comes, so the sid is only taken now, when it goes on the wire
+	 */
+	if (!wsi->mux.my_sid) {
+		wsi->mux.my_sid = h2n->highest_sid;
+		h2n->highest_sid += 2;
+		h2n->highest_sid_opened = wsi->mux.my_sid;
+	} else {
 		lwsl_debug("%s: %p already sid %d\n",
 				__func__, wsi, (int)wsi->mux.my_sid);
 		//assert(0);
@@ -2635,3 +2671,210 @@ lws_h2_client_stream_long_poll_rxonly(struct lws *wsi)
 
 	return 0;
 }
+
+#if defined(LWS_WITH_SERVER)
+
+/*
+ * Each connection keeps a small bloom filter of the urls the peer has had
+ * from us already, whether it asked for them or we pushed them.  A false
+ * positive just costs a push the peer will then ask for itself.
+ */
+
+static uint32_t
+lws_h2_push_digest_hash(const char *url)
+{
+	uint32_t h = 0x811c9dc5; /* fnv-1a */
+
+	while (*url)
+		h = (h ^ (uint8_t)*url++) * 0x01000193;
+
+	return h;
+}
+
+static int
+lws_h2_push_digest_test(struct lws_h2_netconn *h2n, const char *url)
+{
+	uint32_t h = lws_h2_push_digest_hash(url);
+
+	return (h2n->push_digest[(h >> 5) & 7] & (1u << (h & 31))) &&
+	       (h2n->push_digest[(h >> 13) & 7] & (1u << ((h >> 8) & 31)));
+}
+
+static void
+lws_h2_push_digest_add(struct lws_h2_netconn *h2n, const char *url)
+{
+	uint32_t h = lws_h2_push_digest_hash(url);
+
+	h2n->push_digest[(h >> 5) & 7] |= 1u << (h & 31);
+	h2n->push_digest[(h >> 13) & 7] |= 1u << ((h >> 8) & 31);
+}
+
+/*
+ * Reserve a stream for url with a PUSH_PROMISE on wsi's stream, and set the
+ * new stream up as if the peer had sent us a GET for it.  The request is
+ * then served by the usual deferred http action when the stream is writable.
+ *
+ * We are called from wsi's own deferred http action in the POLLOUT handler,
+ * once its target file has been opened, so there's no partial pending on the
+ * network connection and the promise goes out ahead of wsi's response headers.
+ *
+ * The promised request must carry an authority we serve (RFC9113 8.4), so we
+ * reuse the one the peer's request came with; without one, we don't push.
+ */
+
+static int
+lws_h2_push_one(struct lws *wsi, const char *url)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi), *pw;
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	uint8_t buf[LWS_PRE + 384], *start = buf + LWS_PRE, *p = start,
+		*end = buf + sizeof(buf) - 1;
+	const char *scheme = lws_is_ssl(nwsi) ? "https" : "http";
+	char auth[128];
+	int n;
+
+	/* the peer's MAX_CONCURRENT_STREAMS governs streams we initiate */
+	if (h2n->pushes_live >= h2n->peer_set.s[H2SET_MAX_CONCURRENT_STREAMS])
+		return 1;
+
+	n = lws_hdr_copy(wsi, auth, sizeof(auth),
+			 WSI_TOKEN_HTTP_COLON_AUTHORITY);
+	if (n <= 0)
+		n = lws_hdr_copy(wsi, auth, sizeof(auth), WSI_TOKEN_HOST);
+	if (n <= 0)
+		return 1;
+
+	pw = lws_wsi_h2_stream_new(wsi->vhost, nwsi, h2n->highest_push_sid + 2);
+	if (!pw)
+		return 1;
+
+	h2n->pushes_live++;
+	pw->h2.pushed = 1;
+	pw->h2.initialized = 1;
+	pw->h2.END_STREAM = 1;
+	pw->h2.END_HEADERS = 1;
+	pw->hdr_parsing_completed = 1;
+
+	if (lws_header_table_attach(pw, 0))
+		goto bail;
+
+	if (lws_hdr_simple_create(pw, WSI_TOKEN_HTTP_COLON_METHOD, "GET") ||
+	    lws_hdr_simple_create(pw, WSI_TOKEN_HTTP_COLON_SCHEME, scheme) ||
+	    lws_hdr_simple_create(pw, WSI_TOKEN_HTTP_COLON_AUTHORITY, auth) ||
+	    lws_hdr_simple_create(pw, WSI_TOKEN_HTTP_COLON_PATH, url))
+		goto bail;
+
+	/* make it look like an h1 GET in the ah, as for a received request */
+	pw->http.ah->frag_index[WSI_TOKEN_GET_URI] =
+			pw->http.ah->frag_index[WSI_TOKEN_HTTP_COLON_PATH];
+
+	/* the promise is the promised sid followed by the request headers */
+
+	*p++ = (uint8_t)(pw->mux.my_sid >> 24);
+	*p++ = (uint8_t)(pw->mux.my_sid >> 16);
+	*p++ = (uint8_t)(pw->mux.my_sid >> 8);
+	*p++ = (uint8_t)pw->mux.my_sid;
+
+	if (lws_add_http2_header_by_token(wsi, WSI_TOKEN_HTTP_COLON_METHOD,
+					  (unsigned char *)"GET", 3, &p, end) ||
+	    lws_add_http2_header_by_token(wsi, WSI_TOKEN_HTTP_COLON_SCHEME,
+					  (unsigned char *)scheme,
+					  (int)strlen(scheme), &p, end) ||
+	    lws_add_http2_header_by_token(wsi, WSI_TOKEN_HTTP_COLON_AUTHORITY,
+					  (unsigned char *)auth, n, &p, end) ||
+	    lws_add_http2_header_by_token(wsi, WSI_TOKEN_HTTP_COLON_PATH,
+					  (unsigned char *)url,
+					  (int)strlen(url), &p, end))
+		goto bail;
+
+	n = lws_ptr_diff(p, start);
+	if (lws_h2_frame_write(wsi, LWS_H2_FRAME_TYPE_PUSH_PROMISE,
+			       LWS_H2_FLAG_END_HEADERS, wsi->mux.my_sid,
+			       (unsigned int)n, start) != n)
+		goto bail;
+
+	/* only now does the peer know about the sid */
+	h2n->highest_push_sid = pw->mux.my_sid;
+	lws_h2_state(pw, LWS_H2_STATE_RESERVED_LOCAL);
+
+	lwsl_info("%s: sid %d: pushing %s on sid %d\n", __func__,
+		  (int)wsi->mux.my_sid, url, (int)pw->mux.my_sid);
+
+	/* our HEADERS are the next thing on it, so go on to half-closed */
+	lws_h2_state(pw, LWS_H2_STATE_HALF_CLOSED_REMOTE);
+
+	lwsi_set_state(pw, LRS_DEFERRING_ACTION);
+	lws_callback_on_writable(pw);
+
+	return 0;
+
+bail:
+	/*
+	 * The peer never saw a PUSH_PROMISE for pw, so it must go quietly,
+	 * without any RST_STREAM, and its sid is free for the next push
+	 */
+	lws_h2_state(pw, LWS_H2_STATE_IDLE);
+	lws_close_free_wsi(pw, LWS_CLOSE_STATUS_NOSTATUS, "push failed");
+
+	return 1;
+}
+
+/*
+ * wsi's request for uri is being served from file target on mount hit.
+ * Push whatever the mount's push manifest lists for target that the peer
+ * doesn't already have from us on this connection.
+ */
+
+int
+lws_h2_push_manifest(struct lws *wsi, const struct lws_http_mount *hit,
+		     const char *target, const char *uri)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	const struct lws_protocol_vhost_options *pvo;
+	const char *p, *e;
+	char url[128];
+	size_t n;
+
+	lws_h2_push_digest_add(h2n, uri);
+
+	if (!hit->push || wsi->h2.pushed || h2n->we_told_goaway ||
+	    !h2n->peer_set.s[H2SET_ENABLE_PUSH] ||
+	    /* the peer is revalidating a cached copy, so has the assets too */
+	    lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_IF_NONE_MATCH) ||
+	    lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_IF_MODIFIED_SINCE))
+		return 0;
+
+	for (pvo = hit->push; pvo; pvo = pvo->next) {
+		if (strcmp(pvo->name, target))
+			continue;
+
+		for (p = pvo->value; *p; p = e) {
+			while (*p == ',' || *p == ' ')
+				p++;
+			e = p;
+			while (*e && *e != ',' && *e != ' ')
+				e++;
+
+			n = (size_t)lws_ptr_diff(e, p);
+			if (!n || n >= sizeof(url) || *p != '/')
+				continue;
+
+			memcpy(url, p, n);
+			url[n] = '\0';
+
+			if (lws_h2_push_digest_test(h2n, url))
+				continue;
+
+			if (lws_h2_push_one(wsi, url))
+				/* out of streams or ah, the peer can ask */
+				return 0;
+
+			lws_h2_push_digest_add(h2n, url);
+		}
+	}
+
+	return 0;
+}
+
+#endif
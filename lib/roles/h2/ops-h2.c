@@ -93,7 +93,7 @@ const struct http2_settings lws_h2_stock_settings = { {
  * The wsi at this level is the network wsi
  */
 
-static int
+LWS_ROPS_DIRECT int
 rops_handle_POLLIN_h2(struct lws_context_per_thread *pt, struct lws *wsi,
 		       struct lws_pollfd *pollfd)
 {
@@ -295,9 +295,7 @@ drain:
 				if (m) {
 					lwsl_debug("%s: added %p to rxflow list\n",
 							__func__, wsi);
-					if (lws_dll2_is_detached(&wsi->dll_buflist))
-						lws_dll2_add_head(&wsi->dll_buflist,
-							 &pt->dll_buflist_owner);
+					__lws_add_wsi_to_buflist_list(pt, wsi);
 				}
 			}
 	}
@@ -375,7 +373,7 @@ int rops_handle_POLLOUT_h2(struct lws *wsi)
 	return LWS_HP_RET_USER_SERVICE;
 }
 
-static int
+LWS_ROPS_DIRECT int
 rops_write_role_protocol_h2(struct lws *wsi, unsigned char *buf, size_t len,
 			    enum lws_write_protocol *wp)
 {
@@ -551,21 +549,6 @@ rops_pt_init_destroy_h2(struct lws_context *context,
 {
 	context->set = lws_h2_stock_settings;
 
-	/*
-	 * We only want to do this once... we will do it if we are built
-	 * otherwise h1 ops will do it (or nobody if no http at all)
-	 */
-#if !defined(LWS_ROLE_H2) && defined(LWS_WITH_SERVER)
-	if (!destroy) {
-
-		pt->sul_ah_lifecheck.cb = lws_sul_http_ah_lifecheck;
-
-		__lws_sul_insert(&pt->pt_sul_owner, &pt->sul_ah_lifecheck,
-				 30 * LWS_US_PER_SEC);
-	} else
-		lws_dll2_remove(&pt->sul_ah_lifecheck.list);
-#endif
-
 	return 0;
 }
 
@@ -702,9 +685,26 @@ rops_close_kill_connection_h2(struct lws *wsi, enum lws_close_status reason)
 #endif
 			wsi->mux_substream) &&
 	     wsi->mux.parent_wsi) {
+		struct lws *nwsi = wsi->mux.parent_wsi;
+
 		lws_wsi_mux_sibling_disconnect(wsi);
 		if (wsi->h2.pending_status_body)
 			lws_free_set_NULL(wsi->h2.pending_status_body);
+
+		if (wsi->h2.pushed && nwsi->h2.h2n)
+			nwsi->h2.h2n->pushes_live--;
+
+#if defined(LWS_WITH_CLIENT)
+		/*
+		 * A client stream closing by itself (not because the
+		 * connection is going down) frees up room under the peer's
+		 * MAX_CONCURRENT_STREAMS for anyone queued on the connection
+		 */
+		if (wsi->client_mux_substream &&
+		    !wsi->socket_is_permanently_unusable &&
+		    nwsi->dll2_cli_txn_queue_owner.count)
+			lws_wsi_mux_apply_queue(nwsi);
+#endif
 	}
 
 	return 0;
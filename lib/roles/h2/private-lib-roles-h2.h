@@ -179,14 +179,18 @@ enum http2_hpack_type {
 
 
 struct hpack_dt_entry {
-	char *value; /* malloc'd */
+	uint32_t value_ofs; /* start of value in the byte ring, may wrap */
 	uint16_t value_len;
 	uint16_t hdr_len; /* virtual, for accounting */
 	uint16_t lws_hdr_idx; /* LWS_HPACK_IGNORE_ENTRY = IGNORE */
 };
 
 struct hpack_dynamic_table {
-	struct hpack_dt_entry *entries; /* malloc'd */
+	struct hpack_dt_entry *entries; /* malloc'd, together with ring */
+	char *ring; /* entry values, follows entries[] in the same alloc */
+	uint32_t ring_size;
+	uint32_t ring_used;
+	uint32_t ring_tail;
 	uint32_t virtual_payload_usage;
 	uint32_t virtual_payload_max;
 	uint16_t pos;
@@ -283,6 +287,8 @@ struct lws_h2_netconn {
 	uint32_t inside;
 	uint32_t highest_sid;
 	uint32_t highest_sid_opened;
+	uint32_t highest_push_sid;
+	uint32_t push_digest[8]; /* bloom of urls the peer has from us */
 	uint32_t cont_exp_sid;
 	uint32_t dep;
 	uint32_t goaway_last_sid;
@@ -290,6 +296,7 @@ struct lws_h2_netconn {
 	uint32_t hpack_hdr_len;
 
 	uint16_t hpack_pos;
+	uint16_t pushes_live;
 
 	uint8_t frame_state;
 	uint8_t type;
@@ -315,6 +322,7 @@ struct _lws_h2_related {
 	uint8_t			send_END_STREAM:1;
 	uint8_t			long_poll:1;
 	uint8_t			initialized:1;
+	uint8_t			pushed:1;
 };
 
 #define HTTP2_IS_TOPLEVEL_WSI(wsi) (!wsi->mux.parent_wsi)
@@ -352,6 +360,15 @@ LWS_EXTERN int
 lws_add_http2_header_status(struct lws *wsi,
 			    unsigned int code, unsigned char **p,
 			    unsigned char *end);
+LWS_EXTERN int
+lws_hpack_render_indexed(int idx, const unsigned char *value, int length,
+			 unsigned char **p, unsigned char *end);
+LWS_EXTERN int
+lws_hpack_render_header(const unsigned char *name, const unsigned char *value,
+			int length, unsigned char **p, unsigned char *end);
+LWS_EXTERN int
+lws_hpack_render_status(unsigned int code, unsigned char **p,
+			unsigned char *end);
 LWS_EXTERN void
 lws_hpack_destroy_dynamic_header(struct lws *wsi);
 LWS_EXTERN int
@@ -376,6 +393,11 @@ lws_h2_client_handshake(struct lws *wsi);
 LWS_EXTERN struct lws *
 lws_wsi_h2_adopt(struct lws *parent_wsi, struct lws *wsi);
 int
+lws_wsi_h2_client_stream_room(struct lws *nwsi);
+int
+lws_h2_push_manifest(struct lws *wsi, const struct lws_http_mount *hit,
+		     const char *target, const char *uri);
+int
 lws_handle_POLLOUT_event_h2(struct lws *wsi);
 int
 lws_read_h2(struct lws *wsi, unsigned char *buf, lws_filepos_t len);
@@ -512,6 +512,33 @@ lws_client_connect_3_connect(struct lws *wsi, const char *ads,
 		goto oom4;
 	}
 
+#if defined(LWS_WITH_HTTP2) && defined(LWS_WITH_TLS)
+	/*
+	 * Now we know where we would connect to, an h2 connection we already
+	 * have to the same place may be able to take us as a stream instead
+	 */
+
+	if (wsi->client_pipeline && lwsi_role_http(wsi) && wsi->protocol &&
+	    port == wsi->c_port && !lws_socket_is_valid(wsi->desc.sockfd)) {
+		struct lws *w;
+
+		switch (lws_vhost_active_conns_coalesce(wsi, &w)) {
+		case ACTIVE_CONNS_MUXED:
+			lws_addrinfo_clean(wsi);
+			if (wsi->protocol->callback(wsi,
+					LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP,
+					wsi->user_space, NULL, 0))
+				goto failed1;
+
+			return wsi;
+		case ACTIVE_CONNS_QUEUED:
+			lws_addrinfo_clean(wsi);
+
+			return lws_client_connect_4_established(wsi, w, 0);
+		}
+	}
+#endif
+
 	/*
 	 * Let's try connecting to each of the results in turn until one works
 	 * or we run out of results
@@ -880,6 +880,15 @@ lws_client_interpret_server_handshake(struct lws *wsi)
 		wsi->http.rx_content_remain =
 				wsi->http.rx_content_length;
 		wsi->http.content_length_given = 1;
+	} else if (n == HTTP_STATUS_NO_CONTENT ||
+		   n == HTTP_STATUS_NOT_MODIFIED) {
+		/*
+		 * These never have a body, so the transaction is complete at
+		 * the end of the headers and keepalive can carry on
+		 */
+		wsi->http.rx_content_length = 0;
+		wsi->http.rx_content_remain = 0;
+		wsi->http.content_length_given = 1;
 	} else { /* can't do 1.1 without a content length or chunked */
 		if (!wsi->chunked)
 			wsi->http.conn_type = HTTP_CONNECTION_CLOSE;
@@ -945,7 +954,7 @@ lws_client_interpret_server_handshake(struct lws *wsi)
 		 * content-length of zero?  If so, this transaction is already
 		 * completed at the end of the header processing...
 		 */
-		if (lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_CONTENT_LENGTH) &&
+		if (wsi->http.content_length_given &&
 		    !wsi->http.rx_content_length)
 		        return !!lws_http_transaction_completed_client(wsi);
 
@@ -1222,95 +1231,73 @@ lws_http_basic_auth_gen(const char *user, const char *pw, char *buf, size_t len)
 
 #endif
 
-int
-lws_http_client_read(struct lws *wsi, char **buf, int *len)
-{
-	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
-	struct lws_tokens eb;
-	int buffered, n, consumed = 0;
-
-	/*
-	 * If the caller provided a non-NULL *buf and nonzero *len, we should
-	 * use that as the buffer for the read action, limititing it to *len
-	 * (actual payload will be less if chunked headers inside).
-	 *
-	 * If it's NULL / 0 length, buflist_aware_read will use the pt_serv_buf
-	 */
-
-	eb.token = (unsigned char *)*buf;
-	eb.len = *len;
-
-	buffered = lws_buflist_aware_read(pt, wsi, &eb, 0, __func__);
-	*buf = (char *)eb.token; /* may be pointing to buflist or pt_serv_buf */
-	*len = 0;
-
-	/*
-	 * we're taking on responsibility for handling used / unused eb
-	 * when we leave, via lws_buflist_aware_finished_consuming()
-	 */
-
-//	lwsl_notice("%s: eb.len %d ENTRY chunk remaining %d\n", __func__, eb.len,
-//			wsi->chunk_remaining);
-
-	/* allow the source to signal he has data again next time */
-	if (lws_change_pollfd(wsi, 0, LWS_POLLIN))
-		return -1;
-
-	if (buffered < 0) {
-		lwsl_debug("%s: SSL capable error\n", __func__);
-		return -1;
-	}
-
-	if (eb.len <= 0)
-		return 0;
+/*
+ * Decode all the chunked encoding in buf that we can in one pass.  The chunk
+ * headers are parsed out, and the content of each chunk moved down in buf so
+ * it all ends up contiguous from the start, to be passed on in one go however
+ * many chunks it arrived in.
+ *
+ * *used is set to how much of buf was dealt with, and *clen to how much
+ * content is at the start of buf.  Returns -1 for a chunking error, 1 if the
+ * final chunk was seen, else 0.
+ */
 
-	*len = eb.len;
-	wsi->client_rx_avail = 0;
+static int
+lws_client_chunked_decode(struct lws *wsi, char *buf, int len, int *used,
+			  int *clen)
+{
+	char *r = buf, *w = buf, *end = buf + len;
+	int n, ret = 0;
+
+	while (r < end && !ret) {
+
+		if (wsi->chunk_parser == ELCP_CONTENT) {
+			/* the bulk of it: take as much of the chunk as here */
+			n = lws_ptr_diff(end, r);
+			if (n > wsi->chunk_remaining)
+				n = wsi->chunk_remaining;
+			if (w != r)
+				memmove(w, r, n);
+			w += n;
+			r += n;
+			wsi->chunk_remaining -= n;
+			if (!wsi->chunk_remaining)
+				wsi->chunk_parser = ELCP_POST_CR;
+			continue;
+		}
 
-	/*
-	 * server may insist on transfer-encoding: chunked,
-	 * so http client must deal with it
-	 */
-spin_chunks:
-	//lwsl_notice("%s: len %d SPIN chunk remaining %d\n", __func__, *len,
-	//		wsi->chunk_remaining);
-	while (wsi->chunked && (wsi->chunk_parser != ELCP_CONTENT) && *len) {
 		switch (wsi->chunk_parser) {
 		case ELCP_HEX:
-			if ((*buf)[0] == '\x0d') {
+			if (*r == '\x0d') {
 				wsi->chunk_parser = ELCP_CR;
 				break;
 			}
-			n = char_to_hex((*buf)[0]);
-			if (n < 0) {
+			n = char_to_hex(*r);
+			if (n < 0 || wsi->chunk_remaining > 0x7ffffff) {
 				lwsl_err("%s: chunking failure A\n", __func__);
 				return -1;
 			}
 			wsi->chunk_remaining <<= 4;
 			wsi->chunk_remaining |= n;
 			break;
+
 		case ELCP_CR:
-			if ((*buf)[0] != '\x0a') {
+			if (*r != '\x0a') {
 				lwsl_err("%s: chunking failure B\n", __func__);
 				return -1;
 			}
 			if (wsi->chunk_remaining) {
 				wsi->chunk_parser = ELCP_CONTENT;
-				//lwsl_notice("starting chunk size %d (block rem %d)\n",
-				//		wsi->chunk_remaining, *len);
 				break;
 			}
 
 			wsi->chunk_parser = ELCP_TRAILER_CR;
 			break;
 
-		case ELCP_CONTENT:
-			break;
-
 		case ELCP_POST_CR:
-			if ((*buf)[0] != '\x0d') {
+			if (*r != '\x0d') {
 				lwsl_err("%s: chunking failure C\n", __func__);
-				lwsl_hexdump_err(*buf, *len);
+				lwsl_hexdump_err(r, lws_ptr_diff(end, r));
 
 				return -1;
 			}
@@ -1319,7 +1306,7 @@ spin_chunks:
 			break;
 
 		case ELCP_POST_LF:
-			if ((*buf)[0] != '\x0a') {
+			if (*r != '\x0a') {
 				lwsl_err("%s: chunking failure D\n", __func__);
 
 				return -1;
@@ -1330,9 +1317,9 @@ spin_chunks:
 			break;
 
 		case ELCP_TRAILER_CR:
-			if ((*buf)[0] != '\x0d') {
+			if (*r != '\x0d') {
 				lwsl_err("%s: chunking failure F\n", __func__);
-				lwsl_hexdump_err(*buf, *len);
+				lwsl_hexdump_err(r, lws_ptr_diff(end, r));
 
 				return -1;
 			}
@@ -1341,42 +1328,33 @@ spin_chunks:
 			break;
 
 		case ELCP_TRAILER_LF:
-			if ((*buf)[0] != '\x0a') {
+			if (*r != '\x0a') {
 				lwsl_err("%s: chunking failure F\n", __func__);
-				lwsl_hexdump_err(*buf, *len);
+				lwsl_hexdump_err(r, lws_ptr_diff(end, r));
 
 				return -1;
 			}
 
-			(*buf)++;
-			(*len)--;
-			consumed++;
-
 			lwsl_info("final chunk\n");
-			goto completed;
+			ret = 1;
+			break;
 		}
-		(*buf)++;
-		(*len)--;
-		consumed++;
+		r++;
 	}
 
-	if (wsi->chunked && !wsi->chunk_remaining)
-		goto account_and_ret;
+	*used = lws_ptr_diff(r, buf);
+	*clen = lws_ptr_diff(w, buf);
 
-	if (wsi->http.rx_content_remain &&
-	    wsi->http.rx_content_remain < (unsigned int)*len)
-		n = (int)wsi->http.rx_content_remain;
-	else
-		n = *len;
-
-	if (wsi->chunked && wsi->chunk_remaining &&
-	    wsi->chunk_remaining < n)
-		n = wsi->chunk_remaining;
+	return ret;
+}
 
+static int
+lws_client_deliver_rx(struct lws *wsi, char *buf, int n)
+{
 #if defined(LWS_WITH_HTTP_PROXY) && defined(LWS_WITH_HUBBUB)
 	/* hubbub */
 	if (wsi->http.perform_rewrite)
-		lws_rewrite_parse(wsi->http.rw, (unsigned char *)*buf, n);
+		lws_rewrite_parse(wsi->http.rw, (unsigned char *)buf, n);
 	else
 #endif
 	{
@@ -1390,7 +1368,7 @@ spin_chunks:
 		  ) {
 			if (user_callback_handle_rxflow(wsi->protocol->callback,
 				wsi, LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ,
-				wsi->user_space, *buf, n)) {
+				wsi->user_space, buf, n)) {
 				lwsl_info("%s: RECEIVE_CLIENT_HTTP_READ returned -1\n",
 						__func__);
 
@@ -1400,26 +1378,88 @@ spin_chunks:
 			lwsl_notice("%s: swallowed read (%d)\n", __func__, n);
 	}
 
-	(*buf) += n;
-	*len -= n;
-	if (wsi->chunked && wsi->chunk_remaining)
-		wsi->chunk_remaining -= n;
+	return 0;
+}
 
-	//lwsl_notice("chunk_remaining <- %d, block remaining %d\n",
-	//		wsi->chunk_remaining, *len);
+int
+lws_http_client_read(struct lws *wsi, char **buf, int *len)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	int buffered, n, m = 0, consumed = 0;
+	struct lws_tokens eb;
+	char *p;
 
-	consumed += n;
-	//eb.token += n;
-	//eb.len -= n;
+	/*
+	 * If the caller provided a non-NULL *buf and nonzero *len, we should
+	 * use that as the buffer for the read action, limititing it to *len
+	 * (actual payload will be less if chunked headers inside).
+	 *
+	 * If it's NULL / 0 length, buflist_aware_read will use the pt_serv_buf
+	 */
+
+	eb.token = (unsigned char *)*buf;
+	eb.len = *len;
 
-	if (wsi->chunked && !wsi->chunk_remaining)
-		wsi->chunk_parser = ELCP_POST_CR;
+	buffered = lws_buflist_aware_read(pt, wsi, &eb, 0, __func__);
+	*buf = (char *)eb.token; /* may be pointing to buflist or pt_serv_buf */
+	*len = 0;
 
-	if (wsi->chunked && *len)
-		goto spin_chunks;
+	/*
+	 * we're taking on responsibility for handling used / unused eb
+	 * when we leave, via lws_buflist_aware_finished_consuming()
+	 */
+
+//	lwsl_notice("%s: eb.len %d ENTRY chunk remaining %d\n", __func__, eb.len,
+//			wsi->chunk_remaining);
+
+	/* allow the source to signal he has data again next time */
+	if (lws_change_pollfd(wsi, 0, LWS_POLLIN))
+		return -1;
+
+	if (buffered < 0) {
+		lwsl_debug("%s: SSL capable error\n", __func__);
+		return -1;
+	}
+
+	if (eb.len <= 0)
+		return 0;
+
+	*len = eb.len;
+	wsi->client_rx_avail = 0;
+
+	/*
+	 * server may insist on transfer-encoding: chunked,
+	 * so http client must deal with it
+	 */
+	if (wsi->chunked) {
+		m = lws_client_chunked_decode(wsi, *buf, *len, &consumed, &n);
+		if (m < 0)
+			return -1;
+		p = *buf;
+		*buf += consumed;
+		*len -= consumed;
+	} else {
+		if (wsi->http.rx_content_remain &&
+		    wsi->http.rx_content_remain < (unsigned int)*len)
+			n = (int)wsi->http.rx_content_remain;
+		else
+			n = *len;
+
+		p = *buf;
+		*buf += n;
+		*len -= n;
+		consumed = n;
+	}
+
+	if (n && lws_client_deliver_rx(wsi, p, n))
+		return -1;
+
+	if (wsi->chunked) {
+		if (m)
+			goto completed;
 
-	if (wsi->chunked)
 		goto account_and_ret;
+	}
 
 	/* if we know the content length, decrement the content remaining */
 	if (wsi->http.rx_content_length > 0)
@@ -35,18 +35,11 @@ lws_token_to_string(enum lws_token_indexes token)
 	return (unsigned char *)set[token];
 }
 
-int
-lws_add_http_header_by_name(struct lws *wsi, const unsigned char *name,
-			    const unsigned char *value, int length,
-			    unsigned char **p, unsigned char *end)
+static int
+lws_add_http1_header_by_name(const unsigned char *name,
+			     const unsigned char *value, int length,
+			     unsigned char **p, unsigned char *end)
 {
-#ifdef LWS_WITH_HTTP2
-	if (lwsi_role_h2(wsi) || lwsi_role_h2_ENCAPSULATION(wsi))
-		return lws_add_http2_header_by_name(wsi, name,
-						    value, length, p, end);
-#else
-	(void)wsi;
-#endif
 	if (name) {
 		while (*p < end && *name)
 			*((*p)++) = *name++;
@@ -65,6 +58,22 @@ lws_add_http_header_by_name(struct lws *wsi, const unsigned char *name,
 	return 0;
 }
 
+int
+lws_add_http_header_by_name(struct lws *wsi, const unsigned char *name,
+			    const unsigned char *value, int length,
+			    unsigned char **p, unsigned char *end)
+{
+#ifdef LWS_WITH_HTTP2
+	if (lwsi_role_h2(wsi) || lwsi_role_h2_ENCAPSULATION(wsi))
+		return lws_add_http2_header_by_name(wsi, name,
+						    value, length, p, end);
+#else
+	(void)wsi;
+#endif
+
+	return lws_add_http1_header_by_name(name, value, length, p, end);
+}
+
 int lws_finalize_http_header(struct lws *wsi, unsigned char **p,
 			     unsigned char *end)
 {
@@ -272,6 +281,29 @@ struct lws_protocol_vhost_options pvo_hsbph[] = {{
 		"form-action 'self';"
 }};
 
+static const char *
+lws_http_status_description(unsigned int code)
+{
+	const char *description = "";
+
+	if (code >= 400 && code < (400 + LWS_ARRAY_SIZE(err400)))
+		description = err400[code - 400];
+	if (code >= 500 && code < (500 + LWS_ARRAY_SIZE(err500)))
+		description = err500[code - 500];
+
+	if (code == 100)
+		description = "Continue";
+	if (code == 200)
+		description = "OK";
+	if (code == 304)
+		description = "Not Modified";
+	else
+		if (code >= 300 && code < 400)
+			description = "Redirect";
+
+	return description;
+}
+
 int
 lws_add_http_header_status(struct lws *wsi, unsigned int _code,
 			   unsigned char **p, unsigned char *end)
@@ -281,8 +313,8 @@ lws_add_http_header_status(struct lws *wsi, unsigned int _code,
 	};
 	const struct lws_protocol_vhost_options *headers;
 	unsigned int code = _code & LWSAHH_CODE_MASK;
-	const char *description = "", *p1;
 	unsigned char code_and_desc[60];
+	const char *p1;
 	int n;
 
 #ifdef LWS_WITH_ACCESS_LOG
@@ -297,21 +329,6 @@ lws_add_http_header_status(struct lws *wsi, unsigned int _code,
 	} else
 #endif
 	{
-		if (code >= 400 && code < (400 + LWS_ARRAY_SIZE(err400)))
-			description = err400[code - 400];
-		if (code >= 500 && code < (500 + LWS_ARRAY_SIZE(err500)))
-			description = err500[code - 500];
-
-		if (code == 100)
-			description = "Continue";
-		if (code == 200)
-			description = "OK";
-		if (code == 304)
-			description = "Not Modified";
-		else
-			if (code >= 300 && code < 400)
-				description = "Redirect";
-
 		if (wsi->http.request_version < LWS_ARRAY_SIZE(hver))
 			p1 = hver[wsi->http.request_version];
 		else
@@ -319,7 +336,7 @@ lws_add_http_header_status(struct lws *wsi, unsigned int _code,
 
 		n = lws_snprintf((char *)code_and_desc,
 				 sizeof(code_and_desc) - 1, "%s %u %s",
-				 p1, code, description);
+				 p1, code, lws_http_status_description(code));
 
 		if (lws_add_http_header_by_name(wsi, NULL, code_and_desc, n, p,
 						end))
@@ -376,6 +393,282 @@ lws_add_http_header_status(struct lws *wsi, unsigned int _code,
 	return 0;
 }
 
+/*
+ * Header templates: everything lws_add_http_header_status() and friends
+ * would add for a fixed header set, rendered once for h1 and once for h2
+ */
+
+#define LWS_HTT_MAX_RENDER 2048
+
+struct lws_htt_build {
+	unsigned char *p1, *end1;
+#if defined(LWS_WITH_HTTP2)
+	unsigned char *p2, *end2;
+#endif
+};
+
+static int
+lws_htt_add(struct lws_htt_build *b, const char *name, const char *value,
+	    int len)
+{
+	if (lws_add_http1_header_by_name((const unsigned char *)name,
+					 (const unsigned char *)value, len,
+					 &b->p1, b->end1))
+		return 1;
+
+#if defined(LWS_WITH_HTTP2)
+	if (lws_hpack_render_header((const unsigned char *)name,
+				    (const unsigned char *)value, len,
+				    &b->p2, b->end2))
+		return 1;
+#endif
+
+	return 0;
+}
+
+static int
+lws_htt_add_list(struct lws_htt_build *b,
+		 const struct lws_protocol_vhost_options *headers)
+{
+	while (headers) {
+		if (lws_htt_add(b, headers->name, headers->value,
+				(int)strlen(headers->value)))
+			return 1;
+
+		headers = headers->next;
+	}
+
+	return 0;
+}
+
+lws_http_hdr_template_t *
+lws_http_hdr_template_create(struct lws_vhost *vh, unsigned int _code,
+			     const char *content_type,
+			     const struct lws_protocol_vhost_options *headers,
+			     unsigned int flags)
+{
+	unsigned int code = _code & LWSAHH_CODE_MASK;
+	struct lws_context *context = vh->context;
+	lws_http_hdr_template_t *ht = NULL;
+	struct lws_htt_build b;
+	unsigned char *buf, *h1;
+#if defined(LWS_WITH_HTTP2)
+	unsigned char *h2;
+#endif
+	char line[60];
+	int n;
+
+	buf = lws_malloc(2 * LWS_HTT_MAX_RENDER, __func__);
+	if (!buf)
+		return NULL;
+
+	h1 = b.p1 = buf;
+	b.end1 = buf + LWS_HTT_MAX_RENDER;
+#if defined(LWS_WITH_HTTP2)
+	h2 = b.p2 = buf + LWS_HTT_MAX_RENDER;
+	b.end2 = h2 + LWS_HTT_MAX_RENDER;
+
+	if (lws_hpack_render_status(code, &b.p2, b.end2))
+		goto bail;
+#endif
+
+	/* apply patches the version to 1.0 if that's what the client spoke */
+
+	n = lws_snprintf(line, sizeof(line), "HTTP/1.1 %u %s", code,
+			 lws_http_status_description(code));
+	if (lws_add_http1_header_by_name(NULL, (unsigned char *)line, n,
+					 &b.p1, b.end1))
+		goto bail;
+
+	if (lws_htt_add_list(&b, vh->headers))
+		goto bail;
+
+	if ((vh->options &
+	     LWS_SERVER_OPTION_HTTP_HEADERS_SECURITY_BEST_PRACTICES_ENFORCE) &&
+	    lws_htt_add_list(&b, &pvo_hsbph[LWS_ARRAY_SIZE(pvo_hsbph) - 1]))
+		goto bail;
+
+	if (context->server_string && !(_code & LWSAHH_FLAG_NO_SERVER_NAME) &&
+	    lws_htt_add(&b, "server:", context->server_string,
+			context->server_string_len))
+		goto bail;
+
+	if ((vh->options & LWS_SERVER_OPTION_STS) &&
+	    lws_htt_add(&b, "strict-transport-security:",
+			"max-age=15768000 ; includeSubDomains", 36))
+		goto bail;
+
+	if (content_type &&
+	    lws_htt_add(&b, "content-type:", content_type,
+			(int)strlen(content_type)))
+		goto bail;
+
+	if (lws_htt_add_list(&b, headers))
+		goto bail;
+
+	ht = lws_malloc(sizeof(*ht) + (size_t)lws_ptr_diff(b.p1, h1)
+#if defined(LWS_WITH_HTTP2)
+			+ (size_t)lws_ptr_diff(b.p2, h2)
+#endif
+			, __func__);
+	if (!ht)
+		goto bail;
+
+	ht->code = (uint16_t)code;
+	ht->flags = (uint8_t)flags;
+	ht->h1_len = (uint16_t)lws_ptr_diff(b.p1, h1);
+	memcpy(&ht[1], h1, ht->h1_len);
+#if defined(LWS_WITH_HTTP2)
+	ht->h2_len = (uint16_t)lws_ptr_diff(b.p2, h2);
+	memcpy((unsigned char *)&ht[1] + ht->h1_len, h2, ht->h2_len);
+#else
+	ht->h2_len = 0;
+#endif
+
+	lws_free(buf);
+
+	return ht;
+
+bail:
+	lwsl_err("%s: headers too large\n", __func__);
+	lws_free(buf);
+
+	return NULL;
+}
+
+void
+lws_http_hdr_template_destroy(lws_http_hdr_template_t **pht)
+{
+	lws_free_set_NULL(*pht);
+}
+
+/*
+ * IMF-fixdate, eg, "Sun, 06 Nov 1994 08:49:37 GMT", rendered at most once a
+ * second per pt.  We do the civil date from the day count ourselves since
+ * gmtime() isn't threadsafe and strftime() names depend on the locale.
+ */
+
+static const char *
+lws_http_date_pt(struct lws_context_per_thread *pt)
+{
+	static const char * const wday[] = {
+		"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+	}, * const mon[] = {
+		"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+	};
+	time_t t = time(NULL);
+	long days, secs, era, doe, yoe, doy, mp, y, m, d;
+
+	if (pt->http.date[0] && t == pt->http.date_secs)
+		return pt->http.date;
+
+	days = (long)(t / 86400);
+	secs = (long)(t % 86400);
+
+	era = (days + 719468) / 146097;
+	doe = days + 719468 - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = yoe + era * 400 + (m <= 2);
+
+	lws_snprintf(pt->http.date, sizeof(pt->http.date),
+		     "%s, %02ld %s %04ld %02ld:%02ld:%02ld GMT",
+		     wday[(days + 4) % 7], d, mon[m - 1], y, secs / 3600,
+		     (secs / 60) % 60, secs % 60);
+	pt->http.date_secs = t;
+
+	return pt->http.date;
+}
+
+/* slots go out with the name as a static table index on h2 */
+
+static int
+lws_htt_slot(int h2, int idx, enum lws_token_indexes token,
+	     const char *value, int len, unsigned char **p, unsigned char *end)
+{
+#if defined(LWS_WITH_HTTP2)
+	if (h2)
+		return lws_hpack_render_indexed(idx,
+				(const unsigned char *)value, len, p, end);
+#endif
+
+	return lws_add_http1_header_by_name(lws_token_to_string(token),
+					    (const unsigned char *)value, len,
+					    p, end);
+}
+
+int
+lws_http_hdr_template_apply(struct lws *wsi, const lws_http_hdr_template_t *ht,
+			    lws_filepos_t content_len, unsigned char **p,
+			    unsigned char *end)
+{
+	const unsigned char *src = (const unsigned char *)&ht[1];
+	int h2 = 0, len = ht->h1_len;
+	char b[24];
+	int n;
+
+#if defined(LWS_WITH_HTTP2)
+	if (lwsi_role_h2(wsi) || lwsi_role_h2_ENCAPSULATION(wsi)) {
+		wsi->h2.send_END_STREAM = 0;
+		src += ht->h1_len;
+		len = ht->h2_len;
+		h2 = 1;
+	}
+#endif
+
+	if (lws_ptr_diff(end, *p) < len + 2) {
+		lwsl_err("%s: reached end of buffer\n", __func__);
+
+		return 1;
+	}
+
+	memcpy(*p, src, len);
+	if (!h2 && !wsi->http.request_version)
+		(*p)[7] = '0'; /* HTTP/1.1 -> HTTP/1.0 */
+	*p += len;
+
+#ifdef LWS_WITH_ACCESS_LOG
+	wsi->http.access_log.response = ht->code;
+#endif
+
+	if ((ht->flags & LWSHTT_FLAG_DATE) &&
+	    lws_htt_slot(h2, 33, WSI_TOKEN_HTTP_DATE,
+			 lws_http_date_pt(&wsi->context->pt[(int)wsi->tsi]),
+			 29, p, end))
+		return 1;
+
+	if (content_len != LWS_ILLEGAL_HTTP_CONTENT_LEN) {
+		n = lws_snprintf(b, sizeof(b), "%llu",
+				 (unsigned long long)content_len);
+		if (lws_htt_slot(h2, 28, WSI_TOKEN_HTTP_CONTENT_LENGTH, b, n,
+				 p, end))
+			return 1;
+
+		wsi->http.tx_content_length = content_len;
+		wsi->http.tx_content_remain = content_len;
+
+		return 0;
+	}
+
+	/* there was no length... it normally means CONNECTION_CLOSE */
+
+	if (wsi->mux_substream)
+		return 0;
+
+	if (lws_add_http1_header_by_name(
+			lws_token_to_string(WSI_TOKEN_CONNECTION),
+			(const unsigned char *)"close", 5, p, end))
+		return 1;
+
+	wsi->http.conn_type = HTTP_CONNECTION_CLOSE;
+
+	return 0;
+}
+
 int
 lws_return_http_status(struct lws *wsi, unsigned int code,
 		       const char *html_body)
@@ -549,85 +842,76 @@ lws_http_headers_detach(struct lws *wsi)
 
 #if defined(LWS_WITH_SERVER)
 
+/*
+ * Each ah has its own hold deadline on the pt sul list, set when it is
+ * assigned, so we only get called for an ah that actually overstayed.
+ */
+
 void
 lws_sul_http_ah_lifecheck(lws_sorted_usec_list_t *sul)
 {
-	struct allocated_headers *ah;
-	struct lws_context_per_thread *pt = lws_container_of(sul,
-			struct lws_context_per_thread, sul_ah_lifecheck);
+	struct allocated_headers *ah = lws_container_of(sul,
+			struct allocated_headers, sul_hold);
+	struct lws_context_per_thread *pt;
+	const unsigned char *c;
 	struct lws *wsi;
-	time_t now;
-	int m;
+	char buf[256];
+	int m, len;
 
-	now = time(NULL);
+	if (!ah->in_use || !ah->wsi || !ah->assigned)
+		return;
 
-	lws_pt_lock(pt, __func__);
+	/*
+	 * a single ah session somehow got held for
+	 * an unreasonable amount of time.
+	 *
+	 * Dump info on the connection...
+	 */
+	wsi = ah->wsi;
+	pt = &wsi->context->pt[(int)wsi->tsi];
 
-	ah = pt->http.ah_list;
-	while (ah) {
-		int len;
-		char buf[256];
-		const unsigned char *c;
-
-		if (!ah->in_use || !ah->wsi || !ah->assigned ||
-		    (ah->wsi->vhost &&
-		     (now - ah->assigned) <
-		     ah->wsi->vhost->timeout_secs_ah_idle + 360)) {
-			ah = ah->next;
-			continue;
-		}
+	lws_pt_lock(pt, __func__);
 
-		/*
-		 * a single ah session somehow got held for
-		 * an unreasonable amount of time.
-		 *
-		 * Dump info on the connection...
-		 */
-		wsi = ah->wsi;
-		buf[0] = '\0';
+	buf[0] = '\0';
 #if !defined(LWS_PLAT_OPTEE)
-		lws_get_peer_simple(wsi, buf, sizeof(buf));
+	lws_get_peer_simple(wsi, buf, sizeof(buf));
 #else
-		buf[0] = '\0';
+	buf[0] = '\0';
 #endif
-		lwsl_notice("ah excessive hold: wsi %p\n"
-			    "  peer address: %s\n"
-			    "  ah pos %lu\n",
-			    wsi, buf, (unsigned long)ah->pos);
-		buf[0] = '\0';
-		m = 0;
-		do {
-			c = lws_token_to_string(m);
-			if (!c)
-				break;
-			if (!(*c))
-				break;
-
-			len = lws_hdr_total_length(wsi, m);
-			if (!len || len > (int)sizeof(buf) - 1) {
-				m++;
-				continue;
-			}
-
-			if (lws_hdr_copy(wsi, buf, sizeof buf, m) > 0) {
-				buf[sizeof(buf) - 1] = '\0';
-
-				lwsl_notice("   %s = %s\n",
-					    (const char *)c, buf);
-			}
+	lwsl_notice("ah excessive hold: wsi %p\n"
+		    "  peer address: %s\n"
+		    "  ah pos %lu\n",
+		    wsi, buf, (unsigned long)ah->pos);
+	buf[0] = '\0';
+	m = 0;
+	do {
+		c = lws_token_to_string(m);
+		if (!c)
+			break;
+		if (!(*c))
+			break;
+
+		len = lws_hdr_total_length(wsi, m);
+		if (!len || len > (int)sizeof(buf) - 1) {
 			m++;
-		} while (1);
+			continue;
+		}
 
-		/* explicitly detach the ah */
-		lws_header_table_detach(wsi, 0);
+		if (lws_hdr_copy(wsi, buf, sizeof buf, m) > 0) {
+			buf[sizeof(buf) - 1] = '\0';
 
-		/* ... and then drop the connection */
+			lwsl_notice("   %s = %s\n",
+				    (const char *)c, buf);
+		}
+		m++;
+	} while (1);
 
-		__lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS,
-					     "excessive ah");
+	/* explicitly detach the ah */
+	lws_header_table_detach(wsi, 0);
 
-		ah = pt->http.ah_list;
-	}
+	/* ... and then drop the connection */
+
+	__lws_close_free_wsi(wsi, LWS_CLOSE_STATUS_NOSTATUS, "excessive ah");
 
 	lws_pt_unlock(pt);
 }
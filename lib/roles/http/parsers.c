@@ -42,30 +42,81 @@ static const unsigned char lextable_h1[] = {
 static struct allocated_headers *
 _lws_create_ah(struct lws_context_per_thread *pt, ah_data_idx_t data_size)
 {
-	struct allocated_headers *ah = lws_zalloc(sizeof(*ah), "ah struct");
+	struct allocated_headers *ah = pt->http.ah_free_list;
 
+	if (ah) {
+		/* reuse an idle one, it keeps its initial data allocation */
+		pt->http.ah_free_list = ah->next;
+		pt->http.ah_free_list_length--;
+		goto link;
+	}
+
+	ah = lws_zalloc(sizeof(*ah), "ah struct");
 	if (!ah)
 		return NULL;
 
+	/*
+	 * Most requests fit in much less than the max, start small and only
+	 * grow the data allocation if this request needs it
+	 */
+	if (data_size > LWS_AH_DATA_CHUNK)
+		data_size = LWS_AH_DATA_CHUNK;
+
 	ah->data = lws_malloc(data_size, "ah data");
 	if (!ah->data) {
 		lws_free(ah);
 
 		return NULL;
 	}
+	ah->data_length = data_size;
+
+link:
 	ah->next = pt->http.ah_list;
 	pt->http.ah_list = ah;
-	ah->data_length = data_size;
 	pt->http.ah_pool_length++;
 
 	lwsl_info("%s: created ah %p (size %d): pool length %u\n", __func__,
-		    ah, (int)data_size, (unsigned int)pt->http.ah_pool_length);
+		    ah, (int)ah->data_length,
+		    (unsigned int)pt->http.ah_pool_length);
 
 	return ah;
 }
 
 int
-_lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+_lws_ah_grow(struct lws_context *context, struct allocated_headers *ah)
+{
+	size_t lim = (size_t)context->max_http_header_data,
+	       n = (size_t)ah->data_length * 2;
+	char *p;
+
+	/* ah_data_idx_t may be only 16-bit, don't let the size wrap it */
+	if (lim > (ah_data_idx_t)-1)
+		lim = (ah_data_idx_t)-1;
+
+	if (ah->data_length >= lim)
+		return 1;
+
+	if (n > lim)
+		n = lim;
+
+	p = lws_realloc(ah->data, n, "ah data");
+	if (!p) {
+		lwsl_err("%s: OOM growing ah to %u\n", __func__, (unsigned int)n);
+
+		return -1;
+	}
+
+	lwsl_debug("%s: ah %p grown %u -> %u\n", __func__, ah,
+		   (unsigned int)ah->data_length, (unsigned int)n);
+
+	ah->data = p;
+	ah->data_length = (ah_data_idx_t)n;
+
+	return 0;
+}
+
+static int
+_lws_unlink_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 {
 	lws_start_foreach_llp(struct allocated_headers **, a, pt->http.ah_list) {
 		if ((*a) == ah) {
@@ -74,9 +125,6 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 			lwsl_info("%s: freed ah %p : pool length %u\n",
 				    __func__, ah,
 				    (unsigned int)pt->http.ah_pool_length);
-			if (ah->data)
-				lws_free(ah->data);
-			lws_free(ah);
 
 			return 0;
 		}
@@ -85,6 +133,74 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 	return 1;
 }
 
+int
+_lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	if (_lws_unlink_ah(pt, ah))
+		return 1;
+
+#if defined(LWS_WITH_SERVER)
+	lws_dll2_remove(&ah->sul_hold.list);
+#endif
+
+	if (ah->data)
+		lws_free(ah->data);
+	lws_free(ah);
+
+	return 0;
+}
+
+/*
+ * Unlike _lws_destroy_ah(), this keeps a few idle ahs around on the pt so the
+ * next attach doesn't have to allocate.  Anything that grew beyond the initial
+ * allocation is freed, so idle ahs only cost the small size.
+ */
+
+static int
+_lws_release_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
+{
+	ah_data_idx_t len = ah->data_length;
+	char *p;
+
+	if (pt->http.ah_free_list_length >= LWS_AH_FREE_LIST_MAX ||
+	    ah->data_length > LWS_AH_DATA_CHUNK)
+		return _lws_destroy_ah(pt, ah);
+
+	if (_lws_unlink_ah(pt, ah))
+		return 1;
+
+#if defined(LWS_WITH_SERVER)
+	lws_dll2_remove(&ah->sul_hold.list);
+#endif
+	p = ah->data;
+	memset(ah, 0, sizeof(*ah));
+	ah->data = p;
+	ah->data_length = len;
+
+	ah->next = pt->http.ah_free_list;
+	pt->http.ah_free_list = ah;
+	pt->http.ah_free_list_length++;
+
+	return 0;
+}
+
+void
+_lws_destroy_ah_pool(struct lws_context_per_thread *pt)
+{
+	struct allocated_headers *ah;
+
+	while (pt->http.ah_list)
+		_lws_destroy_ah(pt, pt->http.ah_list);
+
+	while (pt->http.ah_free_list) {
+		ah = pt->http.ah_free_list;
+		pt->http.ah_free_list = ah->next;
+		lws_free(ah->data);
+		lws_free(ah);
+	}
+	pt->http.ah_free_list_length = 0;
+}
+
 void
 _lws_header_table_reset(struct allocated_headers *ah)
 {
@@ -127,6 +243,13 @@ __lws_header_table_reset(struct lws *wsi, int autoservice)
 			  wsi->vhost->timeout_secs_ah_idle);
 
 	time(&ah->assigned);
+#if defined(LWS_WITH_SERVER)
+	/* backstop in case the wsi timeout was changed while holding it */
+	ah->sul_hold.cb = lws_sul_http_ah_lifecheck;
+	__lws_sul_insert(&wsi->context->pt[(int)wsi->tsi].pt_sul_owner,
+			 &ah->sul_hold, ((lws_usec_t)wsi->vhost->timeout_secs_ah_idle +
+					 360) * LWS_US_PER_SEC);
+#endif
 
 	if (wsi->position_in_fds_table != LWS_NO_FDS_POS &&
 	    lws_buflist_next_segment_len(&wsi->buflist, NULL) &&
@@ -162,18 +285,15 @@ _lws_header_ensure_we_are_on_waiting_list(struct lws *wsi)
 {
 	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
 	struct lws_pollargs pa;
-	struct lws **pwsi = &pt->http.ah_wait_list;
 
-	while (*pwsi) {
-		if (*pwsi == wsi)
-			return;
-		pwsi = &(*pwsi)->http.ah_wait_list;
-	}
+	if (!lws_dll2_is_detached(&wsi->http.ah_wait_list))
+		return;
 
 	lwsl_info("%s: wsi: %p\n", __func__, wsi);
-	wsi->http.ah_wait_list = pt->http.ah_wait_list;
-	pt->http.ah_wait_list = wsi;
-	pt->http.ah_wait_list_length++;
+	/* we may be going back on after failing to get one, keep orig time */
+	if (!wsi->http.ah_wait_since)
+		wsi->http.ah_wait_since = lws_now_usecs();
+	lws_dll2_add_tail(&wsi->http.ah_wait_list, &pt->http.ah_wait_owner);
 
 	/* we cannot accept input then */
 
@@ -183,24 +303,29 @@ _lws_header_ensure_we_are_on_waiting_list(struct lws *wsi)
 static int
 __lws_remove_from_ah_waiting_list(struct lws *wsi)
 {
-        struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
-	struct lws **pwsi =&pt->http.ah_wait_list;
-
-	while (*pwsi) {
-		if (*pwsi == wsi) {
-			lwsl_info("%s: wsi %p\n", __func__, wsi);
-			/* point prev guy to our next */
-			*pwsi = wsi->http.ah_wait_list;
-			/* we shouldn't point anywhere now */
-			wsi->http.ah_wait_list = NULL;
-			pt->http.ah_wait_list_length--;
-
-			return 1;
-		}
-		pwsi = &(*pwsi)->http.ah_wait_list;
-	}
+	if (lws_dll2_is_detached(&wsi->http.ah_wait_list))
+		return 0;
 
-	return 0;
+	lwsl_info("%s: wsi %p\n", __func__, wsi);
+	lws_dll2_remove(&wsi->http.ah_wait_list);
+
+	return 1;
+}
+
+static void
+_lws_ah_wait_stats(struct lws_context_per_thread *pt, struct lws *wsi)
+{
+	lws_usec_t waited;
+
+	if (!wsi->http.ah_wait_since)
+		return;
+
+	waited = lws_now_usecs() - wsi->http.ah_wait_since;
+	wsi->http.ah_wait_since = 0;
+
+	lws_stats_bump(pt, LWSSTATS_C_AH_WAITED, 1);
+	lws_stats_bump(pt, LWSSTATS_US_AH_WAIT_AVG, (uint64_t)waited);
+	lws_stats_max(pt, LWSSTATS_US_WORST_AH_WAIT, (uint64_t)waited);
 }
 
 int LWS_WARN_UNUSED_RESULT
@@ -267,6 +392,7 @@ lws_header_table_attach(struct lws *wsi, int autoservice)
 	wsi->http.ah->in_use = 1;
 	wsi->http.ah->wsi = wsi; /* mark our owner */
 	pt->http.ah_count_in_use++;
+	_lws_ah_wait_stats(pt, wsi);
 
 #if defined(LWS_WITH_PEER_LIMITS) && (defined(LWS_ROLE_H1) || \
     defined(LWS_ROLE_H2))
@@ -312,7 +438,6 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 	struct allocated_headers *ah = wsi->http.ah;
 	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
 	struct lws_pollargs pa;
-	struct lws **pwsi, **pwsi_eligible;
 	time_t now;
 
 	__lws_remove_from_ah_waiting_list(wsi);
@@ -337,6 +462,9 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 	}
 
 	ah->assigned = 0;
+#if defined(LWS_WITH_SERVER)
+	lws_dll2_remove(&ah->sul_hold.list);
+#endif
 
 	/* if we think we're detaching one, there should be one in use */
 	assert(pt->http.ah_count_in_use > 0);
@@ -351,45 +479,44 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 	ah->wsi = NULL; /* no owner */
 	wsi->http.ah = NULL;
 
-	pwsi = &pt->http.ah_wait_list;
-
 	/* oh there is nobody on the waiting list... leave the ah unattached */
-	if (!*pwsi)
+	if (!pt->http.ah_wait_owner.count)
 		goto nobody_usable_waiting;
 
 	/*
-	 * at least one wsi on the same tsi is waiting, give it to oldest guy
-	 * who is allowed to take it (if any)
+	 * at least one wsi on the same tsi is waiting, give it to the oldest
+	 * guy who is allowed to take it (if any)
 	 */
-	lwsl_info("pt wait list %p\n", *pwsi);
 	wsi = NULL;
-	pwsi_eligible = NULL;
 
-	while (*pwsi) {
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      lws_dll2_get_head(&pt->http.ah_wait_owner)) {
+		struct lws *w = lws_container_of(d, struct lws,
+						 http.ah_wait_list);
 #if defined(LWS_WITH_PEER_LIMITS)
 		/* are we willing to give this guy an ah? */
-		if (!lws_peer_confirm_ah_attach_ok(context, (*pwsi)->peer))
+		if (!lws_peer_confirm_ah_attach_ok(context, w->peer))
 #endif
 		{
-			wsi = *pwsi;
-			pwsi_eligible = pwsi;
+			wsi = w;
+			break;
 		}
 #if defined(LWS_WITH_PEER_LIMITS)
-		else
-			if (!(*pwsi)->http.ah_wait_list)
-				lws_stats_bump(pt,
-					LWSSTATS_C_PEER_LIMIT_AH_DENIED, 1);
+		lws_stats_bump(pt, LWSSTATS_C_PEER_LIMIT_AH_DENIED, 1);
 #endif
-		pwsi = &(*pwsi)->http.ah_wait_list;
-	}
+	} lws_end_foreach_dll(d);
 
 	if (!wsi) /* everybody waiting already has too many ah... */
 		goto nobody_usable_waiting;
 
-	lwsl_info("%s: transferring ah to last eligible wsi in wait list "
+	lwsl_info("%s: transferring ah to oldest eligible wsi in wait list "
 		  "%p (wsistate 0x%lx)\n", __func__, wsi,
 		  (unsigned long)wsi->wsistate);
 
+	/* the guy who got one is out of the list */
+	__lws_remove_from_ah_waiting_list(wsi);
+	_lws_ah_wait_stats(pt, wsi);
+
 	wsi->http.ah = ah;
 	ah->wsi = wsi; /* new owner */
 
@@ -412,11 +539,6 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 		_lws_change_pollfd(wsi, 0, LWS_POLLIN, &pa);
 	}
 
-	/* point prev guy to next guy in list instead */
-	*pwsi_eligible = wsi->http.ah_wait_list;
-	/* the guy who got one is out of the list */
-	wsi->http.ah_wait_list = NULL;
-	pt->http.ah_wait_list_length--;
 
 #if defined(LWS_WITH_CLIENT)
 	if (lwsi_role_client(wsi) && lwsi_state(wsi) == LRS_UNCONNECTED) {
@@ -433,8 +555,6 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 	}
 #endif
 
-	assert(!!pt->http.ah_wait_list_length ==
-			!!(lws_intptr_t)pt->http.ah_wait_list);
 bail:
 	lwsl_info("%s: wsi %p: ah %p (tsi=%d, count = %d)\n", __func__,
 		  (void *)wsi, (void *)ah, pt->tid, pt->http.ah_count_in_use);
@@ -443,7 +563,7 @@ bail:
 
 nobody_usable_waiting:
 	lwsl_info("%s: nobody usable waiting\n", __func__);
-	_lws_destroy_ah(pt, ah);
+	_lws_release_ah(pt, ah);
 	pt->http.ah_count_in_use--;
 
 	goto bail;
@@ -655,13 +775,22 @@ char *lws_hdr_simple_ptr(struct lws *wsi, enum lws_token_indexes h)
 static int LWS_WARN_UNUSED_RESULT
 lws_pos_in_bounds(struct lws *wsi)
 {
+	int n;
+
 	if (!wsi->http.ah)
 		return -1;
 
-	if (wsi->http.ah->pos <
-	    (unsigned int)wsi->context->max_http_header_data)
+	if (wsi->http.ah->pos < wsi->http.ah->data_length)
 		return 0;
 
+	/* grow the ah data allocation towards the max if we can */
+	n = _lws_ah_grow(wsi->context, wsi->http.ah);
+	if (!n)
+		return 0;
+	if (n < 0)
+		/* OOM, not a bad request... but we can't take it either */
+		return 1;
+
 	if ((int)wsi->http.ah->pos >= wsi->context->max_http_header_data - 1) {
 		lwsl_err("Ran out of header data space\n");
 		return 1;
@@ -77,9 +77,15 @@ enum range_states {
 	LWSRS_SYNTAX,
 };
 
+/*
+ * Only allocated while serving a file in response to a request with Range:,
+ * the wsi carries a NULL pointer the rest of the time
+ */
+
 struct lws_range_parsing {
 	unsigned long long start, end, extent, agg, budget;
 	const char buf[128];
+	char multipart_content_type[64];
 	int pos;
 	enum range_states state;
 	char start_valid, end_valid, ctr, count_ranges, did_try, inside, send_ctr;
@@ -102,13 +108,16 @@ lws_ranges_reset(struct lws_range_parsing *rp);
 struct allocated_headers {
 	struct allocated_headers *next; /* linked list */
 	struct lws *wsi; /* owner */
-	char *data; /* prepared by context init to point to dedicated storage */
-	ah_data_idx_t data_length;
+	char *data; /* starts at LWS_AH_DATA_CHUNK, grows to max_http_header_data */
+	ah_data_idx_t data_length; /* currently allocated size of data */
 	/*
 	 * the randomly ordered fragments, indexed by frag_index and
 	 * lws_fragments->nfrag for continuation.
 	 */
 	struct lws_fragments frags[WSI_TOKEN_COUNT];
+#if defined(LWS_WITH_SERVER)
+	lws_sorted_usec_list_t sul_hold; /* excessive hold deadline */
+#endif
 	time_t assigned;
 	/*
 	 * for each recognized token, frag_index says which frag[] his data
@@ -175,16 +184,30 @@ lws_rewrite_parse(struct lws_rewrite *r, const unsigned char *in, int in_len);
 
 struct lws_pt_role_http {
 	struct allocated_headers *ah_list;
-	struct lws *ah_wait_list;
+	struct allocated_headers *ah_free_list; /* idle ahs kept for reuse */
+	lws_dll2_owner_t ah_wait_owner; /* FIFO of wsi waiting for an ah */
 #ifdef LWS_WITH_CGI
 	struct lws_cgi *cgi_list;
 #endif
-	int ah_wait_list_length;
 	uint32_t ah_pool_length;
+	uint32_t ah_free_list_length;
+#if defined(LWS_WITH_SERVER)
+	time_t date_secs; /* time date[] was rendered for */
+	char date[30]; /* IMF-fixdate for header template Date: slots */
+#endif
 
 	int ah_count_in_use;
 };
 
+struct lws_http_hdr_template {
+	uint16_t code;
+	uint16_t h1_len;
+	uint16_t h2_len;
+	uint8_t flags;
+
+	/* h1 rendering, then h2 rendering, are overallocated after this */
+};
+
 struct lws_peer_role_http {
 	uint32_t count_ah;
 	uint32_t total_ah;
@@ -226,7 +249,8 @@ struct _lws_http_mode_related {
 	struct lws_buflist *buflist_post_body;
 #endif
 	struct allocated_headers *ah;
-	struct lws *ah_wait_list;
+	lws_dll2_t ah_wait_list; /* on pt->http.ah_wait_owner */
+	lws_usec_t ah_wait_since;
 
 	unsigned long		writeable_len;
 
@@ -239,8 +263,7 @@ struct _lws_http_mode_related {
 	char multipart_boundary[16];
 #endif
 #if defined(LWS_WITH_RANGES)
-	struct lws_range_parsing range;
-	char multipart_content_type[64];
+	struct lws_range_parsing *range; /* only while serving a Range: */
 #endif
 
 #ifdef LWS_WITH_ACCESS_LOG
@@ -317,6 +340,13 @@ _lws_header_table_reset(struct allocated_headers *ah);
 LWS_EXTERN int
 _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah);
 
+void
+_lws_destroy_ah_pool(struct lws_context_per_thread *pt);
+
+/* 0 = grown, 1 = already at max_http_header_data, -1 = OOM */
+int
+_lws_ah_grow(struct lws_context *context, struct allocated_headers *ah);
+
 int
 lws_http_proxy_start(struct lws *wsi, const struct lws_http_mount *hit,
 		     char *uri_ptr, char ws);
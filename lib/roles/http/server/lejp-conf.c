@@ -133,6 +133,7 @@ static const char * const paths_vhosts[] = {
 
 	"vhosts[].disable-no-protocol-ws-upgrades",
 	"vhosts[].h2-half-closed-long-poll",
+	"vhosts[].mounts[].push.*",
 };
 
 enum lejp_vhost_paths {
@@ -201,6 +202,7 @@ enum lejp_vhost_paths {
 
 	LEJPVP_FLAG_DISABLE_NO_PROTOCOL_WS_UPGRADES,
 	LEJPVP_FLAG_H2_HALF_CLOSED_LONG_POLL,
+	LEJPVP_MOUNT_PUSH,
 };
 
 #define MAX_PLUGIN_DIRS 10
@@ -765,6 +767,20 @@ lejp_vhosts_cb(struct lejp_ctx *ctx, char reason)
 		a->pvo_int->options = NULL;
 		break;
 
+	case LEJPVP_MOUNT_PUSH:
+		pvo = lwsws_align(a);
+		a->p += sizeof(*pvo);
+
+		n = lejp_get_wildcard(ctx, 0, a->p, lws_ptr_diff(a->end, a->p));
+		pvo->next = a->m.push;
+		a->m.push = pvo;
+		pvo->name = a->p;
+		lwsl_notice("  adding push %s -> %s\n", a->p, ctx->buf);
+		a->p += n;
+		pvo->value = a->p;
+		pvo->options = NULL;
+		break;
+
 	case LEJPVP_ENABLE_CLIENT_SSL:
 		a->enable_client_ssl = arg_to_bool(ctx->buf);
 		return 0;
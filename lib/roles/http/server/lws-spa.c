@@ -78,6 +78,7 @@ struct lws_urldecode_stateful {
 	uint8_t inside_quote:1;
 	uint8_t subname:1;
 	uint8_t boundary_real_crlf:1;
+	uint8_t file_spans:1;
 
 	enum urldecode_stateful state;
 
@@ -120,6 +121,7 @@ lws_urldecode_s_create(struct lws_spa *spa, struct lws *wsi, char *out,
 	s->name[0] = '\0';
 	s->data = spa;
 	s->wsi = wsi;
+	s->file_spans = !!(spa->i.flags & LWS_SPA_FLAG_FILE_SPANS);
 
 	if (lws_hdr_copy(wsi, buf, sizeof(buf),
 			 WSI_TOKEN_HTTP_CONTENT_TYPE) > 0) {
@@ -244,6 +246,39 @@ lws_urldecode_s_process(struct lws_urldecode_stateful *s, const char *in,
 		/* states for multipart / mime style */
 
 		case MT_LOOK_BOUND_IN:
+			if (s->file_spans && !s->mp &&
+			    s->content_disp_filename[0]) {
+				const char *cr;
+				char *span;
+				int sl;
+
+				/*
+				 * The boundary can only start at a CR, anything
+				 * before the next one is file content the user
+				 * can have directly from the input
+				 */
+
+				cr = memchr(in, '\x0d', (size_t)len + 1);
+				sl = cr ? lws_ptr_diff(cr, in) : len + 1;
+				if (sl) {
+					if (s->pos) {
+						if (s->output(s->data, s->name,
+							      &s->out, s->pos,
+							      LWS_UFS_CONTENT))
+							return -1;
+						s->pos = 0;
+					}
+
+					span = (char *)in;
+					if (s->output(s->data, s->name, &span,
+						      sl, LWS_UFS_CONTENT))
+						return -1;
+
+					in += sl;
+					len -= sl - 1;
+					continue;
+				}
+			}
 retry_as_first:
 			if (*in == s->mime_boundary[s->mp] &&
 			    s->mime_boundary[s->mp]) {
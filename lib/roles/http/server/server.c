@@ -489,7 +489,7 @@ lws_vfs_prepare_flags(struct lws *wsi)
 
 static int
 lws_http_serve(struct lws *wsi, char *uri, const char *origin,
-	       const struct lws_http_mount *m)
+	       const struct lws_http_mount *m, const char *req_uri)
 {
 	const struct lws_protocol_vhost_options *pvo = m->interpret;
 	struct lws_process_html_args args;
@@ -696,6 +696,12 @@ lws_http_serve(struct lws *wsi, char *uri, const char *origin,
 	if (!mimetype[0])
 		lwsl_debug("sending no mimetype for %s\n", path);
 
+#if defined(LWS_ROLE_H2)
+	/* we know we will serve it now, push what goes with it first */
+	if (wsi->mux_substream && !wsi->handling_404)
+		lws_h2_push_manifest(wsi, m, uri, req_uri);
+#endif
+
 	wsi->sending_chunked = 0;
 	wsi->interpreting = 0;
 
@@ -1683,7 +1689,7 @@ lws_http_action(struct lws *wsi)
 	m = 1;
 #if defined(LWS_WITH_FILE_OPS)
 	if (hit->origin_protocol == LWSMPRO_FILE)
-		m = lws_http_serve(wsi, s, hit->origin, hit);
+		m = lws_http_serve(wsi, s, hit->origin, hit, uri_ptr);
 
 	if (m > 0)
 #endif
@@ -1998,6 +2004,27 @@ raw_transition:
 
 		lwsl_parser("%s: lws_parse sees parsing complete\n", __func__);
 
+		/*
+		 * Anything pipelined behind these headers that was freshly
+		 * read is still in pt->serv_buf, which whatever answers this
+		 * request is free to build its response in.  Move it to the
+		 * buflist first, where it is safe and also tells
+		 * lws_http_transaction_completed() to keep the ah for it.
+		 */
+
+		if (len && !wsi->mux_substream &&
+		    !lws_hdr_total_length(wsi, WSI_TOKEN_CONNECT) &&
+		    *buf >= pt->serv_buf &&
+		    *buf < pt->serv_buf + context->pt_serv_buf_size) {
+			m = lws_buflist_append_segment(&wsi->buflist, *buf, len);
+			if (m < 0)
+				goto bail_nuke_ah;
+			if (m)
+				__lws_add_wsi_to_buflist_list(pt, wsi);
+			*buf += len;
+			len = 0;
+		}
+
 		/* select vhost */
 
 		if (wsi->vhost->listen_port &&
@@ -2466,7 +2493,7 @@ lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
 	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
 	unsigned char *response = pt->serv_buf + LWS_PRE;
 #if defined(LWS_WITH_RANGES)
-	struct lws_range_parsing *rp = &wsi->http.range;
+	struct lws_range_parsing *rp;
 #endif
 	int ret = 0, cclen = 8, n = HTTP_STATUS_OK;
 	char cache_control[50], *cc = "no-store";
@@ -2513,7 +2540,20 @@ lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
 	total_content_length = wsi->http.filelen;
 
 #if defined(LWS_WITH_RANGES)
-	ranges = lws_ranges_init(wsi, rp, wsi->http.filelen);
+	/*
+	 * The range parsing state is large and rarely needed, only keep it
+	 * while we are serving a request that asked for ranges
+	 */
+	lws_free_set_NULL(wsi->http.range);
+	ranges = 0;
+	if (lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_RANGE)) {
+		wsi->http.range = lws_zalloc(sizeof(*wsi->http.range), "ranges");
+		if (!wsi->http.range)
+			goto bail;
+	}
+	rp = wsi->http.range;
+	if (rp)
+		ranges = lws_ranges_init(wsi, rp, wsi->http.filelen);
 
 	lwsl_debug("Range count %d\n", ranges);
 	/*
@@ -2580,8 +2620,8 @@ lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
 
 #if defined(LWS_WITH_RANGES)
 	if (ranges >= 2) { /* multipart byteranges */
-		lws_strncpy(wsi->http.multipart_content_type, content_type,
-			sizeof(wsi->http.multipart_content_type));
+		lws_strncpy(rp->multipart_content_type, content_type,
+			    sizeof(rp->multipart_content_type));
 
 		if (lws_add_http_header_by_token(wsi,
 						 WSI_TOKEN_HTTP_CONTENT_TYPE,
@@ -2638,7 +2678,8 @@ lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
 			goto bail;
 	}
 
-	wsi->http.range.inside = 0;
+	if (rp)
+		rp->inside = 0;
 
 	if (lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_ACCEPT_RANGES,
 					 (unsigned char *)"bytes", 5, &p, end))
@@ -2769,6 +2810,7 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 	lws_filepos_t amount, poss;
 	unsigned char *p, *pstart;
 #if defined(LWS_WITH_RANGES)
+	struct lws_range_parsing *rp = wsi->http.range;
 	unsigned char finished = 0;
 #endif
 	int n, m;
@@ -2815,19 +2857,19 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 		p = pstart = pt->serv_buf + LWS_H2_FRAME_HEADER_LENGTH;
 
 #if defined(LWS_WITH_RANGES)
-		if (wsi->http.range.count_ranges && !wsi->http.range.inside) {
+		if (rp && rp->count_ranges && !rp->inside) {
 
 			lwsl_notice("%s: doing range start %llu\n", __func__,
-				    wsi->http.range.start);
+				    rp->start);
 
 			if ((long long)lws_vfs_file_seek_cur(wsi->http.fop_fd,
-						   wsi->http.range.start -
+						   rp->start -
 						   wsi->http.filepos) < 0)
 				goto file_had_it;
 
-			wsi->http.filepos = wsi->http.range.start;
+			wsi->http.filepos = rp->start;
 
-			if (wsi->http.range.count_ranges > 1) {
+			if (rp->count_ranges > 1) {
 				n =  lws_snprintf((char *)p,
 						context->pt_serv_buf_size -
 						LWS_H2_FRAME_HEADER_LENGTH,
@@ -2836,16 +2878,15 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 					"Content-Range: bytes "
 						"%llu-%llu/%llu\x0d\x0a"
 					"\x0d\x0a",
-					wsi->http.multipart_content_type,
-					wsi->http.range.start,
-					wsi->http.range.end,
-					wsi->http.range.extent);
+					rp->multipart_content_type,
+					rp->start,
+					rp->end,
+					rp->extent);
 				p += n;
 			}
 
-			wsi->http.range.budget = wsi->http.range.end -
-						   wsi->http.range.start + 1;
-			wsi->http.range.inside = 1;
+			rp->budget = rp->end - rp->start + 1;
+			rp->inside = 1;
 		}
 #endif
 
@@ -2888,11 +2929,11 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 		}
 
 #if defined(LWS_WITH_RANGES)
-		if (wsi->http.range.count_ranges) {
-			if (wsi->http.range.count_ranges > 1)
+		if (rp && rp->count_ranges) {
+			if (rp->count_ranges > 1)
 				poss -= 7; /* allow for final boundary */
-			if (poss > wsi->http.range.budget)
-				poss = wsi->http.range.budget;
+			if (poss > rp->budget)
+				poss = rp->budget;
 		}
 #endif
 		if (wsi->sending_chunked) {
@@ -2935,10 +2976,10 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 				p = pstart;
 
 #if defined(LWS_WITH_RANGES)
-			if (wsi->http.range.send_ctr + 1 ==
-				wsi->http.range.count_ranges && // last range
-			    wsi->http.range.count_ranges > 1 && // was 2+ ranges (ie, multipart)
-			    wsi->http.range.budget - amount == 0) {// final part
+			if (rp && rp->send_ctr + 1 ==
+				rp->count_ranges && // last range
+			    rp->count_ranges > 1 && // was 2+ ranges (ie, multipart)
+			    rp->budget - amount == 0) {// final part
 				n += lws_snprintf((char *)pstart + n, 6,
 					"_lws\x0d\x0a"); // append trailing boundary
 				lwsl_debug("added trailing boundary\n");
@@ -2953,14 +2994,14 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 			wsi->http.filepos += amount;
 
 #if defined(LWS_WITH_RANGES)
-			if (wsi->http.range.count_ranges >= 1) {
-				wsi->http.range.budget -= amount;
-				if (wsi->http.range.budget == 0) {
+			if (rp && rp->count_ranges >= 1) {
+				rp->budget -= amount;
+				if (rp->budget == 0) {
 					lwsl_notice("range budget exhausted\n");
-					wsi->http.range.inside = 0;
-					wsi->http.range.send_ctr++;
+					rp->inside = 0;
+					rp->send_ctr++;
 
-					if (lws_ranges_next(&wsi->http.range) < 1) {
+					if (lws_ranges_next(rp) < 1) {
 						finished = 1;
 						goto all_sent;
 					}
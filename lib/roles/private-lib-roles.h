@@ -276,6 +276,16 @@ struct lws_role_ops {
 extern const struct lws_role_ops role_ops_raw_skt, role_ops_raw_file,
 				 role_ops_listen, role_ops_pipe;
 
+/*
+ * Role ops the service path may call directly, see lws_rops_handle_POLLIN()
+ * and friends.  Otherwise they are only reached through the role_ops.
+ */
+#if defined(LWS_WITH_DIRECT_ROLE_DISPATCH)
+#define LWS_ROPS_DIRECT
+#else
+#define LWS_ROPS_DIRECT static
+#endif
+
 /* bring in role private declarations */
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
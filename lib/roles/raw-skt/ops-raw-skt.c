@@ -114,6 +114,15 @@ rops_handle_POLLIN_raw_skt(struct lws_context_per_thread *pt, struct lws *wsi,
 			goto post_rx;
 #endif
 		default:
+#if defined(LWS_WITH_UDP) && defined(LWS_HAVE_RECVMMSG)
+			if (lws_wsi_is_udp_batch(wsi)) {
+				/* drain many dgrams into one callback */
+				if (lws_udp_batch_rx(pt, wsi) < 0)
+					goto fail;
+
+				goto try_pollout;
+			}
+#endif
 			ebuf.token = NULL;
 			ebuf.len = 0;
 
@@ -213,6 +222,16 @@ try_pollout:
 			  LWSSTATS_US_WORST_WRITABLE_DELAY, ul);
 		wsi->active_writable_req_us = 0;
 	}
+#endif
+#if defined(LWS_WITH_UDP) && defined(LWS_HAVE_RECVMMSG)
+	if (lws_wsi_is_udp_batch(wsi)) {
+		/* the user only hears about writeable once the queue drained */
+		n = lws_udp_batch_flush(wsi);
+		if (n < 0)
+			goto fail;
+		if (n)
+			return LWS_HPI_RET_HANDLED;
+	}
 #endif
 	n = user_callback_handle_rxflow(wsi->protocol->callback,
 			wsi, LWS_CALLBACK_RAW_WRITEABLE,
@@ -222,6 +241,12 @@ try_pollout:
 		goto fail;
 	}
 
+#if defined(LWS_WITH_UDP) && defined(LWS_HAVE_RECVMMSG)
+	/* send anything queued during the writeable callback in one go */
+	if (lws_wsi_is_udp_batch(wsi) && lws_udp_batch_flush(wsi) < 0)
+		goto fail;
+#endif
+
 	return LWS_HPI_RET_HANDLED;
 
 fail:
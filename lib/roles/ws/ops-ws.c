@@ -937,7 +937,7 @@ lws_is_ws_with_ext(struct lws *wsi)
 #endif
 }
 
-static int
+LWS_ROPS_DIRECT int
 rops_handle_POLLIN_ws(struct lws_context_per_thread *pt, struct lws *wsi,
 		       struct lws_pollfd *pollfd)
 {
@@ -1560,7 +1560,7 @@ rops_close_role_ws(struct lws_context_per_thread *pt, struct lws *wsi)
 	return 0;
 }
 
-static int
+LWS_ROPS_DIRECT int
 rops_write_role_protocol_ws(struct lws *wsi, unsigned char *buf, size_t len,
 			    enum lws_write_protocol *wp)
 {
@@ -154,7 +154,7 @@ lws_adns_iterate(lws_adns_q_t *q, const uint8_t *pkt, int len,
 {
 	const uint8_t *e = pkt + len, *p, *pay;
 	struct label_stack stack[4];
-	int n = 0, stp = 0, ansc, m;
+	int n = 0, stp = 0, ansc, m, found = 0;
 	uint16_t rrtype, rrpaylen;
 	char *sp, inq;
 	uint32_t ttl;
@@ -276,6 +276,7 @@ start:
 		 *
 		 *    A:      4: ipv4 address
 		 *    AAAA:  16: ipv6 address (if asked for AAAA)
+		 *    PTR:    ?: labelized name (if asked for PTR)
 		 *    CNAME:  ?: labelized name
 		 *
 		 * If we hit a CNAME we need to try to dereference it with
@@ -307,6 +308,25 @@ start:
 do_cb:
 #endif
 			cb(stack[0].name, opaque, ttl, rrtype, p);
+			found++;
+			break;
+
+		case LWS_ADNS_RECORD_PTR:
+			if (q->qtype != LWS_ADNS_RECORD_PTR || !rrpaylen || !*p)
+				break;
+			{
+				char ptr[DNS_MAX], *pp = ptr;
+
+				/* the payload is the labelized name */
+				n = lws_adns_parse_label(pkt, len, p, rrpaylen,
+							 &pp, sizeof(ptr));
+				if (n < 0)
+					return -1;
+
+				cb(stack[0].name, opaque, ttl, rrtype,
+				   (const uint8_t *)ptr);
+				found++;
+			}
 			break;
 
 		case LWS_ADNS_RECORD_CNAME:
@@ -369,7 +389,11 @@ skip:
 	}
 
 	if (!stp)
-		return 1; /* we didn't find anything, but we didn't error */
+		return !found; /* 1 = we didn't find anything, but no error */
+
+	if (found)
+		/* the CNAME's resolution was also in the packet */
+		return 0;
 
 	lwsl_info("%s: '%s' -> CNAME '%s' resolution not provided, recursing\n",
 			__func__, ((const char *)&q[1]) + DNS_MAX,
@@ -428,6 +452,17 @@ skip:
 	return 2;
 }
 
+/*
+ * PTR results store the name after the addrinfo instead of a sockaddr, padded
+ * so any following addrinfo stays aligned
+ */
+
+static size_t
+lws_adns_ptr_size(const char *ptr)
+{
+	return (strlen(ptr) + 1 + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
 int
 lws_async_dns_estimate(const char *name, void *opaque, uint32_t ttl,
 			adns_query_type_t type, const uint8_t *payload)
@@ -435,7 +470,9 @@ lws_async_dns_estimate(const char *name, void *opaque, uint32_t ttl,
 	size_t *est = (size_t *)opaque, my;
 
 	my = sizeof(struct addrinfo);
-	if (type == LWS_ADNS_RECORD_AAAA)
+	if (type == LWS_ADNS_RECORD_PTR)
+		my += lws_adns_ptr_size((const char *)payload);
+	else if (type == LWS_ADNS_RECORD_AAAA)
 		my += sizeof(struct sockaddr_in6);
 	else
 		my += sizeof(struct sockaddr_in);
@@ -475,6 +512,29 @@ lws_async_dns_store(const char *name, void *opaque, uint32_t ttl,
 		adst->prev->ai_next = adst->pos;
 	adst->prev = adst->pos;
 
+	if (type == LWS_ADNS_RECORD_PTR) {
+		char *ptr = (char *)&adst->pos[1];
+
+		/* the name is the result, there's no address */
+
+		memset(adst->pos, 0, sizeof(*adst->pos));
+		i = strlen((const char *)payload);
+		memcpy(ptr, payload, i + 1);
+		if (i && ptr[i - 1] == '.')
+			ptr[i - 1] = '\0';
+		adst->pos->ai_canonname = ptr;
+
+		lwsl_info("%s: %d: %s: PTR %s\n", __func__, adst->ctr,
+			  adst->name, ptr);
+
+		adst->pos = (struct addrinfo *)((uint8_t *)adst->pos +
+				sizeof(struct addrinfo) +
+				lws_adns_ptr_size((const char *)payload));
+		adst->ctr++;
+
+		return 0;
+	}
+
 	adst->pos->ai_flags = 0;
 	adst->pos->ai_family = type == LWS_ADNS_RECORD_AAAA ?
 						AF_INET6 : AF_INET;
@@ -524,7 +584,7 @@ lws_async_dns_store(const char *name, void *opaque, uint32_t ttl,
 }
 
 /*
- * We want to parse out all A or AAAA records
+ * We want to parse out all A or AAAA records, or PTR if that's what we asked
  */
 
 void
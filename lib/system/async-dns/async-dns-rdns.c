@@ -0,0 +1,440 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2020 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Reverse dns on top of the async dns PTR and A / AAAA queries.
+ *
+ * A name from a PTR record is only trusted if a forward lookup of it gives
+ * back the same address, so there are two queries in a row.  The confirmed
+ * result is cached against the address for the PTR's TTL.
+ */
+
+#include "private-lib-core.h"
+#include "private-lib-async-dns.h"
+
+static void
+lws_adns_rdns_cache_destroy(lws_adns_rdns_cache_t *rc)
+{
+	lws_dll2_remove(&rc->sul.list);
+	lws_dll2_remove(&rc->list);
+	lws_free(rc);
+}
+
+static void
+sul_cb_rdns_expire(struct lws_sorted_usec_list *sul)
+{
+	lws_adns_rdns_cache_destroy(lws_container_of(sul,
+						lws_adns_rdns_cache_t, sul));
+}
+
+static lws_adns_rdns_cache_t *
+lws_adns_rdns_get_cache(lws_async_dns_t *dns, const lws_sockaddr46 *sa46)
+{
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      lws_dll2_get_head(&dns->rdns_cached)) {
+		lws_adns_rdns_cache_t *rc = lws_container_of(d,
+						lws_adns_rdns_cache_t, list);
+
+		if (!lws_sa46_compare_ads(&rc->sa46, sa46)) {
+			/* Keep sorted by LRU: move to the head */
+			lws_dll2_remove(&rc->list);
+			lws_dll2_add_head(&rc->list, &dns->rdns_cached);
+
+			return rc;
+		}
+	} lws_end_foreach_dll(d);
+
+	return NULL;
+}
+
+static void
+lws_adns_rdns_cache_add(lws_async_dns_t *dns, lws_adns_rdns_q_t *rq,
+			const char *name, lws_usec_t expiry)
+{
+	size_t n = name ? strlen(name) : 0;
+	lws_adns_rdns_cache_t *rc;
+
+	if (dns->rdns_cached.count >= MAX_RDNS_CACHE_ENTRIES)
+		lws_adns_rdns_cache_destroy(lws_container_of(
+				lws_dll2_get_tail(&dns->rdns_cached),
+				lws_adns_rdns_cache_t, list));
+
+	rc = lws_malloc(sizeof(*rc) + n + 1, __func__);
+	if (!rc)
+		return;
+
+	memset(rc, 0, sizeof(*rc));
+	rc->sa46 = rq->sa46;
+	memcpy(&rc[1], name ? name : "", n + 1);
+
+	lws_dll2_add_head(&rc->list, &dns->rdns_cached);
+
+	/* expiry is an absolute time, the sul wants it relative to now */
+	expiry -= lws_now_usecs();
+	if (expiry < 1)
+		expiry = 1;
+
+	lws_sul_schedule(rq->context, 0, &rc->sul, sul_cb_rdns_expire, expiry);
+}
+
+/*
+ * The leader's lookup finished: cache the result and tell everyone waiting on
+ * the same address, including the leader
+ */
+
+static void
+lws_adns_rdns_complete(lws_adns_rdns_q_t *rq, const char *name,
+		       lws_usec_t expiry)
+{
+	lws_async_dns_t *dns = &rq->context->async_dns;
+	lws_sockaddr46 sa46 = rq->sa46;
+
+	if (!name)
+		expiry = lws_now_usecs() + ((lws_usec_t)
+				(dns->rdns_negative_ttl ? dns->rdns_negative_ttl :
+				 RDNS_NEGATIVE_TTL) * LWS_US_PER_SEC);
+
+	lws_adns_rdns_cache_add(dns, rq, name, expiry);
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&dns->rdns_waiting)) {
+		lws_adns_rdns_q_t *w = lws_container_of(d, lws_adns_rdns_q_t,
+							list);
+
+		if (!lws_sa46_compare_ads(&w->sa46, &sa46)) {
+			lws_dll2_remove(&w->list);
+			if (w->cb)
+				w->cb(w->context, &w->sa46, name, w->opaque);
+			if (w != rq)
+				lws_free(w);
+		}
+	} lws_end_foreach_dll_safe(d, d1);
+
+	/* name may point into rq */
+	lws_free(rq);
+}
+
+static lws_usec_t
+lws_adns_rdns_expiry(const struct addrinfo *ai)
+{
+	lws_adns_cache_t *c = &((lws_adns_cache_t *)ai)[-1];
+
+	if (c->firstcache)
+		c = c->firstcache;
+
+	return c->sul.us;
+}
+
+static struct lws *
+lws_adns_rdns_forward_cb(struct lws *wsi, const char *ads,
+			 const struct addrinfo *result, int n, void *opaque)
+{
+	lws_adns_rdns_q_t *rq = (lws_adns_rdns_q_t *)opaque;
+	const struct addrinfo *ai = result;
+	lws_usec_t expiry = rq->expiry;
+	lws_sockaddr46 sa46;
+	int match = 0;
+
+	while (ai && !match) {
+		memset(&sa46, 0, sizeof(sa46));
+		if (ai->ai_family == AF_INET && ai->ai_addr) {
+			sa46.sa4.sin_family = AF_INET;
+			sa46.sa4.sin_addr =
+				((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+			match = !lws_sa46_compare_ads(&sa46, &rq->sa46);
+		}
+#if defined(LWS_WITH_IPV6)
+		if (ai->ai_family == AF_INET6 && ai->ai_addr) {
+			sa46.sa6.sin6_family = AF_INET6;
+			sa46.sa6.sin6_addr =
+				((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr;
+			match = !lws_sa46_compare_ads(&sa46, &rq->sa46);
+		}
+#endif
+		ai = ai->ai_next;
+	}
+
+	if (result) {
+		/* the cached result may be stale before the PTR is */
+		if (lws_adns_rdns_expiry(result) < expiry)
+			expiry = lws_adns_rdns_expiry(result);
+		lws_async_dns_freeaddrinfo(&result);
+	}
+
+	if (!match)
+		lwsl_info("%s: %s doesn't map back to the address\n",
+			  __func__, rq->name);
+
+	lws_adns_rdns_complete(rq, match ? rq->name : NULL, expiry);
+
+	return NULL;
+}
+
+/*
+ * A PTR to something like "1.2.3.4" would "confirm" by just being parsed as
+ * the address.  Top level domains are never all digits, and hostnames never
+ * have ':', so that's enough to spot them.
+ */
+
+static int
+lws_adns_rdns_numeric(const char *name)
+{
+	const char *p = strrchr(name, '.');
+
+	if (strchr(name, ':'))
+		return 1;
+
+	p = p ? p + 1 : name;
+	if (!*p)
+		return 0;
+
+	while (*p >= '0' && *p <= '9')
+		p++;
+
+	return !*p;
+}
+
+static struct lws *
+lws_adns_rdns_ptr_cb(struct lws *wsi, const char *ads,
+		     const struct addrinfo *result, int n, void *opaque)
+{
+	lws_adns_rdns_q_t *rq = (lws_adns_rdns_q_t *)opaque;
+
+	if (!result || !result->ai_canonname || !result->ai_canonname[0]) {
+		if (result)
+			lws_async_dns_freeaddrinfo(&result);
+		lws_adns_rdns_complete(rq, NULL, 0);
+
+		return NULL;
+	}
+
+	lws_strncpy(rq->name, result->ai_canonname, sizeof(rq->name));
+	rq->expiry = lws_adns_rdns_expiry(result);
+	lws_async_dns_freeaddrinfo(&result);
+
+	/*
+	 * Confirm it... this may complete, and free rq, before it returns.
+	 * A numeric "name" would just be parsed, it doesn't confirm anything.
+	 */
+
+	if (lws_adns_rdns_numeric(rq->name) ||
+	    strlen(rq->name) >= DNS_MAX - 1) {
+		lws_adns_rdns_complete(rq, NULL, 0);
+
+		return NULL;
+	}
+
+	lws_async_dns_query(rq->context, rq->tsi, rq->name,
+			    rq->sa46.sa4.sin_family == AF_INET ?
+				LWS_ADNS_RECORD_A : LWS_ADNS_RECORD_AAAA,
+			    lws_adns_rdns_forward_cb, NULL, rq);
+
+	return NULL;
+}
+
+/*
+ * 1.2.3.4 -> 4.3.2.1.in-addr.arpa
+ * 2001:db8::1 -> 1.0.0.0 ... 8.b.d.0.1.0.0.2.ip6.arpa
+ */
+
+static void
+lws_adns_rdns_qname(const lws_sockaddr46 *sa46, char *buf, size_t len)
+{
+	char *p = buf, *end = buf + len;
+	const uint8_t *a;
+	int n;
+
+#if defined(LWS_WITH_IPV6)
+	if (sa46->sa4.sin_family == AF_INET6) {
+		static const char *hex = "0123456789abcdef";
+
+		a = (const uint8_t *)&sa46->sa6.sin6_addr;
+		for (n = 15; n >= 0; n--)
+			p += lws_snprintf(p, (size_t)lws_ptr_diff(end, p),
+					  "%c.%c.", hex[a[n] & 0xf],
+					  hex[a[n] >> 4]);
+		lws_snprintf(p, (size_t)lws_ptr_diff(end, p), "ip6.arpa");
+
+		return;
+	}
+#endif
+
+	a = (const uint8_t *)&sa46->sa4.sin_addr;
+	for (n = 3; n >= 0; n--)
+		p += lws_snprintf(p, (size_t)lws_ptr_diff(end, p), "%u.", a[n]);
+	lws_snprintf(p, (size_t)lws_ptr_diff(end, p), "in-addr.arpa");
+}
+
+#if defined(LWS_WITH_IPV6)
+static const uint8_t v4mapped[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+};
+#endif
+
+lws_async_dns_retcode_t
+lws_async_dns_rdns(struct lws_context *context, int tsi,
+		   const lws_sockaddr46 *sa46, lws_async_dns_rdns_cb_t cb,
+		   void *opaque)
+{
+	lws_async_dns_t *dns = &context->async_dns;
+	lws_adns_rdns_q_t *rq;
+	lws_adns_rdns_cache_t *rc;
+	char qname[DNS_MAX];
+	int leader = 1;
+
+	rq = lws_zalloc(sizeof(*rq), __func__);
+	if (!rq) {
+		cb(context, sa46, NULL, opaque);
+
+		return LADNS_RET_FAILED;
+	}
+
+	rq->sa46 = *sa46;
+	rq->context = context;
+	rq->cb = cb;
+	rq->opaque = opaque;
+	rq->tsi = (uint8_t)tsi;
+
+#if defined(LWS_WITH_IPV6)
+	/* look up ::ffff:1.2.3.4 as 1.2.3.4, it's what the PTR is for */
+	if (sa46->sa4.sin_family == AF_INET6 &&
+	    !memcmp(&sa46->sa6.sin6_addr, v4mapped, sizeof(v4mapped))) {
+		memset(&rq->sa46, 0, sizeof(rq->sa46));
+		rq->sa46.sa4.sin_family = AF_INET;
+		memcpy(&rq->sa46.sa4.sin_addr,
+		       &sa46->sa6.sin6_addr.s6_addr[12], 4);
+	}
+#endif
+
+	if (rq->sa46.sa4.sin_family != AF_INET
+#if defined(LWS_WITH_IPV6)
+	    && rq->sa46.sa4.sin_family != AF_INET6
+#endif
+	) {
+		lws_free(rq);
+		cb(context, sa46, NULL, opaque);
+
+		return LADNS_RET_FAILED;
+	}
+
+	rc = lws_adns_rdns_get_cache(dns, &rq->sa46);
+	if (rc) {
+		const char *name = (const char *)&rc[1];
+
+		lws_free(rq);
+		cb(context, sa46, *name ? name : NULL, opaque);
+
+		return LADNS_RET_FOUND;
+	}
+
+	/* if someone is already looking up this address, wait on theirs */
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      lws_dll2_get_head(&dns->rdns_waiting)) {
+		lws_adns_rdns_q_t *w = lws_container_of(d, lws_adns_rdns_q_t,
+							list);
+
+		if (!lws_sa46_compare_ads(&w->sa46, &rq->sa46)) {
+			leader = 0;
+			break;
+		}
+	} lws_end_foreach_dll(d);
+
+	lws_dll2_add_tail(&rq->list, &dns->rdns_waiting);
+	if (!leader)
+		return LADNS_RET_CONTINUING;
+
+	rq->leader = 1;
+	lws_adns_rdns_qname(&rq->sa46, qname, sizeof(qname));
+
+	/* don't touch rq after this, it may already be completed */
+
+	lws_async_dns_query(context, tsi, qname, LWS_ADNS_RECORD_PTR,
+			    lws_adns_rdns_ptr_cb, NULL, rq);
+
+	return LADNS_RET_CONTINUING;
+}
+
+void
+lws_async_dns_rdns_cancel(struct lws_context *context, void *opaque)
+{
+	lws_async_dns_t *dns = &context->async_dns;
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&dns->rdns_waiting)) {
+		lws_adns_rdns_q_t *w = lws_container_of(d, lws_adns_rdns_q_t,
+							list);
+
+		if (w->opaque == opaque) {
+			if (w->leader)
+				/* its queries still refer to it, just mute it */
+				w->cb = NULL;
+			else {
+				lws_dll2_remove(&w->list);
+				lws_free(w);
+			}
+		}
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
+lws_async_dns_retcode_t
+lws_get_peer_name_async(struct lws *wsi, lws_async_dns_rdns_cb_t cb,
+			void *opaque)
+{
+	lws_sockaddr46 sa46;
+	socklen_t len = sizeof(sa46);
+
+	memset(&sa46, 0, sizeof(sa46));
+	wsi = lws_get_network_wsi(wsi);
+	if (getpeername(wsi->desc.sockfd, (struct sockaddr *)&sa46, &len) < 0) {
+		lwsl_info("%s: getpeername: %d\n", __func__, LWS_ERRNO);
+		cb(wsi->context, &sa46, NULL, opaque);
+
+		return LADNS_RET_FAILED;
+	}
+
+	return lws_async_dns_rdns(wsi->context, wsi->tsi, &sa46, cb, opaque);
+}
+
+static int
+rdns_clean(struct lws_dll2 *d, void *user)
+{
+	lws_free(lws_container_of(d, lws_adns_rdns_q_t, list));
+
+	return 0;
+}
+
+static int
+rdns_cache_clean(struct lws_dll2 *d, void *user)
+{
+	lws_adns_rdns_cache_destroy(lws_container_of(d, lws_adns_rdns_cache_t,
+						     list));
+
+	return 0;
+}
+
+void
+lws_async_dns_rdns_deinit(lws_async_dns_t *dns)
+{
+	lws_dll2_foreach_safe(&dns->rdns_waiting, NULL, rdns_clean);
+	lws_dll2_foreach_safe(&dns->rdns_cached, NULL, rdns_cache_clean);
+}
@@ -158,7 +158,11 @@ lws_async_dns_writeable(struct lws *wsi, lws_adns_q_t *q)
 	memset(p, 0, DHO_SIZEOF);
 
 #if defined(LWS_WITH_IPV6)
-	if (!q->responded) {
+	if (q->qtype == LWS_ADNS_RECORD_PTR) {
+		/* there's just the one query */
+		which = 0;
+		q->asked = 1;
+	} else if (!q->responded) {
 		/* must pick between ipv6 and ipv4 */
 		which = q->sent[0] >= q->sent[1];
 		q->sent[which]++;
@@ -203,8 +207,11 @@ lws_async_dns_writeable(struct lws *wsi, lws_adns_q_t *q)
 		goto qfail;
 	}
 
-	lws_ser_wu16be(p, which ? LWS_ADNS_RECORD_AAAA :
-				     LWS_ADNS_RECORD_A);
+	if (q->qtype == LWS_ADNS_RECORD_PTR)
+		lws_ser_wu16be(p, LWS_ADNS_RECORD_PTR);
+	else
+		lws_ser_wu16be(p, which ? LWS_ADNS_RECORD_AAAA :
+					     LWS_ADNS_RECORD_A);
 	p += 2;
 
 	lws_ser_wu16be(p, 1); /* IN class */
@@ -220,7 +227,8 @@ lws_async_dns_writeable(struct lws *wsi, lws_adns_q_t *q)
 	}
 
 #if defined(LWS_WITH_IPV6)
-	if (!q->responded && q->sent[0] != q->sent[1])
+	if (q->qtype != LWS_ADNS_RECORD_PTR &&
+	    !q->responded && q->sent[0] != q->sent[1])
 		lws_callback_on_writable(wsi);
 #endif
 
@@ -444,6 +452,7 @@ clean(struct lws_dll2 *d, void *user)
 void
 lws_async_dns_deinit(lws_async_dns_t *dns)
 {
+	lws_async_dns_rdns_deinit(dns);
 	lws_dll2_foreach_safe(&dns->waiting, NULL, clean);
 	lws_dll2_foreach_safe(&dns->cached, NULL, cache_clean);
 }
@@ -660,10 +669,13 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 		goto failed;
 	}
 
-	/* there's an ongoing query we can share the result of */
+	/*
+	 * there's an ongoing query we can share the result of... only wsi can
+	 * be listed on it, a standalone cb needs a query of its own
+	 */
 
 	q = lws_adns_get_query(dns, qtype, &dns->waiting, 0, name);
-	if (q) {
+	if (q && wsi) {
 		lwsl_debug("%s: dns piggybacking: %d:%s\n", __func__,
 				qtype, name);
 		if (wsi)
@@ -28,6 +28,8 @@
 #define DNS_PACKET_LEN		1400	/* Buffer size for DNS packet	*/
 #define MAX_CACHE_ENTRIES	10	/* Dont cache more than that	*/
 #define DNS_QUERY_TIMEOUT	30	/* Query timeout, seconds	*/
+#define MAX_RDNS_CACHE_ENTRIES	32	/* Addresses with cached names	*/
+#define RDNS_NEGATIVE_TTL	60	/* Default for caching failures	*/
 
 /*
  * ... when we completed a query then the query object is destroyed and a
@@ -84,6 +86,39 @@ typedef struct {
 	/* name overallocated here */
 } lws_adns_q_t;
 
+/*
+ * lws_async_dns_rdns() results are cached against the address, so repeat
+ * lookups don't need to find the PTR and confirm it again
+ */
+
+typedef struct lws_adns_rdns_cache {
+	lws_sorted_usec_list_t	sul;	/* for cache TTL management */
+	lws_dll2_t		list;
+
+	lws_sockaddr46		sa46;
+	/* confirmed name overallocated here, "" if none */
+} lws_adns_rdns_cache_t;
+
+/*
+ * ... and these are used while the PTR and forward lookups are ongoing.  If
+ * there's already one ongoing for the same address, later ones just wait on
+ * the leader's result.
+ */
+
+typedef struct {
+	lws_dll2_t		list;
+
+	lws_sockaddr46		sa46;
+	struct lws_context	*context;
+	lws_async_dns_rdns_cb_t	cb;	/* NULL if cancelled */
+	void			*opaque;
+	lws_usec_t		expiry;	/* of the PTR result */
+	uint8_t			tsi;
+	uint8_t			leader;
+
+	char			name[DNS_MAX]; /* PTR result being confirmed */
+} lws_adns_rdns_q_t;
+
 enum {
 	DHO_TID,
 	DHO_FLAGS = 2,
@@ -122,3 +157,6 @@ lws_async_dns_trim_cache(lws_async_dns_t *dns);
 
 int
 lws_async_dns_get_new_tid(struct lws_context *context, lws_adns_q_t *q);
+
+void
+lws_async_dns_rdns_deinit(lws_async_dns_t *dns);
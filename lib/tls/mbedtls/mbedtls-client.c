@@ -246,6 +246,48 @@ lws_tls_client_confirm_peer_cert(struct lws *wsi, char *ebuf, int ebuf_len)
 	return -1;
 }
 
+/* a leading "*." in the SAN may only stand in for exactly one label */
+
+static int
+lws_tls_mbedtls_san_match(const char *san, size_t len, const char *host)
+{
+	size_t hl = strlen(host);
+	const char *dot;
+
+	if (len == hl && !strncasecmp(san, host, len))
+		return 1;
+
+	if (len < 3 || san[0] != '*' || san[1] != '.')
+		return 0;
+
+	dot = strchr(host, '.');
+	if (!dot || dot == host)
+		return 0;
+
+	return (size_t)(hl - lws_ptr_diff(dot, host)) == len - 1 &&
+	       !strncasecmp(san + 1, dot, len - 1);
+}
+
+int
+lws_tls_client_peer_cert_covers(struct lws *wsi, const char *host)
+{
+	const mbedtls_x509_crt *x509 =
+			ssl_get_peer_mbedtls_x509_crt(wsi->tls.ssl);
+	const mbedtls_x509_sequence *san;
+
+	if (!x509)
+		return 0;
+
+	for (san = &x509->subject_alt_names; san && san->buf.p;
+							san = san->next)
+		if (san->buf.tag == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2) &&
+		    lws_tls_mbedtls_san_match((const char *)san->buf.p,
+					      san->buf.len, host))
+			return 1;
+
+	return 0;
+}
+
 int
 lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 				    const struct lws_context_creation_info *info,
@@ -47,7 +47,7 @@ lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 {
 	struct lws_context *context = wsi->context;
 	struct lws_context_per_thread *pt = &context->pt[(int)wsi->tsi];
-	int n = 0, m;
+	int n = 0;
 
 	if (!wsi->tls.ssl)
 		return lws_ssl_capable_read_no_ssl(wsi, buf, len);
@@ -55,7 +55,12 @@ lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 	lws_stats_bump(pt, LWSSTATS_C_API_READ, 1);
 
 	errno = 0;
-	n = SSL_read(wsi->tls.ssl, buf, len);
+	/*
+	 * This is the hot path, go to mbedtls directly rather than through
+	 * the OpenSSL api emulation
+	 */
+	n = mbedtls_ssl_read(SSL_mbedtls_ssl_context_from_SSL(wsi->tls.ssl),
+			     buf, (size_t)len);
 #if defined(LWS_PLAT_FREERTOS)
 	if (!n && errno == LWS_ENOTCONN) {
 		lwsl_debug("%p: SSL_read ENOTCONN\n", wsi);
@@ -81,27 +86,25 @@ lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 	}
 
 	if (n < 0) {
-		m = SSL_get_error(wsi->tls.ssl, n);
-		lwsl_debug("%p: ssl err %d errno %d\n", wsi, m, errno);
+		lwsl_debug("%p: mbedtls_ssl_read -0x%x errno %d\n", wsi, -n,
+			   errno);
 		if (errno == LWS_ENOTCONN) {
 			/* If the socket isn't connected anymore, bail out. */
 			wsi->socket_is_permanently_unusable = 1;
 			return LWS_SSL_CAPABLE_ERROR;
 		}
-		if (m == SSL_ERROR_ZERO_RETURN ||
-		    m == SSL_ERROR_SYSCALL)
-			return LWS_SSL_CAPABLE_ERROR;
 
-		if (m == SSL_ERROR_WANT_READ || SSL_want_read(wsi->tls.ssl)) {
-			lwsl_debug("%s: WANT_READ\n", __func__);
-			lwsl_debug("%p: LWS_SSL_CAPABLE_MORE_SERVICE\n", wsi);
-			return LWS_SSL_CAPABLE_MORE_SERVICE;
-		}
-		if (m == SSL_ERROR_WANT_WRITE || SSL_want_write(wsi->tls.ssl)) {
-			lwsl_debug("%s: WANT_WRITE\n", __func__);
+		switch (n) {
+		case MBEDTLS_ERR_SSL_WANT_READ:
+		case MBEDTLS_ERR_SSL_WANT_WRITE:
 			lwsl_debug("%p: LWS_SSL_CAPABLE_MORE_SERVICE\n", wsi);
 			return LWS_SSL_CAPABLE_MORE_SERVICE;
+
+		case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+			/* cleanly shut down */
+			return LWS_SSL_CAPABLE_ERROR;
 		}
+
 		wsi->socket_is_permanently_unusable = 1;
 
 		return LWS_SSL_CAPABLE_ERROR;
@@ -136,10 +139,8 @@ lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 	if (!wsi->tls.ssl)
 		goto bail;
 
-	if (SSL_pending(wsi->tls.ssl) &&
-	    lws_dll2_is_detached(&wsi->tls.dll_pending_tls))
-		lws_dll2_add_head(&wsi->tls.dll_pending_tls,
-				 &pt->tls.dll_pending_tls_owner);
+	if (SSL_pending(wsi->tls.ssl))
+		__lws_ssl_add_wsi_to_buffered_list(pt, wsi);
 
 	return n;
 bail:
@@ -192,6 +192,9 @@ struct ssl_ctx_st
     int read_buffer_len;
 
     X509_VERIFY_PARAM param;
+
+    /* platform state shared by connections from this ctx, eg, sessions */
+    void *ssl_ctx_pm;
 };
 
 struct ssl_st
@@ -28,6 +28,10 @@
 int ssl_pm_new(SSL *ssl);
 void ssl_pm_free(SSL *ssl);
 
+int ssl_ctx_pm_new(SSL_CTX *ctx);
+void ssl_ctx_pm_free(SSL_CTX *ctx);
+void ssl_ctx_pm_set_timeout(SSL_CTX *ctx, long t);
+
 int ssl_pm_handshake(SSL *ssl);
 int ssl_pm_shutdown(SSL *ssl);
 int ssl_pm_clear(SSL *ssl);
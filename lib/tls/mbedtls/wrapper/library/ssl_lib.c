@@ -18,6 +18,7 @@
 #include "ssl_cert.h"
 #include "ssl_dbg.h"
 #include "ssl_port.h"
+#include "ssl_pm.h"
 
 #include "private-lib-core.h"
 
@@ -217,8 +218,15 @@ SSL_CTX* SSL_CTX_new(const SSL_METHOD *method)
 
     ctx->version = method->version;
 
+    if (ssl_ctx_pm_new(ctx)) {
+        SSL_DEBUG(SSL_LIB_ERROR_LEVEL, "ssl_ctx_pm_new() return -1");
+        goto failed4;
+    }
+
     return ctx;
 
+failed4:
+    ssl_mem_free(ctx);
 failed3:
     ssl_cert_free(cert);
 failed2:
@@ -241,6 +249,8 @@ void SSL_CTX_free(SSL_CTX* ctx)
     if (ctx->alpn_protos)
 	    ssl_mem_free(ctx->alpn_protos);
 
+    ssl_ctx_pm_free(ctx);
+
     ssl_mem_free(ctx);
 }
 
@@ -914,6 +924,7 @@ long SSL_CTX_set_timeout(SSL_CTX *ctx, long t)
 
     l = ctx->session_timeout;
     ctx->session_timeout = t;
+    ssl_ctx_pm_set_timeout(ctx, t);
 
     return l;
 }
@@ -28,11 +28,22 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/error.h"
 #include "mbedtls/certs.h"
+#if defined(MBEDTLS_SSL_CACHE_C)
+#include "mbedtls/ssl_cache.h"
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+#include "mbedtls/ssl_ticket.h"
+#endif
 
 #include "private-lib-core.h"
 
 #define X509_INFO_STRING_LENGTH 8192
 
+/* how many client sessions per SSL_CTX we keep for resumption */
+#if !defined(LWS_MBEDTLS_CLIENT_SESSIONS)
+#define LWS_MBEDTLS_CLIENT_SESSIONS 4
+#endif
+
 struct ssl_pm
 {
     /* local socket file description */
@@ -49,6 +60,37 @@ struct ssl_pm
     mbedtls_entropy_context entropy;
 
     SSL *owner;
+
+    int resume_tried;
+};
+
+/*
+ * One of these per SSL_CTX, holding what lets a connection from it skip the
+ * full handshake: the server session cache and ticket key, and the last few
+ * client sessions by hostname
+ */
+
+struct ssl_ctx_pm
+{
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_context cache;
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_ssl_ticket_context ticket;
+    int ticket_ok;
+#endif
+#if defined(MBEDTLS_SSL_CLI_C)
+    struct {
+        char host[64];
+        mbedtls_ssl_session session;
+    } cs[LWS_MBEDTLS_CLIENT_SESSIONS];
+    int cs_next;
+#if LWS_MAX_SMP > 1
+    pthread_mutex_t lock; /* cs[] is shared by every pt using the ctx */
+#endif
+#endif
 };
 
 struct x509_pm
@@ -96,12 +138,181 @@ static void ssl_platform_debug(void *ctx, int level,
 }
 //#endif
 
+/**
+ * @brief create the SSL_CTX low-level object, done once with the SSL_CTX so
+ *        that the SSL created from it later only ever read it
+ */
+int ssl_ctx_pm_new(SSL_CTX *ctx)
+{
+    struct ssl_ctx_pm *ctx_pm;
+#if defined(MBEDTLS_SSL_TICKET_C)
+    const unsigned char pers[] = "lws ticket";
+#endif
+#if defined(MBEDTLS_SSL_CLI_C)
+    int n;
+#endif
+
+    ctx_pm = ssl_mem_zalloc(sizeof(struct ssl_ctx_pm));
+    if (!ctx_pm) {
+        SSL_DEBUG(SSL_PLATFORM_ERROR_LEVEL, "no enough memory > (ctx_pm)");
+        return -1;
+    }
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+    /* the cache timeout follows SSL_CTX_set_timeout() from here on */
+    mbedtls_ssl_cache_init(&ctx_pm->cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_entropy_init(&ctx_pm->entropy);
+    mbedtls_ctr_drbg_init(&ctx_pm->ctr_drbg);
+    mbedtls_ssl_ticket_init(&ctx_pm->ticket);
+
+    /* the ticket key is only needed by servers */
+    if (ctx->method->endpoint &&
+        !mbedtls_ctr_drbg_seed(&ctx_pm->ctr_drbg, mbedtls_entropy_func,
+                               &ctx_pm->entropy, pers, sizeof(pers)) &&
+        !mbedtls_ssl_ticket_setup(&ctx_pm->ticket, mbedtls_ctr_drbg_random,
+                                  &ctx_pm->ctr_drbg,
+                                  MBEDTLS_CIPHER_AES_256_GCM, 86400))
+        ctx_pm->ticket_ok = 1;
+#endif
+#if defined(MBEDTLS_SSL_CLI_C)
+    for (n = 0; n < LWS_MBEDTLS_CLIENT_SESSIONS; n++)
+        mbedtls_ssl_session_init(&ctx_pm->cs[n].session);
+#if LWS_MAX_SMP > 1
+    pthread_mutex_init(&ctx_pm->lock, NULL);
+#endif
+#endif
+
+    ctx->ssl_ctx_pm = ctx_pm;
+
+    return 0;
+}
+
+/**
+ * @brief follow SSL_CTX_set_timeout() for the server session cache; the
+ *        ticket lifetime stays what it was when the ctx was created
+ */
+void ssl_ctx_pm_set_timeout(SSL_CTX *ctx, long t)
+{
+#if defined(MBEDTLS_SSL_CACHE_C) && defined(MBEDTLS_HAVE_TIME)
+    struct ssl_ctx_pm *ctx_pm = (struct ssl_ctx_pm *)ctx->ssl_ctx_pm;
+
+    if (ctx_pm && t > 0)
+        mbedtls_ssl_cache_set_timeout(&ctx_pm->cache, (int)t);
+#else
+    (void)ctx;
+    (void)t;
+#endif
+}
+
+void ssl_ctx_pm_free(SSL_CTX *ctx)
+{
+    struct ssl_ctx_pm *ctx_pm = (struct ssl_ctx_pm *)ctx->ssl_ctx_pm;
+#if defined(MBEDTLS_SSL_CLI_C)
+    int n;
+#endif
+
+    if (!ctx_pm)
+        return;
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_free(&ctx_pm->cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_free(&ctx_pm->ticket);
+    mbedtls_ctr_drbg_free(&ctx_pm->ctr_drbg);
+    mbedtls_entropy_free(&ctx_pm->entropy);
+#endif
+#if defined(MBEDTLS_SSL_CLI_C)
+    for (n = 0; n < LWS_MBEDTLS_CLIENT_SESSIONS; n++)
+        mbedtls_ssl_session_free(&ctx_pm->cs[n].session);
+#if LWS_MAX_SMP > 1
+    pthread_mutex_destroy(&ctx_pm->lock);
+#endif
+#endif
+
+    ssl_mem_free(ctx_pm);
+    ctx->ssl_ctx_pm = NULL;
+}
+
+#if defined(MBEDTLS_SSL_CLI_C) && defined(MBEDTLS_X509_CRT_PARSE_C)
+
+/*
+ * Before a client handshake starts, offer the session we kept from the last
+ * connection to the same host, if any
+ */
+
+static void ssl_pm_client_resume(struct ssl_pm *ssl_pm)
+{
+    struct ssl_ctx_pm *ctx_pm = ssl_pm->owner->ctx->ssl_ctx_pm;
+    const char *host = ssl_pm->ssl.hostname;
+    int n;
+
+    ssl_pm->resume_tried = 1;
+
+    if (!ctx_pm || !host)
+        return;
+
+#if LWS_MAX_SMP > 1
+    pthread_mutex_lock(&ctx_pm->lock);
+#endif
+    for (n = 0; n < LWS_MBEDTLS_CLIENT_SESSIONS; n++)
+        if (!strcmp(ctx_pm->cs[n].host, host)) {
+            /* this copies the session, so the slot may be reused after */
+            if (mbedtls_ssl_set_session(&ssl_pm->ssl,
+                                        &ctx_pm->cs[n].session))
+                lwsl_info("%s: unable to offer session\n", __func__);
+            break;
+        }
+#if LWS_MAX_SMP > 1
+    pthread_mutex_unlock(&ctx_pm->lock);
+#endif
+}
+
+/* after a client handshake completed, keep its session for next time */
+
+static void ssl_pm_client_keep_session(struct ssl_pm *ssl_pm)
+{
+    struct ssl_ctx_pm *ctx_pm = ssl_pm->owner->ctx->ssl_ctx_pm;
+    const char *host = ssl_pm->ssl.hostname;
+    int n;
+
+    if (!ctx_pm || !host || strlen(host) >= sizeof(ctx_pm->cs[0].host))
+        return;
+
+#if LWS_MAX_SMP > 1
+    pthread_mutex_lock(&ctx_pm->lock);
+#endif
+    for (n = 0; n < LWS_MBEDTLS_CLIENT_SESSIONS; n++)
+        if (!strcmp(ctx_pm->cs[n].host, host))
+            break;
+
+    if (n == LWS_MBEDTLS_CLIENT_SESSIONS) {
+        n = ctx_pm->cs_next;
+        ctx_pm->cs_next = (n + 1) % LWS_MBEDTLS_CLIENT_SESSIONS;
+    }
+
+    mbedtls_ssl_session_free(&ctx_pm->cs[n].session);
+    mbedtls_ssl_session_init(&ctx_pm->cs[n].session);
+    ctx_pm->cs[n].host[0] = '\0';
+
+    if (!mbedtls_ssl_get_session(&ssl_pm->ssl, &ctx_pm->cs[n].session))
+        lws_strncpy(ctx_pm->cs[n].host, host, sizeof(ctx_pm->cs[n].host));
+#if LWS_MAX_SMP > 1
+    pthread_mutex_unlock(&ctx_pm->lock);
+#endif
+}
+
+#endif
+
 /**
  * @brief create SSL low-level object
  */
 int ssl_pm_new(SSL *ssl)
 {
     struct ssl_pm *ssl_pm;
+    struct ssl_ctx_pm *ctx_pm;
     int ret;
 
     const unsigned char pers[] = "OpenSSL PM";
@@ -120,10 +331,9 @@ int ssl_pm_new(SSL *ssl)
 
     ssl_pm->owner = ssl;
 
-    if (!ssl->ctx->read_buffer_len)
-	    ssl->ctx->read_buffer_len = 2048;
-
-    max_content_len = ssl->ctx->read_buffer_len;
+    /* leave ctx->read_buffer_len 0 unless the user set it, see MFL below */
+    max_content_len = ssl->ctx->read_buffer_len ?
+		      (unsigned int)ssl->ctx->read_buffer_len : 2048;
     // printf("ssl->ctx->read_buffer_len = %d ++++++++++++++++++++\n", ssl->ctx->read_buffer_len);
 
     mbedtls_net_init(&ssl_pm->fd);
@@ -171,6 +381,47 @@ int ssl_pm_new(SSL *ssl)
 
     mbedtls_ssl_conf_rng(&ssl_pm->conf, mbedtls_ctr_drbg_random, &ssl_pm->ctr_drbg);
 
+    ctx_pm = (struct ssl_ctx_pm *)ssl->ctx->ssl_ctx_pm;
+#if defined(MBEDTLS_SSL_SRV_C)
+    if (ctx_pm && endpoint == MBEDTLS_SSL_IS_SERVER) {
+#if defined(MBEDTLS_SSL_CACHE_C)
+        mbedtls_ssl_conf_session_cache(&ssl_pm->conf, &ctx_pm->cache,
+                                       mbedtls_ssl_cache_get,
+                                       mbedtls_ssl_cache_set);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+        if (ctx_pm->ticket_ok)
+            mbedtls_ssl_conf_session_tickets_cb(&ssl_pm->conf,
+                                                mbedtls_ssl_ticket_write,
+                                                mbedtls_ssl_ticket_parse,
+                                                &ctx_pm->ticket);
+#endif
+    }
+#else
+    (void)ctx_pm;
+#endif
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    /*
+     * If the user asked for a small read buffer, ask the server to keep its
+     * records that small too.  With MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH, both
+     * sides' record buffers then shrink to fit after the handshake.
+     */
+    if (endpoint == MBEDTLS_SSL_IS_CLIENT && ssl->ctx->read_buffer_len &&
+        ssl->ctx->read_buffer_len <= 4096) {
+        unsigned char mfl = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+
+        if (ssl->ctx->read_buffer_len <= 512)
+            mfl = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+        else if (ssl->ctx->read_buffer_len <= 1024)
+            mfl = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+        else if (ssl->ctx->read_buffer_len <= 2048)
+            mfl = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+
+        mbedtls_ssl_conf_max_frag_len(&ssl_pm->conf, mfl);
+    }
+#endif
+
 //#ifdef CONFIG_OPENSSL_LOWLEVEL_DEBUG
  //   mbedtls_debug_set_threshold(MBEDTLS_DEBUG_LEVEL);
 //    mbedtls_ssl_conf_dbg(&ssl_pm->conf, ssl_platform_debug, NULL);
@@ -305,6 +556,10 @@ int ssl_pm_handshake(SSL *ssl)
     }
 
     if (ssl_pm->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+#if defined(MBEDTLS_SSL_CLI_C) && defined(MBEDTLS_X509_CRT_PARSE_C)
+	    if (!ssl->method->endpoint && !ssl_pm->resume_tried)
+		    ssl_pm_client_resume(ssl_pm);
+#endif
 	    ssl_speed_up_enter();
 
 	   /* mbedtls return codes
@@ -331,6 +586,12 @@ int ssl_pm_handshake(SSL *ssl)
     if (ret == 0) { /* successful */
         struct x509_pm *x509_pm = (struct x509_pm *)ssl->session->peer->x509_pm;
 
+#if defined(MBEDTLS_SSL_CLI_C) && defined(MBEDTLS_X509_CRT_PARSE_C)
+        if (!ssl->method->endpoint && ssl_pm->resume_tried == 1) {
+            ssl_pm_client_keep_session(ssl_pm);
+            ssl_pm->resume_tried = 2; /* only once per connection */
+        }
+#endif
         x509_pm->ex_crt = (mbedtls_x509_crt *)mbedtls_ssl_get_peer_cert(&ssl_pm->ssl);
         return 1; /* openssl successful */
     }
@@ -891,6 +1152,11 @@ SSL *SSL_SSL_from_mbedtls_ssl_context(mbedtls_ssl_context *msc)
 	return ssl_pm->owner;
 }
 
+mbedtls_ssl_context *SSL_mbedtls_ssl_context_from_SSL(SSL *ssl)
+{
+	return &((struct ssl_pm *)ssl->ssl_pm)->ssl;
+}
+
 #include "ssl_cert.h"
 
 void SSL_set_SSL_CTX(SSL *ssl, SSL_CTX *ctx)
@@ -218,6 +218,8 @@ lws_ssl_client_bio_create(struct lws *wsi)
 #if !defined(USE_WOLFSSL)
 	SSL_set_mode(wsi->tls.ssl,  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 #endif
+	/* the handshake is i/o too */
+	lws_tls_hot_touch(wsi);
 	/*
 	 * use server name indication (SNI), if supported,
 	 * when establishing connection
@@ -489,6 +491,30 @@ lws_tls_client_confirm_peer_cert(struct lws *wsi, char *ebuf, int ebuf_len)
 #endif
 }
 
+/*
+ * Returns nonzero if the peer certificate on this connection is also valid
+ * for another authority, ie, one of its SANs matches host
+ */
+
+int
+lws_tls_client_peer_cert_covers(struct lws *wsi, const char *host)
+{
+#if defined(LWS_HAVE_X509_check_host)
+	X509 *x509 = SSL_get_peer_certificate(wsi->tls.ssl);
+	int n;
+
+	if (!x509)
+		return 0;
+
+	n = X509_check_host(x509, host, strlen(host), 0, NULL) == 1;
+	X509_free(x509);
+
+	return n;
+#else
+	return 0;
+#endif
+}
+
 int
 lws_tls_client_vhost_extra_cert_mem(struct lws_vhost *vh,
                 const uint8_t *der, size_t der_len)
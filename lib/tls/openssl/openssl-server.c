@@ -582,6 +582,8 @@ lws_tls_server_new_nonblocking(struct lws *wsi, lws_sockfd_type accept_fd)
 
 	SSL_set_mode(wsi->tls.ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
 				   SSL_MODE_RELEASE_BUFFERS);
+	/* the handshake is i/o too */
+	lws_tls_hot_touch(wsi);
 	bio = SSL_get_rbio(wsi->tls.ssl);
 	if (bio)
 		BIO_set_nbio(bio, 1); /* nonblocking */
@@ -606,6 +608,7 @@ int
 lws_tls_server_abort_connection(struct lws *wsi)
 {
 	SSL_shutdown(wsi->tls.ssl);
+	__lws_tls_hot_remove(wsi);
 	SSL_free(wsi->tls.ssl);
 
 	return 0;
@@ -635,10 +638,8 @@ lws_tls_server_accept(struct lws *wsi)
 
 		lws_openssl_describe_cipher(wsi);
 
-		if (SSL_pending(wsi->tls.ssl) &&
-		    lws_dll2_is_detached(&wsi->tls.dll_pending_tls))
-			lws_dll2_add_head(&wsi->tls.dll_pending_tls,
-					  &pt->tls.dll_pending_tls_owner);
+		if (SSL_pending(wsi->tls.ssl))
+			__lws_ssl_add_wsi_to_buffered_list(pt, wsi);
 
 		return LWS_SSL_CAPABLE_DONE;
 	}
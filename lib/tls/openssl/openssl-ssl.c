@@ -173,6 +173,57 @@ lws_ssl_destroy(struct lws_vhost *vhost)
 #endif
 }
 
+#if defined(LWS_HAVE_SSL_free_buffers)
+
+/*
+ * OpenSSL reads and writes records through its own ~16KB buffers per
+ * connection.  With SSL_MODE_RELEASE_BUFFERS it frees them each time they
+ * empty, costing a malloc + free of the read buffer for every record read;
+ * without it, every idle connection holds them forever.
+ *
+ * So instead, up to LWS_TLS_HOT_BUFFERS connections per pt are allowed to
+ * keep their buffers, kept on an LRU list by last i/o.  Touching one that
+ * isn't on it when the list is full makes the least recently used one give
+ * its buffers back.  Steady-state i/o on busy connections then doesn't
+ * allocate, and the memory held by idle ones stays bounded.
+ */
+
+#if !defined(LWS_TLS_HOT_BUFFERS)
+#define LWS_TLS_HOT_BUFFERS 32
+#endif
+
+void
+lws_tls_hot_touch(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->context->pt[(int)wsi->tsi];
+	struct lws *lru;
+
+	if (pt->tls.hot_owner.head == &wsi->tls.dll_hot)
+		return;
+
+	if (lws_dll2_is_detached(&wsi->tls.dll_hot)) {
+		/* OpenSSL should only free the buffers when we say so */
+		SSL_clear_mode(wsi->tls.ssl, SSL_MODE_RELEASE_BUFFERS);
+
+		if (pt->tls.hot_owner.count >= LWS_TLS_HOT_BUFFERS) {
+			lru = lws_container_of(pt->tls.hot_owner.tail,
+					       struct lws, tls.dll_hot);
+			lws_dll2_remove(&lru->tls.dll_hot);
+			/*
+			 * This fails harmlessly if it still has buffered rx,
+			 * that will bring it back on the list soon anyway
+			 */
+			if (lru->tls.ssl)
+				SSL_free_buffers(lru->tls.ssl);
+		}
+	} else
+		lws_dll2_remove(&wsi->tls.dll_hot);
+
+	lws_dll2_add_head(&wsi->tls.dll_hot, &pt->tls.hot_owner);
+}
+
+#endif
+
 int
 lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 {
@@ -265,6 +316,7 @@ lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 	}
 
 	lws_stats_bump(pt, LWSSTATS_B_READ, n);
+	lws_tls_hot_touch(wsi);
 
 #if defined(LWS_WITH_SERVER_STATUS)
 	if (wsi->vhost)
@@ -297,10 +349,8 @@ lws_ssl_capable_read(struct lws *wsi, unsigned char *buf, int len)
 	if (!wsi->tls.ssl)
 		goto bail;
 
-	if (SSL_pending(wsi->tls.ssl) &&
-	    lws_dll2_is_detached(&wsi->tls.dll_pending_tls))
-		lws_dll2_add_head(&wsi->tls.dll_pending_tls,
-				  &pt->tls.dll_pending_tls_owner);
+	if (SSL_pending(wsi->tls.ssl))
+		__lws_ssl_add_wsi_to_buffered_list(pt, wsi);
 
 	return n;
 bail:
@@ -332,8 +382,11 @@ lws_ssl_capable_write(struct lws *wsi, unsigned char *buf, int len)
 	errno = 0;
 	ERR_clear_error();
 	n = SSL_write(wsi->tls.ssl, buf, len);
-	if (n > 0)
+	if (n > 0) {
+		lws_tls_hot_touch(wsi);
+
 		return n;
+	}
 
 	m = lws_ssl_get_error(wsi, n);
 	if (m != SSL_ERROR_SYSCALL) {
@@ -415,6 +468,7 @@ lws_ssl_close(struct lws *wsi)
 	if (!wsi->socket_is_permanently_unusable)
 		SSL_shutdown(wsi->tls.ssl);
 	compatible_close(n);
+	__lws_tls_hot_remove(wsi);
 	SSL_free(wsi->tls.ssl);
 	wsi->tls.ssl = NULL;
 
@@ -39,6 +39,10 @@ struct lws_context_tls {
 
 struct lws_pt_tls {
 	struct lws_dll2_owner dll_pending_tls_owner;
+	struct lws_dll2_owner dll_pending_tls_fc_owner; /* flowcontrolled */
+#if defined(LWS_HAVE_SSL_free_buffers)
+	struct lws_dll2_owner hot_owner; /* conns keeping tls buffers, LRU */
+#endif
 };
 
 struct lws_tls_ss_pieces;
@@ -73,6 +77,9 @@ struct lws_lws_tls {
 	lws_tls_conn *ssl;
 	lws_tls_bio *client_bio;
 	struct lws_dll2 dll_pending_tls;
+#if defined(LWS_HAVE_SSL_free_buffers)
+	struct lws_dll2 dll_hot;
+#endif
 	unsigned int use_ssl;
 	unsigned int redirect_to_https:1;
 };
@@ -96,9 +103,20 @@ lws_ssl_SSL_CTX_destroy(struct lws_vhost *vhost);
 LWS_EXTERN void
 lws_ssl_context_destroy(struct lws_context *context);
 void
+__lws_ssl_add_wsi_to_buffered_list(struct lws_context_per_thread *pt,
+				   struct lws *wsi);
+void
 __lws_ssl_remove_wsi_from_buffered_list(struct lws *wsi);
 LWS_VISIBLE void
 lws_ssl_remove_wsi_from_buffered_list(struct lws *wsi);
+#if defined(LWS_HAVE_SSL_free_buffers)
+void
+lws_tls_hot_touch(struct lws *wsi);
+#define __lws_tls_hot_remove(wsi) lws_dll2_remove(&(wsi)->tls.dll_hot)
+#else
+#define lws_tls_hot_touch(wsi)
+#define __lws_tls_hot_remove(wsi)
+#endif
 LWS_EXTERN int
 lws_ssl_client_bio_create(struct lws *wsi);
 LWS_EXTERN int
@@ -162,6 +180,8 @@ lws_tls_client_connect(struct lws *wsi, char *errbuf, int len);
 LWS_EXTERN int
 lws_tls_client_confirm_peer_cert(struct lws *wsi, char *ebuf, int ebuf_len);
 LWS_EXTERN int
+lws_tls_client_peer_cert_covers(struct lws *wsi, const char *host);
+LWS_EXTERN int
 lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 			    const struct lws_context_creation_info *info,
 			    const char *cipher_list,
@@ -52,6 +52,24 @@ lws_tls_fake_POLLIN_for_buffered(struct lws_context_per_thread *pt)
 	return !!ret;
 }
 
+/*
+ * Flowcontrolled guys can't use their buffered rx yet, they wait on a separate
+ * list until they're allowed rx again, so the service loop doesn't keep
+ * visiting them
+ */
+
+void
+__lws_ssl_add_wsi_to_buffered_list(struct lws_context_per_thread *pt,
+				   struct lws *wsi)
+{
+	if (!lws_dll2_is_detached(&wsi->tls.dll_pending_tls))
+		return;
+
+	lws_dll2_add_head(&wsi->tls.dll_pending_tls, lws_is_flowcontrolled(wsi) ?
+					&pt->tls.dll_pending_tls_fc_owner :
+					&pt->tls.dll_pending_tls_owner);
+}
+
 void
 __lws_ssl_remove_wsi_from_buffered_list(struct lws *wsi)
 {
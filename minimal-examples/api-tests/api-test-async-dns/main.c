@@ -12,7 +12,7 @@
 #include <libwebsockets.h>
 #include <signal.h>
 
-static int interrupted, dtest, ok, fail, _exp = 26;
+static int interrupted, dtest, ok, fail, _exp = 30, rdns_exp_step;
 struct lws_context *context;
 
 /*
@@ -119,6 +119,109 @@ next_test_cb(lws_sorted_usec_list_t *sul)
 }
 
 
+/*
+ * We set failed reverse lookups to be cached for 1s.  192.0.2.1 is in
+ * TEST-NET-1 and has no PTR, so the first lookup fails whether we can reach a
+ * dns server or not.  Straight after, the same lookup must be answered from
+ * the cache, and 2s later, the entry must have left the cache.
+ */
+
+static void
+rdns_exp_cb(struct lws_context *cx, const lws_sockaddr46 *sa46,
+	    const char *name, void *opaque);
+
+static lws_async_dns_retcode_t
+rdns_exp_lookup(void)
+{
+	lws_sockaddr46 sa46;
+
+	memset(&sa46, 0, sizeof(sa46));
+	lws_sa46_parse_numeric_address("192.0.2.1", &sa46);
+
+	return lws_async_dns_rdns(context, 0, &sa46, rdns_exp_cb, NULL);
+}
+
+static void
+rdns_exp_again_cb(lws_sorted_usec_list_t *sul)
+{
+	if (rdns_exp_lookup() == LADNS_RET_FOUND) {
+		lwsl_err("%s: negative rdns entry didn't expire\n", __func__);
+		fail++;
+	} else
+		ok++;
+}
+
+static void
+rdns_exp_cb(struct lws_context *cx, const lws_sockaddr46 *sa46,
+	    const char *name, void *opaque)
+{
+	lwsl_notice("%s: step %d: rdns: %s\n", __func__, rdns_exp_step,
+		    name ? name : "(none)");
+
+	if (name) {
+		lwsl_err("%s: unexpected name\n", __func__);
+		fail++;
+	}
+
+	switch (rdns_exp_step) {
+	case 0:
+		ok++;
+		rdns_exp_step = 1;
+		if (rdns_exp_lookup() != LADNS_RET_FOUND) {
+			lwsl_err("%s: negative rdns entry not cached\n",
+				 __func__);
+			fail++;
+		} else
+			ok++;
+		rdns_exp_step = 2;
+		lws_sul_schedule(context, 0, &sul, rdns_exp_again_cb,
+				 2 * LWS_US_PER_SEC);
+		break;
+	case 1:
+		/* the cache hit, called from inside the lookup */
+		break;
+	default:
+		/* carry on with the forward lookups */
+		lws_sul_schedule(context, 0, &sul, next_test_cb, 1);
+		break;
+	}
+}
+
+static void
+rdns_exp_test_cb(lws_sorted_usec_list_t *sul)
+{
+	rdns_exp_lookup();
+}
+
+/* reverse dns for 8.8.8.8 confirms back to it */
+
+static void
+rdns_cb(struct lws_context *cx, const lws_sockaddr46 *sa46, const char *name,
+	void *opaque)
+{
+	lwsl_notice("%s: rdns: %s\n", __func__, name ? name : "(none)");
+
+	if (name && !strcmp(name, "dns.google"))
+		ok++;
+	else {
+		lwsl_err("%s: rdns test: no match\n", __func__);
+		fail++;
+	}
+
+	interrupted = 1;
+}
+
+static void
+rdns_test_cb(lws_sorted_usec_list_t *sul)
+{
+	lws_sockaddr46 sa46;
+
+	memset(&sa46, 0, sizeof(sa46));
+	lws_sa46_parse_numeric_address("8.8.8.8", &sa46);
+
+	lws_async_dns_rdns(context, 0, &sa46, rdns_cb, NULL);
+}
+
 struct lws *
 cb1(struct lws *wsi_unused, const char *ads, const struct addrinfo *a, int n,
     void *opaque)
@@ -192,7 +295,7 @@ again:
 next:
 	lws_async_dns_freeaddrinfo(&a);
 	if (dtest == (int)LWS_ARRAY_SIZE(adt))
-		interrupted = 1;
+		lws_sul_schedule(context, 0, &sul, rdns_test_cb, 1);
 	else
 		lws_sul_schedule(context, 0, &sul, next_test_cb, 1);
 
@@ -225,6 +328,7 @@ main(int argc, const char **argv)
 	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
 	info.port = CONTEXT_PORT_NO_LISTEN;
 	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.adns_rdns_negative_ttl_secs = 1;
 
 	context = lws_create_context(&info);
 	if (!context) {
@@ -295,7 +399,7 @@ main(int argc, const char **argv)
 
 	/* kick off the async dns tests */
 
-	lws_sul_schedule(context, 0, &sul, next_test_cb, 1);
+	lws_sul_schedule(context, 0, &sul, rdns_exp_test_cb, 1);
 
 	/* the usual lws event loop */
 
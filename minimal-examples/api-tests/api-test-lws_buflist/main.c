@@ -0,0 +1,143 @@
+/*
+ * lws-api-test-lws_buflist
+ *
+ * Written in 2010-2020 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+
+static int destroyed;
+
+static void
+ref_destroy(void *opaque, uint8_t *buf)
+{
+	destroyed++;
+	free(opaque);
+}
+
+int main(int argc, const char **argv)
+{
+	int n, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, e = 0;
+	struct lws_buflist *bl = NULL;
+	uint8_t *b, *ref, tmp[16];
+	const char *p;
+	size_t acc;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_buflist\n");
+
+	/*
+	 * 1) append many more segments than the old list walk sanity limit,
+	 *    only the first one should report it was first
+	 */
+
+	for (n = 0; n < 20000; n++) {
+		tmp[0] = (uint8_t)n;
+		tmp[1] = (uint8_t)(n >> 8);
+		if (lws_buflist_append_segment(&bl, tmp, 2) != !n) {
+			lwsl_err("%s: append %d failed\n", __func__, n);
+			return 1;
+		}
+	}
+
+	if (lws_buflist_total_len(&bl) != 40000) {
+		lwsl_err("%s: bad total len\n", __func__);
+		e++;
+	}
+
+	/* 2) consume half, then append more to check the tail followed */
+
+	for (n = 0; n < 10000; n++) {
+		if (lws_buflist_next_segment_len(&bl, &b) != 2 ||
+		    b[0] != (uint8_t)n || b[1] != (uint8_t)(n >> 8)) {
+			lwsl_err("%s: bad segment %d\n", __func__, n);
+			e++;
+			break;
+		}
+		lws_buflist_use_segment(&bl, 2);
+	}
+
+	tmp[0] = 0xaa;
+	if (lws_buflist_append_segment(&bl, tmp, 1)) {
+		lwsl_err("%s: append after consume\n", __func__);
+		e++;
+	}
+
+	/* 3) append by reference, the payload must not be copied */
+
+	ref = malloc(LWS_PRE + 8);
+	if (!ref)
+		return 1;
+	memcpy(ref + LWS_PRE, "zerocopy", 8);
+	if (lws_buflist_append_segment_ref(&bl, ref + LWS_PRE, 8, ref_destroy,
+					   ref)) {
+		lwsl_err("%s: append ref\n", __func__);
+		e++;
+	}
+
+	if (lws_buflist_total_len(&bl) != 20009) {
+		lwsl_err("%s: bad total len after ref\n", __func__);
+		e++;
+	}
+
+	acc = 0;
+	while (lws_buflist_next_segment_len(&bl, &b) == 2) {
+		acc++;
+		lws_buflist_use_segment(&bl, 2);
+	}
+	if (acc != 10000 || !b || *b != 0xaa) {
+		lwsl_err("%s: bad drain %d\n", __func__, (int)acc);
+		e++;
+	}
+	lws_buflist_use_segment(&bl, 1);
+
+	if (lws_buflist_next_segment_len(&bl, &b) != 8 ||
+	    b != ref + LWS_PRE || destroyed) {
+		lwsl_err("%s: ref segment copied or lost\n", __func__);
+		e++;
+	}
+
+	lws_buflist_use_segment(&bl, 4);
+	if (destroyed) {
+		lwsl_err("%s: ref destroyed early\n", __func__);
+		e++;
+	}
+	if (lws_buflist_use_segment(&bl, 4) || bl || destroyed != 1) {
+		lwsl_err("%s: ref not destroyed when used\n", __func__);
+		e++;
+	}
+
+	/* 4) destroy_all must also release referenced buffers */
+
+	ref = malloc(16);
+	if (!ref)
+		return 1;
+	if (lws_buflist_append_segment(&bl, tmp, 1) != 1 ||
+	    lws_buflist_append_segment_ref(&bl, ref, 16, ref_destroy, ref) ||
+	    lws_buflist_append_segment(&bl, tmp, 1)) {
+		lwsl_err("%s: append mixed\n", __func__);
+		e++;
+	}
+	lws_buflist_destroy_all_segments(&bl);
+	if (bl || destroyed != 2) {
+		lwsl_err("%s: destroy_all\n", __func__);
+		e++;
+	}
+
+	if (e) {
+		lwsl_user("Completed: FAIL\n");
+
+		return 1;
+	}
+
+	lwsl_user("Completed: PASS\n");
+
+	return 0;
+}
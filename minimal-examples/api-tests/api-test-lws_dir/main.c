@@ -0,0 +1,210 @@
+/*
+ * lws-api-test-lws_dir
+ *
+ * Written in 2010-2020 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define COUNT 1000
+
+struct walk {
+	char last[64];
+	int count;
+	int files;
+	int ordered;
+};
+
+static int
+walk_cb(const char *dirpath, void *user, struct lws_dir_entry *lde)
+{
+	struct walk *w = (struct walk *)user;
+
+	if (w->last[0] && strcmp(w->last, lde->name) >= 0)
+		w->ordered = 0;
+	lws_strncpy(w->last, lde->name, sizeof(w->last));
+
+	if (lde->type == LDOT_FILE)
+		w->files++;
+	w->count++;
+
+	return 0;
+}
+
+static int
+stop_cb(const char *dirpath, void *user, struct lws_dir_entry *lde)
+{
+	return ++((struct walk *)user)->count == 3;
+}
+
+/* reverse order, so the top-N are the alphabetically last ones */
+
+static int
+reverse_compare(const struct lws_dir_entry *a, const struct lws_dir_entry *b)
+{
+	return strcmp(b->name, a->name);
+}
+
+static int
+touch(const char *dir, const char *name)
+{
+	char path[256];
+	int fd;
+
+	lws_snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_CREAT | O_WRONLY, 0600);
+	if (fd < 0)
+		return 1;
+
+	close(fd);
+
+	return 0;
+}
+
+static int
+rm_cb(const char *dirpath, void *user, struct lws_dir_entry *lde)
+{
+	char path[256];
+
+	lws_snprintf(path, sizeof(path), "%s/%s", dirpath, lde->name);
+	unlink(path);
+
+	return 0;
+}
+
+int main(int argc, const char **argv)
+{
+	int n, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, e = 0;
+	char dir[128], name[32];
+	struct lws_dir_cache *dc;
+	struct walk w;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_dir\n");
+
+	lws_snprintf(dir, sizeof(dir), "/tmp/lws-api-test-dir-%d",
+		     (int)getpid());
+	if (mkdir(dir, 0700)) {
+		lwsl_err("%s: unable to create %s\n", __func__, dir);
+		return 1;
+	}
+
+	/* create the names out of order, plus one that must be skipped */
+
+	for (n = 0; n < COUNT; n++) {
+		lws_snprintf(name, sizeof(name), "f%04d", (n * 7) % COUNT);
+		if (touch(dir, name)) {
+			e++;
+			goto bail;
+		}
+	}
+	touch(dir, "backup~");
+
+	/* 1) lws_dir() is complete and alphabetical */
+
+	memset(&w, 0, sizeof(w));
+	w.ordered = 1;
+	if (lws_dir(dir, &w, walk_cb) || w.count != COUNT ||
+	    w.files != COUNT || !w.ordered) {
+		lwsl_err("%s: lws_dir: count %d, files %d, ordered %d\n",
+			 __func__, w.count, w.files, w.ordered);
+		e++;
+	}
+
+	/* 2) unsorted stream sees everything, and stops when asked */
+
+	memset(&w, 0, sizeof(w));
+	if (lws_dir_stream(dir, &w, walk_cb, NULL, 0) || w.count != COUNT) {
+		lwsl_err("%s: stream: count %d\n", __func__, w.count);
+		e++;
+	}
+
+	memset(&w, 0, sizeof(w));
+	if (lws_dir_stream(dir, &w, stop_cb, NULL, 0) != 1 || w.count != 3) {
+		lwsl_err("%s: stream stop: count %d\n", __func__, w.count);
+		e++;
+	}
+
+	/* 3) top-N gives just the first N, in order */
+
+	memset(&w, 0, sizeof(w));
+	w.ordered = 1;
+	if (lws_dir_stream(dir, &w, walk_cb, NULL, 10) || w.count != 10 ||
+	    !w.ordered || strcmp(w.last, "f0009")) {
+		lwsl_err("%s: top-n: count %d, ordered %d, last %s\n", __func__,
+			 w.count, w.ordered, w.last);
+		e++;
+	}
+
+	memset(&w, 0, sizeof(w));
+	w.ordered = 1;
+	if (lws_dir_stream(dir, &w, walk_cb, reverse_compare, 5) ||
+	    w.count != 5 || w.ordered || strcmp(w.last, "f0995")) {
+		lwsl_err("%s: top-n reverse: count %d, last %s\n", __func__,
+			 w.count, w.last);
+		e++;
+	}
+
+	/* 4) cached listing notices changes */
+
+	dc = lws_dir_cache_create(dir, NULL);
+	if (!dc) {
+		e++;
+		goto bail;
+	}
+
+	memset(&w, 0, sizeof(w));
+	if (lws_dir_cache_walk(dc, &w, walk_cb) || w.count != COUNT) {
+		lwsl_err("%s: cache: count %d\n", __func__, w.count);
+		e++;
+	}
+
+	touch(dir, "g0000");
+
+	memset(&w, 0, sizeof(w));
+	if (lws_dir_cache_walk(dc, &w, walk_cb) || w.count != COUNT + 1) {
+		lwsl_err("%s: cache after add: count %d\n", __func__, w.count);
+		e++;
+	}
+
+	memset(&w, 0, sizeof(w));
+	if (lws_dir_cache_walk(dc, &w, walk_cb) || w.count != COUNT + 1) {
+		lwsl_err("%s: cache again: count %d\n", __func__, w.count);
+		e++;
+	}
+
+	lws_dir_cache_destroy(&dc);
+	if (dc)
+		e++;
+
+bail:
+	lws_dir_stream(dir, NULL, rm_cb, NULL, 0);
+	lws_snprintf(name, sizeof(name), "backup~");
+	rm_cb(dir, NULL, &(struct lws_dir_entry){ name, LDOT_FILE });
+	rmdir(dir);
+
+	if (e)
+		goto bail1;
+
+	lwsl_user("Completed: PASS\n");
+
+	return 0;
+
+bail1:
+	lwsl_user("Completed: FAIL %d\n", e);
+
+	return 1;
+}
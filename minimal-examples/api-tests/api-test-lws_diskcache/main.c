@@ -0,0 +1,243 @@
+/*
+ * lws-api-test-lws_diskcache
+ *
+ * Written in 2010-2020 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define FILE_SIZE	1000
+#define LIMIT		(10 * FILE_SIZE)
+
+static char base[128];
+
+static void
+hash_of(int n, char *hash, size_t len)
+{
+	/* spread them over the subdirs like real hashes */
+	lws_snprintf(hash, len, "%02x%038d", (n * 37) & 0xff, n);
+}
+
+static int
+create(struct lws_diskcache_scan *lds, int n)
+{
+	char hash[64], cache[256], buf[FILE_SIZE];
+	size_t ex;
+	int fd;
+
+	hash_of(n, hash, sizeof(hash));
+	if (lws_diskcache_query(lds, 0, hash, &fd, cache, sizeof(cache), &ex) !=
+						LWS_DISKCACHE_QUERY_CREATING)
+		return 1;
+
+	memset(buf, n, sizeof(buf));
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+		close(fd);
+		return 1;
+	}
+	close(fd);
+
+	return lws_diskcache_finalize(lds, cache);
+}
+
+static int
+use(struct lws_diskcache_scan *lds, int n)
+{
+	char hash[64], cache[256];
+	size_t ex;
+	int fd, r;
+
+	hash_of(n, hash, sizeof(hash));
+	r = lws_diskcache_query(lds, 0, hash, &fd, cache, sizeof(cache), &ex);
+	if (r == LWS_DISKCACHE_QUERY_EXISTS) {
+		close(fd);
+		return 0;
+	}
+	if (r == LWS_DISKCACHE_QUERY_CREATING) {
+		/* it wasn't there... clean up the temp file */
+		close(fd);
+		unlink(cache);
+	}
+
+	return 1;
+}
+
+static int
+exists(int n)
+{
+	char hash[64], path[256];
+	struct stat s;
+
+	hash_of(n, hash, sizeof(hash));
+	lws_snprintf(path, sizeof(path), "%s/%c/%c/%s", base, hash[0], hash[1],
+		     hash);
+
+	return !stat(path, &s);
+}
+
+static void
+trim_until_idle(struct lws_diskcache_scan *lds)
+{
+	int n = 0;
+
+	/* a full scan takes one call per subdir */
+	do {
+		lws_diskcache_trim(lds);
+	} while (!lws_diskcache_secs_to_idle(lds) && n++ < 1000);
+}
+
+static int
+rm_rf(const char *dir)
+{
+	char cmd[256];
+
+	lws_snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+
+	return system(cmd);
+}
+
+int main(int argc, const char **argv)
+{
+	int n, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE, e = 0;
+	struct lws_diskcache_scan *lds;
+	char hash[64], path[256];
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_diskcache\n");
+
+	lws_snprintf(base, sizeof(base), "/tmp/lws-api-test-diskcache-%d",
+		     (int)getpid());
+	lws_diskcache_prepare(base, 0700, (int)getuid());
+
+	/* 1) no journal yet: the first trim scans, then evicts the oldest */
+
+	lds = lws_diskcache_create(base, LIMIT);
+	if (!lds)
+		goto bail;
+
+	for (n = 0; n < 15; n++)
+		if (create(lds, n)) {
+			lwsl_err("%s: create %d failed\n", __func__, n);
+			e++;
+		}
+
+	/* using 0 and 1 makes them the most recent */
+	if (use(lds, 0) || use(lds, 1)) {
+		lwsl_err("%s: use failed\n", __func__);
+		e++;
+	}
+
+	trim_until_idle(lds);
+
+	for (n = 0; n < 15; n++)
+		if (exists(n) != (n < 2 || n >= 7)) {
+			lwsl_err("%s: after trim, %d exists %d\n", __func__, n,
+				 exists(n));
+			e++;
+		}
+
+	lws_diskcache_destroy(&lds);
+
+	/* 2) replaying the journal restores the same LRU order */
+
+	lds = lws_diskcache_create(base, LIMIT);
+	if (!lds)
+		goto bail;
+
+	if (create(lds, 20) || create(lds, 21))
+		e++;
+
+	/* with a valid index, one trim call is enough */
+	lws_diskcache_trim(lds);
+
+	for (n = 7; n < 9; n++)
+		if (exists(n)) {
+			lwsl_err("%s: after replay, %d not trimmed\n",
+				 __func__, n);
+			e++;
+		}
+	if (!exists(0) || !exists(1) || !exists(9) || !exists(20) ||
+	    !exists(21)) {
+		lwsl_err("%s: after replay, trimmed too much\n", __func__);
+		e++;
+	}
+
+	lws_diskcache_destroy(&lds);
+
+	/* 3) a file the index wasn't told about is found by a scan */
+
+	hash_of(30, hash, sizeof(hash));
+	lws_snprintf(path, sizeof(path), "%s/%c/%c/%s", base, hash[0], hash[1],
+		     hash);
+	n = open(path, O_CREAT | O_WRONLY, 0600);
+	if (n < 0 || write(n, path, 1) != 1)
+		e++;
+	if (n >= 0)
+		close(n);
+
+	/* no journal forces a rescan, which sees everything on disk */
+
+	lws_snprintf(path, sizeof(path), "%s/journal", base);
+	unlink(path);
+
+	lds = lws_diskcache_create(base, LIMIT);
+	if (!lds)
+		goto bail;
+
+	if (use(lds, 30)) {
+		lwsl_err("%s: unindexed file not found\n", __func__);
+		e++;
+	}
+
+	trim_until_idle(lds);
+
+	if (!exists(30)) {
+		lwsl_err("%s: recently used file trimmed\n", __func__);
+		e++;
+	}
+
+	lws_diskcache_destroy(&lds);
+
+	/* 4) well under the limit with a valid index, we can idle for a while */
+
+	lds = lws_diskcache_create(base, LIMIT * 100);
+	if (!lds)
+		goto bail;
+
+	lws_diskcache_trim(lds);
+
+	n = lws_diskcache_secs_to_idle(lds);
+	if (n <= 1) {
+		lwsl_err("%s: secs_to_idle %d when undersize\n", __func__, n);
+		e++;
+	}
+
+	lws_diskcache_destroy(&lds);
+
+	rm_rf(base);
+
+	if (e)
+		goto bail;
+
+	lwsl_user("Completed: PASS\n");
+
+	return 0;
+
+bail:
+	lwsl_user("Completed: FAIL %d\n", e);
+
+	return 1;
+}
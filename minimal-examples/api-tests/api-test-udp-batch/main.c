@@ -0,0 +1,287 @@
+/*
+ * lws-api-test-udp-batch
+ *
+ * Written in 2010-2020 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test confirms batched UDP rx and tx on wsi created with
+ * LWS_CAUDP_BATCH, over loopback.
+ *
+ * A "client" udp wsi queues a run of numbered datagrams with
+ * lws_udp_batch_queue() and sends them with lws_udp_batch_flush().  A bound
+ * "server" udp wsi receives them in LWS_CALLBACK_RAW_RX_UDP_BATCH, checks
+ * they arrived in order and queues an echo of each back to the peer address
+ * it was given for that datagram.  The client checks it gets every echo back.
+ *
+ * Where the platform has no recvmmsg(), lws delivers the datagrams one at a
+ * time by LWS_CALLBACK_RAW_RX instead, and that is checked the same way.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <signal.h>
+#if !defined(WIN32)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#define TEST_PORT	7691
+#define TEST_DGRAMS	24
+
+static int interrupted, fail, srv_next, cli_next, batches;
+static struct lws *wsi_srv, *wsi_cli;
+static lws_sorted_usec_list_t sul;
+static struct lws_context *context;
+
+static void
+timeout_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: timed out: srv %d, cli %d\n", __func__, srv_next,
+		 cli_next);
+	fail++;
+	interrupted = 1;
+}
+
+static void
+fill(uint8_t *buf, size_t len, int seq)
+{
+	size_t n;
+
+	for (n = 0; n < len; n++)
+		buf[n] = (uint8_t)(seq + (int)n);
+}
+
+/* the length steps every 4 datagrams, so there are runs of same-size ones */
+
+static size_t
+len_for_seq(int seq)
+{
+	return 64 + (size_t)((seq / 4) * 16);
+}
+
+static int
+check(const uint8_t *buf, size_t len, int seq)
+{
+	uint8_t exp[512];
+
+	if (len != len_for_seq(seq)) {
+		lwsl_err("%s: seq %d: len %d, expected %d\n", __func__, seq,
+			 (int)len, (int)len_for_seq(seq));
+		return 1;
+	}
+
+	fill(exp, len, seq);
+	if (memcmp(buf, exp, len)) {
+		lwsl_err("%s: seq %d: content mismatch\n", __func__, seq);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+rx_one(struct lws *wsi, const uint8_t *buf, size_t len,
+       const struct sockaddr *sa, socklen_t salen)
+{
+	if (wsi == wsi_srv) {
+		if (check(buf, len, srv_next)) {
+			fail++;
+			return 0;
+		}
+		srv_next++;
+
+		/* echo it back to the peer it came from */
+
+		if (lws_udp_batch_queue(wsi, buf, len, sa, salen)) {
+			lwsl_err("%s: echo queue failed\n", __func__);
+			fail++;
+		}
+
+		return 0;
+	}
+
+	if (check(buf, len, cli_next)) {
+		fail++;
+		return 0;
+	}
+
+	if (++cli_next == TEST_DGRAMS)
+		interrupted = 1;
+
+	return 0;
+}
+
+static int
+callback_udp_batch(struct lws *wsi, enum lws_callback_reasons reason,
+		   void *user, void *in, size_t len)
+{
+	const lws_udp_dgram_t *dg = (const lws_udp_dgram_t *)in;
+	const struct lws_udp *udp;
+	size_t n;
+
+	switch (reason) {
+
+	case LWS_CALLBACK_RAW_RX_UDP_BATCH:
+		if (wsi == wsi_srv)
+			batches++;
+		for (n = 0; n < len; n++)
+			rx_one(wsi, dg[n].buf, dg[n].len, dg[n].sa,
+			       dg[n].salen);
+		break;
+
+	case LWS_CALLBACK_RAW_RX:
+		/* platform has no recvmmsg(), datagrams come singly */
+		udp = lws_get_udp(wsi);
+		if (wsi == wsi_srv)
+			batches++;
+		rx_one(wsi, (const uint8_t *)in, len, &udp->sa,
+		       (socklen_t)udp->salen);
+		if (wsi == wsi_srv)
+			lws_udp_batch_flush(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct lws_protocols protocols[] = {
+	{ "udp-batch", callback_udp_batch, 0, 0 },
+	{ NULL, NULL, 0, 0 } /* terminator */
+};
+
+void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
+/*
+ * Create a fresh context and pair of udp wsi with the given extra flags, and
+ * run the datagrams through them
+ */
+
+static int
+test_pass(const char *name, int flags)
+{
+	struct lws_context_creation_info info;
+	struct sockaddr_in sin;
+	struct lws_vhost *vh;
+	uint8_t buf[512];
+	int n;
+
+	lwsl_user("%s: pass %s\n", __func__, name);
+
+	interrupted = fail = srv_next = cli_next = batches = 0;
+	/* the previous pass' context took its list with it */
+	memset(&sul, 0, sizeof(sul));
+
+	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	info.port = CONTEXT_PORT_NO_LISTEN_SERVER;
+	info.protocols = protocols;
+
+	vh = lws_create_vhost(context, &info);
+	if (!vh) {
+		lwsl_err("lws vhost creation failed\n");
+		fail++;
+		goto bail;
+	}
+
+	wsi_srv = lws_create_adopt_udp(vh, "127.0.0.1", TEST_PORT,
+				       LWS_CAUDP_BIND | LWS_CAUDP_BATCH | flags,
+				       protocols[0].name, NULL, NULL, NULL,
+				       NULL);
+	if (!wsi_srv) {
+		lwsl_err("%s: failed to create bound udp wsi\n", __func__);
+		fail++;
+		goto bail;
+	}
+
+	wsi_cli = lws_create_adopt_udp(vh, "127.0.0.1", TEST_PORT,
+				       LWS_CAUDP_BATCH | flags,
+				       protocols[0].name, NULL, NULL, NULL,
+				       NULL);
+	if (!wsi_cli) {
+		lwsl_err("%s: failed to create client udp wsi\n", __func__);
+		fail++;
+		goto bail;
+	}
+
+	/* queue all the test datagrams and send them together */
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(TEST_PORT);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	for (n = 0; n < TEST_DGRAMS; n++) {
+		fill(buf, len_for_seq(n), n);
+		if (lws_udp_batch_queue(wsi_cli, buf, len_for_seq(n),
+					(const struct sockaddr *)&sin,
+					sizeof(sin))) {
+			lwsl_err("%s: queue %d failed\n", __func__, n);
+			fail++;
+			goto bail;
+		}
+	}
+
+	if (lws_udp_batch_flush(wsi_cli)) {
+		lwsl_err("%s: flush failed\n", __func__);
+		fail++;
+		goto bail;
+	}
+
+	lws_sul_schedule(context, 0, &sul, timeout_cb, 5 * LWS_US_PER_SEC);
+
+	n = 0;
+	while (n >= 0 && !interrupted)
+		n = lws_service(context, 0);
+
+bail:
+	lws_context_destroy(context);
+
+	if (fail || cli_next != TEST_DGRAMS) {
+		lwsl_err("%s: %s: FAIL: srv rx %d, cli rx %d / %d\n", __func__,
+			 name, srv_next, cli_next, TEST_DGRAMS);
+
+		return 1;
+	}
+
+	lwsl_user("%s: %s: %d datagrams in %d server rx callbacks\n",
+		  __func__, name, cli_next, batches);
+
+	return 0;
+}
+
+int main(int argc, const char **argv)
+{
+	int e = 0, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE;
+	const char *p;
+
+	signal(SIGINT, sigint_handler);
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: udp batching\n");
+
+	e |= test_pass("batch", 0);
+	e |= test_pass("batch + gso / gro", LWS_CAUDP_GSO_GRO);
+
+	lwsl_user("Completed: %s\n", e ? "FAIL" : "PASS");
+
+	return e;
+}
@@ -51,6 +51,25 @@ client_message_handler(DBusConnection *conn, DBusMessage *message, void *data)
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+/*
+ * With --batch, the messages that arrived together are handed to us together
+ */
+
+static void
+client_batch_handler(struct lws_dbus_ctx *ctx, DBusMessage **msgs, int count)
+{
+	const char *str;
+	int n;
+
+	lwsl_notice("%s: %d messages\n", __func__, count);
+
+	for (n = 0; n < count; n++)
+		if (dbus_message_get_args(msgs[n], NULL,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID))
+			lwsl_notice("%s: '%s'\n", __func__, str);
+}
+
 static void
 destroy_dbus_client_conn(struct lws_dbus_ctx *ctx)
 {
@@ -253,6 +272,10 @@ int main(int argc, const char **argv)
 	if (!dbus_ctx)
 		goto bail1;
 
+	if (lws_cmdline_option(argc, argv, "--batch") &&
+	    lws_dbus_set_batch_handler(dbus_ctx, client_batch_handler))
+		goto bail2;
+
 	if (remote_method_call(dbus_ctx))
 		goto bail2;
 
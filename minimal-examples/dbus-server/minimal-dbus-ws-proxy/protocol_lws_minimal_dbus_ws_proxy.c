@@ -42,6 +42,10 @@
  * things in this ringbuffer.  But the way lws_ring works, when the message
  * allocated in DBUS world is queued on the ringbuffer, the ringbuffer itself
  * takes responsibility for deallocation.  So there is no problem.
+ *
+ * What goes on the ring is a reference on the DBUS message itself, with a
+ * pointer to the payload inside it.  The payload is only copied once, directly
+ * into the LWS_PRE-prefixed tx buffer, when the ws connection is writeable.
  */
 
 #if !defined (LWS_PLUGIN_STATIC)
@@ -63,7 +67,8 @@
 struct vhd_dbus_proxy;
 
 struct msg {
-	void *payload; /* is malloc'd */
+	DBusMessage *m; /* we hold a ref on this */
+	const uint8_t *payload; /* points inside m */
 	size_t len;
 	char binary;
 	char first;
@@ -73,6 +78,9 @@ struct msg {
 struct pss_dbus_proxy {
 	struct lws_ring *ring_out;
 	uint32_t ring_out_tail;
+
+	unsigned char *tx; /* LWS_PRE + tx_len */
+	size_t tx_len;
 };
 
 struct lws_dbus_ctx_wsproxy {
@@ -132,6 +140,9 @@ static const char *server_introspection_xml =
 	"    <method name='Send'>\n"
 	"      <arg name='payload' type='s' direction='in' />\n"
 	"    </method>\n"
+	"    <method name='SendBinary'>\n"
+	"      <arg name='payload' type='ay' direction='in' />\n"
+	"    </method>\n"
 	"    <signal name='Receive'>\n"
 	"    </signal>"
 	"    <signal name='Status'>\n"
@@ -145,7 +156,8 @@ destroy_message(void *_msg)
 {
 	struct msg *msg = _msg;
 
-	free(msg->payload);
+	dbus_message_unref(msg->m);
+	msg->m = NULL;
 	msg->payload = NULL;
 	msg->len = 0;
 }
@@ -311,15 +323,40 @@ issue_dbus_signal(struct lws *wsi, const char *signame, const char *string)
 	return 0;
 }
 
+/* binary ws payloads go out as a byte array, without truncation */
+
+static int
+issue_dbus_signal_binary(struct lws *wsi, const char *signame,
+			 const void *buf, size_t len)
+{
+	struct lws_dbus_ctx_wsproxy *wspctx =
+			lws_get_opaque_parent_data(wsi);
+	DBusMessage *m;
+
+	if (!wspctx)
+		return 1;
+
+	m = dbus_message_new_signal(THIS_OBJECT, THIS_INTERFACE, signame);
+	if (!m) {
+		lwsl_err("%s: new signal failed\n", __func__);
+		return 1;
+	}
+
+	if (lws_dbus_msg_append_bytes(m, buf, len) ||
+	    !dbus_connection_send(wspctx->ctx.conn, m, NULL))
+		lwsl_err("%s: unable to send\n", __func__);
+
+	dbus_message_unref(m);
+
+	return 0;
+}
+
 static DBusHandlerResult
 dmh_send(DBusConnection *c, DBusMessage *m, DBusMessage **reply, void *d)
 {
 	struct lws_dbus_ctx_wsproxy *wspctx = (struct lws_dbus_ctx_wsproxy *)d;
-	const char *payload;
 	struct msg amsg;
-	DBusError err;
-
-	dbus_error_init(&err);
+	int binary;
 
 	if (!wspctx->cwsi || !wspctx->pss) {
 		dbus_message_unref(*reply);
@@ -328,35 +365,24 @@ dmh_send(DBusConnection *c, DBusMessage *m, DBusMessage **reply, void *d)
 		return DBUS_HANDLER_RESULT_HANDLED;
 	}
 
-	if (!dbus_message_get_args(m, &err, DBUS_TYPE_STRING, &payload,
-					    DBUS_TYPE_INVALID)) {
+	if (lws_dbus_msg_payload(m, &amsg.payload, &amsg.len, &binary)) {
 		dbus_message_unref(*reply);
-		*reply = dbus_message_new_error(m, err.name, err.message);
-		dbus_error_free(&err);
+		*reply = dbus_message_new_error(m, DBUS_ERROR_INVALID_ARGS,
+						"Payload must be s or ay");
 
 		return DBUS_HANDLER_RESULT_HANDLED;
 	}
 
 	/*
-	 * we allocate on the ringbuffer in ws world, but responsibility for
-	 * freeing it is understood by lws_ring.
+	 * we hold a ref on the message until it has been written to ws, but
+	 * responsibility for dropping it is understood by lws_ring.
 	 */
 
-	amsg.len = strlen(payload);
-	/* notice we over-allocate by LWS_PRE */
-	amsg.payload = malloc(LWS_PRE + amsg.len);
-	if (!amsg.payload) {
-		lwsl_user("OOM: dropping\n");
-		dbus_message_unref(*reply);
-		*reply = dbus_message_new_error(m, "Send Fail", "OOM");
-
-		return DBUS_HANDLER_RESULT_HANDLED;
-	}
-	amsg.binary = 0;
+	amsg.m = dbus_message_ref(m);
+	amsg.binary = (char)binary;
 	amsg.first = 1;
 	amsg.final = 1;
 
-	memcpy((char *)amsg.payload + LWS_PRE, payload, amsg.len);
 	if (!lws_ring_insert(wspctx->pss->ring_out, &amsg, 1)) {
 		destroy_message(&amsg);
 		lwsl_user("Ring Full!\n");
@@ -381,6 +407,7 @@ struct lws_dbus_methods {
 	{ DBUS_INTERFACE_PROPERTIES,	 "GetAll",	dmh_getall	},
 	{ THIS_INTERFACE,		 "Connect",	dmh_connect	},
 	{ THIS_INTERFACE,		 "Send",	dmh_send	},
+	{ THIS_INTERFACE,		 "SendBinary",	dmh_send	},
 };
 
 static DBusHandlerResult
@@ -683,6 +710,8 @@ callback_minimal_dbus_wsproxy(struct lws *wsi, enum lws_callback_reasons reason,
 
 		wspctx->pss = pss;
 		pss->ring_out_tail = 0;
+		pss->tx = NULL;
+		pss->tx_len = 0;
 		pss->ring_out = lws_ring_create(sizeof(struct msg), 8,
 						   destroy_message);
 		if (!pss->ring_out) {
@@ -707,9 +736,23 @@ callback_minimal_dbus_wsproxy(struct lws *wsi, enum lws_callback_reasons reason,
 			    pmsg->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
 			    pmsg->first, pmsg->final);
 
-		/* notice we allowed for LWS_PRE in the payload already */
-		m = lws_write(wsi, ((unsigned char *)pmsg->payload) + LWS_PRE,
-			      pmsg->len, flags);
+		/* the tx buffer is reused, only growing for bigger payloads */
+
+		if (pmsg->len > pss->tx_len) {
+			unsigned char *tx = realloc(pss->tx,
+						    LWS_PRE + pmsg->len);
+			if (!tx) {
+				lwsl_err("OOM\n");
+				return -1;
+			}
+			pss->tx = tx;
+			pss->tx_len = pmsg->len;
+		}
+
+		/* copy straight out of the dbus message, after LWS_PRE */
+		if (pmsg->len)
+			memcpy(pss->tx + LWS_PRE, pmsg->payload, pmsg->len);
+		m = lws_write(wsi, pss->tx + LWS_PRE, pmsg->len, flags);
 		if (m < (int)pmsg->len) {
 			lwsl_err("ERROR %d writing to ws socket\n", m);
 			return -1;
@@ -737,6 +780,11 @@ callback_minimal_dbus_wsproxy(struct lws *wsi, enum lws_callback_reasons reason,
 			  lws_is_final_fragment(wsi),
 			  lws_frame_is_binary(wsi));
 
+		if (lws_frame_is_binary(wsi)) {
+			issue_dbus_signal_binary(wsi, "Receive", in, len);
+			break;
+		}
+
 		{
 			char strbuf[256];
 			int l = len;
@@ -764,6 +812,8 @@ callback_minimal_dbus_wsproxy(struct lws *wsi, enum lws_callback_reasons reason,
 		/* destroy any ringbuffer and pending messages */
 
 		lws_ring_destroy(pss->ring_out);
+		free(pss->tx);
+		pss->tx = NULL;
 
 		wspctx = lws_get_opaque_parent_data(wsi);
 		if (!wspctx)
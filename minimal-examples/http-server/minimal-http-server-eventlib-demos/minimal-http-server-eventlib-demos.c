@@ -59,6 +59,7 @@ static const struct lws_http_mount mount_ziptest = {
 	LWSMPRO_FILE,	/* origin points to a callback */
 	8,			/* strlen("/ziptest"), ie length of the mountpoint */
 	NULL,
+	NULL,
 
 	{ NULL, NULL } // sentinel
 };
@@ -81,6 +82,7 @@ static const struct lws_http_mount mount_post = {
 	LWSMPRO_CALLBACK,	/* origin points to a callback */
 	9,			/* strlen("/formtest"), ie length of the mountpoint */
 	NULL,
+	NULL,
 
 	{ NULL, NULL } // sentinel
 };
@@ -42,6 +42,24 @@
 #include <string.h>
 #include <stdlib.h>
 
+/*
+ * With OpenSSL and pthreads, the 4096-bit CSR keypair is generated on a worker
+ * thread while the order is negotiated, instead of stalling the event loop for
+ * several seconds.  mbedTLS shares the context DRBG, so it stays inline there.
+ */
+#if defined(LWS_WITH_THREADPOOL) && !defined(LWS_WITH_MBEDTLS)
+#define LWS_ACME_THREADED_KEYGEN
+#include <pthread.h>
+#endif
+
+/* orders in flight at once over the whole process, unless "max-concurrent" */
+#define LWS_ACME_DEFAULT_MAX_CONCURRENT	8
+/* retries for a step whose connection died underneath it */
+#define LWS_ACME_STEP_RETRIES		3
+#define LWS_ACME_RETRY_US		(250 * LWS_US_PER_MS)
+/* interval between polls while the ACME server validates or issues */
+#define LWS_ACME_POLL_US		(1 * LWS_US_PER_SEC)
+
 typedef enum {
 	ACME_STATE_DIRECTORY,	/* get the directory JSON using GET + parse */
 	ACME_STATE_NEW_NONCE,	/* get the replay nonce */
@@ -56,6 +74,59 @@ typedef enum {
 	ACME_STATE_FINISHED
 } lws_acme_state;
 
+enum {
+	ACME_CSR_IDLE,
+	ACME_CSR_RUNNING,
+	ACME_CSR_READY,
+	ACME_CSR_FAILED
+};
+
+struct per_vhost_data__lws_acme_client;
+
+/*
+ * Account keys are shared by every vhost using the same auth-path, so they
+ * are only loaded (or generated) once, and the account only registered once
+ * per directory.
+ */
+struct acme_key {
+	lws_dll2_t list;		/* acme_shared.keys */
+	struct lws_jwk jwk;
+	char kid[100];			/* account URL, once registered... */
+	char kid_dir[128];		/* ...at this directory */
+	int refcount;
+	/* auth-path overallocated after */
+};
+
+/*
+ * State shared by all the vhosts using the plugin in one lws_context.
+ *
+ * The client connections to the ACME server for every order are made on
+ * one "lead" vhost, so with LCCSCF_PIPELINE they share one connection (as
+ * h2 streams, or queued h1 transactions).  A single challenge vhost answers
+ * http-01 for all the orders in flight, and orders beyond max_concurrent wait
+ * on the waiting list for a slot.
+ */
+struct acme_shared {
+	lws_dll2_t list;		/* acme_shared_owner */
+	struct lws_context *context;
+
+	lws_dll2_owner_t vhds;		/* every vhd using the plugin */
+	lws_dll2_owner_t orders;	/* acme_connection in flight */
+	lws_dll2_owner_t waiting;	/* vhds waiting for an order slot */
+	lws_dll2_owner_t zombies;	/* ended orders with keygen running */
+	lws_dll2_owner_t keys;		/* acme_key */
+
+	struct lws_http_mount mount;
+	struct lws_vhost *chall_vhost;
+
+	char urls[6][100];		/* cached directory contents... */
+	char dir_url[128];		/* ...for this directory url */
+
+	int max_concurrent;
+	int chall_port;
+	int client_flags;		/* extra LCCSCF_ for "allow-insecure" */
+};
+
 struct acme_connection {
 	char buf[4096];
 	char replay_nonce[64];
@@ -64,8 +135,7 @@ struct acme_connection {
 	char detail[64];
 	char status[16];
 	char key_auth[256];
-	char http01_mountpoint[256];
-	struct lws_http_mount mount;
+	char csr[2048];
 	char urls[6][100]; /* directory contents */
 	char active_url[100];
 	char authz_url[100];
@@ -74,16 +144,18 @@ struct acme_connection {
 	char cert_url[100];
 	char acct_id[100];
 	char *kid;
+	lws_dll2_t list;		/* acme_shared.orders */
+	lws_sorted_usec_list_t sul;	/* retries and polling */
 	lws_acme_state state;
 	struct lws_client_connect_info i;
 	struct lejp_ctx jctx;
-	struct lws_context_creation_info ci;
-	struct lws_vhost *vhost;
+	struct per_vhost_data__lws_acme_client *vhd;
 
 	struct lws *cwsi;
 
-	const char *real_vh_name;
-	const char *real_vh_iface;
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	pthread_t csr_thread;
+#endif
 
 	char *alloc_privkey_pem;
 
@@ -93,14 +165,21 @@ struct acme_connection {
 	int resp;
 	int cpos;
 
-	int real_vh_port;
 	int goes_around;
+	int retries;
+	/*
+	 * ACME_CSR_, protected by csr_lock.  The keygen thread writes it, so
+	 * it must not share a word with the bitfields below.
+	 */
+	int csr_state;
 
 	size_t len_privkey_pem;
 
 	unsigned int yes:2;
 	unsigned int use:1;
 	unsigned int is_sni_02:1;
+	unsigned int csr_thread_started:1;
+	unsigned int wait_csr:1;
 };
 
 struct per_vhost_data__lws_acme_client {
@@ -113,9 +192,11 @@ struct per_vhost_data__lws_acme_client {
 	 * But ac is only allocated when we are doing the server auth.
 	 */
 	struct acme_connection *ac;
+	struct acme_shared *shared;
+	struct acme_key *key;
 
-	struct lws_jwk jwk;
-	struct lws_genrsa_ctx rsactx;
+	lws_dll2_t list;		/* acme_shared.vhds */
+	lws_dll2_t wait_list;		/* acme_shared.waiting */
 
 	char *pvo_data;
 	char *pvop[LWS_TLS_TOTAL_COUNT];
@@ -129,20 +210,60 @@ struct per_vhost_data__lws_acme_client {
 	int fd_updated_key; /* ...if nonempty next startup will replace old */
 };
 
+struct acme_chall_pss {
+	char key_auth[256];
+};
+
+static lws_dll2_owner_t acme_shared_owner;
+
+#if defined(LWS_ACME_THREADED_KEYGEN)
+static pthread_mutex_t csr_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static int
 callback_chall_http01(struct lws *wsi, enum lws_callback_reasons reason,
         void *user, void *in, size_t len)
 {
-	struct lws_vhost *vhost = lws_get_vhost(wsi);
-	struct acme_connection *ac = lws_vhost_user(vhost);
+	struct acme_shared *sh = lws_vhost_user(lws_get_vhost(wsi));
+	struct acme_chall_pss *pss = (struct acme_chall_pss *)user;
 	uint8_t buf[LWS_PRE + 2048], *start = &buf[LWS_PRE], *p = start,
 		*end = &buf[sizeof(buf) - LWS_PRE - 1];
+	const char *token = (const char *)in;
 	int n;
 
 	switch (reason) {
 	case LWS_CALLBACK_HTTP:
+		/*
+		 * The one challenge vhost answers for every order in flight,
+		 * find the order the token in the url belongs to
+		 */
+		if (len && *token == '/') {
+			token++;
+			len--;
+		}
+
+		pss->key_auth[0] = '\0';
+		lws_start_foreach_dll(struct lws_dll2 *, d, sh->orders.head) {
+			struct acme_connection *ac = lws_container_of(d,
+					struct acme_connection, list);
+
+			if (ac->key_auth[0] && strlen(ac->chall_token) == len &&
+			    !strncmp(ac->chall_token, token, len)) {
+				lws_strncpy(pss->key_auth, ac->key_auth,
+					    sizeof(pss->key_auth));
+				break;
+			}
+		} lws_end_foreach_dll(d);
+
+		if (!pss->key_auth[0]) {
+			lwsl_notice("%s: unknown challenge token\n", __func__);
+			lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL);
+
+			return -1;
+		}
+
 		lwsl_notice("%s: ca connection received, key_auth %s\n",
-			    __func__, ac->key_auth);
+			    __func__, pss->key_auth);
 
 		if (lws_add_http_header_status(wsi, HTTP_STATUS_OK, &p, end)) {
 			lwsl_notice("%s: add status failed\n", __func__);
@@ -157,7 +278,7 @@ callback_chall_http01(struct lws *wsi, enum lws_callback_reasons reason,
 			return -1;
 		}
 
-		n = strlen(ac->key_auth);
+		n = strlen(pss->key_auth);
 		if (lws_add_http_header_content_length(wsi, n, &p, end)) {
 			lwsl_notice("%s: add content_length failed\n",
 					__func__);
@@ -182,7 +303,7 @@ callback_chall_http01(struct lws *wsi, enum lws_callback_reasons reason,
 		return 0;
 
 	case LWS_CALLBACK_HTTP_WRITEABLE:
-		p += lws_snprintf((char *)p, end - p, "%s", ac->key_auth);
+		p += lws_snprintf((char *)p, end - p, "%s", pss->key_auth);
 		lwsl_notice("%s: len %d\n", __func__, lws_ptr_diff(p, start));
 		if (lws_write(wsi, (uint8_t *)start, lws_ptr_diff(p, start),
 			      LWS_WRITE_HTTP_FINAL) != lws_ptr_diff(p, start)) {
@@ -203,7 +324,8 @@ callback_chall_http01(struct lws *wsi, enum lws_callback_reasons reason,
 }
 
 static const struct lws_protocols chall_http01_protocols[] = {
-	{ "http", callback_chall_http01, 0, 0, 0, NULL, 0 },
+	{ "http", callback_chall_http01, sizeof(struct acme_chall_pss),
+	  0, 0, NULL, 0 },
 	{ NULL, NULL, 0, 0, 0, NULL, 0 }
 };
 
@@ -576,17 +698,25 @@ lws_acme_report_status(struct lws_vhost *v, int state, const char *json)
 }
 
 /*
- * Notice: trashes i and url
+ * Notice: trashes ac->i
+ *
+ * The connections for every order are made from the lead vhost (the first
+ * using the plugin), so with LCCSCF_PIPELINE they share one connection to
+ * the ACME server.  The wsi finds its order again via its opaque_user_data.
  */
 static struct lws *
-lws_acme_client_connect(struct lws_context *context, struct lws_vhost *vh,
-		struct lws **pwsi, struct lws_client_connect_info *i,
-		char *url, const char *method)
+lws_acme_client_connect(struct acme_connection *ac, const char *url,
+			const char *method)
 {
+	struct per_vhost_data__lws_acme_client *vhd = ac->vhd, *lead;
+	struct lws_client_connect_info *i = &ac->i;
 	const char *prot, *p;
 	char path[200], _url[256];
 	struct lws *wsi;
 
+	lead = lws_container_of(vhd->shared->vhds.head,
+				struct per_vhost_data__lws_acme_client, list);
+
 	memset(i, 0, sizeof(*i));
 	i->port = 443;
 	lws_strncpy(_url, url, sizeof(_url));
@@ -600,13 +730,15 @@ lws_acme_client_connect(struct lws_context *context, struct lws_vhost *vh,
 	path[0] = '/';
 	lws_strncpy(path + 1, p, sizeof(path) - 1);
 	i->path = path;
-	i->context = context;
-	i->vhost = vh;
-	i->ssl_connection = LCCSCF_USE_SSL;
+	i->context = vhd->context;
+	i->vhost = lead->vhost;
+	i->ssl_connection = LCCSCF_USE_SSL | LCCSCF_PIPELINE |
+			    vhd->shared->client_flags;
 	i->host = i->address;
 	i->origin = i->address;
 	i->method = method;
-	i->pwsi = pwsi;
+	i->pwsi = &ac->cwsi;
+	i->opaque_user_data = ac;
 	i->protocol = "lws-acme-client";
 
 	wsi = lws_client_connect_via_info(i);
@@ -614,32 +746,263 @@ lws_acme_client_connect(struct lws_context *context, struct lws_vhost *vh,
 		lws_snprintf(path, sizeof(path) - 1,
 			     "Unable to connect to %s", url);
 		lwsl_notice("%s: %s\n", __func__, path);
-		lws_acme_report_status(vh, LWS_CUS_FAILED, path);
+		lws_acme_report_status(vhd->vhost, LWS_CUS_FAILED, path);
 	}
 
 	return wsi;
 }
 
+/*
+ * Issue the request for the state the order is in
+ */
+static struct lws *
+lws_acme_step(struct acme_connection *ac)
+{
+	const char *url, *method = "POST";
+
+	switch (ac->state) {
+	case ACME_STATE_DIRECTORY:
+		url = ac->vhd->pvop_active[LWS_TLS_SET_DIR_URL];
+		method = "GET";
+		break;
+	case ACME_STATE_NEW_NONCE:
+		url = ac->urls[JAD_NEW_NONCE_URL];
+		method = "GET";
+		break;
+	case ACME_STATE_NEW_ACCOUNT:
+		url = ac->urls[JAD_NEW_ACCOUNT_URL];
+		break;
+	case ACME_STATE_NEW_ORDER:
+		url = ac->urls[JAD_NEW_ORDER_URL];
+		break;
+	case ACME_STATE_AUTHZ:
+		url = ac->authz_url;
+		break;
+	case ACME_STATE_START_CHALL:
+		url = ac->challenge_uri;
+		break;
+	case ACME_STATE_POLLING:
+		url = ac->order_url;
+		break;
+	case ACME_STATE_POLLING_CSR:
+		url = ac->finalize_url;
+		break;
+	case ACME_STATE_DOWNLOAD_CERT:
+		url = ac->cert_url;
+		break;
+	default:
+		return NULL;
+	}
+
+	return lws_acme_client_connect(ac, url, method);
+}
+
+static int
+lws_acme_csr_create(struct acme_connection *ac)
+{
+	int n;
+
+	n = lws_tls_acme_sni_csr_create(ac->vhd->context,
+					&ac->vhd->pvop_active[0],
+					(uint8_t *)ac->csr, sizeof(ac->csr) - 1,
+					&ac->alloc_privkey_pem,
+					&ac->len_privkey_pem);
+	if (n < 0)
+		return 1;
+
+	ac->csr[n] = '\0';
+
+	return 0;
+}
+
 static void
-lws_acme_finished(struct per_vhost_data__lws_acme_client *vhd)
+lws_acme_csr_set_state(struct acme_connection *ac, int state)
 {
-	lwsl_notice("%s\n", __func__);
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	pthread_mutex_lock(&csr_lock);
+#endif
+	ac->csr_state = state;
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	pthread_mutex_unlock(&csr_lock);
+#endif
+}
 
-	if (vhd->ac) {
-		if (vhd->ac->vhost)
-			lws_vhost_destroy(vhd->ac->vhost);
-		if (vhd->ac->alloc_privkey_pem)
-			free(vhd->ac->alloc_privkey_pem);
-		free(vhd->ac);
+#if defined(LWS_ACME_THREADED_KEYGEN)
+static void *
+lws_acme_csr_thread(void *d)
+{
+	struct acme_connection *ac = (struct acme_connection *)d;
+	int n = lws_acme_csr_create(ac);
+
+	lws_acme_csr_set_state(ac, n ? ACME_CSR_FAILED : ACME_CSR_READY);
+
+	/* the service thread picks it up in LWS_CALLBACK_EVENT_WAIT_CANCELLED */
+	lws_cancel_service(ac->vhd->context);
+
+	return NULL;
+}
+#endif
+
+static int
+lws_acme_csr_state(struct acme_connection *ac)
+{
+	int n;
+
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	pthread_mutex_lock(&csr_lock);
+#endif
+	n = ac->csr_state;
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	pthread_mutex_unlock(&csr_lock);
+#endif
+
+	return n;
+}
+
+/*
+ * Send the CSR to the finalize url once it exists... if the worker thread is
+ * still making the key, EVENT_WAIT_CANCELLED brings us back when it's done
+ */
+static int
+lws_acme_finalize(struct acme_connection *ac)
+{
+	switch (lws_acme_csr_state(ac)) {
+	case ACME_CSR_RUNNING:
+		ac->wait_csr = 1;
+		return 0;
+	case ACME_CSR_IDLE:
+		if (lws_acme_csr_create(ac)) {
+			lwsl_notice("CSR generation failed\n");
+			return 1;
+		}
+		lws_acme_csr_set_state(ac, ACME_CSR_READY);
+		break;
+	case ACME_CSR_FAILED:
+		lwsl_notice("CSR generation failed\n");
+		return 1;
 	}
 
-	lws_genrsa_destroy(&vhd->rsactx);
-	lws_jwk_destroy(&vhd->jwk);
+	ac->wait_csr = 0;
+
+	return !lws_acme_step(ac);
+}
+
+static void
+lws_acme_destroy_order(struct acme_connection *ac)
+{
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	if (ac->csr_thread_started)
+		pthread_join(ac->csr_thread, NULL);
+#endif
+	lws_dll2_remove(&ac->list);
+	if (ac->alloc_privkey_pem)
+		free(ac->alloc_privkey_pem);
+	free(ac);
+}
+
+/*
+ * Free the ended orders of this vhost whose keygen thread has finished, or
+ * if force, wait for them to finish
+ */
+static void
+lws_acme_reap_zombies(struct per_vhost_data__lws_acme_client *vhd, int force)
+{
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   vhd->shared->zombies.head) {
+		struct acme_connection *ac = lws_container_of(d,
+					struct acme_connection, list);
+
+		if (ac->vhd == vhd &&
+		    (force || lws_acme_csr_state(ac) != ACME_CSR_RUNNING))
+			lws_acme_destroy_order(ac);
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
+static int
+lws_acme_start_acquisition(struct per_vhost_data__lws_acme_client *vhd);
+
+/*
+ * End this vhost's order, if any.  If promote, the freed slot goes to the
+ * longest waiting vhost; only the vhost teardown path doesn't want that.
+ */
+static void
+lws_acme_finished(struct per_vhost_data__lws_acme_client *vhd, int promote)
+{
+	struct acme_shared *sh = vhd->shared;
+	struct acme_connection *ac = vhd->ac;
+	struct lws_dll2 *d;
+
+	lwsl_notice("%s\n", __func__);
+
+	lws_dll2_remove(&vhd->wait_list);
+
+	if (!ac)
+		return;
 
 	vhd->ac = NULL;
+
+	lws_sul_schedule(vhd->context, 0, &ac->sul, NULL,
+			 LWS_SET_TIMER_USEC_CANCEL);
+	if (ac->cwsi)
+		/* any step still in flight no longer has an order */
+		lws_set_opaque_user_data(ac->cwsi, NULL);
+	lws_dll2_remove(&ac->list);
+	if (lws_acme_csr_state(ac) == ACME_CSR_RUNNING)
+		/*
+		 * Don't stall the event loop waiting for the keygen thread,
+		 * the order is freed when it tells us it's done (or at vhost
+		 * destroy, which has to wait for it anyway)
+		 */
+		lws_dll2_add_tail(&ac->list, &sh->zombies);
+	else
+		lws_acme_destroy_order(ac);
+
 #if defined(LWS_WITH_ESP32)
 	lws_esp32.acme = 0; /* enable scanning */
 #endif
+
+	/* the challenge vhost is only needed while orders are in flight */
+
+	if (!sh->orders.count && sh->chall_vhost) {
+		lws_vhost_destroy(sh->chall_vhost);
+		sh->chall_vhost = NULL;
+	}
+
+	if (!promote)
+		return;
+
+	/* let the longest waiting vhost have the slot */
+
+	d = lws_dll2_get_head(&sh->waiting);
+	if (d) {
+		lws_dll2_remove(d);
+		lws_acme_start_acquisition(lws_container_of(d,
+			struct per_vhost_data__lws_acme_client, wait_list));
+	}
+}
+
+static void
+lws_acme_fail(struct per_vhost_data__lws_acme_client *vhd,
+	      const char *failreason)
+{
+	if (!vhd->ac)
+		/* it already failed while we were trying the step */
+		return;
+
+	lwsl_notice("%s: failed out\n", __func__);
+	lws_acme_report_status(vhd->vhost, LWS_CUS_FAILED, failreason);
+	lws_acme_finished(vhd, 1);
+}
+
+static void
+lws_acme_sul_cb(lws_sorted_usec_list_t *sul)
+{
+	struct acme_connection *ac = lws_container_of(sul,
+					struct acme_connection, sul);
+	struct per_vhost_data__lws_acme_client *vhd = ac->vhd;
+
+	if (!lws_acme_step(ac))
+		lws_acme_fail(vhd, NULL);
 }
 
 static const char * const pvo_names[] = {
@@ -656,67 +1019,157 @@ static const char * const pvo_names[] = {
 	"key-path",
 };
 
+static struct acme_shared *
+lws_acme_shared_get(struct lws_context *context)
+{
+	struct acme_shared *sh;
+
+	lws_start_foreach_dll(struct lws_dll2 *, d, acme_shared_owner.head) {
+		sh = lws_container_of(d, struct acme_shared, list);
+		if (sh->context == context)
+			return sh;
+	} lws_end_foreach_dll(d);
+
+	sh = malloc(sizeof(*sh));
+	if (!sh)
+		return NULL;
+
+	memset(sh, 0, sizeof(*sh));
+	sh->context = context;
+	sh->max_concurrent = LWS_ACME_DEFAULT_MAX_CONCURRENT;
+	sh->chall_port = 80;
+	lws_dll2_add_tail(&sh->list, &acme_shared_owner);
+
+	return sh;
+}
+
 static int
 lws_acme_load_create_auth_keys(struct per_vhost_data__lws_acme_client *vhd,
 		int bits)
 {
+	const char *path = vhd->pvop[LWS_TLS_SET_AUTH_PATH];
+	struct lws_genrsa_ctx rsactx;
+	struct acme_key *k;
 	int n;
 
-	if (!lws_jwk_load(&vhd->jwk, vhd->pvop[LWS_TLS_SET_AUTH_PATH],
-				NULL, NULL))
+	if (vhd->key)
 		return 0;
 
-	vhd->jwk.kty = LWS_GENCRYPTO_KTY_RSA;
+	/* another vhost may already have loaded or created it */
 
-	lwsl_notice("Generating ACME %d-bit keypair... "
-			"will take a little while\n", bits);
-	n = lws_genrsa_new_keypair(vhd->context, &vhd->rsactx, LGRSAM_PKCS1_1_5,
-			vhd->jwk.e, bits);
-	if (n) {
-		lwsl_notice("failed to create keypair\n");
-		return 1;
-	}
+	lws_start_foreach_dll(struct lws_dll2 *, d, vhd->shared->keys.head) {
+		k = lws_container_of(d, struct acme_key, list);
+		if (!strcmp((const char *)&k[1], path)) {
+			k->refcount++;
+			vhd->key = k;
 
-	lwsl_notice("...keypair generated\n");
+			return 0;
+		}
+	} lws_end_foreach_dll(d);
 
-	if (lws_jwk_save(&vhd->jwk, vhd->pvop[LWS_TLS_SET_AUTH_PATH])) {
-		lwsl_notice("unable to save %s\n",
-				vhd->pvop[LWS_TLS_SET_AUTH_PATH]);
+	k = malloc(sizeof(*k) + strlen(path) + 1);
+	if (!k)
 		return 1;
+	memset(k, 0, sizeof(*k));
+	strcpy((char *)&k[1], path);
+
+	if (lws_jwk_load(&k->jwk, path, NULL, NULL)) {
+		k->jwk.kty = LWS_GENCRYPTO_KTY_RSA;
+
+		lwsl_notice("Generating ACME %d-bit keypair... "
+				"will take a little while\n", bits);
+		n = lws_genrsa_new_keypair(vhd->context, &rsactx,
+					   LGRSAM_PKCS1_1_5, k->jwk.e, bits);
+		if (n) {
+			lwsl_notice("failed to create keypair\n");
+			free(k);
+
+			return 1;
+		}
+		lws_genrsa_destroy(&rsactx);
+
+		lwsl_notice("...keypair generated\n");
+
+		if (lws_jwk_save(&k->jwk, path)) {
+			lwsl_notice("unable to save %s\n", path);
+			lws_jwk_destroy(&k->jwk);
+			free(k);
+
+			return 1;
+		}
 	}
 
+	k->refcount = 1;
+	lws_dll2_add_tail(&k->list, &vhd->shared->keys);
+	vhd->key = k;
+
 	return 0;
 }
 
+static void
+lws_acme_release_auth_keys(struct per_vhost_data__lws_acme_client *vhd)
+{
+	struct acme_key *k = vhd->key;
+
+	if (!k)
+		return;
+
+	vhd->key = NULL;
+	if (--k->refcount)
+		return;
+
+	lws_dll2_remove(&k->list);
+	lws_jwk_destroy(&k->jwk);
+	free(k);
+}
+
 static int
-lws_acme_start_acquisition(struct per_vhost_data__lws_acme_client *vhd,
-		struct lws_vhost *v)
+lws_acme_start_acquisition(struct per_vhost_data__lws_acme_client *vhd)
 {
-	char buf[128];
+	struct acme_shared *sh = vhd->shared;
+	struct acme_connection *ac;
 
 	/* ...and we were given enough info to do the update? */
 
 	if (!vhd->pvop[LWS_TLS_REQ_ELEMENT_COMMON_NAME])
 		return -1;
 
+	/* ...and we aren't already doing it or waiting to? */
+
+	if (vhd->ac || !lws_dll2_is_detached(&vhd->wait_list))
+		return 0;
+
+	if ((int)sh->orders.count >= sh->max_concurrent) {
+		lwsl_notice("%s: vhost %s waits for one of %d orders\n",
+			    __func__, lws_get_vhost_name(vhd->vhost),
+			    sh->max_concurrent);
+		lws_dll2_add_tail(&vhd->wait_list, &sh->waiting);
+
+		return 0;
+	}
+
 	/*
 	 * ...well... we should try to do something about it then...
 	 */
 	lwsl_notice("%s: ACME cert needs creating / updating:  "
 			"vhost %s\n", __func__, lws_get_vhost_name(vhd->vhost));
 
-	vhd->ac = malloc(sizeof(*vhd->ac));
-	memset(vhd->ac, 0, sizeof(*vhd->ac));
+	ac = vhd->ac = malloc(sizeof(*vhd->ac));
+	if (!ac)
+		return 1;
+	memset(ac, 0, sizeof(*ac));
+	ac->vhd = vhd;
+	lws_dll2_add_tail(&ac->list, &sh->orders);
 
 	/*
 	 * So if we don't have it, the first job is get the directory.
 	 *
-	 * If we already have the directory, jump straight into trying
-	 * to register our key.
+	 * If another order already got the directory from the same place,
+	 * jump straight into getting a nonce.  After that we register our key
+	 * unless it was already registered at this directory.
 	 *
-	 * We always try to register the keys... if it's not the first
-	 * time, we will get a JSON body in the (legal, nonfatal)
-	 * response like this
+	 * If it's not the first time, we will get a JSON body in the (legal,
+	 * nonfatal) response like this
 	 *
 	 * {
 	 *   "type": "urn:acme:error:malformed",
@@ -724,19 +1177,11 @@ lws_acme_start_acquisition(struct per_vhost_data__lws_acme_client *vhd,
 	 *   "status": 409
 	 * }
 	 */
-	if (!vhd->ac->urls[0][0]) {
-		vhd->ac->state = ACME_STATE_DIRECTORY;
-		lws_snprintf(buf, sizeof(buf) - 1, "%s",
-				vhd->pvop_active[LWS_TLS_SET_DIR_URL]);
-	} else {
-		vhd->ac->state = ACME_STATE_NEW_ACCOUNT;
-		lws_snprintf(buf, sizeof(buf) - 1, "%s",
-				vhd->ac->urls[JAD_NEW_ACCOUNT_URL]);
-	}
-
-	vhd->ac->real_vh_port = lws_get_vhost_port(vhd->vhost);
-	vhd->ac->real_vh_name = lws_get_vhost_name(vhd->vhost);
-	vhd->ac->real_vh_iface = lws_get_vhost_iface(vhd->vhost);
+	if (!strcmp(sh->dir_url, vhd->pvop_active[LWS_TLS_SET_DIR_URL])) {
+		memcpy(ac->urls, sh->urls, sizeof(ac->urls));
+		ac->state = ACME_STATE_NEW_NONCE;
+	} else
+		ac->state = ACME_STATE_DIRECTORY;
 
 	lws_acme_report_status(vhd->vhost, LWS_CUS_STARTING, NULL);
 
@@ -749,15 +1194,27 @@ lws_acme_start_acquisition(struct per_vhost_data__lws_acme_client *vhd,
 			"Auth keys created");
 #endif
 
-	if (lws_acme_client_connect(vhd->context, vhd->vhost,
-				&vhd->ac->cwsi, &vhd->ac->i, buf, "GET"))
+#if defined(LWS_ACME_THREADED_KEYGEN)
+	/*
+	 * The CSR keypair isn't needed until the challenge passes, start
+	 * making it now on a worker thread.  If we can't, it's made inline
+	 * when it's needed.
+	 */
+	lws_acme_csr_set_state(ac, ACME_CSR_RUNNING);
+	if (pthread_create(&ac->csr_thread, NULL, lws_acme_csr_thread, ac))
+		lws_acme_csr_set_state(ac, ACME_CSR_IDLE);
+	else
+		ac->csr_thread_started = 1;
+#endif
+
+	if (lws_acme_step(ac))
 		return 0;
 
 #if defined(LWS_WITH_ESP32)
 bail:
 #endif
-	free(vhd->ac);
-	vhd->ac = NULL;
+	/* don't let our failure stall the vhosts queued behind us */
+	lws_acme_finished(vhd, 1);
 
 	return 1;
 }
@@ -777,12 +1234,17 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 	struct acme_connection *ac = NULL;
 	unsigned char **pp, *pend;
 	const char *content_type;
+	struct acme_shared *sh;
 	struct lws_jwe jwe;
-	struct lws *cwsi;
 	int n, m;
 
-	if (vhd)
-		ac = vhd->ac;
+	/*
+	 * Client connections are all made on the lead vhost, the order they
+	 * belong to (and so its vhost's vhd) is in the opaque user data
+	 */
+	ac = (struct acme_connection *)lws_get_opaque_user_data(wsi);
+	if (ac)
+		vhd = ac->vhd;
 
 	lws_jwe_init(&jwe, lws_get_context(wsi));
 
@@ -841,6 +1303,23 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 			return -1;
 		}
 
+		sh = vhd->shared = lws_acme_shared_get(vhd->context);
+		if (!sh)
+			return -1;
+		lws_dll2_add_tail(&vhd->list, &sh->vhds);
+
+		/* these apply to all the vhosts using the plugin */
+
+		if (!lws_pvo_get_str(in, "max-concurrent", &content_type) &&
+		    atoi(content_type) > 0)
+			sh->max_concurrent = atoi(content_type);
+		if (!lws_pvo_get_str(in, "challenge-port", &content_type))
+			sh->chall_port = atoi(content_type);
+		if (!lws_pvo_get_str(in, "allow-insecure", &content_type) &&
+		    atoi(content_type))
+			sh->client_flags |= LCCSCF_ALLOW_SELFSIGNED |
+					LCCSCF_SKIP_SERVER_CERT_HOSTNAME_CHECK;
+
 #if !defined(LWS_WITH_ESP32)
 		/*
 		 * load (or create) the registration keypair while we
@@ -874,12 +1353,25 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 		break;
 
 	case LWS_CALLBACK_PROTOCOL_DESTROY:
-		if (vhd && vhd->pvo_data) {
+		if (!vhd)
+			break;
+		sh = vhd->shared;
+		if (sh) {
+			/* keygen threads may still be using the pvos */
+			lws_acme_finished(vhd, 0);
+			lws_acme_reap_zombies(vhd, 1);
+			lws_acme_release_auth_keys(vhd);
+			lws_dll2_remove(&vhd->list);
+			if (!sh->vhds.count) {
+				lws_dll2_remove(&sh->list);
+				free(sh);
+			}
+			vhd->shared = NULL;
+		}
+		if (vhd->pvo_data) {
 			free(vhd->pvo_data);
 			vhd->pvo_data = NULL;
 		}
-		if (vhd)
-			lws_acme_finished(vhd);
 		break;
 
 	case LWS_CALLBACK_VHOST_CERT_AGING:
@@ -902,6 +1394,10 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 		if (vhd->vhost != caa->vh)
 			return 1;
 
+		/* ...and we aren't already on it? */
+		if (vhd->ac || !lws_dll2_is_detached(&vhd->wait_list))
+			break;
+
 		for (n = 0; n < (int)LWS_ARRAY_SIZE(vhd->pvop);n++)
 			if (caa->element_overrides[n])
 				vhd->pvop_active[n] = caa->element_overrides[n];
@@ -912,7 +1408,18 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 				lws_get_vhost_name(caa->vh),
 				vhd->pvop_active[LWS_TLS_SET_DIR_URL]);
 
-		lws_acme_start_acquisition(vhd, caa->vh);
+		lws_acme_start_acquisition(vhd);
+		break;
+
+	case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+		if (!vhd || !vhd->shared)
+			break;
+
+		/* did a keygen thread finish? */
+		lws_acme_reap_zombies(vhd, 0);
+		if (vhd->ac && vhd->ac->wait_csr &&
+		    lws_acme_finalize(vhd->ac))
+			lws_acme_fail(vhd, NULL);
 		break;
 
 	/*
@@ -923,24 +1430,39 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 		lwsl_notice("%s: CLIENT_ESTABLISHED\n", __func__);
 		break;
 
-	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
-		lwsl_notice("%s: CLIENT_CONNECTION_ERROR: %p\n", __func__, wsi);
+	case LWS_CALLBACK_CLOSED:
+		lwsl_notice("%s: CLOSED: %p\n", __func__, wsi);
 		break;
 
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
 	case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
-		lwsl_notice("%s: CLOSED_CLIENT_HTTP: %p\n", __func__, wsi);
-		break;
+		lwsl_notice("%s: %s: %p\n", __func__,
+			    reason == LWS_CALLBACK_CLOSED_CLIENT_HTTP ?
+			    "CLOSED_CLIENT_HTTP" : "CLIENT_CONNECTION_ERROR",
+			    wsi);
+		if (!ac || ac->cwsi != wsi)
+			break;
 
-	case LWS_CALLBACK_CLOSED:
-		lwsl_notice("%s: CLOSED: %p\n", __func__, wsi);
+		/*
+		 * The step went away before it completed... the shared
+		 * connection may have been closed underneath it on behalf of
+		 * another order.  Try the step again a few times.
+		 */
+		ac->cwsi = NULL;
+		if (ac->retries++ == LWS_ACME_STEP_RETRIES) {
+			lws_acme_fail(vhd, "Connection lost");
+			break;
+		}
+		lws_sul_schedule(vhd->context, 0, &ac->sul, lws_acme_sul_cb,
+				 LWS_ACME_RETRY_US);
 		break;
 
 	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP:
+		if (!ac)
+			break;
 		lwsl_notice("%s: ESTABLISHED_CLIENT_HTTP:"
 				"%p, state:%d, status:%d\n", __func__, wsi,
 				ac->state, lws_http_client_http_response(wsi));
-		if (!ac)
-			break;
 		ac->resp = lws_http_client_http_response(wsi);
 		/* we get a new nonce each time */
 		if (lws_hdr_total_length(wsi, WSI_TOKEN_REPLAY_NONCE) &&
@@ -957,26 +1479,6 @@ callback_acme_client(struct lws *wsi, enum lws_callback_reasons reason,
 			lejp_construct(&ac->jctx, cb_dir, vhd, jdir_tok,
 					LWS_ARRAY_SIZE(jdir_tok));
 			break;
-		case ACME_STATE_NEW_NONCE:
-			/*
-			 *  we try to * register our keys next.
-			 *  It's OK if it ends up * they're already registered,
-			 *  this eliminates any * gaps where we stored the key
-			 *  but registration did not complete for some reason...
-			 */
-			ac->state = ACME_STATE_NEW_ACCOUNT;
-			lws_acme_report_status(vhd->vhost, LWS_CUS_REG, NULL);
-
-			strcpy(buf, ac->urls[JAD_NEW_ACCOUNT_URL]);
-			cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-					&ac->cwsi, &ac->i, buf, "POST");
-			if (!cwsi) {
-				lwsl_notice("%s: failed to connect to acme\n",
-						__func__);
-				goto failed;
-			}
-
-			return -1;
 
 		case ACME_STATE_NEW_ACCOUNT:
 			if (!lws_hdr_total_length(wsi,
@@ -1060,7 +1562,7 @@ pkt_add_hdrs:
 				lwsl_notice("%s: no RSA1_5\n", __func__);
 				goto failed;
 			}
-			jwe.jwk = vhd->jwk;
+			jwe.jwk = vhd->key->jwk;
 
 			ac->len = jws_create_packet(&jwe,
 					start, p - start,
@@ -1138,18 +1640,9 @@ pkt_add_hdrs:
 			if (ac->goes_around)
 				break;
 
-			p += lws_snprintf(p, end - p, "{\"csr\":\"");
-			n = lws_tls_acme_sni_csr_create(vhd->context,
-					&vhd->pvop_active[0],
-					(uint8_t *)p, end - p,
-					&ac->alloc_privkey_pem,
-					&ac->len_privkey_pem);
-			if (n < 0) {
-				lwsl_notice("CSR generation failed\n");
-				goto failed;
-			}
-			p += n;
-			p += lws_snprintf(p, end - p, "\"}");
+			/* the CSR was already made by lws_acme_finalize() */
+			p += lws_snprintf(p, end - p, "{\"csr\":\"%s\"}",
+					  ac->csr);
 			puts(start);
 			strcpy(ac->active_url, ac->finalize_url);
 			goto pkt_add_hdrs;
@@ -1248,6 +1741,16 @@ pkt_add_hdrs:
 		if (!ac)
 			return -1;
 
+		/*
+		 * This step is done: the wsi is finished with the order, and
+		 * we return 0 so the connection stays up for the next step of
+		 * this or other orders queued on it.
+		 */
+		lws_set_opaque_user_data(wsi, NULL);
+		ac->cwsi = NULL;
+		ac->retries = 0;
+		sh = vhd->shared;
+
 		switch (ac->state) {
 		case ACME_STATE_DIRECTORY:
 			lejp_destruct(&ac->jctx);
@@ -1257,18 +1760,38 @@ pkt_add_hdrs:
 			for (n = 0; n < 6; n++)
 				lwsl_notice("   %d: %s\n", n, ac->urls[n]);
 
+			/* later orders can skip getting the directory */
+
+			memcpy(sh->urls, ac->urls, sizeof(sh->urls));
+			lws_strncpy(sh->dir_url,
+				    vhd->pvop_active[LWS_TLS_SET_DIR_URL],
+				    sizeof(sh->dir_url));
+
 			ac->state = ACME_STATE_NEW_NONCE;
+			break;
 
-			strcpy(buf, ac->urls[JAD_NEW_NONCE_URL]);
-			cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-					&ac->cwsi, &ac->i, buf,
-					"GET");
-			if (!cwsi) {
-				lwsl_notice("%s: failed to connect to acme\n",
-						__func__);
-				goto failed;
+		case ACME_STATE_NEW_NONCE:
+			/*
+			 *  we try to * register our keys next.
+			 *  It's OK if it ends up * they're already registered,
+			 *  this eliminates any * gaps where we stored the key
+			 *  but registration did not complete for some reason...
+			 *
+			 *  ...unless it was already done at this directory by
+			 *  another order using the same key.
+			 */
+			if (!strcmp(vhd->key->kid_dir,
+				    vhd->pvop_active[LWS_TLS_SET_DIR_URL])) {
+				lws_strncpy(ac->acct_id, vhd->key->kid,
+					    sizeof(ac->acct_id));
+				ac->kid = ac->acct_id;
+				ac->state = ACME_STATE_NEW_ORDER;
+				break;
 			}
-			return -1; /* close the completed client connection */
+
+			ac->state = ACME_STATE_NEW_ACCOUNT;
+			lws_acme_report_status(vhd->vhost, LWS_CUS_REG, NULL);
+			break;
 
 		case ACME_STATE_NEW_ACCOUNT:
 			if ((ac->resp >= 200 && ac->resp < 299) ||
@@ -1277,24 +1800,17 @@ pkt_add_hdrs:
 				 * Our account already existed, or exists now.
 				 *
 				 */
+				lws_strncpy(vhd->key->kid, ac->acct_id,
+					    sizeof(vhd->key->kid));
+				lws_strncpy(vhd->key->kid_dir,
+					vhd->pvop_active[LWS_TLS_SET_DIR_URL],
+					sizeof(vhd->key->kid_dir));
 				ac->state = ACME_STATE_NEW_ORDER;
-
-				strcpy(buf, ac->urls[JAD_NEW_ORDER_URL]);
-				cwsi = lws_acme_client_connect(vhd->context,
-						vhd->vhost, &ac->cwsi,
-						&ac->i, buf, "POST");
-				if (!cwsi)
-					lwsl_notice("%s: failed to connect\n",
-							__func__);
-
-				/* close the completed client connection */
-				return -1;
-			} else {
-				lwsl_notice("newAccount replied %d\n",
-						ac->resp);
-				goto failed;
+				break;
 			}
-			return -1; /* close the completed client connection */
+
+			lwsl_notice("newAccount replied %d\n", ac->resp);
+			goto failed;
 
 		case ACME_STATE_NEW_ORDER:
 			lejp_destruct(&ac->jctx);
@@ -1309,16 +1825,7 @@ pkt_add_hdrs:
 			ac->state = ACME_STATE_AUTHZ;
 			lws_acme_report_status(vhd->vhost, LWS_CUS_AUTH,
 					NULL);
-
-			strcpy(buf, ac->authz_url);
-			cwsi = lws_acme_client_connect(vhd->context,
-					vhd->vhost, &ac->cwsi,
-					&ac->i, buf, "POST");
-			if (!cwsi)
-				lwsl_notice("%s: failed to connect\n",
-						__func__);
-
-			return -1; /* close the completed client connection */
+			break;
 
 		case ACME_STATE_AUTHZ:
 			lejp_destruct(&ac->jctx);
@@ -1340,69 +1847,59 @@ pkt_add_hdrs:
 			lws_acme_report_status(vhd->vhost, LWS_CUS_CHALLENGE,
 					NULL);
 
-			memset(&ac->ci, 0, sizeof(ac->ci));
-
 			/* compute the key authorization */
 
 			p = ac->key_auth;
 			end = p + sizeof(ac->key_auth) - 1;
 
 			p += lws_snprintf(p, end - p, "%s.", ac->chall_token);
-			lws_jwk_rfc7638_fingerprint(&vhd->jwk, digest);
+			lws_jwk_rfc7638_fingerprint(&vhd->key->jwk, digest);
 			n = lws_jws_base64_enc(digest, 32, p, end - p);
 			if (n < 0)
 				goto failed;
 
 			lwsl_notice("key_auth: '%s'\n", ac->key_auth);
 
-			lws_snprintf(ac->http01_mountpoint,
-					sizeof(ac->http01_mountpoint),
-					"/.well-known/acme-challenge/%s",
-					ac->chall_token);
-
-			memset(&ac->mount, 0, sizeof (struct lws_http_mount));
-			ac->mount.protocol = "http";
-			ac->mount.mountpoint = ac->http01_mountpoint;
-			ac->mount.mountpoint_len =
-				strlen(ac->http01_mountpoint);
-			ac->mount.origin_protocol = LWSMPRO_CALLBACK;
-
-			ac->ci.mounts = &ac->mount;
-
-			/* listen on the same port as the vhost that triggered
-			 * us */
-			ac->ci.port = 80;
-
-			/* make ourselves protocols[0] for the new vhost */
-			ac->ci.protocols = chall_http01_protocols;
-
-			/*
-			 * vhost .user points to the ac associated with the
-			 * temporary vhost
-			 */
-			ac->ci.user = ac;
+			if (!sh->chall_vhost) {
+				struct lws_context_creation_info ci;
 
-			ac->vhost = lws_create_vhost(lws_get_context(wsi),
-					&ac->ci);
-			if (!ac->vhost)
-				goto failed;
+				/*
+				 * One challenge vhost answers for all the
+				 * orders in flight, it finds the key_auth from
+				 * the token in the url
+				 */
+				memset(&sh->mount, 0, sizeof(sh->mount));
+				sh->mount.protocol = "http";
+				sh->mount.mountpoint =
+						"/.well-known/acme-challenge";
+				sh->mount.mountpoint_len =
+					strlen(sh->mount.mountpoint);
+				sh->mount.origin_protocol = LWSMPRO_CALLBACK;
+
+				memset(&ci, 0, sizeof(ci));
+				ci.mounts = &sh->mount;
+				ci.port = sh->chall_port;
+
+				/* make ourselves protocols[0] for the vhost */
+				ci.protocols = chall_http01_protocols;
+
+				/* vhost .user points to the shared state */
+				ci.user = sh;
+
+				sh->chall_vhost = lws_create_vhost(
+						lws_get_context(wsi), &ci);
+				if (!sh->chall_vhost)
+					goto failed;
+			}
 
 			lwsl_notice("challenge_uri %s\n", ac->challenge_uri);
 
 			/*
-			 * The challenge-specific vhost is up... let the ACME
-			 * server know we are ready to roll...
+			 * The challenge vhost is up... let the ACME server
+			 * know we are ready to roll...
 			 */
 			ac->goes_around = 0;
-			cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-						       &ac->cwsi, &ac->i,
-						       ac->challenge_uri,
-						       "POST");
-			if (!cwsi) {
-				lwsl_notice("%s: connect failed\n", __func__);
-				goto failed;
-			}
-			return -1; /* close the completed client connection */
+			break;
 
 		case ACME_STATE_START_CHALL:
 			lwsl_notice("%s: COMPLETED start chall: %s\n",
@@ -1419,17 +1916,11 @@ poll_again:
 				goto failed;
 			}
 
-			strcpy(buf, ac->order_url);
-			cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-						       &ac->cwsi, &ac->i, buf,
-						       "POST");
-			if (!cwsi) {
-				lwsl_notice("%s: failed to connect to acme\n",
-						__func__);
+			/* give the server a moment to try the challenge */
+			lws_sul_schedule(vhd->context, 0, &ac->sul,
+					 lws_acme_sul_cb, LWS_ACME_POLL_US);
 
-				goto failed;
-			}
-			return -1; /* close the completed client connection */
+			return 0;
 
 		case ACME_STATE_POLLING:
 
@@ -1455,13 +1946,8 @@ poll_again:
 
 			lwsl_notice("Challenge passed\n");
 
-			/*
-			 * The challenge was validated... so delete the
-			 * temp vhost now its job is done
-			 */
-			if (ac->vhost)
-				lws_vhost_destroy(ac->vhost);
-			ac->vhost = NULL;
+			/* the challenge vhost no longer needs to answer us */
+			ac->key_auth[0] = '\0';
 
 			/*
 			 * now our JWK is accepted as authorized to make
@@ -1473,17 +1959,10 @@ poll_again:
 			lws_acme_report_status(vhd->vhost, LWS_CUS_REQ, NULL);
 			ac->goes_around = 0;
 
-			strcpy(buf, ac->finalize_url);
-			cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-						       &ac->cwsi, &ac->i, buf,
-						       "POST");
-			if (!cwsi) {
-				lwsl_notice("%s: failed to connect to acme\n",
-						__func__);
-
+			if (lws_acme_finalize(ac))
 				goto failed;
-			}
-			return -1; /* close the completed client connection */
+
+			return 0;
 
 		case ACME_STATE_POLLING_CSR:
 			if (ac->resp < 200 || ac->resp > 202) {
@@ -1499,35 +1978,15 @@ poll_again:
 
 					goto failed;
 				}
-				strcpy(buf, ac->finalize_url);
-				cwsi = lws_acme_client_connect(vhd->context,
-						vhd->vhost,
-						&ac->cwsi, &ac->i, buf,
-						"POST");
-				if (!cwsi) {
-					lwsl_notice("%s: "
-						"failed to connect to acme\n",
-							__func__);
+				lws_sul_schedule(vhd->context, 0, &ac->sul,
+						 lws_acme_sul_cb,
+						 LWS_ACME_POLL_US);
 
-					goto failed;
-				}
-				/* close the completed client connection */
-				return -1;
+				return 0;
 			}
 
 			ac->state = ACME_STATE_DOWNLOAD_CERT;
-
-			strcpy(buf, ac->cert_url);
-			cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-						       &ac->cwsi, &ac->i, buf,
-						       "POST");
-			if (!cwsi) {
-				lwsl_notice("%s: failed to connect to acme\n",
-						__func__);
-
-				goto failed;
-			}
-			return -1;
+			break;
 
 		case ACME_STATE_DOWNLOAD_CERT:
 
@@ -1576,7 +2035,11 @@ poll_again:
 				vhd->pvop_active[LWS_TLS_SET_CERT_PATH],
 				vhd->pvop_active[LWS_TLS_SET_KEY_PATH]);
 
-			/* notify lws there was a cert update */
+			/*
+			 * notify lws there was a cert update... vhosts using
+			 * these cert paths load it into their existing
+			 * SSL_CTX, so connections up now are undisturbed
+			 */
 
 			if (lws_tls_cert_updated(vhd->context,
 					vhd->pvop_active[LWS_TLS_SET_CERT_PATH],
@@ -1587,25 +2050,31 @@ poll_again:
 				lwsl_notice("problem setting certs\n");
 			}
 
-			lws_acme_finished(vhd);
+			lws_acme_finished(vhd, 1);
 			lws_acme_report_status(vhd->vhost,
 					LWS_CUS_SUCCESS, NULL);
 
-			return -1;
+			return 0;
 
 		default:
-			break;
+			return 0;
 		}
-		break;
+
+		/* issue the next step for the order */
+
+		if (!lws_acme_step(ac)) {
+			lwsl_notice("%s: failed to connect to acme\n",
+				    __func__);
+			goto failed;
+		}
+
+		return 0;
 
 	case LWS_CALLBACK_USER + 0xac33:
-		if (!vhd)
+		if (!vhd || !vhd->ac)
 			break;
-		cwsi = lws_acme_client_connect(vhd->context, vhd->vhost,
-				&ac->cwsi, &ac->i,
-				ac->challenge_uri,
-				"GET");
-		if (!cwsi) {
+		if (!lws_acme_client_connect(vhd->ac, vhd->ac->challenge_uri,
+					     "GET")) {
 			lwsl_notice("%s: failed to connect\n", __func__);
 			goto failed;
 		}
@@ -1618,9 +2087,11 @@ poll_again:
 	return 0;
 
 failed:
-	lwsl_notice("%s: failed out\n", __func__);
-	lws_acme_report_status(vhd->vhost, LWS_CUS_FAILED, failreason);
-	lws_acme_finished(vhd);
+	lws_acme_fail(vhd, failreason);
+
+	if (reason == LWS_CALLBACK_COMPLETED_CLIENT_HTTP)
+		/* the connection is still good for any other orders */
+		return 0;
 
 	return -1;
 }
@@ -102,6 +102,7 @@
 		c2.classList.add("ogn");
 		c2.classList.add("r");
 		c2.innerHTML = humanize(file.size);
+		c2.setAttribute("size", file.size);
 
 		c3.classList.add("ogn");
 		c3.innerHTML = file.name;
@@ -142,6 +143,25 @@
 		});
 	}
 
+	function upload_progress(u)
+	{
+		var t = document.getElementById("ongoing"), n, m, c, pc;
+
+		for (n = 0; n < u.length; n++)
+			for (m = 0; m < t.rows.length; m++) {
+				c = t.rows[m].cells;
+				if (c[0].classList.contains("err") ||
+				    !u[n].name.endsWith(c[2].textContent))
+					continue;
+
+				pc = Math.floor((u[n].size * 100) /
+					(c[1].getAttribute("size") || 1));
+				c[0].textContent = Math.min(pc, 100) + "% " +
+						   humanize(u[n].bps) + "/s";
+				break;
+			}
+	}
+
 	function da_drop(e) {
 		var da = document.getElementById("da");
 
@@ -243,6 +263,11 @@
 				var j = JSON.parse(msg.data), s = "", n,
 				t = document.getElementById("dd-list");
 
+				if (j.uploads) {
+					upload_progress(j.uploads);
+					return;
+				}
+
 				server_max_size = j.max_size;
 				document.getElementById("size").innerHTML =
 					"Server maximum file size " +
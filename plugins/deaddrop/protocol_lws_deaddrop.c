@@ -58,9 +58,13 @@ struct vhd_deaddrop {
 	const struct lws_protocols *protocol;
 
 	struct pss_deaddrop *pss_head;
+	struct pss_deaddrop *upload_head;
 
 	const char *upload_dir;
 
+	lws_usec_t last_progress;
+	int progress_version;
+
 	struct lwsac *lwsac_head;
 	struct dir_entry *dire_head;
 	int filelist_version;
@@ -76,10 +80,13 @@ struct pss_deaddrop {
 	char filename[256];
 	char user[32];
 	unsigned long long file_length;
+	lws_usec_t upload_start;
 	lws_filefd_type fd;
 	int response_code;
+	int progress_version;
 
 	struct pss_deaddrop *pss_list;
+	struct pss_deaddrop *upload_list;
 
 	struct lwsac *lwsac_head;
 	struct dir_entry *dire;
@@ -89,8 +96,12 @@ struct pss_deaddrop {
 	uint8_t sent_headers:1;
 	uint8_t sent_body:1;
 	uint8_t first:1;
+	uint8_t uploading:1;
 };
 
+/* don't tell the ws clients about upload progress more often than this */
+#define DEADDROP_PROGRESS_INTERVAL_US (500 * LWS_US_PER_MS)
+
 static const char * const param_names[] = {
 	"text",
 	"send",
@@ -255,6 +266,70 @@ bail:
 	return -1;
 }
 
+/*
+ * Let the ws clients know how the ongoing uploads are doing, at most every
+ * DEADDROP_PROGRESS_INTERVAL_US unless something started or stopped
+ */
+
+static void
+upload_progress(struct vhd_deaddrop *vhd, int force)
+{
+	lws_usec_t now = lws_now_usecs();
+
+	if (!force && now - vhd->last_progress < DEADDROP_PROGRESS_INTERVAL_US)
+		return;
+
+	vhd->last_progress = now;
+	vhd->progress_version++;
+
+	lws_start_foreach_llp(struct pss_deaddrop **, ppss, vhd->pss_head) {
+		lws_callback_on_writable((*ppss)->wsi);
+	} lws_end_foreach_llp(ppss, pss_list);
+}
+
+static void
+upload_start(struct pss_deaddrop *pss)
+{
+	pss->upload_start = lws_now_usecs();
+	pss->uploading = 1;
+	pss->upload_list = pss->vhd->upload_head;
+	pss->vhd->upload_head = pss;
+
+	upload_progress(pss->vhd, 1);
+}
+
+static void
+upload_stop(struct pss_deaddrop *pss)
+{
+	if (!pss->uploading)
+		return;
+
+	lws_start_foreach_llp(struct pss_deaddrop **, ppss,
+			      pss->vhd->upload_head) {
+		if (*ppss == pss) {
+			*ppss = pss->upload_list;
+			break;
+		}
+	} lws_end_foreach_llp(ppss, upload_list);
+
+	pss->uploading = 0;
+	upload_progress(pss->vhd, 1);
+}
+
+/* the upload didn't complete: drop the fd and the partial temp file */
+
+static void
+upload_abandon(struct pss_deaddrop *pss)
+{
+	if (pss->fd != LWS_INVALID_FILE) {
+		close((int)(long long)pss->fd);
+		pss->fd = LWS_INVALID_FILE;
+		unlink(pss->filename);
+	}
+
+	upload_stop(pss);
+}
+
 static int
 file_upload_cb(void *data, const char *name, const char *filename,
 	       char *buf, int len, enum lws_spa_fileupload_states state)
@@ -295,6 +370,7 @@ file_upload_cb(void *data, const char *name, const char *filename,
 					pss->filename, errno);
 			return -1;
 		}
+		upload_start(pss);
 		break;
 
 	case LWS_UFS_FINAL_CONTENT:
@@ -306,25 +382,44 @@ file_upload_cb(void *data, const char *name, const char *filename,
 			if (pss->file_length > pss->vhd->max_size) {
 				pss->response_code =
 					HTTP_STATUS_REQ_ENTITY_TOO_LARGE;
-				close((int)(long long)pss->fd);
-				pss->fd = LWS_INVALID_FILE;
-				unlink(pss->filename);
+				upload_abandon(pss);
 
 				return -1;
 			}
 
-			if (pss->fd != LWS_INVALID_FILE) {
+			/*
+			 * The spa gives us the content straight from the rx
+			 * buffer in spans as big as it can, so this is the
+			 * only copy
+			 */
+
+			while (pss->fd != LWS_INVALID_FILE && len) {
 				n = write((int)(long long)pss->fd, buf, len);
 				lwsl_debug("%s: write %d says %d\n", __func__,
 					   len, n);
-				lws_set_timeout(pss->wsi, PENDING_TIMEOUT_HTTP_CONTENT, 30);
+				if (n < 0) {
+					if (errno == EINTR)
+						continue;
+					lwsl_err("%s: write failed (errno %d)\n",
+						 __func__, errno);
+					pss->response_code =
+					      HTTP_STATUS_INTERNAL_SERVER_ERROR;
+					upload_abandon(pss);
+
+					return -1;
+				}
+				buf += n;
+				len -= n;
 			}
+			lws_set_timeout(pss->wsi, PENDING_TIMEOUT_HTTP_CONTENT, 30);
+			upload_progress(pss->vhd, 0);
 		}
 		if (state == LWS_UFS_CONTENT)
 			break;
 
 		if (pss->fd != LWS_INVALID_FILE)
 			close((int)(long long)pss->fd);
+		upload_stop(pss);
 
 		/* the temp filename without the ~ */
 		lws_strncpy(filename2, pss->filename, sizeof(filename2));
@@ -338,12 +433,58 @@ file_upload_cb(void *data, const char *name, const char *filename,
 
 		break;
 	case LWS_UFS_CLOSE:
+		/* if we didn't get the final content, it didn't complete */
+		upload_abandon(pss);
 		break;
 	}
 
 	return 0;
 }
 
+/*
+ * returns length in bytes of the JSON describing ongoing uploads
+ */
+
+static int
+format_progress(struct pss_deaddrop *pss, char *start, char *end)
+{
+	lws_usec_t now = lws_now_usecs();
+	char *p = start, name[128];
+	const char *cp;
+	int first = 1;
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "{\"uploads\":[");
+
+	lws_start_foreach_llp(struct pss_deaddrop **, ppss,
+			      pss->vhd->upload_head) {
+		struct pss_deaddrop *u = *ppss;
+		unsigned long long bps = 0;
+
+		if (lws_ptr_diff(end, p) < (int)sizeof(name) + 64)
+			break;
+
+		/* the name under upload-dir, without the trailing ~ */
+		cp = u->filename + strlen(u->vhd->upload_dir) + 1;
+		lws_json_purify(name, cp, sizeof(name) - 1, NULL);
+		if (name[0] && name[strlen(name) - 1] == '~')
+			name[strlen(name) - 1] = '\0';
+
+		if (now > u->upload_start)
+			bps = (u->file_length * LWS_US_PER_SEC) /
+					(unsigned long long)(now - u->upload_start);
+
+		p += lws_snprintf(p, lws_ptr_diff(end, p),
+				  "%c{\"name\":\"%s\",\"size\":%llu,"
+				  "\"bps\":%llu}", first ? ' ' : ',', name,
+				  u->file_length, bps);
+		first = 0;
+	} lws_end_foreach_llp(ppss, upload_list);
+
+	p += lws_snprintf(p, lws_ptr_diff(end, p), "]}");
+
+	return lws_ptr_diff(p, start);
+}
+
 /*
  * returns length in bytes
  */
@@ -491,8 +632,20 @@ callback_deaddrop(struct lws *wsi, enum lws_callback_reasons reason,
 		break;
 
 	case LWS_CALLBACK_SERVER_WRITEABLE:
-		if (pss->lwsac_head && !pss->dire)
+		if (!pss->first && !pss->dire) {
+			/* not sending the file list, any upload news? */
+			if (pss->progress_version == vhd->progress_version)
+				return 0;
+
+			pss->progress_version = vhd->progress_version;
+			n = format_progress(pss, (char *)start, (char *)end);
+			if (lws_write(wsi, start, n, LWS_WRITE_TEXT) < 0) {
+				lwsl_notice("%s: ws write failed\n", __func__);
+				return 1;
+			}
+
 			return 0;
+		}
 
 		was = 0;
 		if (pss->first) {
@@ -522,6 +675,12 @@ callback_deaddrop(struct lws *wsi, enum lws_callback_reasons reason,
 		if (!pss->dire) {
 			p += lws_snprintf((char *)p, lws_ptr_diff(end, p),
 					  "]}");
+			/*
+			 * The list is done, even if it was empty.  Any
+			 * progress news from meanwhile goes out next and
+			 * syncs pss->progress_version then.
+			 */
+			pss->first = 0;
 			if (pss->lwsac_head) {
 				lwsac_unreference(&pss->lwsac_head);
 				pss->lwsac_head = NULL;
@@ -548,7 +707,9 @@ callback_deaddrop(struct lws *wsi, enum lws_callback_reasons reason,
 			/* what we just sent is already out of date */
 			start_sending_dir(pss);
 			lws_callback_on_writable(wsi);
-		}
+		} else
+			if (pss->progress_version != vhd->progress_version)
+				lws_callback_on_writable(wsi);
 
 		return 0;
 
@@ -558,14 +719,25 @@ callback_deaddrop(struct lws *wsi, enum lws_callback_reasons reason,
 
 		/* create the POST argument parser if not already existing */
 		if (!pss->spa) {
+			lws_spa_create_info_t i;
+
 			pss->vhd = vhd;
 			pss->wsi = wsi;
-			pss->spa = lws_spa_create(wsi, param_names,
-						  LWS_ARRAY_SIZE(param_names),
-						  1024, file_upload_cb, pss);
+
+			memset(&i, 0, sizeof(i));
+			i.param_names = param_names;
+			i.count_params = LWS_ARRAY_SIZE(param_names);
+			i.max_storage = 1024;
+			i.opt_cb = file_upload_cb;
+			i.opt_data = pss;
+			/* file content comes straight from the rx buffer */
+			i.flags = LWS_SPA_FLAG_FILE_SPANS;
+
+			pss->spa = lws_spa_create_via_info(wsi, &i);
 			if (!pss->spa)
 				return -1;
 
+			pss->fd = LWS_INVALID_FILE;
 			pss->filename[0] = '\0';
 			pss->file_length = 0;
 			/* catchall */
@@ -237,6 +237,7 @@ static const struct lws_http_mount mount_ziptest = {
 	LWSMPRO_FILE,	/* origin points to a callback */
 	8,			/* strlen("/ziptest"), ie length of the mountpoint */
 	NULL,
+	NULL,
 
 	{ NULL, NULL } // sentinel
 };
@@ -259,6 +260,7 @@ static const struct lws_http_mount mount_post = {
 	LWSMPRO_CALLBACK,	/* origin points to a callback */
 	9,			/* strlen("/formtest"), ie length of the mountpoint */
 	NULL,
+	NULL,
 
 	{ NULL, NULL } // sentinel
 };
@@ -287,6 +289,7 @@ static const struct lws_http_mount mount = {
 	LWSMPRO_FILE,	/* mount type is a directory in a filesystem */
 	1,		/* strlen("/"), ie length of the mountpoint */
 	NULL,
+	NULL,
 
 	{ NULL, NULL } // sentinel
 };